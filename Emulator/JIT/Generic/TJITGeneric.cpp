@@ -187,6 +187,58 @@ TJITGeneric::Run(TARMProcessor* ioCPU, volatile Boolean* inSignal)
 	}
 }
 
+// -------------------------------------------------------------------------- //
+//  * RunUnits( TARMProcessor*, volatile Boolean*, KUInt32 )
+// -------------------------------------------------------------------------- //
+KUInt32
+TJITGeneric::RunUnits(
+	TARMProcessor* ioCPU,
+	volatile Boolean* inSignal,
+	KUInt32 inMaxUnits)
+{
+	volatile KUInt32* pendingInterrupts = &ioCPU->mPendingInterrupts;
+	KUInt32* pcPtr = &ioCPU->mCurrentRegisters[TARMProcessor::kR15];
+	TMemory* theMemoryInterface = ioCPU->mMemory;
+	TEmulator* theEmulator = ioCPU->mEmulator;
+	JITUnit* theJITUnit = GetJITUnitForPC(ioCPU, theMemoryInterface, *pcPtr);
+	KUInt32 theCount = 0;
+	while (theCount < inMaxUnits)
+	{
+		// Same as Run, except that we count the units.
+		while (*inSignal && (theCount < inMaxUnits))
+		{
+			theJITUnit = theJITUnit->fFuncPtr(theJITUnit, ioCPU);
+			theCount++;
+		}
+
+		// We may have been signaled because there was an interrupt.
+		if (theEmulator->IsInterrupted())
+		{
+			KUInt32 theInterrupt = *pendingInterrupts;
+			theEmulator->AckInterrupt();
+			if (theInterrupt & TARMProcessor::kResetInterrupt)
+			{
+				ioCPU->Reset();
+				// Unmaskable.
+				theJITUnit = GetJITUnitForPC(ioCPU, theMemoryInterface, *pcPtr);
+			} else if ((theInterrupt & TARMProcessor::kFIQInterrupt) && !ioCPU->mCPSR_F)
+			{
+				ioCPU->FIQ();
+				theJITUnit = GetJITUnitForPC(ioCPU, theMemoryInterface, *pcPtr);
+			} else if ((theInterrupt & TARMProcessor::kIRQInterrupt) && !ioCPU->mCPSR_I)
+			{
+				ioCPU->IRQ();
+				theJITUnit = GetJITUnitForPC(ioCPU, theMemoryInterface, *pcPtr);
+			}
+		} else if (!*inSignal)
+		{
+			break;
+		}
+	}
+
+	return theCount;
+}
+
 // -------------------------------------------------------------------------- //
 //  * Step( TARMProcessor*, KUInt32 )
 // -------------------------------------------------------------------------- //
@@ -81,6 +81,22 @@ public:
 		TARMProcessor* ioObject,
 		volatile Boolean* inSignal);
 
+	///
+	/// Run with JIT for a bounded number of JIT units.
+	/// This is used in virtual time mode, where time advances with the code
+	/// that was executed.
+	///
+	/// \param ioObject			ARM CPU.
+	/// \param inSignal			pointer to a signal set to false to stop
+	///							execution.
+	/// \param inMaxUnits		maximum number of JIT units to execute.
+	/// \return the number of JIT units that were executed.
+	///
+	virtual KUInt32 RunUnits(
+		TARMProcessor* ioObject,
+		volatile Boolean* inSignal,
+		KUInt32 inMaxUnits);
+
 	///
 	/// Get a JIT unit for a given PC.
 	///
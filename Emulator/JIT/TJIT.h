@@ -107,6 +107,21 @@ public:
 		volatile Boolean* inSignal)
 		= 0;
 
+	///
+	/// Run with JIT for a bounded number of JIT units.
+	///
+	/// \param ioObject			ARM CPU.
+	/// \param inSignal			pointer to a signal set to false to stop
+	///							execution.
+	/// \param inMaxUnits		maximum number of JIT units to execute.
+	/// \return the number of JIT units that were executed.
+	///
+	virtual KUInt32 RunUnits(
+		TARMProcessor* ioObject,
+		volatile Boolean* inSignal,
+		KUInt32 inMaxUnits)
+		= 0;
+
 	///
 	/// Accessor to a page.
 	/// Return NULL if the page cannot be accessed because a translation
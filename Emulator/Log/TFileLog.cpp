@@ -56,14 +56,40 @@ TFileLog::~TFileLog(void)
 	}
 }
 
+// -------------------------------------------------------------------------- //
+//  * Reopen( const char* )
+// -------------------------------------------------------------------------- //
+void
+TFileLog::Reopen(const char* inFilePath)
+{
+	LockMutex();
+	if (mFile)
+	{
+		(void) ::fclose(mFile);
+	}
+	mFile = ::fopen(inFilePath, "a");
+	if (mFile == NULL)
+	{
+		(void) ::fprintf(
+			stderr,
+			"Couldn't open file %s for writing (%i)\n",
+			inFilePath,
+			errno);
+	}
+	UnlockMutex();
+}
+
 // -------------------------------------------------------------------------- //
 //  * DoLogLine( const char* )
 // -------------------------------------------------------------------------- //
 void
 TFileLog::DoLogLine(const char* inLine)
 {
-	(void) ::fprintf(mFile, "%s\n", inLine);
-	(void) ::fflush(mFile);
+	if (mFile)
+	{
+		(void) ::fprintf(mFile, "%s\n", inLine);
+		(void) ::fflush(mFile);
+	}
 }
 
 // ========================================================================= //
@@ -52,6 +52,13 @@ public:
 	///
 	virtual ~TFileLog(void);
 
+	///
+	/// Close the current file and append the log to another one.
+	///
+	/// \param inFilePath	path of the new log file.
+	///
+	void Reopen(const char* inFilePath);
+
 private:
 	///
 	/// Log a line.
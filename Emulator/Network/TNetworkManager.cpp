@@ -28,6 +28,16 @@
 #include <K/Threads/TCondVar.h>
 #include <K/Threads/TMutex.h>
 #include <K/Threads/TThread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SSE2 is part of x86-64.
+#if defined(__x86_64__) || defined(_M_X64)
+#define NETWORKCHECKSUM_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #if TARGET_OS_WIN32
 #else
 #include <sys/select.h>
@@ -45,10 +55,7 @@ TNetworkManager::TNetworkManager(TLog* inLog) :
 {
 	mSelectCondVar = new TCondVar();
 	mSelectMutex = new TMutex();
-	mSelectMutex->Lock();
-	mThread = new TThread(this);
-	mSelectCondVar->Wait(mSelectMutex);
-	mSelectMutex->Unlock();
+	TNetworkManager::StartThreads();
 }
 
 // -------------------------------------------------------------------------- //
@@ -56,11 +63,80 @@ TNetworkManager::TNetworkManager(TLog* inLog) :
 // -------------------------------------------------------------------------- //
 TNetworkManager::~TNetworkManager()
 {
+	(void) TNetworkManager::StopThreads();
 	delete mSelectMutex;
 	delete mThread;
 	delete mSelectCondVar;
 }
 
+// -------------------------------------------------------------------------- //
+//  * StopThreads( void )
+// -------------------------------------------------------------------------- //
+Boolean
+TNetworkManager::StopThreads(void)
+{
+	if (mThread == NULL)
+	{
+		return true;
+	}
+
+	// Stop the thread if it waits for a set of fds. It holds the mutex while
+	// it is in select(), and we can't stop it then (TryLock returns true
+	// if the mutex was already locked).
+	if (mSelectMutex->TryLock())
+	{
+		return false;
+	}
+	// The thread may have left already, if select() failed.
+	if (mSelectNFDS != -2)
+	{
+		mSelectNFDS = -1;
+		mSelectCondVar->Signal();
+	}
+	while (mSelectNFDS != -2)
+	{
+		mSelectCondVar->Wait(mSelectMutex);
+	}
+	mSelectMutex->Unlock();
+
+	delete mThread;
+	mThread = NULL;
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * StartThreads( void )
+// -------------------------------------------------------------------------- //
+void
+TNetworkManager::StartThreads(void)
+{
+	if (mThread)
+	{
+		return;
+	}
+
+	mSelectMutex->Lock();
+	mSelectNFDS = 0;
+	mThread = new TThread(this);
+	// Wait for the thread to be running.
+	mSelectCondVar->Wait(mSelectMutex);
+	mSelectMutex->Unlock();
+}
+
+// -------------------------------------------------------------------------- //
+//  * ReceiveDataToMemory(KUInt32, KUInt32)
+// -------------------------------------------------------------------------- //
+int
+TNetworkManager::ReceiveDataToMemory(KUInt32 address, KUInt32 size)
+{
+	KUInt8* buffer = (KUInt8*) ::malloc(size);
+	int err = ReceiveData(buffer, size);
+	if (err == 0)
+		(void) mMemory->FastWriteBuffer(address, size, buffer);
+	::free(buffer);
+	return err;
+}
+
 void
 TNetworkManager::LogBuffer(KUInt8* data, ssize_t size)
 {
@@ -210,31 +286,156 @@ TNetworkManager::LogPacket(KUInt8* d, ssize_t n)
 	}
 }
 
-KUInt16
-TNetworkManager::GetUDPChecksum(KUInt8* d, ssize_t n, Boolean set)
+namespace {
+
+// Sum of the bytes read as native 32 bit words, not folded. An odd number of
+// trailing bytes is padded with zeros.
+KUInt64
+SumWordsPortable(const KUInt8* data, size_t size, KUInt64 sum)
 {
-	KUInt32 s = 0;
-	KUInt16 UDPLength = n - 34;
-	ssize_t i;
-	// UDP Pseudo Header:
-	s = s + (d[26] << 8) + d[27] + (d[28] << 8) + d[29]; // src IP
-	s = s + (d[30] << 8) + d[31] + (d[32] << 8) + d[33]; // dst IP
-	s = s + d[23] + UDPLength;
-	if (set)
+	while (size >= 4)
 	{
-		d[40] = d[41] = 0;
+		KUInt32 w;
+		(void) ::memcpy(&w, data, 4);
+		sum += w;
+		data += 4;
+		size -= 4;
+	}
+	if (size)
+	{
+		KUInt32 w = 0;
+		(void) ::memcpy(&w, data, size);
+		sum += w;
+	}
+	return sum;
+}
+
+#if NETWORKCHECKSUM_SSE2
+// Same as above, 64 bytes at a time. The 16 bit words are added to 32 bit
+// lanes, which can take 64 kB before they could overflow.
+KUInt64
+SumWordsSSE2(const KUInt8* data, size_t size, KUInt64 sum)
+{
+	const __m128i zero = _mm_setzero_si128();
+	while (size >= 64)
+	{
+		size_t block = size & ~(size_t) 63;
+		if (block > 65536)
+			block = 65536;
+		size -= block;
+		__m128i acc0 = zero;
+		__m128i acc1 = zero;
+		for (; block; block -= 64, data += 64)
+		{
+			__m128i v0 = _mm_loadu_si128((const __m128i*) data);
+			__m128i v1 = _mm_loadu_si128((const __m128i*) (data + 16));
+			__m128i v2 = _mm_loadu_si128((const __m128i*) (data + 32));
+			__m128i v3 = _mm_loadu_si128((const __m128i*) (data + 48));
+			acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v0, zero));
+			acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v0, zero));
+			acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v1, zero));
+			acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v1, zero));
+			acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v2, zero));
+			acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v2, zero));
+			acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v3, zero));
+			acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v3, zero));
+		}
+		// Widen to 64 bits before adding the two accumulators.
+		__m128i acc = _mm_add_epi64(
+			_mm_add_epi64(_mm_unpacklo_epi32(acc0, zero), _mm_unpackhi_epi32(acc0, zero)),
+			_mm_add_epi64(_mm_unpacklo_epi32(acc1, zero), _mm_unpackhi_epi32(acc1, zero)));
+		KUInt64 lanes[2];
+		_mm_storeu_si128((__m128i*) lanes, acc);
+		sum += lanes[0] + lanes[1];
 	}
-	// UDP Data
-	for (i = 34; i < n; i += 2)
+	return SumWordsPortable(data, size, sum);
+}
+#endif
+
+// Sum of the IPv4 pseudo header of a TCP or UDP packet.
+KUInt16
+PseudoHeaderSum(const KUInt8* d, ssize_t n)
+{
+	KUInt32 s = TNetworkManager::OnesComplementSum(d + 26, 8); // src and dst IP
+	s = s + d[23] + (KUInt16) (n - 34);
+	while (s >> 16)
+		s = (s & 0xFFFF) + (s >> 16);
+	return s;
+}
+
+// Rewrite a field of a packet and update the checksum at inChecksum.
+void
+RewriteField16(KUInt8* d, int inField, KUInt16 inValue, int inChecksum)
+{
+	KUInt16 theOld = (d[inField] << 8) | d[inField + 1];
+	KUInt16 theChecksum = (d[inChecksum] << 8) | d[inChecksum + 1];
+	theChecksum = TNetworkManager::UpdateChecksum16(theChecksum, theOld, inValue);
+	d[inField] = inValue >> 8;
+	d[inField + 1] = inValue;
+	d[inChecksum] = theChecksum >> 8;
+	d[inChecksum + 1] = theChecksum;
+}
+
+} // namespace
+
+KUInt16
+TNetworkManager::OnesComplementSum(const KUInt8* d, ssize_t n, KUInt16 sum)
+{
+	KUInt64 s = 0;
+	if (n > 0)
 	{
-		s += (d[i] << 8);
-		if (i + 1 < n)
-			s += d[i + 1];
+#if NETWORKCHECKSUM_SSE2
+		s = SumWordsSSE2(d, n, 0);
+#else
+		s = SumWordsPortable(d, n, 0);
+#endif
 	}
-	// 1's complement
 	while (s >> 16)
 		s = (s & 0xFFFF) + (s >> 16);
-	s = ~s;
+#if TARGET_RT_LITTLE_ENDIAN
+	// The one's complement sum does not depend on the byte order, so it is
+	// enough to swap the result (RFC 1071).
+	s = ((s & 0xFF) << 8) | (s >> 8);
+#endif
+	s += sum;
+	s = (s & 0xFFFF) + (s >> 16);
+	return (KUInt16) s;
+}
+
+KUInt16
+TNetworkManager::UpdateChecksum16(KUInt16 checksum, KUInt16 oldValue, KUInt16 newValue)
+{
+	// HC' = ~(~HC + ~m + m'), RFC 1624 eqn. 3
+	KUInt32 s = (KUInt32) (KUInt16) ~checksum + (KUInt16) ~oldValue + newValue;
+	while (s >> 16)
+		s = (s & 0xFFFF) + (s >> 16);
+	return (KUInt16) ~s;
+}
+
+KUInt16
+TNetworkManager::UpdateChecksum32(KUInt16 checksum, KUInt32 oldValue, KUInt32 newValue)
+{
+	checksum = UpdateChecksum16(checksum, oldValue >> 16, newValue >> 16);
+	return UpdateChecksum16(checksum, oldValue & 0xFFFF, newValue & 0xFFFF);
+}
+
+void
+TNetworkManager::RewriteTCPAck(KUInt8* d, KUInt32 ack)
+{
+	RewriteField16(d, 42, ack >> 16, 50);
+	RewriteField16(d, 44, ack & 0xFFFF, 50);
+}
+
+KUInt16
+TNetworkManager::GetUDPChecksum(KUInt8* d, ssize_t n, Boolean set)
+{
+	if (set)
+	{
+		d[40] = d[41] = 0;
+	}
+	// UDP Pseudo Header and UDP Data
+	KUInt16 s = PseudoHeaderSum(d, n);
+	s = ~OnesComplementSum(d + 34, n - 34, s);
 	// set it
 	if (set)
 	{
@@ -249,28 +450,13 @@ TNetworkManager::GetUDPChecksum(KUInt8* d, ssize_t n, Boolean set)
 KUInt16
 TNetworkManager::GetTCPChecksum(KUInt8* d, ssize_t n, Boolean set)
 {
-	KUInt32 s = 0;
-	KUInt16 TCPLength = n - 34;
-	ssize_t i;
-	// TCP Pseudo Header:
-	s = s + (d[26] << 8) + d[27] + (d[28] << 8) + d[29]; // src IP
-	s = s + (d[30] << 8) + d[31] + (d[32] << 8) + d[33]; // dst IP
-	s = s + d[23] + TCPLength;
 	if (set)
 	{
 		d[50] = d[51] = 0;
 	}
-	// TCP Data
-	for (i = 34; i < n; i += 2)
-	{
-		s += (d[i] << 8);
-		if (i + 1 < n)
-			s += d[i + 1];
-	}
-	// 1's complement
-	while (s >> 16)
-		s = (s & 0xFFFF) + (s >> 16);
-	s = ~s;
+	// TCP Pseudo Header and TCP Data
+	KUInt16 s = PseudoHeaderSum(d, n);
+	s = ~OnesComplementSum(d + 34, n - 34, s);
 	// set it
 	if (set)
 	{
@@ -286,22 +472,12 @@ KUInt16
 TNetworkManager::GetIPv4Checksum(KUInt8* d, ssize_t n, Boolean set)
 {
 	(void) n;
-	(void) set;
 
-	KUInt32 s = 0;
-	KUInt16 v, i;
 	if (set)
 	{
 		d[24] = d[25] = 0;
 	}
-	for (i = 14; i < 34; i += 2)
-	{
-		v = (d[i] << 8) | d[i + 1];
-		s += v;
-	}
-	while (s >> 16)
-		s = (s & 0xFFFF) + (s >> 16);
-	s = ~s;
+	KUInt16 s = ~OnesComplementSum(d + 14, 20);
 	if (set)
 	{
 		if (s == 0)
@@ -319,9 +495,12 @@ void
 TNetworkManager::AsyncWaitForReadyToRead(int nfds, const fd_set* inFDSet)
 {
 	mSelectMutex->Lock();
-	mSelectNFDS = nfds;
-	mSelectSet = *inFDSet;
-	mSelectCondVar->Signal();
+	if (mSelectNFDS != -2)
+	{
+		mSelectNFDS = nfds;
+		mSelectSet = *inFDSet;
+		mSelectCondVar->Signal();
+	}
 	mSelectMutex->Unlock();
 }
 
@@ -336,16 +515,30 @@ TNetworkManager::Run()
 	while (true)
 	{
 		mSelectCondVar->Wait(mSelectMutex);
+		if (mSelectNFDS < 0)
+		{
+			break;
+		}
 
-		int nbReady = select(mSelectNFDS, &mSelectSet, NULL, NULL, NULL);
+		int nbReady;
+		do
+		{
+			nbReady = select(mSelectNFDS, &mSelectSet, NULL, NULL, NULL);
+		} while ((nbReady < 0) && (errno == EINTR));
 		if (nbReady > 0)
 		{
 			IsReadyToRead(&mSelectSet);
 		} else if (nbReady < 0)
 		{
+			if (mLog)
+				mLog->FLogLine("TNetworkManager: select failed (%d)", errno);
 			break;
 		}
 	}
+
+	// StopThreads waits for us to leave, whatever the reason.
+	mSelectNFDS = -2;
+	mSelectCondVar->Signal();
 	mSelectMutex->Unlock();
 }
 
@@ -125,6 +125,30 @@ public:
 	///
 	virtual int ReceiveData(KUInt8* data, KUInt32 size) = 0;
 
+	///
+	/// Newton receives a block of data right into its memory.
+	/// The default implementation calls ReceiveData() with a temporary buffer.
+	/// Managers that keep the block in a buffer may copy it directly.
+	///
+	/// \param address virtual address of the Newton buffer
+	/// \param size the number of bytes that we expect in the buffer
+	///
+	virtual int ReceiveDataToMemory(KUInt32 address, KUInt32 size);
+
+	///
+	/// Stop the threads of the manager.
+	/// This is required before the process forks, as the child would not
+	/// inherit the threads, and could block on a mutex one of them held.
+	///
+	/// \return false if a thread is busy and could not be stopped.
+	///
+	virtual Boolean StopThreads(void);
+
+	///
+	/// (Re)start the threads of the manager, after StopThreads.
+	///
+	virtual void StartThreads(void);
+
 	///
 	/// Newton device driver timer expired.
 	///
@@ -148,27 +172,63 @@ public:
 	void LogUDPPacket(KUInt8* data, ssize_t size);
 	// void LogPayload(KUInt8 *data, ssize_t size, const char *d="");
 
-	KUInt16 GetIPv4Checksum(KUInt8* data, ssize_t size, Boolean set = 0);
-	void
+	static KUInt16 GetIPv4Checksum(KUInt8* data, ssize_t size, Boolean set = 0);
+	static void
 	SetIPv4Checksum(KUInt8* data, ssize_t size)
 	{
 		GetIPv4Checksum(data, size, true);
 	}
 
-	KUInt16 GetTCPChecksum(KUInt8* data, ssize_t size, Boolean set = 0);
-	void
+	static KUInt16 GetTCPChecksum(KUInt8* data, ssize_t size, Boolean set = 0);
+	static void
 	SetTCPChecksum(KUInt8* data, ssize_t size)
 	{
 		GetTCPChecksum(data, size, true);
 	}
 
-	KUInt16 GetUDPChecksum(KUInt8* data, ssize_t size, Boolean set = 0);
-	void
+	static KUInt16 GetUDPChecksum(KUInt8* data, ssize_t size, Boolean set = 0);
+	static void
 	SetUDPChecksum(KUInt8* data, ssize_t size)
 	{
 		GetUDPChecksum(data, size, true);
 	}
 
+	///
+	/// Add a block of data to a one's complement sum (RFC 1071).
+	/// The data is read as 16 bit words in network order, and an odd last byte
+	/// is padded with zero. Uses SSE2 where available.
+	///
+	/// \param data the bytes to add
+	/// \param size number of bytes
+	/// \param sum the sum of the previous blocks, which must have an even size
+	/// \return the folded sum, not inverted
+	///
+	static KUInt16 OnesComplementSum(const KUInt8* data, ssize_t size, KUInt16 sum = 0);
+
+	///
+	/// Update an Internet checksum after a 16 bit word changed (RFC 1624).
+	///
+	/// \param checksum the checksum as stored in the packet
+	/// \param oldValue the word before the change
+	/// \param newValue the word after the change
+	/// \return the new checksum
+	///
+	static KUInt16 UpdateChecksum16(KUInt16 checksum, KUInt16 oldValue, KUInt16 newValue);
+
+	///
+	/// Update an Internet checksum after a 32 bit word changed (RFC 1624).
+	///
+	static KUInt16 UpdateChecksum32(KUInt16 checksum, KUInt32 oldValue, KUInt32 newValue);
+
+	///
+	/// Change the acknowledgement number of a TCP packet and update its
+	/// checksum, without summing the packet again.
+	///
+	/// \param data the raw ethernet packet with valid checksums
+	/// \param ack the new acknowledgement number
+	///
+	static void RewriteTCPAck(KUInt8* data, KUInt32 ack);
+
 	///
 	/// Asynchronously wait for sockets to be readable and call IsReadyToRead in the async thread.
 	/// This function returns immediatly. The fd_set is copied.
@@ -60,7 +60,6 @@
  - UDP protocol
  - ARP protocol
  - DHCP protocol
- - socket handling in threads
  - testing:
  * SimpleMail
  * Courier
@@ -81,6 +80,10 @@
  - TCP connect
  - TCP send
  - TCP receive
+ - socket handling in threads (Linux, with epoll)
+ - TCP and UDP handlers indexed by flow
+ - packet buffers from a pool, host data received in place
+ - TCP segments sized to the MSS and receive window of the Newton
 
  Newton Synchronization happens on port: TCP 3679 (works mostly well with NCX 2.0)
 
@@ -157,9 +160,12 @@
 //
 
 #include "TUsermodeNetwork.h"
+#include "Emulator/TMemory.h"
 #include "Emulator/Log/TLog.h"
+#include "Emulator/PCMCIA/TPCMCIAController.h"
 
 #include <chrono>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -182,6 +188,10 @@ typedef int socklen_t;
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#if TARGET_OS_LINUX
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 #ifdef __ANDROID__
 #include <malloc.h>
 #else
@@ -201,6 +211,12 @@ typedef int socklen_t;
  */
 const KUInt32 kUDPExpirationTime = 1000;
 
+/**
+ Events of the reader thread carry the flow key of their handler. No flow goes
+ to port 0 of 0.0.0.0, so the key 0 is the wake up event.
+ */
+static const KUInt64 kReaderWakeKey = 0;
+
 static KUInt32
 MakeIP(KUInt8 a, KUInt8 b, KUInt8 c, KUInt8 d)
 {
@@ -222,6 +238,79 @@ static const KUInt32 kGatewayIP = MakeIP(192, 168, 1, 1);
 static const KUInt32 kNameServerIP = MakeIP(127, 0, 0, 53);
 #endif
 
+/**
+ * Buffers for packets, allocated in slabs and reused.
+ *
+ * All packets for the Newton are single Ethernet frames, so one buffer size
+ * fits all of them. Freed buffers go to a free list, and busy connections don't
+ * call malloc() and free() for every frame. The pool keeps its slabs until the
+ * application quits.
+ */
+class PacketPool
+{
+public:
+	static const ssize_t kBufferSize = 1536; ///< An Ethernet frame, rounded up
+	static const int kBuffersPerSlab = 32;
+
+	/**
+	 * Release all slabs.
+	 */
+	~PacketPool()
+	{
+		for (KUInt8* slab : mSlabs)
+			::free(slab);
+	}
+
+	/**
+	 * Take a buffer from the pool.
+	 * \return a buffer of kBufferSize bytes, or nullptr if no memory is left
+	 */
+	KUInt8*
+	Alloc()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mFree.empty())
+		{
+			KUInt8* slab = (KUInt8*) ::malloc(kBufferSize * kBuffersPerSlab);
+			if (!slab)
+				return nullptr;
+			mSlabs.push_back(slab);
+			for (int i = kBuffersPerSlab - 1; i >= 0; i--)
+				mFree.push_back(slab + i * kBufferSize);
+		}
+		KUInt8* buffer = mFree.back();
+		mFree.pop_back();
+		return buffer;
+	}
+
+	/**
+	 * Return a buffer to the pool.
+	 */
+	void
+	Free(KUInt8* inBuffer)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFree.push_back(inBuffer);
+	}
+
+	/**
+	 * Number of buffers in all slabs.
+	 */
+	KUInt32
+	GetBufferCount()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return (KUInt32) (mSlabs.size() * kBuffersPerSlab);
+	}
+
+private:
+	std::mutex mMutex; // the pool is shared by all network interfaces
+	std::vector<KUInt8*> mSlabs;
+	std::vector<KUInt8*> mFree;
+};
+
+static PacketPool gPacketPool;
+
 /**
  * This class is used to build and interprete TCP/IP packages.
  */
@@ -247,6 +336,7 @@ public:
 
 	/**
 	 * Create a new packet.
+	 * Copies of up to PacketPool::kBufferSize bytes use a buffer from the pool.
 	 * \param data pointer to some place in memory that contains the packet data
 	 * \param size number of bytes in this packet
 	 * \param copy if set, the packet data will be copied, otherwise this class
@@ -257,7 +347,12 @@ public:
 	{
 		if (copy)
 		{
-			mData = (KUInt8*) malloc(size);
+			if (size <= PacketPool::kBufferSize)
+				mData = gPacketPool.Alloc();
+			if (mData)
+				mPooled = true;
+			else
+				mData = (KUInt8*) malloc(size);
 			if (data)
 			{
 				memcpy(mData, data, size);
@@ -287,7 +382,9 @@ public:
 	 */
 	~Packet()
 	{
-		if (mData && mCopy)
+		if (mData && mPooled)
+			gPacketPool.Free(mData);
+		else if (mData && mCopy)
 			::free(mData);
 	}
 
@@ -817,6 +914,7 @@ private:
 	KUInt8* mData = nullptr;
 	ssize_t mSize = 0;
 	KUInt8 mCopy = 0;
+	bool mPooled = false; ///<! mData belongs to gPacketPool
 	KUInt32 mIndex = 0;
 	static KUInt32 mIndexCount;
 };
@@ -872,6 +970,25 @@ public:
 	{
 	}
 
+	/**
+	 * Read the data waiting on the host socket and queue it for the Newton.
+	 * Called by the reader thread when the socket is readable, or by timer()
+	 * on hosts without the reader thread.
+	 */
+	virtual void
+	ReadSocket()
+	{
+	}
+
+	/**
+	 * Return the host socket that ReadSocket() reads.
+	 */
+	virtual int
+	GetSocket()
+	{
+		return INVALID_SOCKET;
+	}
+
 	/**
 	 * Find out if this packet can be handled.
 	 * If it can not be handled, the packet will be offered to the next handler.
@@ -894,6 +1011,9 @@ public:
 	PacketHandler* mNext = nullptr;
 	TUsermodeNetwork* mNet = nullptr;
 	TLog* mLog = nullptr;
+	bool mWatched = false; ///<! the reader thread will call ReadSocket() once
+	KUInt8 mFlowProtocol = 0; ///<! IP protocol of the flow, 0 if the handler has no flow
+	KUInt64 mFlowKey = 0; ///<! index of the flow, see TUsermodeNetwork::FlowKey()
 };
 
 /**
@@ -915,7 +1035,7 @@ public:
 								// we expect a SYN package from the Newt and will reply with SYN ACK (or timeout)
 		kStateConnectionWaitACK, // we expect the ACK connection packet
 		kStateConnected, // socket was opened successfully
-		kStateConnectedWaitACK, // package was forewarded to Newt, now I want an ACK
+		kStateConnectedWaitACK, // the receive window of the Newton is full, now I want an ACK
 		kStatePeerDiscWaitForACK, // Peer disconnected, we sent a FIN, wait for an ACK from Newton
 		kStatePeerDiscWaitForFIN, // Peer disconnected, we got the ACK, now we wait for a FIN from Newton
 		kStateNewwtonDiscWaitForACK, // Newton requested a disconnect, we sent a FIN+ACK, waiting for final ACK
@@ -962,6 +1082,8 @@ public:
 		theirIP = packet.GetIPDstIP();
 		theirPort = packet.GetTCPDstPort();
 		theirID = 1000;
+		mFlowProtocol = Packet::kIPProtocolTCP;
+		mFlowKey = TUsermodeNetwork::FlowKey(myPort, theirIP, theirPort);
 
 		// SYN-ACK packet should have ACK set to client SEQ + 1
 		mNewtonPacketsSeq = packet.GetTCPSeq() + 1;
@@ -1048,6 +1170,18 @@ public:
 		return p;
 	}
 
+	/**
+	 * Shrink a packet created by NewPacket() to a smaller payload.
+	 * \param p the packet
+	 * \param size the new size of the payload
+	 */
+	void
+	SetPayloadSize(Packet* p, ssize_t size)
+	{
+		p->SetSize(size + 54);
+		p->SetIPTotalLength(size + 54 - 14);
+	}
+
 	/**
 	 * Update the IP and TCP checksums in the packet.
 	 */
@@ -1070,6 +1204,7 @@ public:
 	connect(Packet& packet)
 	{
 		mSeqBase = mNewtonPacketsSeq = packet.GetTCPSeq();
+		ReadMSSOption(packet);
 		// create a socket
 		mSocket = ::socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
 		if (mSocket == INVALID_SOCKET)
@@ -1180,16 +1315,16 @@ public:
 				return connect(packet);
 			case kStateConnectionWaitACK:
 				mEinsteinPacketsSeq = packet.GetTCPAck();
+				mNewtonAck = mEinsteinPacketsSeq;
+				mNewtonWindow = packet.GetTCPWindow();
 				state = kStateConnected;
+				mNet->WatchSocket(this, mSocket);
 				return 1;
 			case kStateConnected:
 			case kStateConnectedWaitACK:
-				// Make sure that we don;t forward packes until the last one was acknowledged
-				if ((state == kStateConnectedWaitACK) && (packet.GetTCPFlags() & Packet::kTCPFlagACK))
-				{
-					// mNewtonPacketsSeq = packet.GetTCPAck();
-					state = kStateConnected;
-				}
+				// Acknowledged data makes room in the window of the Newton.
+				if (packet.GetTCPFlags() & Packet::kTCPFlagACK)
+					UpdateWindow(packet);
 				// The socket is connected. Traffic can come from either side
 				if (packet.GetTCPPayloadSize() > 0)
 				{
@@ -1198,6 +1333,9 @@ public:
 					::send(mSocket, (char*) packet.GetTCPPayloadStart(), packet.GetTCPPayloadSize(), 0);
 					// FIXME: use return value
 					mNewtonPacketsSeq = packet.GetTCPSeq() + (KUInt32) packet.GetTCPPayloadSize();
+					// Segments that the Newton didn't pick up yet carry the ACK.
+					if (mNet->AckQueuedSegments(myPort, theirIP, theirPort, mNewtonPacketsSeq))
+						return 1;
 					// return an ACK to Newton
 					Packet* reply = NewPacket(0);
 					reply->SetTCPFlags(Packet::kTCPFlagACK);
@@ -1279,74 +1417,170 @@ public:
 
 	/**
 	 * Handle all reoccuring events.
-	 * We currently use polling to read from the sockets. This is easy on the
-	 * host and does not delay package delivery too much. In a future version
-	 * it would be better to used threads to read from the sockets and
-	 * interrupts to send data to the Newton.
+	 * On Linux, the reader thread reads the socket and we only resume reading
+	 * if it stopped because the Fifo was full. Elsewhere, we poll the socket.
 	 */
 	void
 	timer() override
 	{
+#if TARGET_OS_LINUX
+		if ((state == kStateConnected) && !mWatched)
+			mNet->WatchSocket(this, mSocket);
+#else
 		// Don't do anything until Newton picked up all packages.
 		if (mNet->PacketAvailable()) // DataAvailable())
 			return;
-		switch (state)
+		ReadSocket();
+#endif
+	}
+
+	int
+	GetSocket() override
+	{
+		return mSocket;
+	}
+
+	/**
+	 * Forward the data from the peer to the Newton.
+	 * We queue as many segments as the receive window of the Newton allows,
+	 * each one no larger than its MSS, and then wait for an ACK. Connections
+	 * don't wait for each other.
+	 */
+	void
+	ReadSocket() override
+	{
+		if (state != kStateConnected)
+			return;
+		while (!mNet->IsQueueFull())
 		{
-			case kStateNewwtonDiscWaitForACK:
-				// TODO: count down the timer and remove myself if expired
-				return;
-			case kStateDisconnected:
-				// TODO: this should not happen
+			KUInt32 window = GetSendWindow();
+			if (window == 0)
+			{
+				// The Newton must acknowledge some data first.
+				state = kStateConnectedWaitACK;
 				return;
-			case kStateConnected: {
-				KUInt8 buf[TUsermodeNetwork::kMaxRxBuffer];
-				ssize_t avail = ::recv(mSocket, (char*) buf, sizeof(buf), 0);
-				if (avail == -1)
-				{
-					// FIXME: do stuff depending on the error that occured
-				} else if (avail == 0)
-				{
-					// Peer has closed connection.
-					LOG_PROTOCOL("  ,---- Einstein > Newton -- TCP ----------");
-					LOG_PROTOCOL("  | Peer is closing the connection. Send FIN.");
-					// Foreward a FIN request to the Newton
-					Packet* reply = NewPacket(0);
-					reply->SetTCPFlags(Packet::kTCPFlagFIN | Packet::kTCPFlagACK);
-					reply->SetTCPAck(mNewtonPacketsSeq);
-					UpdateChecksums(reply);
-					LOG_HEADER_DO(mNet->Log(reply, "  | W E>N", __LINE__, 0, mSeqBase);)
-					mNet->Enqueue(reply);
-					// Increment sequence number for last packet.
-					mEinsteinPacketsSeq++;
-					LOG_PROTOCOL("  `---- Einstein > Newton -- done ---------");
-					// Wait for the newton to acknowledge the FIN and and send a FIN to peer.
-					state = kStatePeerDiscWaitForACK;
-					break;
-				} else if (avail > 0)
+			}
+			// Receive the data right into the payload of the reply.
+			ssize_t size = (window < mMSS) ? window : mMSS;
+			Packet* reply = NewPacket(size);
+			ssize_t avail = ::recv(mSocket, (char*) reply->GetTCPPayloadStart(), size, 0);
+			if (avail < 1)
+			{
+				delete reply;
+			}
+			if (avail == -1)
+			{
+#if TARGET_OS_WIN32
+				bool wouldBlock = (WSAGetLastError() == WSAEWOULDBLOCK);
+#else
+				bool wouldBlock = (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+#endif
+				if (wouldBlock)
 				{
-					LOG_PROTOCOL("  ,---- Einstein > Newton -- TCP ----------");
-					LOG_PROTOCOL("  | W>E N Received %d bytes payload.", (int) avail);
-					Packet* reply = NewPacket(avail);
-					memcpy(reply->GetTCPPayloadStart(), buf, avail);
-					reply->SetTCPFlags(Packet::kTCPFlagACK /*|Packet::kTCPFlagPSH*/);
-					reply->SetTCPAck(mNewtonPacketsSeq);
-					UpdateChecksums(reply);
-					LOG_PROTOCOL("  | W E N Forwarding %d bytes total, %d bytes payload.",
-						34 + reply->GetTCPHeaderLength() + reply->GetTCPPayloadSize(),
-						reply->GetTCPPayloadSize());
-					LOG_HEADER_DO(mNet->Log(reply, "  | W E>N", __LINE__, 0, mSeqBase);)
-					mNet->Enqueue(reply);
-					mEinsteinPacketsSeq += avail;
-					LOG_PROTOCOL("  `---- Einstein > Newton -- done ---------");
-					// The following line blocks the handler from sending new
-					// packages until the last sent package was acknowledged
-					// bei NewtonOS.
-					state = kStateConnectedWaitACK;
+					mNet->WatchSocket(this, mSocket);
+					return;
 				}
+				// The connection is broken, close it as if the peer did.
+				avail = 0;
+			}
+			if (avail == 0)
+			{
+				// Peer has closed connection.
+				LOG_PROTOCOL("  ,---- Einstein > Newton -- TCP ----------");
+				LOG_PROTOCOL("  | Peer is closing the connection. Send FIN.");
+				// Foreward a FIN request to the Newton
+				Packet* fin = NewPacket(0);
+				fin->SetTCPFlags(Packet::kTCPFlagFIN | Packet::kTCPFlagACK);
+				fin->SetTCPAck(mNewtonPacketsSeq);
+				UpdateChecksums(fin);
+				LOG_HEADER_DO(mNet->Log(fin, "  | W E>N", __LINE__, 0, mSeqBase);)
+				mNet->Enqueue(fin);
+				// Increment sequence number for last packet.
+				mEinsteinPacketsSeq++;
+				LOG_PROTOCOL("  `---- Einstein > Newton -- done ---------");
+				// Wait for the newton to acknowledge the FIN and and send a FIN to peer.
+				state = kStatePeerDiscWaitForACK;
+				return;
+			}
+			LOG_PROTOCOL("  ,---- Einstein > Newton -- TCP ----------");
+			LOG_PROTOCOL("  | W>E N Received %d bytes payload.", (int) avail);
+			SetPayloadSize(reply, avail);
+			reply->SetTCPFlags(Packet::kTCPFlagACK /*|Packet::kTCPFlagPSH*/);
+			reply->SetTCPAck(mNewtonPacketsSeq);
+			UpdateChecksums(reply);
+			LOG_PROTOCOL("  | W E N Forwarding %d bytes total, %d bytes payload.",
+				34 + reply->GetTCPHeaderLength() + reply->GetTCPPayloadSize(),
+				reply->GetTCPPayloadSize());
+			LOG_HEADER_DO(mNet->Log(reply, "  | W E>N", __LINE__, 0, mSeqBase);)
+			mNet->Enqueue(reply);
+			mEinsteinPacketsSeq += avail;
+			LOG_PROTOCOL("  `---- Einstein > Newton -- done ---------");
+		}
+	}
+
+	/**
+	 * Return how many more bytes the Newton can receive right now.
+	 */
+	KUInt32
+	GetSendWindow()
+	{
+		KUInt32 inFlight = mEinsteinPacketsSeq - mNewtonAck;
+		return (inFlight < mNewtonWindow) ? mNewtonWindow - inFlight : 0;
+	}
+
+	/**
+	 * Take note of an ACK from the Newton.
+	 * An ACK may cover several segments (the Newton delays its ACKs), and it
+	 * updates the receive window, which may let us send again.
+	 * \param packet a packet from the Newton with the ACK flag set
+	 */
+	void
+	UpdateWindow(Packet& packet)
+	{
+		KUInt32 ack = packet.GetTCPAck();
+		// Ignore old ACKs and ACKs for data that we didn't send.
+		if (((KSInt32) (ack - mNewtonAck) < 0) || ((KSInt32) (ack - mEinsteinPacketsSeq) > 0))
+			return;
+		mNewtonAck = ack;
+		mNewtonWindow = packet.GetTCPWindow();
+		if ((state == kStateConnectedWaitACK) && (GetSendWindow() > 0))
+		{
+			state = kStateConnected;
+			mNet->WatchSocket(this, mSocket);
+		}
+	}
+
+	/**
+	 * Read the maximum segment size from the options of the Newton SYN.
+	 * \param packet the SYN packet
+	 */
+	void
+	ReadMSSOption(Packet& packet)
+	{
+		KUInt32 end = 34 + packet.GetTCPHeaderLength();
+		if (end > (KUInt32) packet.Size())
+			end = (KUInt32) packet.Size();
+		KUInt32 i = 54;
+		while (i + 1 < end)
+		{
+			KUInt8 kind = packet.Get8(i);
+			if (kind == 0) // end of options
 				break;
+			if (kind == 1) // no operation
+			{
+				i++;
+				continue;
 			}
-			default:
+			KUInt8 len = packet.Get8(i + 1);
+			if (len < 2)
 				break;
+			if ((kind == 2) && (len == 4) && (i + 4 <= end))
+			{
+				KUInt32 mss = packet.Get16(i + 2);
+				if ((mss > 0) && (mss < mMSS))
+					mMSS = mss;
+			}
+			i += len;
 		}
 	}
 
@@ -1384,6 +1618,9 @@ public:
 	KUInt32 mEinsteinPacketsSeq = 0; ///<! sequence number of our packets, incremented after each send
 	KUInt32 mSeqBase = 0;
 	KUInt32 mNewtonPacketsSeq = 0; ///<! sequence number of Newton packets for our ACKs
+	KUInt32 mNewtonAck = 0; ///<! our sequence number that the Newton acknowledged last
+	KUInt32 mNewtonWindow = 0; ///<! bytes that the Newton can receive after mNewtonAck
+	KUInt32 mMSS = TUsermodeNetwork::kMaxRxBuffer; ///<! largest segment that we send to the Newton
 	KUInt16 theirID = 0;
 	enum State state = kStateDisconnected;
 	int mSocket = INVALID_SOCKET;
@@ -1418,6 +1655,8 @@ public:
 		theirMAC = packet.GetDstMAC();
 		theirIP = packet.GetIPDstIP();
 		theirPort = packet.GetUDPDstPort();
+		mFlowProtocol = Packet::kIPProtocolUDP;
+		mFlowKey = TUsermodeNetwork::FlowKey(myPort, theirIP, theirPort);
 		LOG_PROTOCOL("| Adding UDP handler for port %d to %u.%u.%u.%u.",
 			theirPort,
 			(unsigned int) ((theirIP >> 24) & 0xff),
@@ -1486,6 +1725,19 @@ public:
 		return p;
 	}
 
+	/**
+	 * Shrink a packet created by NewPacket() to a smaller payload.
+	 * \param p the packet
+	 * \param size the new size of the payload
+	 */
+	void
+	SetPayloadSize(Packet* p, ssize_t size)
+	{
+		p->SetSize(size + 42);
+		p->SetIPTotalLength(size + 42 - 14);
+		p->SetUDPLength(size + 8);
+	}
+
 	/**
 	 * Update IP and UDP cheksums.
 	 */
@@ -1531,6 +1783,7 @@ public:
 			theirSockAddr.sin_family = AF_INET;
 			theirSockAddr.sin_addr.s_addr = htonl(theirIP);
 			theirSockAddr.sin_port = htons(theirPort);
+			mNet->WatchSocket(this, mSocket);
 		}
 		mExpire = kUDPExpirationTime;
 		LOG_HEADER_DO(mNet->Log(&packet, "| W<E N", __LINE__);)
@@ -1547,43 +1800,68 @@ public:
 
 	/**
 	 * Handle all reoccuring events.
-	 * We currently use polling to read from the sockets. This is easy on the
-	 * host and does not delay package delivery too much. In a future version
-	 * it would be better to used threads to read from the sockets and
-	 * interrupts to send data to the Newton.
+	 * On Linux, the reader thread reads the socket and we only resume reading
+	 * if it stopped because the Fifo was full. Elsewhere, we poll the socket.
+	 * The handler is removed when no packets went through for a while.
 	 */
 	void
 	timer() override
 	{
-		// Don't do anything until Newton picked up all packages.
-		if (mNet->PacketAvailable()) // DataAvailable())
+		if (mSocket == INVALID_SOCKET)
 			return;
-		KUInt8 buf[TUsermodeNetwork::kMaxRxBuffer];
+#if TARGET_OS_LINUX
+		if (!mWatched)
+			mNet->WatchSocket(this, mSocket);
+#else
+		// Don't do anything until Newton picked up all packages.
+		if (!mNet->PacketAvailable()) // DataAvailable())
+			ReadSocket();
+#endif
+		if (--mExpire == 0)
+		{
+			LOG_PROTOCOL("[ Timer expired. Removing UDP handler for port %u to %u.%u.%u.%u.",
+				theirPort,
+				(unsigned int) ((theirIP >> 24) & 0xff),
+				(unsigned int) ((theirIP >> 16) & 0xff),
+				(unsigned int) ((theirIP >> 8) & 0xff),
+				(unsigned int) (theirIP & 0xff));
+			mNet->RemovePacketHandler(this);
+		}
+	}
+
+	int
+	GetSocket() override
+	{
+		return mSocket;
+	}
+
+	/**
+	 * Forward the datagrams from the peer to the Newton.
+	 */
+	void
+	ReadSocket() override
+	{
 		socklen_t addrLen = sizeof(theirSockAddr);
 		if (mSocket == INVALID_SOCKET)
 			return;
 		int maxTry = 5;
 		for (; maxTry > 0; maxTry--)
 		{
-			ssize_t avail = recvfrom(mSocket, (char*) buf, sizeof(buf), 0, (struct sockaddr*) &theirSockAddr, &addrLen);
+			if (mNet->IsQueueFull())
+				return;
+			// Receive the datagram right into the payload of the reply.
+			Packet* reply = NewPacket(TUsermodeNetwork::kMaxRxBuffer);
+			ssize_t avail = recvfrom(mSocket, (char*) reply->GetUDPPayloadStart(), TUsermodeNetwork::kMaxRxBuffer,
+				0, (struct sockaddr*) &theirSockAddr, &addrLen);
 			if (avail < 1)
 			{
-				if (--mExpire == 0)
-				{
-					LOG_PROTOCOL("[ Timer expired. Removing UDP handler for port %u to %u.%u.%u.%u.",
-						theirPort,
-						(unsigned int) ((theirIP >> 24) & 0xff),
-						(unsigned int) ((theirIP >> 16) & 0xff),
-						(unsigned int) ((theirIP >> 8) & 0xff),
-						(unsigned int) (theirIP & 0xff));
-					mNet->RemovePacketHandler(this);
-				}
+				delete reply;
+				mNet->WatchSocket(this, mSocket);
 				return;
 			}
 			LOG_PROTOCOL("  ,---- Einstein > Newton -- UDP ----------");
 			LOG_PROTOCOL("  | W>E N Received %d bytes (UDP).", (int) avail);
-			Packet* reply = NewPacket(avail);
-			memcpy(reply->GetUDPPayloadStart(), buf, avail);
+			SetPayloadSize(reply, avail);
 			UpdateChecksums(reply);
 			LOG_HEADER_DO(mNet->Log(reply, "  | W E>N", __LINE__);)
 			mNet->LogPacket(reply->Data(), reply->Size());
@@ -1593,6 +1871,8 @@ public:
 			LOG_PROTOCOL("  `---- Einstein > Newton -- done ---------");
 			mExpire = kUDPExpirationTime;
 		}
+		// More datagrams may be waiting, the thread will call us again.
+		mNet->WatchSocket(this, mSocket);
 	}
 
 	/**
@@ -2095,6 +2375,23 @@ TUsermodeNetwork::TUsermodeNetwork(TLog* inLog) :
 	WORD wVersionRequested = MAKEWORD(2, 2);
 	WSAStartup(wVersionRequested, &wsaData);
 #endif
+#if TARGET_OS_LINUX
+	mEpoll = ::epoll_create1(EPOLL_CLOEXEC);
+	mWakeFD = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if ((mEpoll == -1) || (mWakeFD == -1))
+	{
+		LOG_ERROR("Can't create the reader thread (%d).", errno);
+		if (mEpoll != -1)
+			::close(mEpoll);
+		mEpoll = -1;
+		return;
+	}
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.u64 = kReaderWakeKey;
+	(void) ::epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWakeFD, &ev);
+	mReader = new std::thread(&TUsermodeNetwork::ReadSockets, this);
+#endif
 }
 
 /**
@@ -2102,6 +2399,14 @@ TUsermodeNetwork::TUsermodeNetwork(TLog* inLog) :
  */
 TUsermodeNetwork::~TUsermodeNetwork()
 {
+#if TARGET_OS_LINUX
+	// stop the reader thread
+	(void) StopThreads();
+	if (mWakeFD != -1)
+		::close(mWakeFD);
+	if (mEpoll != -1)
+		::close(mEpoll);
+#endif
 	// release the package pipe
 	while (mFirstPacket)
 		DropPacket();
@@ -2123,21 +2428,19 @@ TUsermodeNetwork::~TUsermodeNetwork()
 int
 TUsermodeNetwork::SendPacket(KUInt8* data, KUInt32 size)
 {
+	std::lock_guard<std::mutex> lock(mMutex);
 	int result = 0;
 	Packet packet(data, size, 0); // convert data into a packet
 	LOG_PROTOCOL(",---- Einstein < Newton -----------------");
 
-	// offer this package to all active handlers
-	PacketHandler* ph = mFirstPacketHandler;
-	while (ph)
+	// offer this package to the handler of its connection
+	PacketHandler* ph = FindPacketHandler(packet);
+	if (ph)
 	{
 		result = ph->send(packet);
 		// A result of 1 means handled, -1 means error, either way, we are done.
 		if (result != 0)
 			goto done;
-		// A result of 0 means that we could not handle this package, so we will
-		// try to find another handler.
-		ph = ph->mNext;
 	}
 
 	LOG_PROTOCOL("| Searching for a new handler:");
@@ -2193,6 +2496,7 @@ done:
 int
 TUsermodeNetwork::TimerExpired()
 {
+	std::lock_guard<std::mutex> lock(mMutex);
 	PacketHandler* ph = mFirstPacketHandler;
 	while (ph)
 	{
@@ -2220,26 +2524,15 @@ TUsermodeNetwork::GetDeviceAddress(KUInt8* data, KUInt32 size)
 
 /**
  * Return the number of bytes available for the Newton driver.
+ *
+ * Queued packets go out as fast as the Newton takes them: the sockets are
+ * not read while the queue is full, and TCP keeps to the Newton's window.
  */
 KUInt32
 TUsermodeNetwork::DataAvailable()
 {
-	// static std::chrono::time_point<std::chrono::steady_clock> delayBase = 0;
-	static auto delayBase = std::chrono::steady_clock::now();
-
-	if (mLastPacket)
-	{
-		auto now = std::chrono::steady_clock::now();
-		std::chrono::duration<double> delayDelta = now - delayBase;
-		auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(delayDelta);
-		if (seconds.count() < 0.25)
-			return 0;
-		delayBase = now;
-		return (KUInt32) mLastPacket->Size();
-	} else
-	{
-		return 0;
-	}
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mLastPacket ? (KUInt32) mLastPacket->Size() : 0;
 }
 
 /**
@@ -2249,6 +2542,7 @@ int
 TUsermodeNetwork::ReceiveData(KUInt8* data, KUInt32 size)
 {
 	LOG_CHATTY("    [ W E>N Newton requests packet, size %d", size);
+	std::lock_guard<std::mutex> lock(mMutex);
 	Packet* pkt = mLastPacket;
 	if (pkt)
 	{
@@ -2272,6 +2566,71 @@ TUsermodeNetwork::ReceiveData(KUInt8* data, KUInt32 size)
 	}
 }
 
+/**
+ * Stop the reader thread before the select thread of the base class.
+ */
+Boolean
+TUsermodeNetwork::StopThreads()
+{
+#if TARGET_OS_LINUX
+	if (mReader)
+	{
+		KUInt64 one = 1;
+		(void) ::write(mWakeFD, &one, sizeof(one));
+		mReader->join();
+		delete mReader;
+		mReader = nullptr;
+		// The next reader must not see the wake up.
+		(void) ::read(mWakeFD, &one, sizeof(one));
+	}
+#endif
+	return TNetworkManager::StopThreads();
+}
+
+/**
+ * Restart the threads stopped by StopThreads().
+ */
+void
+TUsermodeNetwork::StartThreads()
+{
+	TNetworkManager::StartThreads();
+#if TARGET_OS_LINUX
+	if ((mReader == nullptr) && (mEpoll != -1))
+		mReader = new std::thread(&TUsermodeNetwork::ReadSockets, this);
+#endif
+}
+
+/**
+ * Copy the next packet into Newton memory, without an intermediate buffer.
+ */
+int
+TUsermodeNetwork::ReceiveDataToMemory(KUInt32 address, KUInt32 size)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Packet* pkt = mLastPacket;
+	if (!pkt || (size != pkt->Size()))
+	{
+		LOG_ERROR("    [ W E>N Newton requested %d bytes, but the pending packet does not match.", size);
+		return -1;
+	}
+	if (mMemory->FastWriteBuffer(address, size, pkt->Data()))
+	{
+		LOG_ERROR("    [ W E>N Can't write packet %d to 0x%08X.", pkt->Index(), (unsigned int) address);
+		return -1;
+	}
+	DropPacket();
+	return 0;
+}
+
+/**
+ * Return the number of buffers in the packet pool.
+ */
+KUInt32
+TUsermodeNetwork::GetPacketBufferCount()
+{
+	return gPacketPool.GetBufferCount();
+}
+
 /**
  * Add a new handler for a package type to the list.
  */
@@ -2286,6 +2645,9 @@ TUsermodeNetwork::AddPacketHandler(PacketHandler* inPacketHandler)
 	inPacketHandler->mNext = n;
 	inPacketHandler->mPrev = NULL;
 	mFirstPacketHandler = inPacketHandler;
+	auto flows = GetFlows(inPacketHandler->mFlowProtocol);
+	if (flows)
+		(*flows)[inPacketHandler->mFlowKey] = inPacketHandler;
 }
 
 /**
@@ -2304,9 +2666,53 @@ TUsermodeNetwork::RemovePacketHandler(PacketHandler* ph)
 		pn->mPrev = pp;
 	else
 		mLastPacketHandler = pp;
+	auto flows = GetFlows(ph->mFlowProtocol);
+	if (flows)
+	{
+		auto it = flows->find(ph->mFlowKey);
+		if ((it != flows->end()) && (it->second == ph))
+			flows->erase(it);
+	}
 	delete ph;
 }
 
+/**
+ * Find the handler of an open TCP connection or UDP port.
+ * Other packets are handled by the canHandle() functions.
+ */
+PacketHandler*
+TUsermodeNetwork::FindPacketHandler(Packet& inPacket)
+{
+	if (inPacket.GetType() != Packet::kNetTypeIP)
+		return nullptr;
+	KUInt8 protocol = inPacket.GetIPProtocol();
+	KUInt64 key;
+	if (protocol == Packet::kIPProtocolTCP)
+		key = FlowKey(inPacket.GetTCPSrcPort(), inPacket.GetIPDstIP(), inPacket.GetTCPDstPort());
+	else if (protocol == Packet::kIPProtocolUDP)
+		key = FlowKey(inPacket.GetUDPSrcPort(), inPacket.GetIPDstIP(), inPacket.GetUDPDstPort());
+	else
+		return nullptr;
+	auto flows = GetFlows(protocol);
+	auto it = flows->find(key);
+	if (it == flows->end())
+		return nullptr;
+	return it->second;
+}
+
+/**
+ * Return the index of TCP or UDP handlers.
+ */
+std::unordered_map<KUInt64, PacketHandler*>*
+TUsermodeNetwork::GetFlows(KUInt8 inProtocol)
+{
+	if (inProtocol == Packet::kIPProtocolTCP)
+		return &mTCPFlows;
+	if (inProtocol == Packet::kIPProtocolUDP)
+		return &mUDPFlows;
+	return nullptr;
+}
+
 /**
  * Add a new packet to the beginning of the pipe.
  * This makes the given block ready to be sent at the next possible occasion.
@@ -2324,6 +2730,7 @@ TUsermodeNetwork::Enqueue(Packet* inPacket)
 	inPacket->mNext = n;
 	inPacket->mPrev = NULL;
 	mFirstPacket = inPacket;
+	mPacketCount++;
 }
 
 /**
@@ -2341,10 +2748,125 @@ TUsermodeNetwork::DropPacket()
 		else
 			mFirstPacket = NULL;
 		mLastPacket = prevPkt;
+		mPacketCount--;
 		delete pkt;
 	}
 }
 
+/**
+ * Update the acknowledgement number of the queued segments of a TCP flow.
+ *
+ * Only the ACK field and the checksum change, so the checksum is updated
+ * incrementally. SYN and RST segments are left alone.
+ */
+bool
+TUsermodeNetwork::AckQueuedSegments(KUInt16 inNewtonPort, KUInt32 inPeerIP, KUInt16 inPeerPort, KUInt32 inAck)
+{
+	bool acked = false;
+	for (Packet* pkt = mFirstPacket; pkt; pkt = pkt->mNext)
+	{
+		if ((pkt->GetType() != Packet::kNetTypeIP)
+			|| (pkt->GetIPProtocol() != Packet::kIPProtocolTCP)
+			|| (pkt->GetTCPDstPort() != inNewtonPort)
+			|| (pkt->GetIPSrcIP() != inPeerIP)
+			|| (pkt->GetTCPSrcPort() != inPeerPort))
+			continue;
+		KUInt16 flags = pkt->GetTCPFlags();
+		if (!(flags & Packet::kTCPFlagACK)
+			|| (flags & (Packet::kTCPFlagSYN | Packet::kTCPFlagRST)))
+			continue;
+		// Never move an ACK backwards.
+		if ((KSInt32) (inAck - pkt->GetTCPAck()) > 0)
+			RewriteTCPAck(pkt->Data(), inAck);
+		acked = true;
+	}
+	return acked;
+}
+
+/**
+ * Ask the reader thread to call ReadSocket() once the socket is readable.
+ *
+ * The socket is watched for one event only, so that a handler that is waiting
+ * for an ACK from the Newton is not woken up over and over.
+ */
+void
+TUsermodeNetwork::WatchSocket(PacketHandler* inHandler, int inSocket)
+{
+#if TARGET_OS_LINUX
+	if ((mEpoll == -1) || (inSocket == INVALID_SOCKET))
+		return;
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u64 = inHandler->mFlowKey;
+	// Closing a socket removes it from the set, so it may be new again.
+	if ((::epoll_ctl(mEpoll, EPOLL_CTL_MOD, inSocket, &ev) == -1)
+		&& (::epoll_ctl(mEpoll, EPOLL_CTL_ADD, inSocket, &ev) == -1))
+	{
+		LOG_ERROR("Can't watch socket %d (%d).", inSocket, errno);
+		return;
+	}
+	inHandler->mWatched = true;
+#else
+	(void) inHandler;
+	(void) inSocket;
+#endif
+}
+
+/**
+ * Reader thread loop.
+ *
+ * Data from the peers is queued as soon as it arrives, and an interrupt tells
+ * the Newton driver that packets are waiting.
+ */
+void
+TUsermodeNetwork::ReadSockets()
+{
+#if TARGET_OS_LINUX
+	struct epoll_event events[16];
+	for (;;)
+	{
+		int n = ::epoll_wait(mEpoll, events, 16, -1);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			LOG_ERROR("epoll_wait failed (%d).", errno);
+			break;
+		}
+		std::lock_guard<std::mutex> lock(mMutex);
+		KUInt32 queued = mPacketCount;
+		for (int i = 0; i < n; i++)
+		{
+			KUInt64 key = events[i].data.u64;
+			if (key == kReaderWakeKey)
+				return;
+			// The handler may have been removed since the event, and a TCP
+			// and a UDP flow may share a key. Reading a socket that has no
+			// data only watches it again.
+			auto tcp = mTCPFlows.find(key);
+			if ((tcp != mTCPFlows.end()) && tcp->second->mWatched)
+			{
+				tcp->second->mWatched = false;
+				tcp->second->ReadSocket();
+			}
+			auto udp = mUDPFlows.find(key);
+			if ((udp != mUDPFlows.end()) && udp->second->mWatched)
+			{
+				udp->second->mWatched = false;
+				udp->second->ReadSocket();
+			}
+		}
+		if (mPacketCount > queued)
+		{
+			// TODO: this assumes that the network card is in slot 0
+			TPCMCIAController* controller = mMemory ? mMemory->GetPCMCIAController(0) : nullptr;
+			if (controller)
+				controller->RaiseInterrupt(TPCMCIAController::kSocketCardIREQIntVector);
+		}
+	}
+#endif
+}
+
 /**
  * Write a brief one-liner description of the given package.
  */
@@ -27,6 +27,11 @@
 #include <K/Defines/KDefinitions.h>
 #include "TNetworkManager.h"
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 class TLog;
 class TInterruptManager;
 class TMemoryManager;
@@ -44,6 +49,7 @@ class TUsermodeNetwork : public TNetworkManager
 public:
 	static const int kMaxTxBuffer = 1448;
 	static const int kMaxRxBuffer = 1448;
+	static const int kMaxQueuedPackets = 64; ///< Sockets are not read while the Fifo is this long.
 
 	///
 	/// Constructor
@@ -95,13 +101,44 @@ public:
 	///
 	int ReceiveData(KUInt8* data, KUInt32 size) override;
 
+	///
+	/// Newton receives a block of data right into its memory.
+	/// The packet is copied from its buffer to the Newton in one go.
+	///
+	/// \param address virtual address of the Newton buffer
+	/// \param size the number of bytes that we expect in the buffer
+	///
+	int ReceiveDataToMemory(KUInt32 address, KUInt32 size) override;
+
 	///
 	/// Newton device timer expired.
-	/// Out of lazyness and for testing only, we use this timer to poll the open
-	/// sockets of all active protocols.
+	/// On Linux, a thread reads the sockets as soon as data arrives and the
+	/// timer only resumes reading after the Fifo was full. On other hosts,
+	/// we use this timer to poll the open sockets of all active protocols.
 	///
 	int TimerExpired() override;
 
+	///
+	/// Stop the reader thread and the thread of the base class.
+	/// The sockets stay open, and the reader resumes with StartThreads.
+	///
+	Boolean StopThreads(void) override;
+
+	///
+	/// (Re)start the threads, after StopThreads.
+	///
+	void StartThreads(void) override;
+
+	///
+	/// Have the reader thread call ReadSocket() on the handler once the socket
+	/// is readable. The handler must ask again after each call.
+	/// This does nothing on hosts without the reader thread.
+	///
+	/// \param inHandler the handler that reads the socket
+	/// \param inSocket the host socket
+	///
+	void WatchSocket(PacketHandler* inHandler, int inSocket);
+
 	///
 	/// Add a new packet handler to the list.
 	///
@@ -111,6 +148,38 @@ public:
 	/// Remove the packet handler from the list and delete it.
 	void RemovePacketHandler(PacketHandler*);
 
+	///
+	/// Number of TCP and UDP connections in the flow index.
+	///
+	KUInt32
+	GetFlowCount()
+	{
+		return (KUInt32) (mTCPFlows.size() + mUDPFlows.size());
+	}
+
+	///
+	/// Create the index of a TCP or UDP flow.
+	/// The Newton only has one IP address, so the Newton port and the peer
+	/// address and port identify the flow of a protocol.
+	///
+	/// \param inNewtonPort the port on the Newton side
+	/// \param inPeerIP the IP address of the peer
+	/// \param inPeerPort the port on the peer side
+	/// \return the key in the flow index
+	///
+	static KUInt64
+	FlowKey(KUInt16 inNewtonPort, KUInt32 inPeerIP, KUInt16 inPeerPort)
+	{
+		return ((KUInt64) inPeerIP << 32) | ((KUInt64) inNewtonPort << 16) | inPeerPort;
+	}
+
+	///
+	/// Number of packet buffers that were allocated so far.
+	/// Buffers are reused, so this is the most that were in use at once,
+	/// rounded up to a full slab.
+	///
+	static KUInt32 GetPacketBufferCount();
+
 	///
 	/// Add a package to the Fifo so that NewtonOS can pick it up later.
 	///
@@ -121,6 +190,18 @@ public:
 	///
 	void DropPacket();
 
+	///
+	/// Let the TCP segments of a flow that are still in the Fifo acknowledge
+	/// new data from the Newton, instead of queueing an ACK of their own.
+	///
+	/// \param inNewtonPort the port on the Newton side
+	/// \param inPeerIP the IP address of the peer
+	/// \param inPeerPort the port on the peer side
+	/// \param inAck the new acknowledgement number
+	/// \return true if a queued segment now carries the acknowledgement
+	///
+	bool AckQueuedSegments(KUInt16 inNewtonPort, KUInt32 inPeerIP, KUInt16 inPeerPort, KUInt32 inAck);
+
 	///
 	/// Chek if any packets are in the Fifo.
 	///
@@ -130,19 +211,73 @@ public:
 		return (mLastPacket != nullptr);
 	}
 
+	///
+	/// Check if the Fifo is too long to read more from the sockets.
+	///
+	bool
+	IsQueueFull()
+	{
+		return (mPacketCount >= kMaxQueuedPackets);
+	}
+
+	///
+	/// Number of packets in the Fifo.
+	///
+	KUInt32
+	GetPacketCount()
+	{
+		return mPacketCount;
+	}
+
 	///
 	/// Print a brief summary of a packge.
 	///
 	void Log(class Packet* p, const char* label, int line, int adjSeq = 0, int adjAck = 0);
 
 private:
+	///
+	/// Reader thread loop: wait for sockets to become readable, let their
+	/// handlers queue the data, and tell NewtonOS with an interrupt.
+	///
+	void ReadSockets();
+
+	///
+	/// Find the handler of the TCP or UDP flow of a packet.
+	///
+	/// \param inPacket a packet from the Newton
+	/// \return the handler, or nullptr if the flow has none
+	///
+	PacketHandler* FindPacketHandler(Packet& inPacket);
+
+	///
+	/// Return the flow index of a protocol.
+	///
+	/// \param inProtocol the IP protocol
+	/// \return the index, or nullptr if the protocol has no flows
+	///
+	std::unordered_map<KUInt64, PacketHandler*>* GetFlows(KUInt8 inProtocol);
+
+	// Taken by the emulator and the reader thread to use handlers and packets.
+	std::mutex mMutex;
+
 	// Linked list of packet handlers.
 	PacketHandler* mFirstPacketHandler = nullptr;
 	PacketHandler* mLastPacketHandler = nullptr;
 
+	// TCP and UDP handlers, indexed by FlowKey().
+	std::unordered_map<KUInt64, PacketHandler*> mTCPFlows;
+	std::unordered_map<KUInt64, PacketHandler*> mUDPFlows;
+
 	// Double linked list of packets, used as a Fifo.
 	Packet* mFirstPacket = nullptr;
 	Packet* mLastPacket = nullptr;
+	std::atomic<KUInt32> mPacketCount { 0 };
+
+#if TARGET_OS_LINUX
+	int mEpoll = -1; // Sockets that handlers want to read.
+	int mWakeFD = -1; // eventfd to stop the reader thread.
+	std::thread* mReader = nullptr;
+#endif
 };
 
 #endif
@@ -344,6 +344,19 @@ TPlatformManager::SendAEvent(EPort inPortId, KUInt32 inSize, const KUInt8* inDat
 	mMutex->Unlock();
 }
 
+// -------------------------------------------------------------------------- //
+//  * GetPendingEventCount( void )
+// -------------------------------------------------------------------------- //
+KUInt32
+TPlatformManager::GetPendingEventCount(void)
+{
+	mMutex->Lock();
+	KUInt32 theCount = mEventQueuePCrsr - mEventQueueCCrsr;
+	mMutex->Unlock();
+
+	return theCount;
+}
+
 // -------------------------------------------------------------------------- //
 //  * SendNetworkCardEvent( void )
 // -------------------------------------------------------------------------- //
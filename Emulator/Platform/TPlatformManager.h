@@ -197,6 +197,13 @@ public:
 	///
 	void SendAEvent(EPort inPortId, KUInt32 inSize, const KUInt8* inData);
 
+	///
+	/// Get the number of events the Newton didn't fetch yet.
+	///
+	/// \return the number of pending events.
+	///
+	KUInt32 GetPendingEventCount(void);
+
 	///
 	/// Send a Network card insertion event.
 	///
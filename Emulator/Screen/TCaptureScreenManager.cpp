@@ -0,0 +1,281 @@
+// ==============================
+// File:			TCaptureScreenManager.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "TCaptureScreenManager.h"
+
+// ANSI C & POSIX
+#include <string.h>
+
+// Einstein
+#include "Emulator/Log/TLog.h"
+#include "Emulator/TInterruptManager.h"
+
+// -------------------------------------------------------------------------- //
+//  * WriteCapture16( FILE*, KUInt32 )
+// -------------------------------------------------------------------------- //
+static inline void
+WriteCapture16(FILE* inFile, KUInt32 inValue)
+{
+	(void) ::fputc((inValue >> 8) & 0xFF, inFile);
+	(void) ::fputc(inValue & 0xFF, inFile);
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteCapture32( FILE*, KUInt32 )
+// -------------------------------------------------------------------------- //
+static inline void
+WriteCapture32(FILE* inFile, KUInt32 inValue)
+{
+	WriteCapture16(inFile, inValue >> 16);
+	WriteCapture16(inFile, inValue);
+}
+
+// -------------------------------------------------------------------------- //
+//  * TCaptureScreenManager( TLog*, const char*, KUInt32, KUInt32, ... )
+// -------------------------------------------------------------------------- //
+TCaptureScreenManager::TCaptureScreenManager(
+	TLog* inLog,
+	const char* inPath,
+	KUInt32 inPortraitWidth /* = kDefaultPortraitWidth */,
+	KUInt32 inPortraitHeight /* = kDefaultPortraitHeight */,
+	Boolean inFullScreen /* = false */,
+	Boolean inScreenIsLandscape /* = true */) :
+		TNullScreenManager(
+			inLog,
+			inPortraitWidth,
+			inPortraitHeight,
+			inFullScreen,
+			inScreenIsLandscape),
+		mFile(nil),
+		mWidth(GetActualScreenWidth()),
+		mHeight(GetActualScreenHeight())
+{
+	mFile = ::fopen(inPath, "wb");
+	if (mFile == nil)
+	{
+		if (inLog)
+		{
+			inLog->FLogLine("Cannot create capture stream %s", inPath);
+		}
+		return;
+	}
+
+	WriteCapture32(mFile, kCaptureSignature);
+	WriteCapture16(mFile, kCaptureVersion);
+	WriteCapture16(mFile, 0);
+	WriteCapture16(mFile, mWidth);
+	WriteCapture16(mFile, mHeight);
+	WriteCapture32(mFile, TInterruptManager::kTicksPerSecond);
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TCaptureScreenManager( void )
+// -------------------------------------------------------------------------- //
+TCaptureScreenManager::~TCaptureScreenManager(void)
+{
+	if (mFile)
+	{
+		(void) ::fclose(mFile);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * ScreenOrientationChanged( EOrientation )
+// -------------------------------------------------------------------------- //
+void
+TCaptureScreenManager::ScreenOrientationChanged(EOrientation inNewOrientation)
+{
+	if (GetLog())
+	{
+		GetLog()->FLogLine(
+			"TCaptureScreenManager::ScreenOrientationChanged(%d)",
+			(int) inNewOrientation);
+	}
+
+	// Only the dimensions of the buffer matter to the stream.
+	KUInt32 theWidth = GetActualScreenWidth();
+	KUInt32 theHeight = GetActualScreenHeight();
+	if (mFile && ((theWidth != mWidth) || (theHeight != mHeight)))
+	{
+		mWidth = theWidth;
+		mHeight = theHeight;
+		WriteRecordHeader(kGeometryRecord);
+		WriteCapture16(mFile, mWidth);
+		WriteCapture16(mFile, mHeight);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * BacklightChanged( Boolean )
+// -------------------------------------------------------------------------- //
+void
+TCaptureScreenManager::BacklightChanged(Boolean inNewBacklight)
+{
+	if (mFile)
+	{
+		WriteRecordHeader(kBacklightRecord);
+		(void) ::fputc(inNewBacklight ? 1 : 0, mFile);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * UpdateScreenRect( SRect* )
+// -------------------------------------------------------------------------- //
+void
+TCaptureScreenManager::UpdateScreenRect(SRect* inUpdatedRect)
+{
+	if (mFile == nil)
+	{
+		return;
+	}
+
+	// Round out to whole bytes and clip to the screen. The bounds stay even:
+	// with an odd width, the last column is padded to a whole byte.
+	KUInt32 top = inUpdatedRect->fTop;
+	KUInt32 left = inUpdatedRect->fLeft & ~1;
+	KUInt32 bottom = inUpdatedRect->fBottom;
+	KUInt32 right = (inUpdatedRect->fRight + 1) & ~1;
+	if (bottom > mHeight)
+	{
+		bottom = mHeight;
+	}
+	if (right > ((mWidth + 1) & ~1))
+	{
+		right = (mWidth + 1) & ~1;
+	}
+	if ((top >= bottom) || (left >= right))
+	{
+		return;
+	}
+
+	// Gather the rows of the rectangle. The screen buffer has no byte for
+	// the last column of an odd width: the stream gets a blank one.
+	KUInt32 srcRowBytes = mWidth * kBitsPerPixel / 8;
+	KUInt32 theRowBytes = (right - left) * kBitsPerPixel / 8;
+	KUInt32 theCopiedBytes = theRowBytes;
+	if ((left * kBitsPerPixel / 8) + theCopiedBytes > srcRowBytes)
+	{
+		theCopiedBytes = srcRowBytes - (left * kBitsPerPixel / 8);
+	}
+	KUInt32 theSize = theRowBytes * (bottom - top);
+	if (mRows.size() < theSize)
+	{
+		mRows.resize(theSize);
+		mPacked.resize(theSize + ((theSize + 127) / 128));
+	}
+	const KUInt8* srcRowPtr = GetScreenBuffer()
+		+ (top * srcRowBytes)
+		+ (left * kBitsPerPixel / 8);
+	KUInt8* dstRowPtr = mRows.data();
+	for (KUInt32 indexRow = top; indexRow < bottom; indexRow++)
+	{
+		(void) ::memcpy(dstRowPtr, srcRowPtr, theCopiedBytes);
+		if (theCopiedBytes < theRowBytes)
+		{
+			dstRowPtr[theCopiedBytes] = 0;
+		}
+		srcRowPtr += srcRowBytes;
+		dstRowPtr += theRowBytes;
+	}
+	KUInt32 thePackedSize = PackBits(mRows.data(), theSize, mPacked.data());
+
+	WriteRecordHeader(kFrameRecord);
+	WriteCapture16(mFile, top);
+	WriteCapture16(mFile, left);
+	WriteCapture16(mFile, bottom);
+	WriteCapture16(mFile, right);
+	WriteCapture32(mFile, thePackedSize);
+	(void) ::fwrite(mPacked.data(), 1, thePackedSize, mFile);
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteRecordHeader( ERecord )
+// -------------------------------------------------------------------------- //
+void
+TCaptureScreenManager::WriteRecordHeader(ERecord inType)
+{
+	KUInt32 theTime = 0;
+	TInterruptManager* theInterruptManager = GetInterruptManager();
+	if (theInterruptManager)
+	{
+		theTime = theInterruptManager->GetTimer();
+	}
+	(void) ::fputc(inType, mFile);
+	WriteCapture32(mFile, theTime);
+}
+
+// -------------------------------------------------------------------------- //
+//  * PackBits( const KUInt8*, KUInt32, KUInt8* )
+// -------------------------------------------------------------------------- //
+KUInt32
+TCaptureScreenManager::PackBits(
+	const KUInt8* inSrc,
+	KUInt32 inSize,
+	KUInt8* outDst)
+{
+	KUInt8* theCursor = outDst;
+	KUInt32 indexSrc = 0;
+	while (indexSrc < inSize)
+	{
+		// Measure the run at this position.
+		KUInt32 theRun = 1;
+		while ((indexSrc + theRun < inSize)
+			&& (theRun < 128)
+			&& (inSrc[indexSrc + theRun] == inSrc[indexSrc]))
+		{
+			theRun++;
+		}
+		if (theRun >= 3)
+		{
+			*theCursor++ = (KUInt8) (257 - theRun);
+			*theCursor++ = inSrc[indexSrc];
+			indexSrc += theRun;
+		} else
+		{
+			// Literals, until the next run of 3 bytes.
+			KUInt32 theCount = 0;
+			while ((indexSrc + theCount < inSize) && (theCount < 128))
+			{
+				if ((indexSrc + theCount + 2 < inSize)
+					&& (inSrc[indexSrc + theCount] == inSrc[indexSrc + theCount + 1])
+					&& (inSrc[indexSrc + theCount] == inSrc[indexSrc + theCount + 2]))
+				{
+					break;
+				}
+				theCount++;
+			}
+			*theCursor++ = (KUInt8) (theCount - 1);
+			(void) ::memcpy(theCursor, &inSrc[indexSrc], theCount);
+			theCursor += theCount;
+			indexSrc += theCount;
+		}
+	}
+
+	return (KUInt32) (theCursor - outDst);
+}
+
+// ============================================================= //
+// Real programmers don't draw flowcharts. Flowcharts are, after //
+// all, the illiterate's form of documentation.                  //
+// ============================================================= //
@@ -0,0 +1,169 @@
+// ==============================
+// File:			TCaptureScreenManager.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _TCAPTURESCREENMANAGER_H
+#define _TCAPTURESCREENMANAGER_H
+
+#include <K/Defines/KDefinitions.h>
+#include "Emulator/Screen/TNullScreenManager.h"
+
+#include <stdio.h>
+#include <vector>
+
+///
+/// Class for a headless screen manager that records the screen.
+///
+/// Every rectangle passed to UpdateScreenRect is appended to a capture
+/// stream, with the emulated time. The stream is read back with
+/// TCaptureStreamReader (e.g. by EinsteinCapture, which renders PNG files).
+///
+/// Stream format (all integers are big endian):
+/// - header: 'ECAP', version (16 bits), 0 (16 bits), width and height of the
+///   screen buffer (16 bits each), timer ticks per second (32 bits).
+/// - records: type (8 bits), timer value (32 bits), then:
+///   - kFrameRecord: top, left, bottom, right (16 bits each, left and right
+///     are even), size of the data (32 bits), PackBits data of the 4 bits
+///     rows of the rectangle.
+///   - kGeometryRecord: new width and height (16 bits each). The screen is
+///     cleared.
+///   - kBacklightRecord: new state (8 bits).
+///
+/// Only the damaged rectangles are encoded, so the cost of the capture is
+/// proportional to the damaged area.
+///
+class TCaptureScreenManager
+		: public TNullScreenManager
+{
+public:
+	/// Stream constants.
+	enum {
+		kCaptureSignature = 'ECAP',
+		kCaptureVersion = 1,
+		kCaptureHeaderSize = 16
+	};
+
+	/// Record types.
+	enum ERecord {
+		kFrameRecord = 'F',
+		kGeometryRecord = 'G',
+		kBacklightRecord = 'B'
+	};
+
+	///
+	/// Constructor from a log, a path and dimensions.
+	///
+	/// \param inLog				log interface (can be null)
+	/// \param inPath				path of the capture stream.
+	/// \param inPortraitWidth		width (in portrait mode).
+	/// \param inPortraitHeight		height (in portrait mode).
+	/// \param inFullScreen			whether we're full screen (and we do
+	///								emulate the rotation).
+	/// \param inScreenIsLandscape	whether the physical screen is in landscape.
+	///
+	TCaptureScreenManager(
+		TLog* inLog,
+		const char* inPath,
+		KUInt32 inPortraitWidth = kDefaultPortraitWidth,
+		KUInt32 inPortraitHeight = kDefaultPortraitHeight,
+		Boolean inFullScreen = false,
+		Boolean inScreenIsLandscape = true);
+
+	///
+	/// Destructor.
+	/// Closes the capture stream.
+	///
+	virtual ~TCaptureScreenManager(void);
+
+	///
+	/// Determine if the capture stream could be created.
+	///
+	/// \return \c true if screen updates are recorded.
+	///
+	Boolean
+	IsCapturing(void) const
+	{
+		return mFile != nil;
+	}
+
+	///
+	/// Notify that the screen orientation changed.
+	/// Records the new dimensions of the screen buffer.
+	///
+	/// \param inNewOrientation	the new orientation of the screen.
+	///
+	virtual void ScreenOrientationChanged(
+		EOrientation inNewOrientation);
+
+	///
+	/// Notify that the backlight changed.
+	/// Records the new state.
+	///
+	/// \param inNewBacklight the new state of the backlight.
+	///
+	virtual void BacklightChanged(Boolean inNewBacklight);
+
+	///
+	/// Notify that some screen bits changed.
+	/// Records the bits of the rectangle.
+	///
+	/// \param inUpdateRect	rectangle of the bits that changed.
+	///
+	virtual void UpdateScreenRect(SRect* inUpdatedRect);
+
+	///
+	/// Compress bytes with PackBits.
+	///
+	/// \param inSrc	bytes to compress.
+	/// \param inSize	number of bytes.
+	/// \param outDst	destination, at least inSize + (inSize + 127) / 128
+	///					bytes.
+	/// \return the size of the compressed data.
+	///
+	static KUInt32 PackBits(
+		const KUInt8* inSrc,
+		KUInt32 inSize,
+		KUInt8* outDst);
+
+private:
+	///
+	/// Write the type and the time of a record.
+	///
+	/// \param inType	type of the record.
+	///
+	void WriteRecordHeader(ERecord inType);
+
+	/// \name Variables
+	FILE* mFile; ///< Capture stream.
+	KUInt32 mWidth; ///< Width of the screen buffer, as recorded.
+	KUInt32 mHeight; ///< Height of the screen buffer, as recorded.
+	std::vector<KUInt8> mRows; ///< Rows of the rectangle being recorded.
+	std::vector<KUInt8> mPacked; ///< Same, compressed.
+};
+
+#endif
+// _TCAPTURESCREENMANAGER_H
+
+// ============================================================= //
+// A picture is worth a thousand words, but it uses up three     //
+// thousand times the memory.                                    //
+// ============================================================= //
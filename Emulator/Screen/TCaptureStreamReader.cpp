@@ -0,0 +1,291 @@
+// ==============================
+// File:			TCaptureStreamReader.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "TCaptureStreamReader.h"
+
+// ANSI C & POSIX
+#include <string.h>
+
+// Einstein
+#include "Emulator/Screen/TCaptureScreenManager.h"
+
+// -------------------------------------------------------------------------- //
+//  * TCaptureStreamReader( const char* )
+// -------------------------------------------------------------------------- //
+TCaptureStreamReader::TCaptureStreamReader(const char* inPath) :
+		mFile(nil),
+		mRecordType(0),
+		mTicksPerSecond(0),
+		mHasTimer(false),
+		mTimer(0),
+		mTime(0),
+		mWidth(0),
+		mHeight(0),
+		mBacklight(false),
+		mTop(0),
+		mLeft(0),
+		mBottom(0),
+		mRight(0)
+{
+	mFile = ::fopen(inPath, "rb");
+	if (mFile == nil)
+	{
+		return;
+	}
+
+	KUInt32 theSignature;
+	KUInt32 theVersion;
+	KUInt32 theReserved;
+	KUInt32 theWidth;
+	KUInt32 theHeight;
+	if (!Read32(&theSignature)
+		|| !Read16(&theVersion)
+		|| !Read16(&theReserved)
+		|| !Read16(&theWidth)
+		|| !Read16(&theHeight)
+		|| !Read32(&mTicksPerSecond)
+		|| (theSignature != TCaptureScreenManager::kCaptureSignature)
+		|| (theVersion != TCaptureScreenManager::kCaptureVersion)
+		|| (mTicksPerSecond == 0))
+	{
+		(void) ::fclose(mFile);
+		mFile = nil;
+		return;
+	}
+	SetGeometry(theWidth, theHeight);
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TCaptureStreamReader( void )
+// -------------------------------------------------------------------------- //
+TCaptureStreamReader::~TCaptureStreamReader(void)
+{
+	if (mFile)
+	{
+		(void) ::fclose(mFile);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * ReadRecord( void )
+// -------------------------------------------------------------------------- //
+Boolean
+TCaptureStreamReader::ReadRecord(void)
+{
+	if (mFile == nil)
+	{
+		return false;
+	}
+
+	int theType = ::fgetc(mFile);
+	KUInt32 theTimer;
+	if ((theType == EOF) || !Read32(&theTimer))
+	{
+		return false;
+	}
+
+	// The timer wraps around every 20 minutes or so.
+	if (mHasTimer)
+	{
+		mTime += (KUInt32) (theTimer - mTimer);
+	}
+	mTimer = theTimer;
+	mHasTimer = true;
+
+	switch (theType)
+	{
+		case TCaptureScreenManager::kFrameRecord:
+		{
+			KUInt32 theTop;
+			KUInt32 theLeft;
+			KUInt32 theBottom;
+			KUInt32 theRight;
+			KUInt32 thePackedSize;
+			if (!Read16(&theTop)
+				|| !Read16(&theLeft)
+				|| !Read16(&theBottom)
+				|| !Read16(&theRight)
+				|| !Read32(&thePackedSize)
+				|| (theTop >= theBottom) || (theBottom > mHeight)
+				|| (theLeft >= theRight) || (theRight > ((mWidth + 1) & ~1))
+				|| (theLeft & 1) || (theRight & 1))
+			{
+				return false;
+			}
+			KUInt32 theRowBytes = (theRight - theLeft) / 2;
+			KUInt32 theSize = theRowBytes * (theBottom - theTop);
+			if (thePackedSize > theSize + ((theSize + 127) / 128))
+			{
+				return false;
+			}
+			mPacked.resize(thePackedSize);
+			mRows.resize(theSize);
+			if ((::fread(mPacked.data(), 1, thePackedSize, mFile) != thePackedSize)
+				|| !UnpackBits(mPacked.data(), thePackedSize, mRows.data(), theSize))
+			{
+				return false;
+			}
+
+			KUInt32 dstRowBytes = (mWidth + 1) / 2;
+			const KUInt8* srcRowPtr = mRows.data();
+			KUInt8* dstRowPtr = mScreen.data()
+				+ (theTop * dstRowBytes)
+				+ (theLeft / 2);
+			for (KUInt32 indexRow = theTop; indexRow < theBottom; indexRow++)
+			{
+				(void) ::memcpy(dstRowPtr, srcRowPtr, theRowBytes);
+				srcRowPtr += theRowBytes;
+				dstRowPtr += dstRowBytes;
+			}
+			mTop = theTop;
+			mLeft = theLeft;
+			mBottom = theBottom;
+			mRight = theRight;
+		}
+		break;
+
+		case TCaptureScreenManager::kGeometryRecord:
+		{
+			KUInt32 theWidth;
+			KUInt32 theHeight;
+			if (!Read16(&theWidth) || !Read16(&theHeight))
+			{
+				return false;
+			}
+			SetGeometry(theWidth, theHeight);
+		}
+		break;
+
+		case TCaptureScreenManager::kBacklightRecord:
+		{
+			int theState = ::fgetc(mFile);
+			if (theState == EOF)
+			{
+				return false;
+			}
+			mBacklight = (theState != 0);
+		}
+		break;
+
+		default:
+			return false;
+	}
+
+	mRecordType = theType;
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * UnpackBits( const KUInt8*, KUInt32, KUInt8*, KUInt32 )
+// -------------------------------------------------------------------------- //
+Boolean
+TCaptureStreamReader::UnpackBits(
+	const KUInt8* inSrc,
+	KUInt32 inSrcSize,
+	KUInt8* outDst,
+	KUInt32 inDstSize)
+{
+	const KUInt8* theSrcEnd = inSrc + inSrcSize;
+	KUInt8* theDstCursor = outDst;
+	KUInt8* theDstEnd = outDst + inDstSize;
+	while (inSrc < theSrcEnd)
+	{
+		KUInt32 theHeader = *inSrc++;
+		if (theHeader < 128)
+		{
+			KUInt32 theCount = theHeader + 1;
+			if ((KUInt32) (theSrcEnd - inSrc) < theCount
+				|| (KUInt32) (theDstEnd - theDstCursor) < theCount)
+			{
+				return false;
+			}
+			(void) ::memcpy(theDstCursor, inSrc, theCount);
+			inSrc += theCount;
+			theDstCursor += theCount;
+		} else if (theHeader > 128)
+		{
+			KUInt32 theCount = 257 - theHeader;
+			if ((inSrc == theSrcEnd)
+				|| (KUInt32) (theDstEnd - theDstCursor) < theCount)
+			{
+				return false;
+			}
+			(void) ::memset(theDstCursor, *inSrc++, theCount);
+			theDstCursor += theCount;
+		}
+	}
+
+	return theDstCursor == theDstEnd;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Read16( KUInt32* )
+// -------------------------------------------------------------------------- //
+Boolean
+TCaptureStreamReader::Read16(KUInt32* outValue)
+{
+	KUInt8 theBytes[2];
+	if (::fread(theBytes, 1, 2, mFile) != 2)
+	{
+		return false;
+	}
+	*outValue = (theBytes[0] << 8) | theBytes[1];
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Read32( KUInt32* )
+// -------------------------------------------------------------------------- //
+Boolean
+TCaptureStreamReader::Read32(KUInt32* outValue)
+{
+	KUInt32 theHigh;
+	KUInt32 theLow;
+	if (!Read16(&theHigh) || !Read16(&theLow))
+	{
+		return false;
+	}
+	*outValue = (theHigh << 16) | theLow;
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetGeometry( KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TCaptureStreamReader::SetGeometry(KUInt32 inWidth, KUInt32 inHeight)
+{
+	mWidth = inWidth;
+	mHeight = inHeight;
+	mScreen.assign(((inWidth + 1) / 2) * inHeight, 0);
+	mTop = 0;
+	mLeft = 0;
+	mBottom = inHeight;
+	mRight = inWidth;
+}
+
+// ============================================================= //
+// The trouble with computers is that they do what you tell      //
+// them, not what you want.                                      //
+// ============================================================= //
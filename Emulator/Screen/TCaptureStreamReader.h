@@ -0,0 +1,209 @@
+// ==============================
+// File:			TCaptureStreamReader.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _TCAPTURESTREAMREADER_H
+#define _TCAPTURESTREAMREADER_H
+
+#include <K/Defines/KDefinitions.h>
+
+#include <stdio.h>
+#include <vector>
+
+///
+/// Class to replay a stream written by TCaptureScreenManager.
+///
+/// Each record is applied to a copy of the screen buffer (4 bits per pixel,
+/// already inverted, left pixel in the high nibble).
+///
+class TCaptureStreamReader
+{
+public:
+	///
+	/// Constructor from a path.
+	///
+	/// \param inPath	path of the capture stream.
+	///
+	TCaptureStreamReader(const char* inPath);
+
+	///
+	/// Destructor.
+	///
+	~TCaptureStreamReader(void);
+
+	///
+	/// Determine if the stream could be opened and has a valid header.
+	///
+	/// \return \c true if records can be read.
+	///
+	Boolean
+	IsOpen(void) const
+	{
+		return mFile != nil;
+	}
+
+	///
+	/// Read and apply the next record.
+	///
+	/// \return \c false at the end of the stream (or if it is truncated).
+	///
+	Boolean ReadRecord(void);
+
+	///
+	/// Accessor on the type of the last record
+	/// (a TCaptureScreenManager::ERecord).
+	///
+	KUInt32
+	GetRecordType(void) const
+	{
+		return mRecordType;
+	}
+
+	///
+	/// Accessor on the time of the last record, in ticks since the first one.
+	///
+	KUInt64
+	GetTime(void) const
+	{
+		return mTime;
+	}
+
+	///
+	/// Accessor on the number of timer ticks per second.
+	///
+	KUInt32
+	GetTicksPerSecond(void) const
+	{
+		return mTicksPerSecond;
+	}
+
+	///
+	/// Accessor on the width of the screen buffer.
+	///
+	KUInt32
+	GetWidth(void) const
+	{
+		return mWidth;
+	}
+
+	///
+	/// Accessor on the height of the screen buffer.
+	///
+	KUInt32
+	GetHeight(void) const
+	{
+		return mHeight;
+	}
+
+	///
+	/// Accessor on the screen buffer, 4 bits per pixel. Each row starts on
+	/// a byte: with an odd width, the last nibble of the rows is padding.
+	///
+	const KUInt8*
+	GetScreenBuffer(void) const
+	{
+		return mScreen.data();
+	}
+
+	///
+	/// Accessor on the state of the backlight.
+	///
+	Boolean
+	GetBacklight(void) const
+	{
+		return mBacklight;
+	}
+
+	///
+	/// Accessor on the rectangle of the last frame record.
+	/// The rectangle is the whole screen after a geometry record.
+	///
+	void
+	GetRect(
+		KUInt32* outTop,
+		KUInt32* outLeft,
+		KUInt32* outBottom,
+		KUInt32* outRight) const
+	{
+		*outTop = mTop;
+		*outLeft = mLeft;
+		*outBottom = mBottom;
+		*outRight = mRight;
+	}
+
+	///
+	/// Decompress PackBits data.
+	///
+	/// \param inSrc		compressed data.
+	/// \param inSrcSize	size of the compressed data.
+	/// \param outDst		destination.
+	/// \param inDstSize	expected size of the data.
+	/// \return \c false if the data is corrupted.
+	///
+	static Boolean UnpackBits(
+		const KUInt8* inSrc,
+		KUInt32 inSrcSize,
+		KUInt8* outDst,
+		KUInt32 inDstSize);
+
+private:
+	///
+	/// Read a 16 bits value.
+	///
+	Boolean Read16(KUInt32* outValue);
+
+	///
+	/// Read a 32 bits value.
+	///
+	Boolean Read32(KUInt32* outValue);
+
+	///
+	/// Set the dimensions of the screen and clear it.
+	///
+	void SetGeometry(KUInt32 inWidth, KUInt32 inHeight);
+
+	/// \name Variables
+	FILE* mFile; ///< Capture stream.
+	KUInt32 mRecordType; ///< Type of the last record.
+	KUInt32 mTicksPerSecond; ///< Timer ticks per second.
+	Boolean mHasTimer; ///< If a record was read (mTimer is valid).
+	KUInt32 mTimer; ///< Timer value of the last record.
+	KUInt64 mTime; ///< Time of the last record.
+	KUInt32 mWidth; ///< Width of the screen.
+	KUInt32 mHeight; ///< Height of the screen.
+	Boolean mBacklight; ///< State of the backlight.
+	KUInt32 mTop; ///< Top of the last rectangle.
+	KUInt32 mLeft; ///< Left of the last rectangle.
+	KUInt32 mBottom; ///< Bottom of the last rectangle.
+	KUInt32 mRight; ///< Right of the last rectangle.
+	std::vector<KUInt8> mScreen; ///< Screen buffer.
+	std::vector<KUInt8> mPacked; ///< Data of the last rectangle.
+	std::vector<KUInt8> mRows; ///< Same, decompressed.
+};
+
+#endif
+// _TCAPTURESTREAMREADER_H
+
+// ============================================================= //
+// The computer is mightier than the pen, the sword, and usually //
+// the programmer.                                               //
+// ============================================================= //
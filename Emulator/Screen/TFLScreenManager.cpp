@@ -42,6 +42,7 @@
 // Einstein
 #include "Emulator/Log/TLog.h"
 #include "Emulator/Platform/TPlatformManager.h"
+#include "Emulator/Screen/UPixelConversion.h"
 #include "app/FLTK/TFLApp.h"
 
 #if TARGET_OS_WIN32 || TARGET_OS_MAC
@@ -837,19 +838,6 @@ TFLScreenManager::UpdateScreenRect(SRect* inUpdateRect)
 		width = mWidget->getRGBWidth();
 	}
 
-	KUInt8 rs, gs, bs;
-	if (GetBacklight())
-	{
-		rs = 1;
-		gs = 0;
-		bs = 1;
-	} else
-	{
-		rs = 0;
-		gs = 0;
-		bs = 0;
-	}
-
 	// Update the buffer.
 	// We copy more pixels than what we should.
 	if (left & 0x1)
@@ -877,6 +865,32 @@ TFLScreenManager::UpdateScreenRect(SRect* inUpdateRect)
 
 	int indexRows;
 
+#if SRC_BITMAP_FORMAT_RGBA
+	// R G B 0 in memory, whatever the host endianness.
+	const UPixelConversion::SLUT32& theLUT
+		= UPixelConversion::GetRGBALUT32(GetBacklight());
+
+	for (indexRows = height; indexRows != 0; indexRows--)
+	{
+		UPixelConversion::Convert4To32(
+			srcRowPtr, (KUInt32*) dstRowPtr, srcWidthInBytes, theLUT);
+		srcRowPtr += srcRowBytes;
+		dstRowPtr += dstRowBytes;
+	}
+#else
+	KUInt8 rs, gs, bs;
+	if (GetBacklight())
+	{
+		rs = 1;
+		gs = 0;
+		bs = 1;
+	} else
+	{
+		rs = 0;
+		gs = 0;
+		bs = 0;
+	}
+
 	for (indexRows = height; indexRows != 0; indexRows--)
 	{
 		KUInt8* srcCursor = srcRowPtr;
@@ -903,6 +917,7 @@ TFLScreenManager::UpdateScreenRect(SRect* inUpdateRect)
 		srcRowPtr += srcRowBytes;
 		dstRowPtr += dstRowBytes;
 	}
+#endif
 
 	mWidget->redraw();
 }
@@ -0,0 +1,254 @@
+// ==============================
+// File:			TInkBenchmark.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "TInkBenchmark.h"
+
+// C++
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Einstein
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/Screen/TScreenManager.h"
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+// Interval between two looks at the screen, in host time. The latencies
+// don't depend on it.
+#define kPollMicroseconds 1000
+
+// -------------------------------------------------------------------------- //
+//  * TInkBenchmark( TLog*, TScreenManager*, TInterruptManager*, ... )
+// -------------------------------------------------------------------------- //
+TInkBenchmark::TInkBenchmark(
+	TLog* inLog,
+	TScreenManager* inScreenManager,
+	TInterruptManager* inInterruptManager,
+	TPlatformManager* inPlatformManager) :
+		mScreenManager(inScreenManager),
+		mInterruptManager(inInterruptManager),
+		mReplay(inLog, inScreenManager, inInterruptManager, inPlatformManager),
+		mSettleTicks(0),
+		mTimeoutTicks(0),
+		mStrokeCount(0),
+		mUnchangedCount(0),
+		mTimeoutCount(0),
+		mBusySeconds(0.0),
+		mTotalSeconds(0.0)
+{
+	SetSettleTime(kDefaultSettleTime);
+	SetTimeout(kDefaultTimeout);
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TInkBenchmark( void )
+// -------------------------------------------------------------------------- //
+TInkBenchmark::~TInkBenchmark(void)
+{
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetSettleTime( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInkBenchmark::SetSettleTime(KUInt32 inMilliseconds)
+{
+	mSettleTicks = (KUInt32) (((KUInt64) inMilliseconds)
+		* TInterruptManager::kTicksPerSecond / 1000);
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetTimeout( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInkBenchmark::SetTimeout(KUInt32 inMilliseconds)
+{
+	mTimeoutTicks = (KUInt32) (((KUInt64) inMilliseconds)
+		* TInterruptManager::kTicksPerSecond / 1000);
+}
+
+// -------------------------------------------------------------------------- //
+//  * RunStroke( const char* )
+// -------------------------------------------------------------------------- //
+Boolean
+TInkBenchmark::RunStroke(const char* inPath)
+{
+	if (!mReplay.Load(inPath))
+	{
+		return false;
+	}
+
+	typedef std::chrono::steady_clock TClock;
+	KUInt64 theHash = mScreenManager->GetScreenHash();
+	TClock::time_point theHostStart = TClock::now();
+	KUInt32 theStart = mInterruptManager->GetTimer();
+	KUInt32 theNow = theStart;
+	mReplay.Start();
+
+	// Wait for the tablet driver to read the whole stroke. The ink drawn
+	// meanwhile isn't part of the recognition.
+	while ((!mReplay.IsDone() || mScreenManager->GetPendingSampleCount())
+		&& ((KUInt32) (theNow - theStart) < mTimeoutTicks))
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(kPollMicroseconds));
+		theNow = mInterruptManager->GetTimer();
+		theHash = mScreenManager->GetScreenHash();
+	}
+	// The latency goes from the pen up to the present of the last change,
+	// both stamped in emulated time: the polling doesn't add to it.
+	KUInt32 theInputDone = mReplay.IsDone() ? mReplay.GetDoneTimer() : theNow;
+	TClock::time_point theHostInputDone = TClock::now();
+
+	// Recognition is over when the screen is still for the settle time.
+	Boolean hasChanged = false;
+	Boolean isPresentPending = false;
+	KUInt32 thePresentCount = mScreenManager->GetPresentCount();
+	KUInt32 theLastChange = theInputDone;
+	TClock::time_point theHostLastChange = theHostInputDone;
+	while (((KUInt32) (theNow - theLastChange) < mSettleTicks)
+		&& ((KUInt32) (theNow - theStart) < mTimeoutTicks))
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(kPollMicroseconds));
+		theNow = mInterruptManager->GetTimer();
+		KUInt64 theNewHash = mScreenManager->GetScreenHash();
+		if (theNewHash != theHash)
+		{
+			// The change is stamped by the present that shows it, until
+			// then by the time it was seen.
+			theHash = theNewHash;
+			theLastChange = theNow;
+			theHostLastChange = TClock::now();
+			hasChanged = true;
+			isPresentPending = true;
+		}
+		KUInt32 theNewPresentCount = mScreenManager->GetPresentCount();
+		if (theNewPresentCount != thePresentCount)
+		{
+			thePresentCount = theNewPresentCount;
+			if (isPresentPending)
+			{
+				theLastChange = mScreenManager->GetLastPresentTime();
+				isPresentPending = false;
+			}
+		}
+	}
+	mReplay.Stop();
+
+	mStrokeCount++;
+	mTotalSeconds += std::chrono::duration<double>(TClock::now() - theHostStart).count();
+	mBusySeconds += std::chrono::duration<double>(theHostLastChange - theHostStart).count();
+	if ((KUInt32) (theNow - theStart) >= mTimeoutTicks)
+	{
+		mTimeoutCount++;
+	} else if (!hasChanged)
+	{
+		mUnchangedCount++;
+	} else
+	{
+		mLatencies.push_back(
+			((double) (KUInt32) (theLastChange - theInputDone)) * 1000.0
+			/ TInterruptManager::kTicksPerSecond);
+		mHostLatencies.push_back(
+			std::chrono::duration<double, std::milli>(
+				theHostLastChange - theHostInputDone)
+				.count());
+	}
+
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteReport( FILE* ) const
+// -------------------------------------------------------------------------- //
+void
+TInkBenchmark::WriteReport(FILE* inFile) const
+{
+	(void) ::fprintf(inFile, "{\n");
+	(void) ::fprintf(inFile, "  \"strokes\": %u,\n", (unsigned int) mStrokeCount);
+	(void) ::fprintf(inFile, "  \"recognized\": %u,\n", (unsigned int) mLatencies.size());
+	(void) ::fprintf(inFile, "  \"unchanged\": %u,\n", (unsigned int) mUnchangedCount);
+	(void) ::fprintf(inFile, "  \"timeouts\": %u,\n", (unsigned int) mTimeoutCount);
+	(void) ::fprintf(inFile, "  \"settle_ms\": %.3f,\n",
+		mSettleTicks * 1000.0 / TInterruptManager::kTicksPerSecond);
+	(void) ::fprintf(inFile, "  \"host_seconds\": %.6f,\n", mTotalSeconds);
+	(void) ::fprintf(inFile, "  \"busy_host_seconds\": %.6f,\n", mBusySeconds);
+	// The settle time is a cost of the benchmark, not of the emulator.
+	(void) ::fprintf(inFile, "  \"strokes_per_second\": %.3f,\n",
+		(mBusySeconds > 0.0) ? mStrokeCount / mBusySeconds : 0.0);
+	(void) ::fprintf(inFile, "  \"latency_ms\": ");
+	WriteDistribution(inFile, mLatencies);
+	(void) ::fprintf(inFile, ",\n  \"host_latency_ms\": ");
+	WriteDistribution(inFile, mHostLatencies);
+	(void) ::fprintf(inFile, "\n}\n");
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteDistribution( FILE*, const std::vector<double>& )
+// -------------------------------------------------------------------------- //
+void
+TInkBenchmark::WriteDistribution(FILE* inFile, const std::vector<double>& inLatencies)
+{
+	std::vector<double> theSorted(inLatencies);
+	std::sort(theSorted.begin(), theSorted.end());
+	double theSum = 0.0;
+	for (double theLatency : theSorted)
+	{
+		theSum += theLatency;
+	}
+
+	// Nearest rank percentiles.
+	KUInt32 theCount = (KUInt32) theSorted.size();
+	auto thePercentile = [&theSorted, theCount](KUInt32 inPercent) {
+		if (theCount == 0)
+		{
+			return 0.0;
+		}
+		KUInt32 theRank = (inPercent * theCount + 99) / 100;
+		return theSorted[(theRank > 0) ? theRank - 1 : 0];
+	};
+	(void) ::fprintf(inFile,
+		"{ \"count\": %u, \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, "
+		"\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f,\n    \"samples\": [",
+		(unsigned int) theCount,
+		theCount ? theSorted.front() : 0.0,
+		theCount ? theSum / theCount : 0.0,
+		thePercentile(50),
+		thePercentile(90),
+		thePercentile(99),
+		theCount ? theSorted.back() : 0.0);
+	for (KUInt32 indexLatency = 0; indexLatency < inLatencies.size(); indexLatency++)
+	{
+		(void) ::fprintf(inFile, "%s%.3f", indexLatency ? ", " : "", inLatencies[indexLatency]);
+	}
+	(void) ::fprintf(inFile, "] }");
+}
+
+// ============================================================= //
+// There are three kinds of lies: lies, damned lies, and         //
+// statistics.                                                   //
+//                 -- Benjamin Disraeli                          //
+// ============================================================= //
@@ -0,0 +1,188 @@
+// ==============================
+// File:			TInkBenchmark.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _TINKBENCHMARK_H
+#define _TINKBENCHMARK_H
+
+#include <K/Defines/KDefinitions.h>
+#include "Emulator/Screen/TInputReplay.h"
+
+#include <stdio.h>
+#include <vector>
+
+class TLog;
+class TInterruptManager;
+class TPlatformManager;
+class TScreenManager;
+
+///
+/// Class to measure how fast the Newton recognizes ink.
+///
+/// Each stroke is an input log (see TInputReplay) replayed while the
+/// emulator runs. Recognition is considered over when the screen didn't
+/// change for the settle time after the tablet driver read the last sample;
+/// the latency is the time from that read to the last change of the screen.
+/// Latencies are measured in emulated time (timer ticks) and in host time.
+///
+/// With virtual time, the emulated latencies don't depend on the host and
+/// the host times measure the speed of the emulator.
+///
+class TInkBenchmark
+{
+public:
+	/// Defaults, in milliseconds of emulated time.
+	enum {
+		kDefaultSettleTime = 500,
+		kDefaultTimeout = 10000
+	};
+
+	///
+	/// Constructor from the managers of the emulator.
+	///
+	/// \param inLog				log for errors (may be nil).
+	/// \param inScreenManager		screen manager (pen and screen hash).
+	/// \param inInterruptManager	interrupt manager (timer).
+	/// \param inPlatformManager	platform manager (may be nil).
+	///
+	TInkBenchmark(
+		TLog* inLog,
+		TScreenManager* inScreenManager,
+		TInterruptManager* inInterruptManager,
+		TPlatformManager* inPlatformManager);
+
+	///
+	/// Destructor.
+	///
+	~TInkBenchmark(void);
+
+	///
+	/// Set how long the screen must be still after a stroke.
+	///
+	/// \param inMilliseconds	settle time, in emulated milliseconds.
+	///
+	void SetSettleTime(KUInt32 inMilliseconds);
+
+	///
+	/// Set the maximum time for a stroke, recognition included.
+	///
+	/// \param inMilliseconds	timeout, in emulated milliseconds.
+	///
+	void SetTimeout(KUInt32 inMilliseconds);
+
+	///
+	/// Replay a stroke and wait for the recognition to finish.
+	/// The emulator must be running.
+	///
+	/// \param inPath	path of the input log of the stroke.
+	/// \return \c false if the log couldn't be read.
+	///
+	Boolean RunStroke(const char* inPath);
+
+	///
+	/// Write the results as a JSON object.
+	///
+	/// \param inFile	file to write to.
+	///
+	void WriteReport(FILE* inFile) const;
+
+	///
+	/// Accessor on the number of strokes that were replayed.
+	///
+	KUInt32
+	GetStrokeCount(void) const
+	{
+		return mStrokeCount;
+	}
+
+	///
+	/// Accessor on the emulated latencies, in milliseconds, of the strokes
+	/// that changed the screen.
+	///
+	const std::vector<double>&
+	GetLatencies(void) const
+	{
+		return mLatencies;
+	}
+
+	///
+	/// Accessor on the number of strokes that didn't change the screen.
+	///
+	KUInt32
+	GetUnchangedCount(void) const
+	{
+		return mUnchangedCount;
+	}
+
+	///
+	/// Accessor on the number of strokes that timed out.
+	///
+	KUInt32
+	GetTimeoutCount(void) const
+	{
+		return mTimeoutCount;
+	}
+
+private:
+	///
+	/// Constructeur par copie volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TInkBenchmark(const TInkBenchmark& inCopy);
+
+	///
+	/// Opérateur d'assignation volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TInkBenchmark& operator=(const TInkBenchmark& inCopy);
+
+	///
+	/// Write the distribution of latencies as a JSON object.
+	///
+	/// \param inFile		file to write to.
+	/// \param inLatencies	latencies, in milliseconds.
+	///
+	static void WriteDistribution(FILE* inFile, const std::vector<double>& inLatencies);
+
+	/// \name Variables
+	TScreenManager* mScreenManager; ///< Source of the screen hash.
+	TInterruptManager* mInterruptManager; ///< Source of the time.
+	TInputReplay mReplay; ///< Replay of the strokes.
+	KUInt32 mSettleTicks; ///< Settle time, in ticks.
+	KUInt32 mTimeoutTicks; ///< Timeout, in ticks.
+	KUInt32 mStrokeCount; ///< Strokes replayed.
+	KUInt32 mUnchangedCount; ///< Strokes that didn't change the screen.
+	KUInt32 mTimeoutCount; ///< Strokes that timed out.
+	double mBusySeconds; ///< Host time from the strokes to the last changes.
+	double mTotalSeconds; ///< Host time of the strokes, settle included.
+	std::vector<double> mLatencies; ///< Emulated latencies (ms).
+	std::vector<double> mHostLatencies; ///< Host latencies (ms).
+};
+
+#endif
+// _TINKBENCHMARK_H
+
+// ============================================================= //
+// Measure twice, cut once.                                      //
+// ============================================================= //
@@ -0,0 +1,387 @@
+// ==============================
+// File:			TInputReplay.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "TInputReplay.h"
+
+// ANSI C & POSIX
+#include <stdio.h>
+#include <string.h>
+
+// Einstein
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/Log/TLog.h"
+#include "Emulator/Platform/TPlatformManager.h"
+#include "Emulator/Screen/TScreenManager.h"
+
+// -------------------------------------------------------------------------- //
+//  * TInputReplay( TLog*, TScreenManager*, TInterruptManager*, ... )
+// -------------------------------------------------------------------------- //
+TInputReplay::TInputReplay(
+	TLog* inLog,
+	TScreenManager* inScreenManager,
+	TInterruptManager* inInterruptManager,
+	TPlatformManager* inPlatformManager) :
+		mLog(inLog),
+		mScreenManager(inScreenManager),
+		mInterruptManager(inInterruptManager),
+		mPlatformManager(inPlatformManager),
+		mPlayedCount(0),
+		mStallCount(0),
+		mDoneTimer(0),
+		mStarted(false),
+		mBaseTimer(0),
+		mTimer(0),
+		mElapsed(0),
+		mScheduled(false)
+{
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TInputReplay( void )
+// -------------------------------------------------------------------------- //
+TInputReplay::~TInputReplay(void)
+{
+	Stop();
+}
+
+// -------------------------------------------------------------------------- //
+//  * Load( const char* )
+// -------------------------------------------------------------------------- //
+Boolean
+TInputReplay::Load(const char* inPath)
+{
+	Stop();
+	mEvents.clear();
+	mPlayedCount = 0;
+	mStarted = false;
+
+	FILE* theFile = ::fopen(inPath, "rb");
+	if (theFile == nil)
+	{
+		if (mLog)
+		{
+			mLog->FLogLine("Cannot open input log %s", inPath);
+		}
+		return false;
+	}
+
+	// Binary logs start with a signature, text logs can't.
+	KUInt8 theSignature[4];
+	Boolean theResult;
+	if ((::fread(theSignature, 1, 4, theFile) == 4)
+		&& ((((KUInt32) theSignature[0]) << 24
+				| theSignature[1] << 16
+				| theSignature[2] << 8
+				| theSignature[3])
+			== kSignature))
+	{
+		theResult = LoadBinary(theFile);
+	} else
+	{
+		::rewind(theFile);
+		theResult = LoadText(theFile);
+	}
+	(void) ::fclose(theFile);
+
+	if (!theResult)
+	{
+		if (mLog)
+		{
+			mLog->FLogLine(
+				"Invalid input log %s (event %u)",
+				inPath,
+				(unsigned int) mEvents.size() + 1);
+		}
+		mEvents.clear();
+	}
+
+	return theResult;
+}
+
+// -------------------------------------------------------------------------- //
+//  * LoadBinary( FILE* )
+// -------------------------------------------------------------------------- //
+Boolean
+TInputReplay::LoadBinary(FILE* inFile)
+{
+	KUInt8 theHeader[8];
+	if (::fread(theHeader, 1, sizeof(theHeader), inFile) != sizeof(theHeader))
+	{
+		return false;
+	}
+	KUInt32 theVersion = theHeader[0] << 8 | theHeader[1];
+	KUInt32 theTicksPerSecond = ((KUInt32) theHeader[4]) << 24
+		| theHeader[5] << 16
+		| theHeader[6] << 8
+		| theHeader[7];
+	if ((theVersion != kVersion) || (theTicksPerSecond == 0))
+	{
+		return false;
+	}
+
+	KUInt8 theRecord[10];
+	Boolean hasTime = false;
+	KUInt32 theLastTime = 0;
+	KUInt64 theTime = 0;
+	size_t theCount;
+	while ((theCount = ::fread(theRecord, 1, sizeof(theRecord), inFile)) == sizeof(theRecord))
+	{
+		KUInt32 theRecordTime = ((KUInt32) theRecord[0]) << 24
+			| theRecord[1] << 16
+			| theRecord[2] << 8
+			| theRecord[3];
+
+		// Times wrap around like the timer.
+		if (hasTime)
+		{
+			theTime += (KUInt32) (theRecordTime - theLastTime);
+		} else
+		{
+			theTime = theRecordTime;
+		}
+		theLastTime = theRecordTime;
+		hasTime = true;
+
+		SEvent theEvent;
+		theEvent.fTime = theTime * TInterruptManager::kTicksPerSecond / theTicksPerSecond;
+		theEvent.fType = theRecord[4];
+		theEvent.fArg = theRecord[5];
+		theEvent.fX = (KUInt16) (theRecord[6] << 8 | theRecord[7]);
+		theEvent.fY = (KUInt16) (theRecord[8] << 8 | theRecord[9]);
+		if (theEvent.fType > kKeyUpEvent)
+		{
+			return false;
+		}
+		mEvents.push_back(theEvent);
+	}
+
+	// A truncated record is an error.
+	return theCount == 0;
+}
+
+// -------------------------------------------------------------------------- //
+//  * LoadText( FILE* )
+// -------------------------------------------------------------------------- //
+Boolean
+TInputReplay::LoadText(FILE* inFile)
+{
+	char theLine[256];
+	while (::fgets(theLine, sizeof(theLine), inFile))
+	{
+		const char* theCrsr = theLine;
+		while ((*theCrsr == ' ') || (*theCrsr == '\t'))
+		{
+			theCrsr++;
+		}
+		if ((*theCrsr == '#') || (*theCrsr == '\n') || (*theCrsr == '\r')
+			|| (*theCrsr == '\0'))
+		{
+			continue;
+		}
+
+		double theMilliseconds;
+		char theVerb[16];
+		int theConsumed = 0;
+		if ((::sscanf(theCrsr, "%lf %15s %n", &theMilliseconds, theVerb, &theConsumed) < 2)
+			|| (theMilliseconds < 0.0))
+		{
+			return false;
+		}
+		const char* theArgs = theCrsr + theConsumed;
+
+		SEvent theEvent;
+		theEvent.fTime = (KUInt64) (theMilliseconds * (TInterruptManager::kTicksPerSecond / 1000.0) + 0.5);
+		theEvent.fArg = 0;
+		theEvent.fX = 0;
+		theEvent.fY = 0;
+		unsigned int theX;
+		unsigned int theY;
+		unsigned int thePressure = 4;
+		if (::strcmp(theVerb, "down") == 0)
+		{
+			if ((::sscanf(theArgs, "%u %u %u", &theX, &theY, &thePressure) < 2)
+				|| (theX > 0xFFFF) || (theY > 0xFFFF) || (thePressure > 0xFF))
+			{
+				return false;
+			}
+			theEvent.fType = kPenDownEvent;
+			theEvent.fX = (KUInt16) theX;
+			theEvent.fY = (KUInt16) theY;
+			theEvent.fArg = (KUInt8) thePressure;
+		} else if (::strcmp(theVerb, "up") == 0)
+		{
+			theEvent.fType = kPenUpEvent;
+		} else if ((::strcmp(theVerb, "keydown") == 0)
+			|| (::strcmp(theVerb, "keyup") == 0))
+		{
+			int theKeyCode;
+			if ((::sscanf(theArgs, "%i", &theKeyCode) != 1)
+				|| (theKeyCode < 0) || (theKeyCode > 0xFF))
+			{
+				return false;
+			}
+			theEvent.fType = (theVerb[3] == 'd') ? kKeyDownEvent : kKeyUpEvent;
+			theEvent.fArg = (KUInt8) theKeyCode;
+		} else
+		{
+			return false;
+		}
+
+		// Events must be sorted.
+		if (!mEvents.empty() && (theEvent.fTime < mEvents.back().fTime))
+		{
+			return false;
+		}
+		mEvents.push_back(theEvent);
+	}
+
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Start( void )
+// -------------------------------------------------------------------------- //
+void
+TInputReplay::Start(void)
+{
+	Stop();
+
+	mPlayedCount = 0;
+	mStallCount = 0;
+	mDoneTimer = 0;
+	mBaseTimer = mInterruptManager->GetTimer();
+	mTimer = mBaseTimer;
+	mElapsed = 0;
+	mStarted = true;
+	mScheduled = true;
+	mInterruptManager->ScheduleCallback(this);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Stop( void )
+// -------------------------------------------------------------------------- //
+void
+TInputReplay::Stop(void)
+{
+	if (mScheduled)
+	{
+		mInterruptManager->CancelCallback(this);
+		mScheduled = false;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * TimerCallback( KUInt32 )
+// -------------------------------------------------------------------------- //
+KUInt32
+TInputReplay::TimerCallback(KUInt32 inTimer)
+{
+	KUInt32 theDelay = Play(inTimer);
+	if (IsDone())
+	{
+		return 0;
+	}
+
+	// The drivers that lag behind are polled again.
+	return theDelay ? theDelay : kDriverPollTicks;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Play( KUInt32 )
+// -------------------------------------------------------------------------- //
+KUInt32
+TInputReplay::Play(KUInt32 inTimer)
+{
+	if (!mStarted)
+	{
+		mBaseTimer = inTimer;
+		mTimer = inTimer;
+		mElapsed = 0;
+		mStarted = true;
+	}
+
+	// The timer wraps around every 20 minutes or so.
+	mElapsed += (KUInt32) (inTimer - mTimer);
+	mTimer = inTimer;
+
+	KUInt32 theDelay = 0;
+	KUInt32 theIndex = mPlayedCount;
+	while (theIndex < mEvents.size())
+	{
+		const SEvent& theEvent = mEvents[theIndex];
+		if (theEvent.fTime > mElapsed)
+		{
+			KUInt64 theTicks = theEvent.fTime - mElapsed;
+			theDelay = (theTicks > 0xFFFFFFFF) ? 0xFFFFFFFF : (KUInt32) theTicks;
+			break;
+		}
+
+		// Wait for the drivers instead of flooding them.
+		Boolean isKey = (theEvent.fType == kKeyDownEvent)
+			|| (theEvent.fType == kKeyUpEvent);
+		if (isKey
+				? (mPlatformManager
+					  && (mPlatformManager->GetPendingEventCount() >= kMaxPendingEvents))
+				: (mScreenManager->GetPendingSampleCount() >= kMaxPendingSamples))
+		{
+			mStallCount++;
+			break;
+		}
+
+		// Samples carry the time they were due at.
+		KUInt32 theTime = mBaseTimer + (KUInt32) theEvent.fTime;
+		switch (theEvent.fType)
+		{
+			case kPenDownEvent:
+				mScreenManager->PenDown(theEvent.fX, theEvent.fY, theEvent.fArg, theTime);
+				break;
+
+			case kPenUpEvent:
+				mScreenManager->PenUp(theTime);
+				break;
+
+			case kKeyDownEvent:
+				mScreenManager->KeyDown(theEvent.fArg);
+				break;
+
+			case kKeyUpEvent:
+				mScreenManager->KeyUp(theEvent.fArg);
+				break;
+		}
+		theIndex++;
+	}
+	if ((theIndex == mEvents.size()) && (mPlayedCount < theIndex))
+	{
+		// Before mPlayedCount, so that it is valid once IsDone.
+		mDoneTimer = inTimer;
+	}
+	mPlayedCount = theIndex;
+
+	return theDelay;
+}
+
+// ============================================================= //
+// History repeats itself, first as tragedy, second as farce.    //
+//                 -- Karl Marx                                  //
+// ============================================================= //
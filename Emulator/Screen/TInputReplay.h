@@ -0,0 +1,254 @@
+// ==============================
+// File:			TInputReplay.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _TINPUTREPLAY_H
+#define _TINPUTREPLAY_H
+
+#include <K/Defines/KDefinitions.h>
+#include "Emulator/TInterruptManager.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <vector>
+
+class TLog;
+class TPlatformManager;
+class TScreenManager;
+
+///
+/// Class to replay a log of pen and keyboard events against emulated time.
+///
+/// Event times are relative to the start of the replay and are converted to
+/// timer ticks: the interrupt manager sends an event when its timer reaches
+/// it, like a timer match, with its own time as the sample time, so the
+/// Newton sees the recorded timing even if the host is late. This also works
+/// with virtual time and warp.
+///
+/// Events are never dropped: when the tablet driver or the platform driver
+/// lags behind (kMaxPendingSamples or kMaxPendingEvents), the replay waits
+/// for them to catch up before sending more.
+///
+/// A text log has one event per line, times in milliseconds, and comments
+/// starting with '#':
+///
+///		<ms> down <x> <y> [pressure]
+///		<ms> up
+///		<ms> keydown <code>
+///		<ms> keyup <code>
+///
+/// A binary log starts with kSignature (32 bits), kVersion (16 bits), 16
+/// reserved bits and the number of ticks per second (32 bits), followed by
+/// 10 bytes records: time (32 bits), EEvent (8 bits), pressure or key code
+/// (8 bits), x (16 bits), y (16 bits). Values are big endian.
+///
+class TInputReplay : public TTimerCallback
+{
+public:
+	/// Log constants.
+	enum {
+		kSignature = 'EINP',
+		kVersion = 1,
+		kMaxPendingSamples = 256,
+		kMaxPendingEvents = 16,
+		kDriverPollTicks = TInterruptManager::kTicksPerSecond / 5000
+	};
+
+	/// Event types.
+	enum EEvent {
+		kPenDownEvent = 0,
+		kPenUpEvent = 1,
+		kKeyDownEvent = 2,
+		kKeyUpEvent = 3
+	};
+
+	///
+	/// Constructor from the managers events are sent to.
+	///
+	/// \param inLog				log for errors (may be nil).
+	/// \param inScreenManager		screen manager (pen and keys).
+	/// \param inInterruptManager	interrupt manager (timer).
+	/// \param inPlatformManager	platform manager (keys back-pressure,
+	///								may be nil).
+	///
+	TInputReplay(
+		TLog* inLog,
+		TScreenManager* inScreenManager,
+		TInterruptManager* inInterruptManager,
+		TPlatformManager* inPlatformManager);
+
+	///
+	/// Destructor.
+	/// Stops the replay.
+	///
+	virtual ~TInputReplay(void);
+
+	///
+	/// Load a text or binary log.
+	///
+	/// \param inPath	path of the log.
+	/// \return \c false if the log couldn't be read (the error is logged).
+	///
+	Boolean Load(const char* inPath);
+
+	///
+	/// Have the interrupt manager play the events.
+	/// Events are timed from the current value of the timer.
+	///
+	void Start(void);
+
+	///
+	/// Stop playing the events.
+	///
+	void Stop(void);
+
+	///
+	/// Play the events from the timer. When the drivers lag behind, they
+	/// are polled again kDriverPollTicks later.
+	///
+	/// \param inTimer	current value of the timer.
+	/// \return the number of ticks until the next call, 0 once all the
+	///			events were sent.
+	///
+	virtual KUInt32 TimerCallback(KUInt32 inTimer) override;
+
+	///
+	/// Send the events due at a given timer value, unless the drivers lag
+	/// behind.
+	///
+	/// \param inTimer	current value of the timer.
+	/// \return the number of ticks until the next event is due, 0 if the
+	///			replay waits for the drivers or is over.
+	///
+	KUInt32 Play(KUInt32 inTimer);
+
+	///
+	/// Determine if all the events were sent.
+	///
+	Boolean
+	IsDone(void) const
+	{
+		return mPlayedCount == mEvents.size();
+	}
+
+	///
+	/// Accessor on the number of events in the log.
+	///
+	KUInt32
+	GetEventCount(void) const
+	{
+		return (KUInt32) mEvents.size();
+	}
+
+	///
+	/// Accessor on the number of events sent so far.
+	///
+	KUInt32
+	GetPlayedCount(void) const
+	{
+		return mPlayedCount;
+	}
+
+	///
+	/// Accessor on the timer value when the last event was sent.
+	///
+	/// \return the timer value, valid once IsDone.
+	///
+	KUInt32
+	GetDoneTimer(void) const
+	{
+		return mDoneTimer;
+	}
+
+	///
+	/// Accessor on the number of times the replay waited for the drivers.
+	///
+	KUInt32
+	GetStallCount(void) const
+	{
+		return mStallCount;
+	}
+
+private:
+	/// An event of the log.
+	struct SEvent {
+		KUInt64 fTime; ///< Time, in ticks since the start.
+		KUInt8 fType; ///< EEvent.
+		KUInt8 fArg; ///< Pressure or key code.
+		KUInt16 fX; ///< X coordinate of the pen.
+		KUInt16 fY; ///< Y coordinate of the pen.
+	};
+
+	///
+	/// Constructeur par copie volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TInputReplay(const TInputReplay& inCopy);
+
+	///
+	/// Opérateur d'assignation volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TInputReplay& operator=(const TInputReplay& inCopy);
+
+	///
+	/// Read the records of a binary log (after the signature).
+	///
+	/// \param inFile	log.
+	/// \return \c false if the log is invalid.
+	///
+	Boolean LoadBinary(FILE* inFile);
+
+	///
+	/// Read the lines of a text log.
+	///
+	/// \param inFile	log.
+	/// \return \c false if the log is invalid.
+	///
+	Boolean LoadText(FILE* inFile);
+
+	/// \name Variables
+	TLog* mLog; ///< Log for errors.
+	TScreenManager* mScreenManager; ///< Destination of the events.
+	TInterruptManager* mInterruptManager; ///< Source of the time.
+	TPlatformManager* mPlatformManager; ///< Queue of the key events.
+	std::vector<SEvent> mEvents; ///< Events of the log.
+	std::atomic<KUInt32> mPlayedCount; ///< Events sent so far.
+	std::atomic<KUInt32> mStallCount; ///< Waits for the drivers.
+	std::atomic<KUInt32> mDoneTimer; ///< Timer value of the last event.
+	Boolean mStarted; ///< If mBaseTimer and mTimer are valid.
+	KUInt32 mBaseTimer; ///< Timer value at the start.
+	KUInt32 mTimer; ///< Timer value of the last call to Play.
+	KUInt64 mElapsed; ///< Ticks since the start.
+	Boolean mScheduled; ///< Whether the interrupt manager plays us.
+};
+
+#endif
+// _TINPUTREPLAY_H
+
+// ============================================================= //
+// Those who cannot remember the past are condemned to repeat    //
+// it.                                                           //
+//                 -- George Santayana                           //
+// ============================================================= //
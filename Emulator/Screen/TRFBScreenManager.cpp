@@ -0,0 +1,1266 @@
+// ==============================
+// File:			TRFBScreenManager.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "TRFBScreenManager.h"
+
+// ANSI C & POSIX
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// K
+#include <K/Threads/TMutex.h>
+
+// Einstein
+#include "Emulator/Log/TLog.h"
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define kNoBackground 0xFFFFFFFF
+
+static const char kRFBVersion[] = "RFB 003.008\n";
+static const char kRFBDesktopName[] = "Einstein";
+
+/// Key codes of the X keysyms, sorted by keysym.
+static const struct {
+	KUInt32 fKeysym;
+	KUInt8 fKeyCode;
+} kKeysyms[] = {
+	{ ' ', 49 },
+	{ '!', 18 },
+	{ '"', 39 },
+	{ '#', 20 },
+	{ '$', 21 },
+	{ '%', 23 },
+	{ '&', 26 },
+	{ '\'', 39 },
+	{ '(', 25 },
+	{ ')', 29 },
+	{ '*', 28 },
+	{ '+', 24 },
+	{ ',', 43 },
+	{ '-', 27 },
+	{ '.', 47 },
+	{ '/', 44 },
+	{ '0', 29 },
+	{ '1', 18 },
+	{ '2', 19 },
+	{ '3', 20 },
+	{ '4', 21 },
+	{ '5', 23 },
+	{ '6', 22 },
+	{ '7', 26 },
+	{ '8', 28 },
+	{ '9', 25 },
+	{ ':', 41 },
+	{ ';', 41 },
+	{ '<', 43 },
+	{ '=', 24 },
+	{ '>', 47 },
+	{ '?', 44 },
+	{ '@', 19 },
+	{ 'A', 0 },
+	{ 'B', 11 },
+	{ 'C', 8 },
+	{ 'D', 2 },
+	{ 'E', 14 },
+	{ 'F', 3 },
+	{ 'G', 5 },
+	{ 'H', 4 },
+	{ 'I', 34 },
+	{ 'J', 38 },
+	{ 'K', 40 },
+	{ 'L', 37 },
+	{ 'M', 46 },
+	{ 'N', 45 },
+	{ 'O', 31 },
+	{ 'P', 35 },
+	{ 'Q', 12 },
+	{ 'R', 15 },
+	{ 'S', 1 },
+	{ 'T', 17 },
+	{ 'U', 32 },
+	{ 'V', 9 },
+	{ 'W', 13 },
+	{ 'X', 7 },
+	{ 'Y', 16 },
+	{ 'Z', 6 },
+	{ '[', 33 },
+	{ '\\', 42 },
+	{ ']', 30 },
+	{ '^', 22 },
+	{ '_', 27 },
+	{ '`', 50 },
+	{ '{', 33 },
+	{ '|', 42 },
+	{ '}', 30 },
+	{ '~', 50 },
+	{ 0xFF08, 51 }, // BackSpace
+	{ 0xFF09, 48 }, // Tab
+	{ 0xFF0D, 36 }, // Return
+	{ 0xFF1B, 53 }, // Escape
+	{ 0xFF50, 0x73 }, // Home
+	{ 0xFF51, 123 }, // Left
+	{ 0xFF52, 126 }, // Up
+	{ 0xFF53, 124 }, // Right
+	{ 0xFF54, 125 }, // Down
+	{ 0xFF55, 0x74 }, // Page Up
+	{ 0xFF56, 0x79 }, // Page Down
+	{ 0xFF57, 119 }, // End
+	{ 0xFF8D, 76 }, // KP Enter
+	{ 0xFFBE, 0x7A }, // F1
+	{ 0xFFBF, 0x78 }, // F2
+	{ 0xFFC0, 0x63 }, // F3
+	{ 0xFFC1, 0x76 }, // F4
+	{ 0xFFC2, 0x60 }, // F5
+	{ 0xFFC3, 0x61 }, // F6
+	{ 0xFFC4, 0x62 }, // F7
+	{ 0xFFC5, 0x64 }, // F8
+	{ 0xFFC6, 0x65 }, // F9
+	{ 0xFFC7, 0x6D }, // F10
+	{ 0xFFC8, 0x67 }, // F11
+	{ 0xFFC9, 0x6F }, // F12
+	{ 0xFFE1, 56 }, // Shift Left
+	{ 0xFFE2, 56 }, // Shift Right
+	{ 0xFFE3, 59 }, // Control Left
+	{ 0xFFE4, 59 }, // Control Right
+	{ 0xFFE5, 57 }, // Caps Lock
+	{ 0xFFE7, 55 }, // Meta Left
+	{ 0xFFE8, 55 }, // Meta Right
+	{ 0xFFE9, 58 }, // Alt Left
+	{ 0xFFEA, 58 }, // Alt Right
+	{ 0xFFFF, 0x75 }, // Delete
+};
+
+// -------------------------------------------------------------------------- //
+//  * AppendRFB16( std::vector<KUInt8>*, KUInt32 )
+// -------------------------------------------------------------------------- //
+static inline void
+AppendRFB16(std::vector<KUInt8>* ioData, KUInt32 inValue)
+{
+	ioData->push_back((KUInt8) (inValue >> 8));
+	ioData->push_back((KUInt8) inValue);
+}
+
+// -------------------------------------------------------------------------- //
+//  * AppendRFB32( std::vector<KUInt8>*, KUInt32 )
+// -------------------------------------------------------------------------- //
+static inline void
+AppendRFB32(std::vector<KUInt8>* ioData, KUInt32 inValue)
+{
+	AppendRFB16(ioData, inValue >> 16);
+	AppendRFB16(ioData, inValue);
+}
+
+// -------------------------------------------------------------------------- //
+//  * TRFBScreenManager( TLog*, KUInt16, KUInt32, KUInt32, ... )
+// -------------------------------------------------------------------------- //
+TRFBScreenManager::TRFBScreenManager(
+	TLog* inLog,
+	KUInt16 inPort /* = kDefaultPort */,
+	KUInt32 inPortraitWidth /* = kDefaultPortraitWidth */,
+	KUInt32 inPortraitHeight /* = kDefaultPortraitHeight */,
+	Boolean inFullScreen /* = false */,
+	Boolean inScreenIsLandscape /* = true */) :
+		TNullScreenManager(
+			inLog,
+			inPortraitWidth,
+			inPortraitHeight,
+			inFullScreen,
+			inScreenIsLandscape),
+		mListenSocket(-1),
+		mClientSocket(-1),
+		mPort(inPort),
+		mThread(nil),
+		mConnected(false),
+		mQuit(false),
+		mMutex(new TMutex()),
+		mTilesWidth(0),
+		mTilesHeight(0),
+		mGridWidth(0),
+		mGridHeight(0),
+		mDirty(false),
+		mWakePending(false),
+		mPaletteChanged(false),
+		mUpdateRequested(false),
+		mHextile(false),
+		mDesktopSize(false),
+		mColorMapPending(false),
+		mButtonIsDown(false),
+		mClientWidth(0),
+		mClientHeight(0),
+		mLastBackground(kNoBackground)
+{
+	mWakePipe[0] = -1;
+	mWakePipe[1] = -1;
+	(void) ::memset(&mFormat, 0, sizeof(mFormat));
+	(void) ::memset(mPalette, 0, sizeof(mPalette));
+
+	// Loopback only: the server has no authentication.
+	mListenSocket = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (mListenSocket < 0)
+	{
+		if (inLog)
+		{
+			inLog->FLogLine("Cannot create the RFB socket (%i)", errno);
+		}
+		return;
+	}
+	int theOption = 1;
+	(void) ::setsockopt(
+		mListenSocket, SOL_SOCKET, SO_REUSEADDR, &theOption, sizeof(theOption));
+	struct sockaddr_in theAddress;
+	(void) ::memset(&theAddress, 0, sizeof(theAddress));
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	theAddress.sin_port = htons(inPort);
+	socklen_t theAddressLen = sizeof(theAddress);
+	if ((::bind(mListenSocket, (struct sockaddr*) &theAddress, sizeof(theAddress)) < 0)
+		|| (::listen(mListenSocket, 1) < 0)
+		|| (::getsockname(mListenSocket, (struct sockaddr*) &theAddress, &theAddressLen) < 0)
+		|| (::pipe(mWakePipe) < 0))
+	{
+		if (inLog)
+		{
+			inLog->FLogLine("Cannot listen on RFB port %i (%i)", (int) inPort, errno);
+		}
+		(void) ::close(mListenSocket);
+		mListenSocket = -1;
+		return;
+	}
+	mPort = ntohs(theAddress.sin_port);
+
+	mThread = new std::thread(&TRFBScreenManager::ServerLoop, this);
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TRFBScreenManager( void )
+// -------------------------------------------------------------------------- //
+TRFBScreenManager::~TRFBScreenManager(void)
+{
+	if (mThread)
+	{
+		mQuit = true;
+		Wake();
+		// Unblock the thread if it is reading from the client.
+		mMutex->Lock();
+		if (mClientSocket >= 0)
+		{
+			(void) ::shutdown(mClientSocket, SHUT_RDWR);
+		}
+		mMutex->Unlock();
+		mThread->join();
+		delete mThread;
+	}
+	if (mListenSocket >= 0)
+	{
+		(void) ::close(mListenSocket);
+	}
+	if (mWakePipe[0] >= 0)
+	{
+		(void) ::close(mWakePipe[0]);
+		(void) ::close(mWakePipe[1]);
+	}
+	delete mMutex;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ScreenOrientationChanged( EOrientation )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::ScreenOrientationChanged(EOrientation inNewOrientation)
+{
+	if (GetLog())
+	{
+		GetLog()->FLogLine(
+			"TRFBScreenManager::ScreenOrientationChanged(%d)",
+			(int) inNewOrientation);
+	}
+
+	if (mConnected)
+	{
+		Boolean doWake = false;
+		mMutex->Lock();
+		ResetTiles();
+		if (mUpdateRequested && !mWakePending)
+		{
+			mWakePending = true;
+			doWake = true;
+		}
+		mMutex->Unlock();
+		if (doWake)
+		{
+			Wake();
+		}
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * BacklightChanged( Boolean )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::BacklightChanged(Boolean /* inNewBacklight */)
+{
+	if (mConnected)
+	{
+		// The color map can be sent without a request.
+		Boolean doWake = false;
+		mMutex->Lock();
+		mPaletteChanged = true;
+		if (!mWakePending)
+		{
+			mWakePending = true;
+			doWake = true;
+		}
+		mMutex->Unlock();
+		if (doWake)
+		{
+			Wake();
+		}
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * UpdateScreenRect( SRect* )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::UpdateScreenRect(SRect* inUpdatedRect)
+{
+	if (!mConnected)
+	{
+		return;
+	}
+
+	Boolean doWake = false;
+	mMutex->Lock();
+	if ((mGridWidth != GetActualScreenWidth())
+		|| (mGridHeight != GetActualScreenHeight()))
+	{
+		ResetTiles();
+	} else
+	{
+		MarkDirty(
+			inUpdatedRect->fTop,
+			inUpdatedRect->fLeft,
+			inUpdatedRect->fBottom,
+			inUpdatedRect->fRight);
+	}
+	if (mDirty && mUpdateRequested && !mWakePending)
+	{
+		mWakePending = true;
+		doWake = true;
+	}
+	mMutex->Unlock();
+	if (doWake)
+	{
+		Wake();
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * TranslateKeysym( KUInt32 )
+// -------------------------------------------------------------------------- //
+KUInt8
+TRFBScreenManager::TranslateKeysym(KUInt32 inKeysym)
+{
+	KUInt32 theKeysym = inKeysym;
+	if ((theKeysym >= 'a') && (theKeysym <= 'z'))
+	{
+		theKeysym -= 'a' - 'A';
+	}
+	KUInt32 indexLow = 0;
+	KUInt32 indexHigh = sizeof(kKeysyms) / sizeof(kKeysyms[0]);
+	while (indexLow < indexHigh)
+	{
+		KUInt32 indexMiddle = (indexLow + indexHigh) / 2;
+		if (kKeysyms[indexMiddle].fKeysym == theKeysym)
+		{
+			return kKeysyms[indexMiddle].fKeyCode;
+		}
+		if (kKeysyms[indexMiddle].fKeysym < theKeysym)
+		{
+			indexLow = indexMiddle + 1;
+		} else
+		{
+			indexHigh = indexMiddle;
+		}
+	}
+
+	return 0xFF;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ServerLoop( void )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::ServerLoop(void)
+{
+	while (!mQuit)
+	{
+		// Without a client, only wait for one.
+		int theSocket = (mClientSocket >= 0) ? mClientSocket : mListenSocket;
+		fd_set theFDs;
+		FD_ZERO(&theFDs);
+		FD_SET(mWakePipe[0], &theFDs);
+		FD_SET(theSocket, &theFDs);
+		int theMaxFD = (theSocket > mWakePipe[0]) ? theSocket : mWakePipe[0];
+		if (::select(theMaxFD + 1, &theFDs, nil, nil, nil) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		if (FD_ISSET(mWakePipe[0], &theFDs))
+		{
+			KUInt8 theBytes[32];
+			(void) ::read(mWakePipe[0], theBytes, sizeof(theBytes));
+			mMutex->Lock();
+			mWakePending = false;
+			mMutex->Unlock();
+		}
+		if (mQuit)
+		{
+			break;
+		}
+
+		if (mClientSocket < 0)
+		{
+			if (FD_ISSET(mListenSocket, &theFDs))
+			{
+				AcceptClient();
+			}
+		} else
+		{
+			Boolean isOK = true;
+			if (FD_ISSET(mClientSocket, &theFDs))
+			{
+				isOK = HandleClientMessage();
+			}
+			if (isOK)
+			{
+				isOK = SendUpdate();
+			}
+			if (!isOK)
+			{
+				CloseClient();
+			}
+		}
+	}
+
+	CloseClient();
+}
+
+// -------------------------------------------------------------------------- //
+//  * Wake( void )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::Wake(void)
+{
+	KUInt8 theByte = 0;
+	(void) ::write(mWakePipe[1], &theByte, 1);
+}
+
+// -------------------------------------------------------------------------- //
+//  * AcceptClient( void )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::AcceptClient(void)
+{
+	int theSocket = ::accept(mListenSocket, nil, nil);
+	if (theSocket < 0)
+	{
+		return;
+	}
+	int theOption = 1;
+	(void) ::setsockopt(
+		theSocket, IPPROTO_TCP, TCP_NODELAY, &theOption, sizeof(theOption));
+#ifdef SO_NOSIGPIPE
+	(void) ::setsockopt(
+		theSocket, SOL_SOCKET, SO_NOSIGPIPE, &theOption, sizeof(theOption));
+#endif
+	mMutex->Lock();
+	mClientSocket = theSocket;
+	mMutex->Unlock();
+
+	// Protocol version: we speak 3.8 and understand 3.3 and 3.7 clients.
+	char theVersion[13];
+	int theMajor;
+	int theMinor;
+	if (!WriteClient(kRFBVersion, 12)
+		|| !ReadClient(theVersion, 12))
+	{
+		CloseClient();
+		return;
+	}
+	theVersion[12] = 0;
+	if ((::sscanf(theVersion, "RFB %d.%d", &theMajor, &theMinor) != 2)
+		|| (theMajor != 3))
+	{
+		CloseClient();
+		return;
+	}
+
+	// Security: none.
+	KUInt8 theBytes[4] = { 0, 0, 0, 1 };
+	if (theMinor < 7)
+	{
+		if (!WriteClient(theBytes, 4))
+		{
+			CloseClient();
+			return;
+		}
+	} else
+	{
+		theBytes[0] = 1;
+		theBytes[1] = 1;
+		if (!WriteClient(theBytes, 2)
+			|| !ReadClient(theBytes, 1)
+			|| (theBytes[0] != 1))
+		{
+			CloseClient();
+			return;
+		}
+		(void) ::memset(theBytes, 0, sizeof(theBytes));
+		if ((theMinor >= 8) && !WriteClient(theBytes, 4))
+		{
+			CloseClient();
+			return;
+		}
+	}
+
+	// ClientInit (the shared flag doesn't matter with one client).
+	if (!ReadClient(theBytes, 1))
+	{
+		CloseClient();
+		return;
+	}
+
+	// ServerInit, with the color map format.
+	mClientWidth = GetActualScreenWidth();
+	mClientHeight = GetActualScreenHeight();
+	(void) ::memset(&mFormat, 0, sizeof(mFormat));
+	mFormat.fBitsPerPixel = 8;
+	mFormat.fDepth = 8;
+	ComputePalette(GetBacklight());
+	mHextile = false;
+	mDesktopSize = false;
+	mColorMapPending = true;
+	mButtonIsDown = false;
+	mOutput.clear();
+	AppendRFB16(&mOutput, mClientWidth);
+	AppendRFB16(&mOutput, mClientHeight);
+	mOutput.push_back(mFormat.fBitsPerPixel);
+	mOutput.push_back(mFormat.fDepth);
+	mOutput.push_back(mFormat.fBigEndian);
+	mOutput.push_back(mFormat.fTrueColor);
+	mOutput.insert(mOutput.end(), 12, 0);
+	AppendRFB32(&mOutput, sizeof(kRFBDesktopName) - 1);
+	mOutput.insert(
+		mOutput.end(),
+		kRFBDesktopName,
+		kRFBDesktopName + sizeof(kRFBDesktopName) - 1);
+	if (!WriteClient(mOutput.data(), (KUInt32) mOutput.size()))
+	{
+		CloseClient();
+		return;
+	}
+
+	mMutex->Lock();
+	ResetTiles();
+	mUpdateRequested = false;
+	mPaletteChanged = false;
+	mMutex->Unlock();
+	mConnected = true;
+
+	if (GetLog())
+	{
+		GetLog()->FLogLine("RFB client connected (protocol 3.%d)", theMinor);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * CloseClient( void )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::CloseClient(void)
+{
+	if (mClientSocket < 0)
+	{
+		return;
+	}
+
+	mConnected = false;
+	mMutex->Lock();
+	(void) ::close(mClientSocket);
+	mClientSocket = -1;
+	mMutex->Unlock();
+	if (mButtonIsDown)
+	{
+		PenUp();
+		mButtonIsDown = false;
+	}
+
+	if (GetLog())
+	{
+		GetLog()->LogLine("RFB client disconnected");
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * HandleClientMessage( void )
+// -------------------------------------------------------------------------- //
+Boolean
+TRFBScreenManager::HandleClientMessage(void)
+{
+	KUInt8 theBytes[19];
+	if (!ReadClient(theBytes, 1))
+	{
+		return false;
+	}
+
+	switch (theBytes[0])
+	{
+		case 0: // SetPixelFormat
+			{
+				if (!ReadClient(theBytes, 19))
+				{
+					return false;
+				}
+				const KUInt8* theFormat = &theBytes[3];
+				if ((theFormat[0] != 8) && (theFormat[0] != 16) && (theFormat[0] != 32))
+				{
+					return false;
+				}
+				mFormat.fBitsPerPixel = theFormat[0];
+				mFormat.fDepth = theFormat[1];
+				mFormat.fBigEndian = theFormat[2];
+				mFormat.fTrueColor = theFormat[3];
+				mFormat.fRedMax = (KUInt16) ((theFormat[4] << 8) | theFormat[5]);
+				mFormat.fGreenMax = (KUInt16) ((theFormat[6] << 8) | theFormat[7]);
+				mFormat.fBlueMax = (KUInt16) ((theFormat[8] << 8) | theFormat[9]);
+				mFormat.fRedShift = theFormat[10];
+				mFormat.fGreenShift = theFormat[11];
+				mFormat.fBlueShift = theFormat[12];
+				ComputePalette(GetBacklight());
+				mColorMapPending = !mFormat.fTrueColor;
+				mMutex->Lock();
+				ResetTiles();
+				mMutex->Unlock();
+			}
+			break;
+
+		case 2: // SetEncodings
+			{
+				if (!ReadClient(theBytes, 3))
+				{
+					return false;
+				}
+				KUInt32 theCount = (theBytes[1] << 8) | theBytes[2];
+				mHextile = false;
+				mDesktopSize = false;
+				for (KUInt32 indexEncoding = 0; indexEncoding < theCount; indexEncoding++)
+				{
+					if (!ReadClient(theBytes, 4))
+					{
+						return false;
+					}
+					KSInt32 theEncoding = (KSInt32) (((KUInt32) theBytes[0] << 24)
+						| (theBytes[1] << 16) | (theBytes[2] << 8) | theBytes[3]);
+					if (theEncoding == kHextileEncoding)
+					{
+						mHextile = true;
+					} else if (theEncoding == kDesktopSizeEncoding)
+					{
+						mDesktopSize = true;
+					}
+				}
+			}
+			break;
+
+		case 3: // FramebufferUpdateRequest
+			{
+				if (!ReadClient(theBytes, 9))
+				{
+					return false;
+				}
+				KUInt32 theLeft = (theBytes[1] << 8) | theBytes[2];
+				KUInt32 theTop = (theBytes[3] << 8) | theBytes[4];
+				KUInt32 theWidth = (theBytes[5] << 8) | theBytes[6];
+				KUInt32 theHeight = (theBytes[7] << 8) | theBytes[8];
+				mMutex->Lock();
+				mUpdateRequested = true;
+				if (!theBytes[0])
+				{
+					MarkDirty(theTop, theLeft, theTop + theHeight, theLeft + theWidth);
+				}
+				mMutex->Unlock();
+			}
+			break;
+
+		case 4: // KeyEvent
+			{
+				if (!ReadClient(theBytes, 7))
+				{
+					return false;
+				}
+				KUInt32 theKeysym = ((KUInt32) theBytes[3] << 24) | (theBytes[4] << 16)
+					| (theBytes[5] << 8) | theBytes[6];
+				KUInt8 theKeyCode = TranslateKeysym(theKeysym);
+				if (theKeyCode != 0xFF)
+				{
+					if (theBytes[0])
+					{
+						KeyDown(theKeyCode);
+					} else
+					{
+						KeyUp(theKeyCode);
+					}
+				}
+			}
+			break;
+
+		case 5: // PointerEvent
+			{
+				if (!ReadClient(theBytes, 5))
+				{
+					return false;
+				}
+				KUInt32 theX = (theBytes[1] << 8) | theBytes[2];
+				KUInt32 theY = (theBytes[3] << 8) | theBytes[4];
+				if (theX >= mClientWidth)
+				{
+					theX = mClientWidth - 1;
+				}
+				if (theY >= mClientHeight)
+				{
+					theY = mClientHeight - 1;
+				}
+				if (theBytes[0] & 1)
+				{
+					PenDown((KUInt16) theX, (KUInt16) theY);
+					mButtonIsDown = true;
+				} else if (mButtonIsDown)
+				{
+					PenUp();
+					mButtonIsDown = false;
+				}
+			}
+			break;
+
+		case 6: // ClientCutText
+			{
+				if (!ReadClient(theBytes, 7))
+				{
+					return false;
+				}
+				KUInt32 theLength = ((KUInt32) theBytes[3] << 24) | (theBytes[4] << 16)
+					| (theBytes[5] << 8) | theBytes[6];
+				while (theLength > 0)
+				{
+					KUInt32 theCount = (theLength > sizeof(theBytes)) ? sizeof(theBytes) : theLength;
+					if (!ReadClient(theBytes, theCount))
+					{
+						return false;
+					}
+					theLength -= theCount;
+				}
+			}
+			break;
+
+		default:
+			// We cannot skip unknown messages.
+			return false;
+	}
+
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * SendUpdate( void )
+// -------------------------------------------------------------------------- //
+Boolean
+TRFBScreenManager::SendUpdate(void)
+{
+	// Take the dirty tiles.
+	std::vector<Boolean> theTiles;
+	mMutex->Lock();
+	Boolean paletteChanged = mPaletteChanged;
+	mPaletteChanged = false;
+	KUInt32 theWidth = GetActualScreenWidth();
+	KUInt32 theHeight = GetActualScreenHeight();
+	if ((mGridWidth != theWidth) || (mGridHeight != theHeight)
+		|| (paletteChanged && mFormat.fTrueColor))
+	{
+		ResetTiles();
+	}
+	Boolean sendTiles = mUpdateRequested && mDirty;
+	if (sendTiles)
+	{
+		theTiles.swap(mDirtyTiles);
+		mDirtyTiles.assign(theTiles.size(), false);
+		mDirty = false;
+		mUpdateRequested = false;
+	}
+	KUInt32 theTilesWidth = mTilesWidth;
+	KUInt32 theTilesHeight = mTilesHeight;
+	mMutex->Unlock();
+
+	if (paletteChanged)
+	{
+		ComputePalette(GetBacklight());
+		mColorMapPending = !mFormat.fTrueColor;
+	}
+	if (mColorMapPending)
+	{
+		// Grays, or greens with the backlight (like the FLTK screen manager).
+		mColorMapPending = false;
+		mOutput.clear();
+		mOutput.push_back(1);
+		mOutput.push_back(0);
+		AppendRFB16(&mOutput, 0);
+		AppendRFB16(&mOutput, 16);
+		Boolean theBacklight = GetBacklight();
+		for (KUInt32 indexLevel = 0; indexLevel < 16; indexLevel++)
+		{
+			KUInt32 theLevel = indexLevel * 0x11;
+			KUInt32 theRedBlue = theBacklight ? (theLevel >> 1) : theLevel;
+			AppendRFB16(&mOutput, theRedBlue * 0x101);
+			AppendRFB16(&mOutput, theLevel * 0x101);
+			AppendRFB16(&mOutput, theRedBlue * 0x101);
+		}
+		if (!WriteClient(mOutput.data(), (KUInt32) mOutput.size()))
+		{
+			return false;
+		}
+	}
+	if (!sendTiles)
+	{
+		return true;
+	}
+
+	mOutput.clear();
+	mOutput.push_back(0);
+	mOutput.push_back(0);
+	AppendRFB16(&mOutput, 0);
+	KUInt32 theRectCount = 0;
+	if (mDesktopSize
+		&& ((mClientWidth != theWidth) || (mClientHeight != theHeight)))
+	{
+		mClientWidth = theWidth;
+		mClientHeight = theHeight;
+		AppendRFB16(&mOutput, 0);
+		AppendRFB16(&mOutput, 0);
+		AppendRFB16(&mOutput, mClientWidth);
+		AppendRFB16(&mOutput, mClientHeight);
+		AppendRFB32(&mOutput, (KUInt32) kDesktopSizeEncoding);
+		theRectCount++;
+	}
+
+	// Without DesktopSize, the client keeps its dimensions.
+	KUInt32 theClipWidth = (theWidth < mClientWidth) ? theWidth : mClientWidth;
+	KUInt32 theClipHeight = (theHeight < mClientHeight) ? theHeight : mClientHeight;
+	KUInt32 theRowBytes = theWidth * kBitsPerPixel / 8;
+	const KUInt8* theScreen = GetScreenBuffer();
+
+	// One rectangle for each run of dirty tiles in a row of tiles.
+	for (KUInt32 indexTileY = 0; indexTileY < theTilesHeight; indexTileY++)
+	{
+		KUInt32 indexTileX = 0;
+		while (indexTileX < theTilesWidth)
+		{
+			if (!theTiles[(indexTileY * theTilesWidth) + indexTileX])
+			{
+				indexTileX++;
+				continue;
+			}
+			KUInt32 theFirstTile = indexTileX;
+			while ((indexTileX < theTilesWidth)
+				&& theTiles[(indexTileY * theTilesWidth) + indexTileX])
+			{
+				indexTileX++;
+			}
+			KUInt32 theTop = indexTileY * kTileSize;
+			KUInt32 theLeft = theFirstTile * kTileSize;
+			KUInt32 theBottom = theTop + kTileSize;
+			KUInt32 theRight = indexTileX * kTileSize;
+			if (theBottom > theClipHeight)
+			{
+				theBottom = theClipHeight;
+			}
+			if (theRight > theClipWidth)
+			{
+				theRight = theClipWidth;
+			}
+			if ((theTop >= theBottom) || (theLeft >= theRight))
+			{
+				continue;
+			}
+
+			AppendRFB16(&mOutput, theLeft);
+			AppendRFB16(&mOutput, theTop);
+			AppendRFB16(&mOutput, theRight - theLeft);
+			AppendRFB16(&mOutput, theBottom - theTop);
+			theRectCount++;
+			if (mHextile)
+			{
+				AppendRFB32(&mOutput, kHextileEncoding);
+				mLastBackground = kNoBackground;
+				for (KUInt32 theTileLeft = theLeft; theTileLeft < theRight; theTileLeft += kTileSize)
+				{
+					KUInt32 theTileRight = theTileLeft + kTileSize;
+					if (theTileRight > theRight)
+					{
+						theTileRight = theRight;
+					}
+					AppendHextileTile(theRowBytes, theTop, theTileLeft, theBottom, theTileRight);
+				}
+			} else
+			{
+				AppendRFB32(&mOutput, kRawEncoding);
+				for (KUInt32 indexY = theTop; indexY < theBottom; indexY++)
+				{
+					const KUInt8* theRow = theScreen + (indexY * theRowBytes);
+					for (KUInt32 indexX = theLeft; indexX < theRight; indexX++)
+					{
+						KUInt8 theByte = theRow[indexX >> 1];
+						AppendPixel(mPalette[(indexX & 1) ? (theByte & 0x0F) : (theByte >> 4)]);
+					}
+				}
+			}
+		}
+	}
+
+	mOutput[2] = (KUInt8) (theRectCount >> 8);
+	mOutput[3] = (KUInt8) theRectCount;
+	return WriteClient(mOutput.data(), (KUInt32) mOutput.size());
+}
+
+// -------------------------------------------------------------------------- //
+//  * MarkDirty( KUInt32, KUInt32, KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::MarkDirty(
+	KUInt32 inTop,
+	KUInt32 inLeft,
+	KUInt32 inBottom,
+	KUInt32 inRight)
+{
+	KUInt32 theBottom = (inBottom > mGridHeight) ? mGridHeight : inBottom;
+	KUInt32 theRight = (inRight > mGridWidth) ? mGridWidth : inRight;
+	if ((inTop >= theBottom) || (inLeft >= theRight))
+	{
+		return;
+	}
+
+	KUInt32 theLastTileY = (theBottom - 1) / kTileSize;
+	KUInt32 theLastTileX = (theRight - 1) / kTileSize;
+	for (KUInt32 indexTileY = inTop / kTileSize; indexTileY <= theLastTileY; indexTileY++)
+	{
+		for (KUInt32 indexTileX = inLeft / kTileSize; indexTileX <= theLastTileX; indexTileX++)
+		{
+			mDirtyTiles[(indexTileY * mTilesWidth) + indexTileX] = true;
+		}
+	}
+	mDirty = true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ResetTiles( void )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::ResetTiles(void)
+{
+	mGridWidth = GetActualScreenWidth();
+	mGridHeight = GetActualScreenHeight();
+	mTilesWidth = (mGridWidth + kTileSize - 1) / kTileSize;
+	mTilesHeight = (mGridHeight + kTileSize - 1) / kTileSize;
+	mDirtyTiles.assign(mTilesWidth * mTilesHeight, true);
+	mDirty = true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ComputePalette( Boolean )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::ComputePalette(Boolean inBacklight)
+{
+	for (KUInt32 indexLevel = 0; indexLevel < 16; indexLevel++)
+	{
+		if (!mFormat.fTrueColor)
+		{
+			// The color map does the work.
+			mPalette[indexLevel] = indexLevel;
+		} else
+		{
+			KUInt32 theGreen = indexLevel * 0x11;
+			KUInt32 theRedBlue = inBacklight ? (theGreen >> 1) : theGreen;
+			mPalette[indexLevel] =
+				((((theRedBlue * mFormat.fRedMax) + 127) / 255) << mFormat.fRedShift)
+				| ((((theGreen * mFormat.fGreenMax) + 127) / 255) << mFormat.fGreenShift)
+				| ((((theRedBlue * mFormat.fBlueMax) + 127) / 255) << mFormat.fBlueShift);
+		}
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * AppendPixel( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::AppendPixel(KUInt32 inPixel)
+{
+	switch (mFormat.fBitsPerPixel)
+	{
+		case 8:
+			mOutput.push_back((KUInt8) inPixel);
+			break;
+
+		case 16:
+			if (mFormat.fBigEndian)
+			{
+				AppendRFB16(&mOutput, inPixel);
+			} else
+			{
+				mOutput.push_back((KUInt8) inPixel);
+				mOutput.push_back((KUInt8) (inPixel >> 8));
+			}
+			break;
+
+		default:
+			if (mFormat.fBigEndian)
+			{
+				AppendRFB32(&mOutput, inPixel);
+			} else
+			{
+				mOutput.push_back((KUInt8) inPixel);
+				mOutput.push_back((KUInt8) (inPixel >> 8));
+				mOutput.push_back((KUInt8) (inPixel >> 16));
+				mOutput.push_back((KUInt8) (inPixel >> 24));
+			}
+			break;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * AppendHextileTile( KUInt32, KUInt32, KUInt32, KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TRFBScreenManager::AppendHextileTile(
+	KUInt32 inRowBytes,
+	KUInt32 inTop,
+	KUInt32 inLeft,
+	KUInt32 inBottom,
+	KUInt32 inRight)
+{
+	// Hextile subencoding bits.
+	enum {
+		kRaw = 1,
+		kBackgroundSpecified = 2,
+		kForegroundSpecified = 4,
+		kAnySubrects = 8,
+		kSubrectsColoured = 16
+	};
+
+	// Gather the levels and count them.
+	KUInt32 theWidth = inRight - inLeft;
+	KUInt32 theHeight = inBottom - inTop;
+	KUInt8 theLevels[kTileSize * kTileSize];
+	KUInt32 theCounts[16];
+	(void) ::memset(theCounts, 0, sizeof(theCounts));
+	const KUInt8* theScreen = GetScreenBuffer();
+	KUInt8* theLevel = theLevels;
+	for (KUInt32 indexY = inTop; indexY < inBottom; indexY++)
+	{
+		const KUInt8* theRow = theScreen + (indexY * inRowBytes);
+		for (KUInt32 indexX = inLeft; indexX < inRight; indexX++)
+		{
+			KUInt8 theByte = theRow[indexX >> 1];
+			*theLevel = (indexX & 1) ? (theByte & 0x0F) : (theByte >> 4);
+			theCounts[*theLevel++]++;
+		}
+	}
+	KUInt32 theBackgroundLevel = 0;
+	KUInt32 theForegroundLevel = 0;
+	KUInt32 theColorCount = 0;
+	for (KUInt32 indexLevel = 0; indexLevel < 16; indexLevel++)
+	{
+		if (theCounts[indexLevel])
+		{
+			theColorCount++;
+			if (theCounts[indexLevel] > theCounts[theBackgroundLevel])
+			{
+				theBackgroundLevel = indexLevel;
+			}
+		}
+	}
+	for (KUInt32 indexLevel = 0; indexLevel < 16; indexLevel++)
+	{
+		if (theCounts[indexLevel] && (indexLevel != theBackgroundLevel))
+		{
+			theForegroundLevel = indexLevel;
+		}
+	}
+
+	// Plain tiles (most of them) are a byte, or a pixel more.
+	KUInt32 theBackground = mPalette[theBackgroundLevel];
+	size_t theStart = mOutput.size();
+	KUInt8 theSubencoding = 0;
+	mOutput.push_back(0);
+	if (theBackground != mLastBackground)
+	{
+		theSubencoding |= kBackgroundSpecified;
+		AppendPixel(theBackground);
+		mLastBackground = theBackground;
+	}
+	if (theColorCount > 1)
+	{
+		// Runs of each row, with a single foreground for text.
+		Boolean isMonochrome = (theColorCount == 2);
+		theSubencoding |= kAnySubrects;
+		if (isMonochrome)
+		{
+			theSubencoding |= kForegroundSpecified;
+			AppendPixel(mPalette[theForegroundLevel]);
+		} else
+		{
+			theSubencoding |= kSubrectsColoured;
+		}
+		size_t theCountIndex = mOutput.size();
+		mOutput.push_back(0);
+		KUInt32 theSubrectCount = 0;
+		size_t theRawSize = theWidth * theHeight * (mFormat.fBitsPerPixel / 8);
+		for (KUInt32 indexY = 0; (indexY < theHeight) && (theSubrectCount <= 255); indexY++)
+		{
+			const KUInt8* theRow = &theLevels[indexY * theWidth];
+			KUInt32 indexX = 0;
+			while (indexX < theWidth)
+			{
+				KUInt8 theRunLevel = theRow[indexX];
+				if (theRunLevel == theBackgroundLevel)
+				{
+					indexX++;
+					continue;
+				}
+				KUInt32 theRunStart = indexX;
+				while ((indexX < theWidth) && (theRow[indexX] == theRunLevel))
+				{
+					indexX++;
+				}
+				if (!isMonochrome)
+				{
+					AppendPixel(mPalette[theRunLevel]);
+				}
+				mOutput.push_back((KUInt8) ((theRunStart << 4) | indexY));
+				mOutput.push_back((KUInt8) ((indexX - theRunStart - 1) << 4));
+				theSubrectCount++;
+			}
+		}
+
+		if ((theSubrectCount > 255) || ((mOutput.size() - theStart) > theRawSize))
+		{
+			// Noise: raw pixels are smaller.
+			mOutput.resize(theStart);
+			mOutput.push_back(kRaw);
+			for (KUInt32 indexPixel = 0; indexPixel < theWidth * theHeight; indexPixel++)
+			{
+				AppendPixel(mPalette[theLevels[indexPixel]]);
+			}
+			mLastBackground = kNoBackground;
+			return;
+		}
+		mOutput[theCountIndex] = (KUInt8) theSubrectCount;
+	}
+	mOutput[theStart] = theSubencoding;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ReadClient( void*, KUInt32 )
+// -------------------------------------------------------------------------- //
+Boolean
+TRFBScreenManager::ReadClient(void* outBuffer, KUInt32 inCount)
+{
+	KUInt8* theCursor = (KUInt8*) outBuffer;
+	KUInt32 theCount = inCount;
+	while (theCount > 0)
+	{
+		ssize_t theResult = ::recv(mClientSocket, theCursor, theCount, 0);
+		if (theResult <= 0)
+		{
+			if ((theResult < 0) && (errno == EINTR))
+			{
+				continue;
+			}
+			return false;
+		}
+		theCursor += theResult;
+		theCount -= (KUInt32) theResult;
+	}
+
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteClient( const void*, KUInt32 )
+// -------------------------------------------------------------------------- //
+Boolean
+TRFBScreenManager::WriteClient(const void* inBuffer, KUInt32 inCount)
+{
+	const KUInt8* theCursor = (const KUInt8*) inBuffer;
+	KUInt32 theCount = inCount;
+	while (theCount > 0)
+	{
+		ssize_t theResult = ::send(mClientSocket, theCursor, theCount, MSG_NOSIGNAL);
+		if (theResult <= 0)
+		{
+			if ((theResult < 0) && (errno == EINTR))
+			{
+				continue;
+			}
+			return false;
+		}
+		theCursor += theResult;
+		theCount -= (KUInt32) theResult;
+	}
+
+	return true;
+}
+
+// ============================================================= //
+// A bad random number generator: 1, 1, 1, 1, 1, 4.33e+67, 1, 1, //
+// 1, 1, ...                                                     //
+// ============================================================= //
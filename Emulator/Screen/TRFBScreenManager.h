@@ -0,0 +1,300 @@
+// ==============================
+// File:			TRFBScreenManager.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _TRFBSCREENMANAGER_H
+#define _TRFBSCREENMANAGER_H
+
+#include <K/Defines/KDefinitions.h>
+#include "Emulator/Screen/TNullScreenManager.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class TMutex;
+
+///
+/// Class for a headless screen manager that serves the screen with the RFB
+/// (VNC) protocol.
+///
+/// The server listens on the loopback interface and accepts one client at a
+/// time. Screen updates mark 16x16 tiles as dirty and only these tiles are
+/// sent, with the Hextile encoding (or Raw if the client doesn't know it).
+/// The 16 gray levels of the screen are converted with a 16 entries palette
+/// in the format of the client; by default, the server format is an 8 bits
+/// color map with the grays (and the greens, with the backlight).
+///
+/// The pointer drives the pen and X keysyms are translated to key codes.
+///
+/// When no client is connected, the server thread waits for a connection and
+/// screen updates cost nothing.
+///
+class TRFBScreenManager
+		: public TNullScreenManager
+{
+public:
+	/// Protocol constants.
+	enum {
+		kDefaultPort = 5900,
+		kTileSize = 16,
+		kRawEncoding = 0,
+		kHextileEncoding = 5,
+		kDesktopSizeEncoding = -223
+	};
+
+	///
+	/// Constructor from a log, a port and dimensions.
+	///
+	/// \param inLog				log interface (can be null)
+	/// \param inPort				TCP port on the loopback interface (0 to
+	///								let the system choose one).
+	/// \param inPortraitWidth		width (in portrait mode).
+	/// \param inPortraitHeight		height (in portrait mode).
+	/// \param inFullScreen			whether we're full screen (and we do
+	///								emulate the rotation).
+	/// \param inScreenIsLandscape	whether the physical screen is in landscape.
+	///
+	TRFBScreenManager(
+		TLog* inLog,
+		KUInt16 inPort = kDefaultPort,
+		KUInt32 inPortraitWidth = kDefaultPortraitWidth,
+		KUInt32 inPortraitHeight = kDefaultPortraitHeight,
+		Boolean inFullScreen = false,
+		Boolean inScreenIsLandscape = true);
+
+	///
+	/// Destructor.
+	/// Disconnects the client and stops the server.
+	///
+	virtual ~TRFBScreenManager(void);
+
+	///
+	/// Determine if the server could be started.
+	///
+	/// \return \c true if the server is listening.
+	///
+	Boolean
+	IsListening(void) const
+	{
+		return mListenSocket >= 0;
+	}
+
+	///
+	/// Accessor on the port the server listens on.
+	///
+	/// \return the TCP port.
+	///
+	KUInt16
+	GetPort(void) const
+	{
+		return mPort;
+	}
+
+	///
+	/// Notify that the screen orientation changed.
+	/// The client is told about the new dimensions with the next update.
+	///
+	/// \param inNewOrientation	the new orientation of the screen.
+	///
+	virtual void ScreenOrientationChanged(
+		EOrientation inNewOrientation);
+
+	///
+	/// Notify that the backlight changed.
+	/// Switches the palette between grays and greens.
+	///
+	/// \param inNewBacklight the new state of the backlight.
+	///
+	virtual void BacklightChanged(Boolean inNewBacklight);
+
+	///
+	/// Notify that some screen bits changed.
+	/// Marks the tiles of the rectangle as dirty, if a client is connected.
+	///
+	/// \param inUpdateRect	rectangle of the bits that changed.
+	///
+	virtual void UpdateScreenRect(SRect* inUpdatedRect);
+
+	///
+	/// Translate an X keysym to a key code.
+	///
+	/// \param inKeysym	keysym from the client.
+	/// \return the key code or 0xFF if the keysym is unknown.
+	///
+	static KUInt8 TranslateKeysym(KUInt32 inKeysym);
+
+private:
+	/// Pixel format of the client.
+	struct SPixelFormat {
+		KUInt8 fBitsPerPixel;
+		KUInt8 fDepth;
+		KUInt8 fBigEndian;
+		KUInt8 fTrueColor;
+		KUInt16 fRedMax;
+		KUInt16 fGreenMax;
+		KUInt16 fBlueMax;
+		KUInt8 fRedShift;
+		KUInt8 fGreenShift;
+		KUInt8 fBlueShift;
+	};
+
+	///
+	/// Thread loop entry point.
+	///
+	void ServerLoop(void);
+
+	///
+	/// Wake the server thread up.
+	///
+	void Wake(void);
+
+	///
+	/// Accept a connection and perform the handshake.
+	///
+	void AcceptClient(void);
+
+	///
+	/// Close the connection with the client.
+	///
+	void CloseClient(void);
+
+	///
+	/// Read and handle a message from the client.
+	///
+	/// \return \c false if the connection should be closed.
+	///
+	Boolean HandleClientMessage(void);
+
+	///
+	/// Send a framebuffer update with the dirty tiles.
+	///
+	/// \return \c false if the connection should be closed.
+	///
+	Boolean SendUpdate(void);
+
+	///
+	/// Mark the tiles of a rectangle as dirty.
+	/// The mutex must be held.
+	///
+	/// \param inTop		top of the rectangle.
+	/// \param inLeft		left of the rectangle.
+	/// \param inBottom		bottom of the rectangle (excluded).
+	/// \param inRight		right of the rectangle (excluded).
+	///
+	void MarkDirty(
+		KUInt32 inTop,
+		KUInt32 inLeft,
+		KUInt32 inBottom,
+		KUInt32 inRight);
+
+	///
+	/// Resize the tile grid to the screen and mark everything as dirty.
+	/// The mutex must be held.
+	///
+	void ResetTiles(void);
+
+	///
+	/// Compute the pixels of the 16 gray levels in the format of the client.
+	///
+	/// \param inBacklight	whether the backlight is on.
+	///
+	void ComputePalette(Boolean inBacklight);
+
+	///
+	/// Append a pixel in the format of the client to mOutput.
+	///
+	/// \param inPixel	pixel value.
+	///
+	void AppendPixel(KUInt32 inPixel);
+
+	///
+	/// Append a tile with the Hextile encoding to mOutput.
+	///
+	/// \param inRowBytes	bytes per row of the screen buffer.
+	/// \param inTop		top of the tile.
+	/// \param inLeft		left of the tile.
+	/// \param inBottom		bottom of the tile (excluded).
+	/// \param inRight		right of the tile (excluded).
+	///
+	void AppendHextileTile(
+		KUInt32 inRowBytes,
+		KUInt32 inTop,
+		KUInt32 inLeft,
+		KUInt32 inBottom,
+		KUInt32 inRight);
+
+	///
+	/// Read bytes from the client.
+	///
+	/// \param outBuffer	buffer for the bytes.
+	/// \param inCount		number of bytes to read.
+	/// \return \c false if the connection was closed.
+	///
+	Boolean ReadClient(void* outBuffer, KUInt32 inCount);
+
+	///
+	/// Write bytes to the client.
+	///
+	/// \param inBuffer		bytes to write.
+	/// \param inCount		number of bytes to write.
+	/// \return \c false if the connection was closed.
+	///
+	Boolean WriteClient(const void* inBuffer, KUInt32 inCount);
+
+	/// \name Variables
+	int mListenSocket; ///< Listening socket.
+	int mClientSocket; ///< Socket of the client, or -1.
+	int mWakePipe[2]; ///< Pipe to wake the server thread up.
+	KUInt16 mPort; ///< Port we listen on.
+	std::thread* mThread; ///< Server thread.
+	std::atomic<bool> mConnected; ///< Whether a client is connected.
+	std::atomic<bool> mQuit; ///< Whether the thread should exit.
+	TMutex* mMutex; ///< Mutex for the variables shared with the thread.
+	KUInt32 mTilesWidth; ///< Columns of the tile grid.
+	KUInt32 mTilesHeight; ///< Rows of the tile grid.
+	KUInt32 mGridWidth; ///< Screen width of the tile grid.
+	KUInt32 mGridHeight; ///< Screen height of the tile grid.
+	std::vector<Boolean> mDirtyTiles; ///< Tiles to send.
+	Boolean mDirty; ///< Whether a tile is dirty.
+	Boolean mWakePending; ///< Whether a wake up is pending.
+	Boolean mPaletteChanged; ///< Whether the backlight changed.
+	Boolean mUpdateRequested; ///< Whether the client waits for an update.
+	Boolean mHextile; ///< Whether the client accepts Hextile.
+	Boolean mDesktopSize; ///< Whether the client accepts DesktopSize.
+	Boolean mColorMapPending; ///< Whether the color map must be sent.
+	Boolean mButtonIsDown; ///< Whether the first button is down.
+	KUInt32 mClientWidth; ///< Screen width, as known by the client.
+	KUInt32 mClientHeight; ///< Screen height, as known by the client.
+	SPixelFormat mFormat; ///< Pixel format of the client.
+	KUInt32 mPalette[16]; ///< Pixels of the gray levels.
+	KUInt32 mLastBackground; ///< Background of the last Hextile tile.
+	std::vector<KUInt8> mOutput; ///< Message being built.
+};
+
+#endif
+// _TRFBSCREENMANAGER_H
+
+// ============================================================= //
+// The network is the computer.                                  //
+//                 -- John Gage                                  //
+// ============================================================= //
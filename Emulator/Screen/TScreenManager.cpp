@@ -42,41 +42,196 @@
 
 // ANSI C
 #include <stdlib.h>
+#include <string.h>
 
 // K
 #include <K/Defines/UByteSex.h>
 #include <K/Streams/TStream.h>
+#include <K/Threads/TMutex.h>
 
 // Einstein
 #include "Emulator/TInterruptManager.h"
 #include "Emulator/TMemory.h"
 #include "Emulator/Log/TLog.h"
 #include "Emulator/Platform/TPlatformManager.h"
+#include "Emulator/Screen/TSharedScreenBuffer.h"
+#include "Emulator/Screen/TTabletSampleQueue.h"
 
 // -------------------------------------------------------------------------- //
 // Constantes
 // -------------------------------------------------------------------------- //
 
-// 256*2 samples should really be enough.
-#define kTabletBufferSize 512
-
 #define kPenDownSample 0x0000000D
 #define kPenUpSample 0x0000000E
 #define kInvalidSample 0x0000000F
 
-/// ABCDEFGH -> HGFEDCBA
-inline KUInt32
-Swap_Pixels_FromBigEndian(const KUInt32 inWord)
+// Screen hash tiles, in pixels.
+#define kHashTileWidth 32
+#define kHashTileHeight 32
+
+///
+/// Compute what a blit does to 8 pixels (a word, left pixel in the high
+/// nibble): the destination pixels become (dest & ~clear) | set. The clear
+/// mask is in the high word, the set bits in the low word, so that both can
+/// be moved around together.
+///
+inline KUInt64
+BlitBits(KUInt32 inChunk, KUInt32 inMask, KUInt32 inMode)
+{
+	if (inMode == 0)
+	{
+		// srcCopy
+		return (((KUInt64) inMask) << 32) | ((~inChunk) & inMask);
+	} else
+	{
+		return ((KUInt64) (inChunk & inMask)) << 32;
+	}
+}
+
+///
+/// Reverse the order of the pixels of both words: ABCDEFGH -> HGFEDCBA.
+///
+inline KUInt64
+ReversePixels(KUInt64 inBits)
+{
+	inBits = ((inBits >> 4) & 0x0F0F0F0F0F0F0F0FULL)
+		| ((inBits & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	inBits = ((inBits >> 8) & 0x00FF00FF00FF00FFULL)
+		| ((inBits & 0x00FF00FF00FF00FFULL) << 8);
+	return ((inBits >> 16) & 0x0000FFFF0000FFFFULL)
+		| ((inBits & 0x0000FFFF0000FFFFULL) << 16);
+}
+
+///
+/// Transpose a block of 8x8 pixels: pixel x of row y becomes pixel y of
+/// row x. Quarters are swapped, then 2x2 squares, then pixels, for the clear
+/// masks and the set bits at once.
+///
+inline void
+TransposeBlock(KUInt64 ioRows[8])
+{
+	int index;
+	for (index = 0; index < 4; index++)
+	{
+		KUInt64 theTop = ioRows[index];
+		KUInt64 theBottom = ioRows[index + 4];
+		ioRows[index] = (theTop & 0xFFFF0000FFFF0000ULL)
+			| ((theBottom >> 16) & 0x0000FFFF0000FFFFULL);
+		ioRows[index + 4] = ((theTop << 16) & 0xFFFF0000FFFF0000ULL)
+			| (theBottom & 0x0000FFFF0000FFFFULL);
+	}
+	for (index = 0; index < 8; index++)
+	{
+		if (index & 2)
+		{
+			continue;
+		}
+		KUInt64 theTop = ioRows[index];
+		KUInt64 theBottom = ioRows[index + 2];
+		ioRows[index] = (theTop & 0xFF00FF00FF00FF00ULL)
+			| ((theBottom >> 8) & 0x00FF00FF00FF00FFULL);
+		ioRows[index + 2] = ((theTop << 8) & 0xFF00FF00FF00FF00ULL)
+			| (theBottom & 0x00FF00FF00FF00FFULL);
+	}
+	for (index = 0; index < 8; index += 2)
+	{
+		KUInt64 theTop = ioRows[index];
+		KUInt64 theBottom = ioRows[index + 1];
+		ioRows[index] = (theTop & 0xF0F0F0F0F0F0F0F0ULL)
+			| ((theBottom >> 4) & 0x0F0F0F0F0F0F0F0FULL);
+		ioRows[index + 1] = ((theTop << 4) & 0xF0F0F0F0F0F0F0F0ULL)
+			| (theBottom & 0x0F0F0F0F0F0F0F0FULL);
+	}
+}
+
+///
+/// Apply 8 pixels computed by BlitBits to a row of the screen buffer, at
+/// any pixel position. Pixels outside of the row are ignored.
+///
+inline void
+CombinePixels(KUInt8* inRow, int inX, KUInt64 inBits, int inRowPixels)
+{
+	KUInt32 theClear = (KUInt32) (inBits >> 32);
+	KUInt32 theSet = (KUInt32) inBits;
+	if (((inX & 0x07) == 0) && (inX >= 0) && (inX + 8 <= inRowPixels))
+	{
+		KUInt32* theWord = (KUInt32*) (inRow + (inX / 2));
+		if (theClear == 0xFFFFFFFF)
+		{
+			*theWord = UByteSex_ToBigEndian(theSet);
+		} else
+		{
+			*theWord = UByteSex_ToBigEndian(
+				(UByteSex_FromBigEndian(*theWord) & ~theClear) | theSet);
+		}
+	} else
+	{
+		int index;
+		for (index = 0; index < 8; index++)
+		{
+			int theX = inX + index;
+			int theShift = 28 - (index * 4);
+			KUInt8 theClearNibble = (theClear >> theShift) & 0x0F;
+			KUInt8 theSetNibble = (theSet >> theShift) & 0x0F;
+			if ((theX < 0) || (theX >= inRowPixels) || (theClearNibble == 0))
+			{
+				continue;
+			}
+			KUInt8* theByte = inRow + (theX / 2);
+			if (theX & 1)
+			{
+				*theByte = (*theByte & ~theClearNibble) | theSetNibble;
+			} else
+			{
+				*theByte = (*theByte & ~(theClearNibble << 4))
+					| (theSetNibble << 4);
+			}
+		}
+	}
+}
+
+///
+/// Final mix of a 64 bits hash (from MurmurHash3).
+///
+inline KUInt64
+MixHash(KUInt64 inHash)
+{
+	inHash ^= inHash >> 33;
+	inHash *= 0xFF51AFD7ED558CCDULL;
+	inHash ^= inHash >> 33;
+	inHash *= 0xC4CEB9FE1A85EC53ULL;
+	inHash ^= inHash >> 33;
+	return inHash;
+}
+
+///
+/// Hash the pixels of a tile of the screen buffer. Pixels are read as big
+/// endian words, so the hash is the same on every host.
+///
+inline KUInt64
+HashTile(const KUInt8* inRow, KUInt32 inRowBytes, KUInt32 inTileBytes, KUInt32 inRows)
 {
-	// ABCDEFGH -> GHEFCDAB
-#if TARGET_RT_LITTLE_ENDIAN
-	return (inWord >> 4 & 0x0F0F0F0F)
-		| (inWord << 4 & 0xF0F0F0F0);
-#else
-	KUInt32 Swapped1 = UByteSex::Swap(inWord);
-	return (Swapped1 >> 4 & 0x0F0F0F0F)
-		| (Swapped1 << 4 & 0xF0F0F0F0);
-#endif
+	KUInt64 theHash = inTileBytes;
+	for (KUInt32 indexRow = 0; indexRow < inRows; indexRow++)
+	{
+		KUInt32 indexByte = 0;
+		for (; indexByte + 8 <= inTileBytes; indexByte += 8)
+		{
+			KUInt32 theWords[2];
+			::memcpy(theWords, inRow + indexByte, 8);
+			KUInt64 theLane = (((KUInt64) UByteSex_FromBigEndian(theWords[0])) << 32)
+				| UByteSex_FromBigEndian(theWords[1]);
+			theHash ^= theLane * 0x9E3779B97F4A7C15ULL;
+			theHash = ((theHash << 31) | (theHash >> 33)) * 0xC2B2AE3D27D4EB4FULL;
+		}
+		for (; indexByte < inTileBytes; indexByte++)
+		{
+			theHash ^= inRow[indexByte] * 0x9E3779B97F4A7C15ULL;
+			theHash = ((theHash << 31) | (theHash >> 33)) * 0xC2B2AE3D27D4EB4FULL;
+		}
+		inRow += inRowBytes;
+	}
+	return MixHash(theHash);
 }
 
 // -------------------------------------------------------------------------- //
@@ -101,24 +256,55 @@ TScreenManager::TScreenManager(
 		mTabletIsDown(false),
 		mPenIsDown(false),
 		mTabletSampleRate(kDefaultSampleRate),
-		mTabletBuffer(NULL),
-		mTabletBufCCrsr(0),
-		mTabletBufPCrsr(0),
+		mTabletQueue(nil),
+		mPenMutex(nil),
 		mTabletOrientation(kOrientation_Default),
 		mScreenOrientation(kOrientation_Default),
 		mContrast(kDefaultContrast),
 		mBacklight(false),
 		mKbdIsConnected(true),
 		mScreenBuffer(NULL),
+		mDamaged(false),
+		mFrameRate(kDefaultFrameRate),
+		mFrameScheduled(false),
+		mLastPresentTime(0),
+		mBlitCount(0),
+		mPresentCount(0),
+		mDamageMutex(nil),
+		mHashMutex(nil),
+		mHashWidth(0),
+		mHashHeight(0),
+		mHashSum(0),
+		mSharedBuffer(nil),
 		mOverlayIsOn(false)
 {
-	mTabletBuffer = (KUInt32*) ::calloc(1, sizeof(KUInt32) * kTabletBufferSize);
+	mHashMutex = new TMutex();
+	mDamageMutex = new TMutex();
+	mTabletQueue = new TTabletSampleQueue();
+	mPenMutex = new TMutex();
 	mScreenBuffer = NULL;
 	memset(mOverlayIsDirty, 0, sizeof(mOverlayIsDirty));
 	memset(mOverlay, 0, sizeof(mOverlay));
 	ChangeScreenSize(inPortraitWidth, inPortraitHeight);
 }
 
+// -------------------------------------------------------------------------- //
+//  * SetInterruptManager( TInterruptManager* )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::SetInterruptManager(TInterruptManager* inManager)
+{
+	if (mInterruptManager && (mInterruptManager != inManager))
+	{
+		// The callback locks the damage mutex: cancel it without the mutex.
+		mInterruptManager->CancelCallback(this);
+		mDamageMutex->Lock();
+		mFrameScheduled = false;
+		mDamageMutex->Unlock();
+	}
+	mInterruptManager = inManager;
+}
+
 // -------------------------------------------------------------------------- //
 //  * ChangeScreenSize( int, int )
 //  Calling this requires a reboot.
@@ -129,10 +315,27 @@ TScreenManager::ChangeScreenSize(int inPortraitWidth, int inPortraitHeight)
 	mPortraitWidth = inPortraitWidth;
 	mPortraitHeight = inPortraitHeight;
 
-	if (mScreenBuffer)
+	KUInt32 theBufferSize = inPortraitWidth * inPortraitHeight * kBitsPerPixel / 8;
+	if (mSharedBuffer)
+	{
+		// Readers map the region again when they see the new size.
+		mScreenBuffer = mSharedBuffer->Resize(theBufferSize);
+		if (mScreenBuffer == nil)
+		{
+			delete mSharedBuffer;
+			mSharedBuffer = nil;
+		}
+	} else if (mScreenBuffer)
+	{
 		::free(mScreenBuffer);
+		mScreenBuffer = nil;
+	}
 
-	mScreenBuffer = (KUInt8*) ::calloc(1, inPortraitWidth * inPortraitHeight * kBitsPerPixel / 8);
+	if (mScreenBuffer == nil)
+	{
+		mScreenBuffer = (KUInt8*) ::calloc(1, theBufferSize);
+	}
+	InvalidateScreenHash();
 
 	if (mFullScreen)
 	{
@@ -165,6 +368,8 @@ TScreenManager::ChangeScreenSize(int inPortraitWidth, int inPortraitHeight)
 	mOverlayRect.fLeft = 0;
 	mOverlayRect.fRight = static_cast<KUInt16>(GetScreenWidth());
 	mOverlayRect.fBottom = static_cast<KUInt16>(GetScreenHeight());
+
+	PublishScreenBuffer(nil);
 }
 
 // -------------------------------------------------------------------------- //
@@ -172,14 +377,33 @@ TScreenManager::ChangeScreenSize(int inPortraitWidth, int inPortraitHeight)
 // -------------------------------------------------------------------------- //
 TScreenManager::~TScreenManager(void)
 {
-	if (mTabletBuffer)
+	if (mInterruptManager)
+	{
+		mInterruptManager->CancelCallback(this);
+	}
+	if (mTabletQueue)
+	{
+		delete mTabletQueue;
+	}
+	if (mPenMutex)
 	{
-		::free(mTabletBuffer);
+		delete mPenMutex;
 	}
-	if (mScreenBuffer)
+	if (mSharedBuffer)
+	{
+		delete mSharedBuffer;
+	} else if (mScreenBuffer)
 	{
 		::free(mScreenBuffer);
 	}
+	if (mHashMutex)
+	{
+		delete mHashMutex;
+	}
+	if (mDamageMutex)
+	{
+		delete mDamageMutex;
+	}
 }
 
 // -------------------------------------------------------------------------- //
@@ -207,10 +431,10 @@ TScreenManager::Blit(
 	// Call the proper function depending on the orientation.
 	if (mFullScreen)
 	{
-		switch (mScreenOrientation)
+		switch (GetQuarterTurns())
 		{
-			case kOrientation_AppleTop:
-				Blit_270(
+			case 0:
+				Blit_0(
 					baseAddy,
 					srcRowBytes,
 					pixmapTop,
@@ -219,9 +443,8 @@ TScreenManager::Blit(
 					inDstRect,
 					inMode);
 				break;
-			case kOrientation_AppleLeft:
-			case kOrientation_AppleRight:
-				Blit_0(
+			case 1:
+				Blit_90(
 					baseAddy,
 					srcRowBytes,
 					pixmapTop,
@@ -230,8 +453,8 @@ TScreenManager::Blit(
 					inDstRect,
 					inMode);
 				break;
-			case kOrientation_AppleBottom:
-				Blit_90(
+			case 2:
+				Blit_180(
 					baseAddy,
 					srcRowBytes,
 					pixmapTop,
@@ -240,9 +463,8 @@ TScreenManager::Blit(
 					inDstRect,
 					inMode);
 				break;
-				/* FIXME: Matt sais: Blit_180 seems broken.
-			case kOrientation_AppleLeft:
-				Blit_180(
+			case 3:
+				Blit_270(
 					baseAddy,
 					srcRowBytes,
 					pixmapTop,
@@ -250,8 +472,7 @@ TScreenManager::Blit(
 					inSrcRect,
 					inDstRect,
 					inMode);
-			break;
-				 */
+				break;
 		}
 	} else
 	{
@@ -397,7 +618,7 @@ TScreenManager::Blit_0(
 	}
 
 	// Tell the implementation that the screen was updated.
-	UpdateScreenRect(inDstRect);
+	DamageRect(inDstRect);
 }
 
 // -------------------------------------------------------------------------- //
@@ -413,407 +634,639 @@ TScreenManager::Blit_90(
 	SRect* inDstRect,
 	KUInt32 inMode)
 {
-	// We copy more pixels than what we should.
-	KUInt16 srcLeft = inSrcRect->fLeft - inPixmapLeft;
-	KUInt16 dstLeft = inDstRect->fLeft;
+	Blit_Rotated(
+		inBaseAddy,
+		inSrcRowBytes,
+		inPixmapTop,
+		inPixmapLeft,
+		inSrcRect,
+		inDstRect,
+		inMode,
+		1);
+}
 
-	KUInt16 additionalLeftPixels = srcLeft & 0x07;
-	dstLeft -= additionalLeftPixels;
-	srcLeft -= additionalLeftPixels;
-	KUInt32 leftMask = (KUInt32) (0xFFFFFFFF >> (additionalLeftPixels * 4));
-	KUInt16 srcRight = inSrcRect->fRight - inPixmapLeft;
-	KUInt16 additionalRightPixels = srcRight & 0x07;
-	KUInt32 rightMask;
-	if (additionalRightPixels)
+// -------------------------------------------------------------------------- //
+//  * Blit_180( KUInt32, SRect*, SRect* )
+// -------------------------------------------------------------------------- //
+inline void
+TScreenManager::Blit_180(
+	KUInt32 inBaseAddy,
+	KUInt32 inSrcRowBytes,
+	KUInt16 inPixmapTop,
+	KUInt16 inPixmapLeft,
+	SRect* inSrcRect,
+	SRect* inDstRect,
+	KUInt32 inMode)
+{
+	Blit_Rotated(
+		inBaseAddy,
+		inSrcRowBytes,
+		inPixmapTop,
+		inPixmapLeft,
+		inSrcRect,
+		inDstRect,
+		inMode,
+		2);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Blit_270( KUInt32, SRect*, SRect* )
+// -------------------------------------------------------------------------- //
+inline void
+TScreenManager::Blit_270(
+	KUInt32 inBaseAddy,
+	KUInt32 inSrcRowBytes,
+	KUInt16 inPixmapTop,
+	KUInt16 inPixmapLeft,
+	SRect* inSrcRect,
+	SRect* inDstRect,
+	KUInt32 inMode)
+{
+	Blit_Rotated(
+		inBaseAddy,
+		inSrcRowBytes,
+		inPixmapTop,
+		inPixmapLeft,
+		inSrcRect,
+		inDstRect,
+		inMode,
+		3);
+}
+
+// -------------------------------------------------------------------------- //
+//  * GetQuarterTurns( void ) const
+// -------------------------------------------------------------------------- //
+KUInt32
+TScreenManager::GetQuarterTurns(void) const
+{
+	// Quarter turns from the orientation that fits the physical screen.
+	EOrientation theUpright = kOrientation_AppleRight;
+	if ((mPortraitWidth == mPhysicalWidth)
+		&& (mPortraitHeight == mPhysicalHeight))
 	{
-		additionalRightPixels = 8 - additionalRightPixels;
+		theUpright = kOrientation_AppleBottom;
 	}
-	rightMask = (KUInt32) (0xFFFFFFFF << (additionalRightPixels * 4));
-	srcRight += additionalRightPixels;
+	return (mScreenOrientation - theUpright) & 0x03;
+}
 
-	KUInt32 dstRowBytes = mPhysicalWidth * kBitsPerPixel / 8;
+// -------------------------------------------------------------------------- //
+//  * RotatePoint( KUInt32, int, int, int, int, int*, int* )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::RotatePoint(
+	KUInt32 inQuarterTurns,
+	int inWidth,
+	int inHeight,
+	int inX,
+	int inY,
+	int* outX,
+	int* outY)
+{
+	switch (inQuarterTurns & 0x03)
+	{
+		case 0:
+			*outX = inX;
+			*outY = inY;
+			break;
 
-	KUInt16 srcTop = inSrcRect->fTop - inPixmapTop;
-	KUInt16 srcBottom = inSrcRect->fBottom - inPixmapTop;
-	KUInt32 nbRows = srcBottom - srcTop;
-	KUInt32 indexRows;
-	KUInt32 srcRowAddy = inBaseAddy
-		+ (srcTop * inSrcRowBytes)
-		+ (srcLeft * kBitsPerPixel / 8);
-	KUInt8* dstPixelsRow = mScreenBuffer
-		+ (inDstRect->fTop * dstRowBytes)
-		+ (dstLeft * kBitsPerPixel / 8);
-	KUInt32 srcWidthInBytes = (srcRight - srcLeft)
-		* kBitsPerPixel / 8;
-	KUInt32 chunk;
+		case 1:
+			*outX = inHeight - 1 - inY;
+			*outY = inX;
+			break;
 
-	if (srcWidthInBytes <= 4)
+		case 2:
+			*outX = inWidth - 1 - inX;
+			*outY = inHeight - 1 - inY;
+			break;
+
+		default:
+			*outX = inY;
+			*outY = inWidth - 1 - inX;
+			break;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * Blit_Rotated( KUInt32, SRect*, SRect*, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::Blit_Rotated(
+	KUInt32 inBaseAddy,
+	KUInt32 inSrcRowBytes,
+	KUInt16 inPixmapTop,
+	KUInt16 inPixmapLeft,
+	SRect* inSrcRect,
+	SRect* inDstRect,
+	KUInt32 inMode,
+	KUInt32 inQuarterTurns)
+{
+	// Source words are read on 8 pixels boundaries, as in Blit_0. Pixels
+	// outside of the rectangle are masked out.
+	int srcLeft = inSrcRect->fLeft - inPixmapLeft;
+	int srcRight = inSrcRect->fRight - inPixmapLeft;
+	int srcTop = inSrcRect->fTop - inPixmapTop;
+	int dstTop = inDstRect->fTop;
+	int dstBottom = inDstRect->fBottom;
+	int firstWord = srcLeft / 8;
+	int lastWord = (srcRight + 7) / 8;
+	KUInt32 leftMask = (KUInt32) (0xFFFFFFFF >> ((srcLeft & 0x07) * 4));
+	KUInt32 rightMask = 0xFFFFFFFF;
+	if (srcRight & 0x07)
 	{
-		// Single column
-		KUInt32 theMask = leftMask & rightMask;
-		for (indexRows = nbRows; indexRows != 0; indexRows--)
-		{
-			KUInt32* rowPixels = (KUInt32*) dstPixelsRow;
+		rightMask = (KUInt32) (0xFFFFFFFF << ((8 - (srcRight & 0x07)) * 4));
+	}
 
-			(void) mMemory->Read(srcRowAddy, chunk);
-			KUInt32 originalWord = UByteSex_FromBigEndian(*rowPixels);
-			if (inMode == 0)
-			{
-				// srcCopy
-				originalWord = (originalWord & ~theMask)
-					| ((~chunk) & theMask);
-			} else /* if (inMode == 1) */
+	// Logical (Newton) coordinates are source coordinates plus these.
+	int offsetX = inDstRect->fLeft - srcLeft;
+	int offsetY = dstTop - srcTop;
+	int logicalWidth = (int) GetScreenWidth();
+	int logicalHeight = (int) GetScreenHeight();
+	KUInt32 dstRowBytes = mPhysicalWidth * kBitsPerPixel / 8;
+
+	if (inQuarterTurns == 2)
+	{
+		// Rows are mirrored, pixels are reversed within words.
+		int indexY;
+		for (indexY = dstTop; indexY < dstBottom; indexY++)
+		{
+			KUInt32 srcRowAddy = inBaseAddy
+				+ ((indexY - offsetY) * inSrcRowBytes);
+			int indexWord;
+			for (indexWord = firstWord; indexWord < lastWord; indexWord++)
 			{
-				originalWord = ~((~originalWord) | (chunk & theMask));
+				KUInt32 theMask = 0xFFFFFFFF;
+				if (indexWord == firstWord)
+				{
+					theMask &= leftMask;
+				}
+				if (indexWord == lastWord - 1)
+				{
+					theMask &= rightMask;
+				}
+				KUInt32 chunk;
+				(void) mMemory->Read(srcRowAddy + (indexWord * 4), chunk);
+				KUInt64 theBits = BlitBits(chunk, theMask, inMode);
+				// The last pixel of the word is the leftmost one on the screen.
+				int theDstX;
+				int theDstY;
+				RotatePoint(inQuarterTurns, logicalWidth, logicalHeight,
+					(indexWord * 8) + offsetX + 7, indexY, &theDstX, &theDstY);
+				CombinePixels(
+					mScreenBuffer + (theDstY * dstRowBytes),
+					theDstX,
+					ReversePixels(theBits),
+					mPhysicalWidth);
 			}
-			*rowPixels = UByteSex_ToBigEndian(originalWord);
-
-			srcRowAddy += inSrcRowBytes;
-			dstPixelsRow += dstRowBytes;
 		}
 	} else
 	{
-		for (indexRows = nbRows; indexRows != 0; indexRows--)
+		// Blocks of 8x8 pixels are transposed. Rows of a block are aligned
+		// so that they fill a whole word of the rotated screen.
+		int alignY = (inQuarterTurns == 1) ? (logicalHeight & 0x07) : 0;
+		int blockTop = dstTop - ((dstTop - alignY) & 0x07);
+		for (; blockTop < dstBottom; blockTop += 8)
 		{
-			KUInt32* rowPixels = (KUInt32*) dstPixelsRow;
-
-			// First column.
-			(void) mMemory->Read(srcRowAddy, chunk);
-			KUInt32 originalWord = UByteSex_FromBigEndian(*rowPixels);
-			if (inMode == 0)
+			int indexWord;
+			for (indexWord = firstWord; indexWord < lastWord; indexWord++)
 			{
-				// srcCopy
-				originalWord = (originalWord & (~leftMask))
-					| ((~chunk) & leftMask);
-			} else /* if (inMode == 1) */
-			{
-				originalWord = ~((~originalWord)
-					| (chunk & leftMask));
-			}
-			*rowPixels++ = UByteSex_ToBigEndian(originalWord);
-
-			// Middle columns.
-			KUInt32 srcCursor = srcRowAddy + 4;
-			KUInt32 lastPixAddy = srcRowAddy + srcWidthInBytes - 4;
-			while (srcCursor < lastPixAddy)
-			{
-				(void) mMemory->Read(srcCursor, chunk);
-				srcCursor += 4;
-				if (inMode == 0)
+				KUInt32 theMask = 0xFFFFFFFF;
+				if (indexWord == firstWord)
 				{
-					// srcCopy
-					*rowPixels++ = UByteSex_ToBigEndian(~chunk);
-				} else
+					theMask &= leftMask;
+				}
+				if (indexWord == lastWord - 1)
 				{
-					originalWord = UByteSex_FromBigEndian(*rowPixels);
-					*rowPixels++ = UByteSex_ToBigEndian(~(~originalWord | chunk));
+					theMask &= rightMask;
 				}
-			}
+				KUInt64 theBlock[8];
+				int indexRow;
+				for (indexRow = 0; indexRow < 8; indexRow++)
+				{
+					int theY = blockTop + indexRow;
+					if ((theY >= dstTop) && (theY < dstBottom))
+					{
+						KUInt32 chunk;
+						(void) mMemory->Read(
+							inBaseAddy
+								+ ((theY - offsetY) * inSrcRowBytes)
+								+ (indexWord * 4),
+							chunk);
+						theBlock[indexRow] = BlitBits(chunk, theMask, inMode);
+					} else
+					{
+						theBlock[indexRow] = 0;
+					}
+				}
+				TransposeBlock(theBlock);
 
-			// Last column.
-			(void) mMemory->Read(srcCursor, chunk);
-			originalWord = UByteSex_FromBigEndian(*rowPixels);
-			if (inMode == 0)
-			{
-				// srcCopy
-				originalWord = (originalWord & (~rightMask))
-					| ((~chunk) & rightMask);
-			} else /* if (inMode == 1) */
-			{
-				originalWord = ~((~originalWord)
-					| (chunk & rightMask));
+				int theX = (indexWord * 8) + offsetX;
+				for (indexRow = 0; indexRow < 8; indexRow++)
+				{
+					// Row indexRow of the block was column theX + indexRow.
+					// Its leftmost pixel on the screen was at the bottom of
+					// the block when turning clockwise, at the top otherwise.
+					int theDstY;
+					int theDstX;
+					KUInt64 theBits = theBlock[indexRow];
+					if (inQuarterTurns == 1)
+					{
+						RotatePoint(inQuarterTurns, logicalWidth, logicalHeight,
+							theX + indexRow, blockTop + 7, &theDstX, &theDstY);
+						theBits = ReversePixels(theBits);
+					} else
+					{
+						RotatePoint(inQuarterTurns, logicalWidth, logicalHeight,
+							theX + indexRow, blockTop, &theDstX, &theDstY);
+					}
+					if ((theBits != 0)
+						&& (theDstY >= 0)
+						&& (theDstY < (int) mPhysicalHeight))
+					{
+						CombinePixels(
+							mScreenBuffer + (theDstY * dstRowBytes),
+							theDstX,
+							theBits,
+							mPhysicalWidth);
+					}
+				}
 			}
-			*rowPixels = UByteSex_ToBigEndian(originalWord);
-
-			srcRowAddy += inSrcRowBytes;
-			dstPixelsRow += dstRowBytes;
 		}
 	}
 
 	// Tell the implementation that the screen was updated.
-	UpdateScreenRect(inDstRect);
+	int theLeft;
+	int theTop;
+	int theRight;
+	int theBottom;
+	RotatePoint(inQuarterTurns, logicalWidth, logicalHeight,
+		inDstRect->fLeft, inDstRect->fTop, &theLeft, &theTop);
+	RotatePoint(inQuarterTurns, logicalWidth, logicalHeight,
+		inDstRect->fRight - 1, inDstRect->fBottom - 1, &theRight, &theBottom);
+	SRect theDstRect;
+	theDstRect.fTop = (KUInt16) ((theTop < theBottom) ? theTop : theBottom);
+	theDstRect.fBottom = (KUInt16) (((theTop < theBottom) ? theBottom : theTop) + 1);
+	theDstRect.fLeft = (KUInt16) ((theLeft < theRight) ? theLeft : theRight);
+	theDstRect.fRight = (KUInt16) (((theLeft < theRight) ? theRight : theLeft) + 1);
+	DamageRect(&theDstRect);
 }
 
 // -------------------------------------------------------------------------- //
-//  * Blit_180( KUInt32, SRect*, SRect* )
-// FIXME: this function is quite different to Blit_0. Blit_0 is working for me.
+//  * DamageRect( const SRect* )
 // -------------------------------------------------------------------------- //
-inline void
-TScreenManager::Blit_180(
-	KUInt32 inBaseAddy,
-	KUInt32 inSrcRowBytes,
-	KUInt16 inPixmapTop,
-	KUInt16 inPixmapLeft,
-	SRect* inSrcRect,
-	SRect* inDstRect,
-	KUInt32 inMode)
+void
+TScreenManager::DamageRect(const SRect* inRect)
 {
-	// We copy more pixels than what we should.
-	KUInt16 srcLeft = inSrcRect->fLeft - inPixmapLeft;
-	KUInt16 dstLeft = inDstRect->fLeft;
+	mBlitCount++;
 
-	KUInt16 additionalLeftPixels = srcLeft & 0x07;
-	dstLeft -= additionalLeftPixels;
-	srcLeft -= additionalLeftPixels;
-	KUInt32 leftMask = (KUInt32) (0xFFFFFFFF >> (additionalLeftPixels * 4));
-	KUInt16 srcRight = inSrcRect->fRight - inPixmapLeft;
-	KUInt16 additionalRightPixels = srcRight & 0x07;
-	KUInt32 rightMask;
-	if (additionalRightPixels)
+	// Mark the tiles to hash again.
+	mHashMutex->Lock();
+	if (!mDirtyTiles.empty())
 	{
-		additionalRightPixels = 8 - additionalRightPixels;
+		KUInt32 theTilesPerRow = (mHashWidth + kHashTileWidth - 1) / kHashTileWidth;
+		KUInt32 theTileRows = (mHashHeight + kHashTileHeight - 1) / kHashTileHeight;
+		KUInt32 theFirstX = inRect->fLeft / kHashTileWidth;
+		KUInt32 theFirstY = inRect->fTop / kHashTileHeight;
+		KUInt32 theLastX = (inRect->fRight + kHashTileWidth - 1) / kHashTileWidth;
+		KUInt32 theLastY = (inRect->fBottom + kHashTileHeight - 1) / kHashTileHeight;
+		if (theLastX > theTilesPerRow)
+		{
+			theLastX = theTilesPerRow;
+		}
+		if (theLastY > theTileRows)
+		{
+			theLastY = theTileRows;
+		}
+		for (KUInt32 indexY = theFirstY; indexY < theLastY; indexY++)
+		{
+			for (KUInt32 indexX = theFirstX; indexX < theLastX; indexX++)
+			{
+				mDirtyTiles[(indexY * theTilesPerRow) + indexX] = true;
+			}
+		}
 	}
-	rightMask = (KUInt32) (0xFFFFFFFF << (additionalRightPixels * 4));
-	srcRight += additionalRightPixels;
+	mHashMutex->Unlock();
 
-	KUInt32 dstRowBytes = mPhysicalWidth * kBitsPerPixel / 8;
+	mDamageMutex->Lock();
+	if (mDamaged)
+	{
+		if (inRect->fTop < mDamageRect.fTop)
+		{
+			mDamageRect.fTop = inRect->fTop;
+		}
+		if (inRect->fLeft < mDamageRect.fLeft)
+		{
+			mDamageRect.fLeft = inRect->fLeft;
+		}
+		if (inRect->fBottom > mDamageRect.fBottom)
+		{
+			mDamageRect.fBottom = inRect->fBottom;
+		}
+		if (inRect->fRight > mDamageRect.fRight)
+		{
+			mDamageRect.fRight = inRect->fRight;
+		}
+	} else
+	{
+		mDamageRect = *inRect;
+		mDamaged = true;
+	}
 
-	KUInt16 srcTop = inSrcRect->fTop - inPixmapTop;
-	KUInt16 srcBottom = inSrcRect->fBottom - inPixmapTop;
-	KUInt32 nbRows = srcBottom - srcTop;
-	KUInt32 indexRows;
-	KUInt32 srcRowAddy = inBaseAddy
-		+ (srcTop * inSrcRowBytes)
-		+ (srcLeft * kBitsPerPixel / 8);
-	KUInt8* dstPixelsRow = mScreenBuffer
-		+ ((mPhysicalHeight - inDstRect->fTop - 1) * dstRowBytes)
-		+ ((mPhysicalWidth - dstLeft) * kBitsPerPixel / 8);
-	KUInt32 srcWidthInBytes = (srcRight - srcLeft)
-		* kBitsPerPixel / 8;
-	KUInt32 chunk;
+	// The first blit after a pause is presented at once, the following
+	// ones wait for the end of the frame, when the timer presents them.
+	KUInt32 theFrameTicksLeft = GetFrameTicksLeft();
+	Boolean scheduleFrame = false;
+	if (theFrameTicksLeft == 0)
+	{
+		PresentDamage();
+	} else if (!mFrameScheduled)
+	{
+		mFrameScheduled = true;
+		scheduleFrame = true;
+	}
+	mDamageMutex->Unlock();
 
-	if (srcWidthInBytes <= 4)
+	// The timer waits for the callback to return, and the callback locks
+	// the damage mutex: schedule it without the mutex.
+	if (scheduleFrame)
 	{
-		// Single column
-		KUInt32 theMask = leftMask & rightMask;
-		for (indexRows = nbRows; indexRows != 0; indexRows--)
-		{
-			KUInt32* rowPixels = (KUInt32*) dstPixelsRow;
+		mInterruptManager->ScheduleCallback(this, theFrameTicksLeft);
+	}
+}
 
-			(void) mMemory->Read(srcRowAddy, chunk);
-			// Swap the word.
-			--rowPixels;
-			KUInt32 originalWord = Swap_Pixels_FromBigEndian(*rowPixels);
-			if (inMode == 0)
-			{
-				// srcCopy
-				originalWord = (originalWord & ~theMask)
-					| ((~chunk) & theMask);
-			} else /* if (inMode == 1) */
-			{
-				originalWord = ~((~originalWord) | (chunk & theMask));
-			}
-			// Swap the word again.
-			*rowPixels = Swap_Pixels_FromBigEndian(originalWord);
+// -------------------------------------------------------------------------- //
+//  * TimerCallback( KUInt32 )
+// -------------------------------------------------------------------------- //
+KUInt32
+TScreenManager::TimerCallback(KUInt32 /* inTimer */)
+{
+	mDamageMutex->Lock();
+	// A blit may have presented since the callback was scheduled.
+	KUInt32 theFrameTicksLeft = mDamaged ? GetFrameTicksLeft() : 0;
+	if (theFrameTicksLeft == 0)
+	{
+		PresentDamage();
+		mFrameScheduled = false;
+	}
+	mDamageMutex->Unlock();
 
-			srcRowAddy += inSrcRowBytes;
-			dstPixelsRow -= dstRowBytes;
+	return theFrameTicksLeft;
+}
+
+// -------------------------------------------------------------------------- //
+//  * FlushDamage( void )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::FlushDamage(void)
+{
+	mDamageMutex->Lock();
+	PresentDamage();
+	mDamageMutex->Unlock();
+}
+
+// -------------------------------------------------------------------------- //
+//  * GetFrameTicksLeft( void ) const
+// -------------------------------------------------------------------------- //
+KUInt32
+TScreenManager::GetFrameTicksLeft(void) const
+{
+	KUInt32 theFrameRate = mFrameRate.load(std::memory_order_relaxed);
+	if ((theFrameRate == 0) || (mInterruptManager == nil))
+	{
+		return 0;
+	}
+
+	KUInt32 theFrameTicks = TInterruptManager::kTicksPerSecond / theFrameRate;
+	KUInt32 theElapsed = mInterruptManager->GetTimer() - mLastPresentTime;
+	return (theElapsed >= theFrameTicks) ? 0 : (theFrameTicks - theElapsed);
+}
+
+// -------------------------------------------------------------------------- //
+//  * PresentDamage( void )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::PresentDamage(void)
+{
+	if (mDamaged)
+	{
+		mDamaged = false;
+		mPresentCount++;
+		if (mInterruptManager)
+		{
+			mLastPresentTime = mInterruptManager->GetTimer();
 		}
-	} else
+		SRect theRect = mDamageRect;
+		PublishScreenBuffer(&theRect);
+		UpdateScreenRect(&theRect);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * GetScreenHash( void )
+// -------------------------------------------------------------------------- //
+KUInt64
+TScreenManager::GetScreenHash(void)
+{
+	mHashMutex->Lock();
+	KUInt32 theWidth = GetActualScreenWidth();
+	KUInt32 theHeight = GetActualScreenHeight();
+	KUInt32 theTilesPerRow = (theWidth + kHashTileWidth - 1) / kHashTileWidth;
+	KUInt32 theTileRows = (theHeight + kHashTileHeight - 1) / kHashTileHeight;
+	if ((theWidth != mHashWidth) || (theHeight != mHashHeight)
+		|| (mDirtyTiles.size() != theTilesPerRow * theTileRows))
 	{
-		for (indexRows = nbRows; indexRows != 0; indexRows--)
+		// Rotated or invalidated: hash every tile.
+		mHashWidth = theWidth;
+		mHashHeight = theHeight;
+		mHashSum = 0;
+		mTileHashes.assign(theTilesPerRow * theTileRows, 0);
+		mDirtyTiles.assign(theTilesPerRow * theTileRows, true);
+		for (KUInt32 indexTile = 0; indexTile < mTileHashes.size(); indexTile++)
 		{
-			KUInt32* rowPixels = (KUInt32*) dstPixelsRow;
+			mHashSum += MixHash(indexTile);
+		}
+	}
 
-			// First column.
-			(void) mMemory->Read(srcRowAddy, chunk);
-			// Swap the word.
-			--rowPixels;
-			KUInt32 originalWord = Swap_Pixels_FromBigEndian(*rowPixels);
-			if (inMode == 0)
-			{
-				// srcCopy
-				originalWord = (originalWord & (~leftMask))
-					| ((~chunk) & leftMask);
-			} else /* if (inMode == 1) */
+	// Each tile contributes a mix of its hash and its position, so that the
+	// sum can be updated one tile at a time.
+	KUInt32 theRowBytes = theWidth * kBitsPerPixel / 8;
+	for (KUInt32 indexY = 0; indexY < theTileRows; indexY++)
+	{
+		for (KUInt32 indexX = 0; indexX < theTilesPerRow; indexX++)
+		{
+			KUInt32 indexTile = (indexY * theTilesPerRow) + indexX;
+			if (!mDirtyTiles[indexTile])
 			{
-				originalWord = ~((~originalWord)
-					| (chunk & leftMask));
+				continue;
 			}
-			// Swap the word again.
-			*rowPixels-- = Swap_Pixels_FromBigEndian(originalWord);
-
-			// Middle columns.
-			KUInt32 srcCursor = srcRowAddy + 4;
-			KUInt32 lastPixAddy = srcRowAddy + srcWidthInBytes - 4;
-			while (srcCursor < lastPixAddy)
+			mDirtyTiles[indexTile] = false;
+			KUInt32 theLeft = indexX * kHashTileWidth;
+			KUInt32 theTop = indexY * kHashTileHeight;
+			KUInt32 theTileWidth = theWidth - theLeft;
+			if (theTileWidth > kHashTileWidth)
 			{
-				(void) mMemory->Read(srcCursor, chunk);
-				srcCursor += 4;
-				if (inMode == 0)
-				{
-					// srcCopy
-					*rowPixels-- = Swap_Pixels_FromBigEndian(~chunk);
-				} else
-				{
-					originalWord = Swap_Pixels_FromBigEndian(*rowPixels);
-					*rowPixels-- = Swap_Pixels_FromBigEndian(~(~originalWord | chunk));
-				}
+				theTileWidth = kHashTileWidth;
 			}
-
-			// Last column.
-			(void) mMemory->Read(srcCursor, chunk);
-			// Swap.
-			originalWord = Swap_Pixels_FromBigEndian(*rowPixels);
-			if (inMode == 0)
+			KUInt32 theTileHeight = theHeight - theTop;
+			if (theTileHeight > kHashTileHeight)
 			{
-				// srcCopy
-				originalWord = (originalWord & (~rightMask))
-					| ((~chunk) & rightMask);
-			} else /* if (inMode == 1) */
-			{
-				originalWord = ~((~originalWord)
-					| (chunk & rightMask));
+				theTileHeight = kHashTileHeight;
 			}
-			// Swap again.
-			*rowPixels = Swap_Pixels_FromBigEndian(originalWord);
-
-			srcRowAddy += inSrcRowBytes;
-			dstPixelsRow -= dstRowBytes;
+			KUInt64 theTileHash = HashTile(
+				mScreenBuffer + (theTop * theRowBytes) + (theLeft * kBitsPerPixel / 8),
+				theRowBytes,
+				(theTileWidth * kBitsPerPixel + 7) / 8,
+				theTileHeight);
+			mHashSum -= MixHash(mTileHashes[indexTile] ^ indexTile);
+			mHashSum += MixHash(theTileHash ^ indexTile);
+			mTileHashes[indexTile] = theTileHash;
 		}
 	}
+	KUInt64 theHash = MixHash(mHashSum ^ (((KUInt64) theWidth << 16) | theHeight));
+	mHashMutex->Unlock();
 
-	// Tell the implementation that the screen was updated.
-	SRect theDstRect;
-	theDstRect.fTop = mPhysicalHeight - inDstRect->fBottom;
-	theDstRect.fBottom = mPhysicalHeight - inDstRect->fTop;
-	theDstRect.fLeft = mPhysicalWidth - inDstRect->fRight;
-	theDstRect.fRight = mPhysicalWidth - inDstRect->fLeft;
-	UpdateScreenRect(&theDstRect);
+	return theHash;
 }
 
 // -------------------------------------------------------------------------- //
-//  * Blit_270( KUInt32, SRect*, SRect* )
+//  * InvalidateScreenHash( void )
 // -------------------------------------------------------------------------- //
-inline void
-TScreenManager::Blit_270(
-	KUInt32 inBaseAddy,
-	KUInt32 inSrcRowBytes,
-	KUInt16 inPixmapTop,
-	KUInt16 inPixmapLeft,
-	SRect* inSrcRect,
-	SRect* inDstRect,
-	KUInt32 inMode)
+void
+TScreenManager::InvalidateScreenHash(void)
 {
-	// We copy more pixels than what we should.
-	KUInt16 srcLeft = inSrcRect->fLeft - inPixmapLeft;
-	KUInt16 dstLeft = inDstRect->fLeft;
+	mHashMutex->Lock();
+	mDirtyTiles.clear();
+	mTileHashes.clear();
+	mHashMutex->Unlock();
+}
 
-	KUInt16 additionalLeftPixels = srcLeft & 0x07;
-	dstLeft -= additionalLeftPixels;
-	srcLeft -= additionalLeftPixels;
-	KUInt32 leftMask = (KUInt32) (0xFFFFFFFF >> (additionalLeftPixels * 4));
-	KUInt16 srcRight = inSrcRect->fRight - inPixmapLeft;
-	KUInt16 additionalRightPixels = srcRight & 0x07;
-	KUInt32 rightMask;
-	if (additionalRightPixels)
+// -------------------------------------------------------------------------- //
+//  * ExportScreenBuffer( const char* )
+// -------------------------------------------------------------------------- //
+Boolean
+TScreenManager::ExportScreenBuffer(const char* inName)
+{
+	if (mSharedBuffer)
 	{
-		additionalRightPixels = 8 - additionalRightPixels;
+		return false;
 	}
-	rightMask = (KUInt32) (0xFFFFFFFF << (additionalRightPixels * 4));
-	srcRight += additionalRightPixels;
 
-	KUInt32 dstRowBytes = mPhysicalWidth * kBitsPerPixel / 8;
-
-	KUInt16 srcTop = inSrcRect->fTop - inPixmapTop;
-	KUInt16 srcBottom = inSrcRect->fBottom - inPixmapTop;
-	KUInt32 nbRows = srcBottom - srcTop;
-	KUInt32 indexRows;
-	KUInt32 srcRowAddy = inBaseAddy
-		+ (srcTop * inSrcRowBytes)
-		+ (srcLeft * kBitsPerPixel / 8);
-	KUInt8* dstPixelsRow = mScreenBuffer
-		+ (inDstRect->fTop * dstRowBytes)
-		+ (dstLeft * kBitsPerPixel / 8);
-	KUInt32 srcWidthInBytes = (srcRight - srcLeft)
-		* kBitsPerPixel / 8;
-	KUInt32 chunk;
-
-	if (srcWidthInBytes <= 4)
+	KUInt32 theBufferSize = mPortraitWidth * mPortraitHeight * kBitsPerPixel / 8;
+	TSharedScreenBuffer* theSharedBuffer = new TSharedScreenBuffer(inName);
+	KUInt8* theBuffer = theSharedBuffer->Resize(theBufferSize);
+	if (theBuffer == nil)
 	{
-		// Single column
-		KUInt32 theMask = leftMask & rightMask;
-		for (indexRows = nbRows; indexRows != 0; indexRows--)
+		if (mLog)
 		{
-			KUInt32* rowPixels = (KUInt32*) dstPixelsRow;
+			mLog->FLogLine("Cannot export the screen buffer to %s", inName);
+		}
+		delete theSharedBuffer;
+		return false;
+	}
 
-			(void) mMemory->Read(srcRowAddy, chunk);
-			KUInt32 originalWord = UByteSex_FromBigEndian(*rowPixels);
-			if (inMode == 0)
-			{
-				// srcCopy
-				originalWord = (originalWord & ~theMask)
-					| ((~chunk) & theMask);
-			} else /* if (inMode == 1) */
-			{
-				originalWord = ~((~originalWord) | (chunk & theMask));
-			}
-			*rowPixels = UByteSex_ToBigEndian(originalWord);
+	// Move the pixels to the region.
+	(void) ::memcpy(theBuffer, mScreenBuffer, theBufferSize);
+	::free(mScreenBuffer);
+	mScreenBuffer = theBuffer;
+	mSharedBuffer = theSharedBuffer;
+	PublishScreenBuffer(nil);
 
-			srcRowAddy += inSrcRowBytes;
-			dstPixelsRow += dstRowBytes;
-		}
-	} else
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * PublishScreenBuffer( const SRect* )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::PublishScreenBuffer(const SRect* inRect)
+{
+	if (mSharedBuffer == nil)
 	{
-		for (indexRows = nbRows; indexRows != 0; indexRows--)
-		{
-			KUInt32* rowPixels = (KUInt32*) dstPixelsRow;
+		return;
+	}
 
-			// First column.
-			(void) mMemory->Read(srcRowAddy, chunk);
-			KUInt32 originalWord = UByteSex_FromBigEndian(*rowPixels);
-			if (inMode == 0)
-			{
-				// srcCopy
-				originalWord = (originalWord & (~leftMask))
-					| ((~chunk) & leftMask);
-			} else /* if (inMode == 1) */
-			{
-				originalWord = ~((~originalWord)
-					| (chunk & leftMask));
-			}
-			*rowPixels++ = UByteSex_ToBigEndian(originalWord);
+	KUInt32 theWidth = GetActualScreenWidth();
+	KUInt32 theHeight = GetActualScreenHeight();
+	if (inRect)
+	{
+		mSharedBuffer->Publish(
+			theWidth,
+			theHeight,
+			mScreenOrientation,
+			inRect->fTop,
+			inRect->fLeft,
+			inRect->fBottom,
+			inRect->fRight);
+	} else
+	{
+		mSharedBuffer->Publish(
+			theWidth,
+			theHeight,
+			mScreenOrientation,
+			0,
+			0,
+			theHeight,
+			theWidth);
+	}
+}
 
-			// Middle columns.
-			KUInt32 srcCursor = srcRowAddy + 4;
-			KUInt32 lastPixAddy = srcRowAddy + srcWidthInBytes - 4;
-			while (srcCursor < lastPixAddy)
-			{
-				(void) mMemory->Read(srcCursor, chunk);
-				srcCursor += 4;
-				if (inMode == 0)
-				{
-					// srcCopy
-					*rowPixels++ = UByteSex_ToBigEndian(~chunk);
-				} else
-				{
-					originalWord = UByteSex_FromBigEndian(*rowPixels);
-					*rowPixels++ = UByteSex_ToBigEndian(~(~originalWord | chunk));
-				}
-			}
+// -------------------------------------------------------------------------- //
+//  * SetFrameRate( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::SetFrameRate(KUInt32 inFramesPerSecond)
+{
+	// Front-ends call this from their own thread. The pending damage is
+	// presented by the emulator or the timer, not here.
+	mDamageMutex->Lock();
+	mFrameRate = inFramesPerSecond;
+	mDamageMutex->Unlock();
+}
 
-			// Last column.
-			(void) mMemory->Read(srcCursor, chunk);
-			originalWord = UByteSex_FromBigEndian(*rowPixels);
-			if (inMode == 0)
-			{
-				// srcCopy
-				originalWord = (originalWord & (~rightMask))
-					| ((~chunk) & rightMask);
-			} else /* if (inMode == 1) */
-			{
-				originalWord = ~((~originalWord)
-					| (chunk & rightMask));
-			}
-			*rowPixels = UByteSex_ToBigEndian(originalWord);
+// -------------------------------------------------------------------------- //
+//  * SetScreenOrientation( EOrientation )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::SetScreenOrientation(EOrientation inOrientation)
+{
+	// The timer may be presenting the damage with the current orientation.
+	mDamageMutex->Lock();
+	if (mScreenOrientation != inOrientation)
+	{
+		mScreenOrientation = inOrientation;
+		ScreenOrientationChanged(inOrientation);
+		PublishScreenBuffer(nil);
+	}
+	mDamageMutex->Unlock();
+}
 
-			srcRowAddy += inSrcRowBytes;
-			dstPixelsRow += dstRowBytes;
-		}
+// -------------------------------------------------------------------------- //
+//  * SetContrast( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::SetContrast(KUInt32 inContrast)
+{
+	mDamageMutex->Lock();
+	if (inContrast != mContrast)
+	{
+		mContrast = inContrast;
+		ContrastChanged(inContrast);
 	}
+	mDamageMutex->Unlock();
+}
 
-	// Tell the implementation that the screen was updated.
-	UpdateScreenRect(inDstRect);
+// -------------------------------------------------------------------------- //
+//  * SetBacklight( Boolean )
+// -------------------------------------------------------------------------- //
+void
+TScreenManager::SetBacklight(Boolean inBacklight)
+{
+	mDamageMutex->Lock();
+	if (inBacklight != mBacklight)
+	{
+		mBacklight = inBacklight;
+		BacklightChanged(inBacklight);
+	}
+	mDamageMutex->Unlock();
 }
 
 // -------------------------------------------------------------------------- //
@@ -891,34 +1344,25 @@ TScreenManager::PenDown(
 	KUInt8 inPressure /* = 4 */,
 	KUInt32 inTimeInTicks /* = 0 */)
 {
-	KUInt16 theXCoord = inXCoord;
-	KUInt16 theYCoord = inYCoord;
+	int theXCoord = inXCoord;
+	int theYCoord = inYCoord;
 
 	if (mFullScreen)
 	{
-		switch (mTabletOrientation)
-		{
-			case kOrientation_AppleTop:
-				theXCoord = mPhysicalWidth - inYCoord - 1;
-				theYCoord = inXCoord;
-				break;
-			case kOrientation_AppleRight:
-				//				theXCoord = inXCoord;
-				//				theYCoord = inYCoord;
-				break;
-			case kOrientation_AppleBottom:
-				theXCoord = inYCoord;
-				theYCoord = mPhysicalHeight - inXCoord - 1;
-				break;
-			case kOrientation_AppleLeft:
-				theXCoord = mPhysicalHeight - inXCoord - 1;
-				theYCoord = mPhysicalWidth - inYCoord - 1;
-				break;
-		}
+		// Undo the rotation of the blits.
+		RotatePoint(
+			(4 - GetQuarterTurns()) & 0x03,
+			(int) mPhysicalWidth,
+			(int) mPhysicalHeight,
+			inXCoord,
+			inYCoord,
+			&theXCoord,
+			&theYCoord);
 	}
 
 	// Limite: 2048x2048.
 	// Il faut modifier Convert__6TInkerFv pour augmenter.
+	mPenMutex->Lock();
 	if (!mPenIsDown)
 	{
 		InsertSample(kPenDownSample, inTimeInTicks);
@@ -928,6 +1372,7 @@ TScreenManager::PenDown(
 		| (theYCoord & 0x7FF) << 7
 		| (inPressure & 0x0F);
 	InsertSample(theSampleRecord, inTimeInTicks);
+	mPenMutex->Unlock();
 }
 
 // -------------------------------------------------------------------------- //
@@ -936,11 +1381,13 @@ TScreenManager::PenDown(
 void
 TScreenManager::PenUp(KUInt32 inTimeInTicks /* = 0 */)
 {
+	mPenMutex->Lock();
 	if (mPenIsDown)
 	{
 		InsertSample(kPenUpSample, inTimeInTicks);
 		mPenIsDown = false;
 	}
+	mPenMutex->Unlock();
 }
 
 // -------------------------------------------------------------------------- //
@@ -951,21 +1398,17 @@ TScreenManager::GetSample(
 	KUInt32* outPackedSample,
 	KUInt32* outTimeInTicks)
 {
-	Boolean theResult = false;
-	KUInt32 newCCrsr = mTabletBufCCrsr;
-	if (newCCrsr != mTabletBufPCrsr)
-	{
-		theResult = true;
-		*outPackedSample = mTabletBuffer[newCCrsr++];
-		*outTimeInTicks = mTabletBuffer[newCCrsr++];
-		if (newCCrsr == kTabletBufferSize)
-		{
-			newCCrsr = 0;
-		}
-		mTabletBufCCrsr = newCCrsr;
-	}
+	// The tablet driver runs on the emulator thread: don't lock here.
+	return mTabletQueue->Pop(outPackedSample, outTimeInTicks);
+}
 
-	return theResult;
+// -------------------------------------------------------------------------- //
+//  * GetPendingSampleCount( void ) const
+// -------------------------------------------------------------------------- //
+KUInt32
+TScreenManager::GetPendingSampleCount(void) const
+{
+	return mTabletQueue->GetCount();
 }
 
 // -------------------------------------------------------------------------- //
@@ -986,14 +1429,8 @@ TScreenManager::InsertSample(
 
 		//		mPlatformManager->SendTabletSampleEvent( inPackedSample, theTimeInTicks );
 
-		KUInt32 newPCrsr = mTabletBufPCrsr;
-		mTabletBuffer[newPCrsr++] = inPackedSample;
-		mTabletBuffer[newPCrsr++] = inTimeInTicks;
-		if (newPCrsr == kTabletBufferSize)
-		{
-			newPCrsr = 0;
-		}
-		mTabletBufPCrsr = newPCrsr;
+		// The queue grows: samples are never dropped.
+		mTabletQueue->Push(inPackedSample, inTimeInTicks);
 
 		// Tell the driver.
 		RaiseTabletInterrupt();
@@ -1066,6 +1503,8 @@ TScreenManager::TransferState(TStream* inStream)
 
 	KUInt32 count = mPortraitWidth * mPortraitHeight * kBitsPerPixel / 8;
 	inStream->Transfer(mScreenBuffer, &count);
+	InvalidateScreenHash();
+	PublishScreenBuffer(nil);
 
 	if (inStream->IsReading())
 		PowerOnScreen();
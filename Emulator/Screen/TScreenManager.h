@@ -25,11 +25,17 @@
 #define _TSCREENMANAGER_H
 
 #include <K/Defines/KDefinitions.h>
+#include "Emulator/TInterruptManager.h"
+
+#include <atomic>
+#include <vector>
 
 class TLog;
-class TInterruptManager;
 class TMemory;
+class TMutex;
 class TPlatformManager;
+class TSharedScreenBuffer;
+class TTabletSampleQueue;
 class TStream;
 
 #define SIXTEEN_GREYS 1
@@ -50,7 +56,7 @@ class TStream;
 ///
 /// \test	aucun test défini.
 ///
-class TScreenManager
+class TScreenManager : public TTimerCallback
 {
 public:
 	///
@@ -104,7 +110,8 @@ public:
 #if MILLIONS_OF_COLORS
 		kBitsPerPixel = 32,
 #endif
-		kDefaultSampleRate = 0x0000B400
+		kDefaultSampleRate = 0x0000B400,
+		kDefaultFrameRate = 0
 	};
 
 	///
@@ -131,15 +138,14 @@ public:
 
 	///
 	/// Set the interrupt manager.
-	/// This method is called once the interrupt manager is created.
+	/// This method is called once the interrupt manager is created. The
+	/// interrupt manager calls the screen manager back at the end of the
+	/// frames: the callback scheduled with the previous manager is
+	/// cancelled, so pass nil before deleting the interrupt manager.
 	///
 	/// \param inManager	reference to the interrupt manager
 	///
-	void
-	SetInterruptManager(TInterruptManager* inManager)
-	{
-		mInterruptManager = inManager;
-	}
+	void SetInterruptManager(TInterruptManager* inManager);
 
 	///
 	/// Set the memory interface.
@@ -227,6 +233,14 @@ public:
 	///
 	Boolean GetSample(KUInt32* outPackedSample, KUInt32* outTimeInTicks);
 
+	///
+	/// Get the number of samples the tablet driver didn't read yet.
+	/// Input sources can wait for it to decrease instead of flooding the queue.
+	///
+	/// \return the number of pending samples.
+	///
+	KUInt32 GetPendingSampleCount(void) const;
+
 	///
 	/// Notify that the tablet orientation changed.
 	/// This method is called when the tablet driver calls SetTabletOrientation.
@@ -287,7 +301,8 @@ public:
 
 	///
 	/// Notify that the screen orientation changed.
-	/// This method is called when the display driver calls SetScreenOrientation.
+	/// This method is called when the display driver calls SetScreenOrientation,
+	/// with the damage mutex: the timer may be presenting on another thread.
 	///
 	/// \param inNewOrientation	the new orientation of the screen.
 	///
@@ -297,7 +312,8 @@ public:
 
 	///
 	/// Notify that the contrast changed.
-	/// This method is called when the display driver calls SetScreenContrast.
+	/// This method is called when the display driver calls SetScreenContrast,
+	/// with the damage mutex.
 	///
 	/// \param inNewContrast the new contrast of the screen.
 	///
@@ -305,7 +321,8 @@ public:
 
 	///
 	/// Notify that the backlight changed.
-	/// This method is called when the display driver calls SetScreenContrast.
+	/// This method is called when the display driver calls SetBacklight,
+	/// with the damage mutex.
 	///
 	/// \param inNewBacklight the new state of the backlight.
 	///
@@ -325,16 +342,7 @@ public:
 	/// Set the screen orientation.
 	/// This method is called by the display driver.
 	///
-	void
-	SetScreenOrientation(
-		EOrientation inOrientation)
-	{
-		if (mScreenOrientation != inOrientation)
-		{
-			mScreenOrientation = inOrientation;
-			ScreenOrientationChanged(inOrientation);
-		}
-	}
+	void SetScreenOrientation(EOrientation inOrientation);
 
 	///
 	/// Get the contrast of the screen.
@@ -354,15 +362,7 @@ public:
 	///
 	/// \param inContrast	new contrast of the screen.
 	///
-	void
-	SetContrast(KUInt32 inContrast)
-	{
-		if (inContrast != mContrast)
-		{
-			mContrast = inContrast;
-			ContrastChanged(inContrast);
-		}
-	}
+	void SetContrast(KUInt32 inContrast);
 
 	///
 	/// Get the state of the backlight.
@@ -378,15 +378,7 @@ public:
 	/// Set the state of the backlight.
 	/// This method is called by the display driver.
 	///
-	void
-	SetBacklight(Boolean inBacklight)
-	{
-		if (inBacklight != mBacklight)
-		{
-			mBacklight = inBacklight;
-			BacklightChanged(inBacklight);
-		}
-	}
+	void SetBacklight(Boolean inBacklight);
 
 	///
 	/// Notify that some screen bits changed.
@@ -395,6 +387,115 @@ public:
 	///
 	virtual void UpdateScreenRect(SRect* inUpdatedRect) = 0;
 
+	///
+	/// Set the rate at which blitted bits are presented to the host.
+	/// Blits are merged into a single dirty rectangle that is passed to
+	/// UpdateScreenRect at most once per frame, by the timer at the end of
+	/// the frame or when the emulator idles.
+	/// By default, every blit is presented: front-ends opt in.
+	/// The new rate applies from the next blit.
+	///
+	/// \param inFramesPerSecond	frames per second, 0 to present every blit.
+	///
+	void SetFrameRate(KUInt32 inFramesPerSecond);
+
+	///
+	/// Accessor on the frame rate.
+	///
+	/// \return the frames per second, 0 if every blit is presented.
+	///
+	KUInt32
+	GetFrameRate(void) const
+	{
+		return mFrameRate;
+	}
+
+	///
+	/// Present the pending dirty rectangle, if any, to the host.
+	/// This method is called by the emulator when the CPU idles.
+	///
+	void FlushDamage(void);
+
+	///
+	/// Present the pending dirty rectangle at the end of the frame.
+	/// This method is called by the interrupt manager, so that the last
+	/// blits of a busy frame are shown on time.
+	///
+	/// \param inTimer	current value of the timer.
+	/// \return the number of ticks until the end of the frame if a blit
+	///			presented since the call was scheduled, 0 otherwise.
+	///
+	virtual KUInt32 TimerCallback(KUInt32 inTimer) override;
+
+	///
+	/// Accessor on the number of blits since the last reset.
+	///
+	/// \return the number of blits received from the display driver.
+	///
+	KUInt32
+	GetBlitCount(void) const
+	{
+		return mBlitCount;
+	}
+
+	///
+	/// Accessor on the number of presents since the last reset.
+	///
+	/// \return the number of calls to UpdateScreenRect for blits.
+	///
+	KUInt32
+	GetPresentCount(void) const
+	{
+		return mPresentCount;
+	}
+
+	///
+	/// Accessor on the time of the last present.
+	///
+	/// \return the timer value when FlushDamage last presented.
+	///
+	KUInt32
+	GetLastPresentTime(void) const
+	{
+		return mLastPresentTime;
+	}
+
+	///
+	/// Reset the blit and present counters.
+	///
+	void
+	ResetDamageCounters(void)
+	{
+		mBlitCount = 0;
+		mPresentCount = 0;
+	}
+
+	///
+	/// Compute a hash of the screen buffer, to check the screen contents
+	/// without copying them. The buffer is hashed in tiles, and only the
+	/// tiles blitted since the previous call are hashed again.
+	/// This method can be called from any thread.
+	///
+	/// \return a hash of the pixels and of the dimensions of the buffer.
+	///
+	KUInt64 GetScreenHash(void);
+
+	///
+	/// Hash every tile again at the next call to GetScreenHash.
+	/// To call when the screen buffer is written to other than by Blit.
+	///
+	void InvalidateScreenHash(void);
+
+	///
+	/// Place the screen buffer in a named shared memory region, for other
+	/// processes to read without copies (see TSharedScreenBuffer for the
+	/// layout). Call this before the emulator runs.
+	///
+	/// \param inName	name of the region (e.g. "/einstein-screen").
+	/// \return \c true if the region could be created.
+	///
+	Boolean ExportScreenBuffer(const char* inName);
+
 	///
 	/// Get the screen width (from the orientation)
 	///
@@ -692,6 +793,83 @@ private:
 		SRect* inDstRect,
 		KUInt32 inMode);
 
+	///
+	/// Number of clockwise quarter turns from the Newton screen to the
+	/// physical screen, when full screen.
+	///
+	/// \return a number of quarter turns between 0 and 3.
+	///
+	KUInt32 GetQuarterTurns(void) const;
+
+	///
+	/// Rotate a point of a screen clockwise. Blits map Newton coordinates
+	/// to the physical screen with it, and pen samples map them back with
+	/// the opposite rotation.
+	///
+	/// \param inQuarterTurns	number of clockwise quarter turns.
+	/// \param inWidth			width of the screen before the rotation.
+	/// \param inHeight			height of the screen before the rotation.
+	/// \param inX				horizontal coordinate of the point.
+	/// \param inY				vertical coordinate of the point.
+	/// \param outX				horizontal coordinate after the rotation.
+	/// \param outY				vertical coordinate after the rotation.
+	///
+	static void RotatePoint(
+		KUInt32 inQuarterTurns,
+		int inWidth,
+		int inHeight,
+		int inX,
+		int inY,
+		int* outX,
+		int* outY);
+
+	///
+	/// Update some screen bits, with a rotation.
+	/// Blocks of 8x8 pixels are read from the pixmap, transposed and written
+	/// to the (physical) screen buffer a word at a time.
+	///
+	/// \param inQuarterTurns	number of clockwise quarter turns (1 to 3).
+	///
+	void Blit_Rotated(
+		KUInt32 inBaseAddy,
+		KUInt32 inSrcRowBytes,
+		KUInt16 inPixmapTop,
+		KUInt16 inPixmapLeft,
+		SRect* inSrcRect,
+		SRect* inDstRect,
+		KUInt32 inMode,
+		KUInt32 inQuarterTurns);
+
+	///
+	/// Add a rectangle to the dirty rectangle and present it if a frame
+	/// elapsed since the last present.
+	///
+	/// \param inRect	rectangle of the screen buffer that changed.
+	///
+	void DamageRect(const SRect* inRect);
+
+	///
+	/// Compute the time left before the end of the frame.
+	///
+	/// \return the number of ticks until the pending damage can be
+	///			presented, 0 if it can be presented now.
+	///
+	KUInt32 GetFrameTicksLeft(void) const;
+
+	///
+	/// Present the pending dirty rectangle, if any.
+	/// The caller holds mDamageMutex.
+	///
+	void PresentDamage(void);
+
+	///
+	/// Publish the geometry and a dirty rectangle to the shared region, if
+	/// the screen buffer is exported.
+	///
+	/// \param inRect	rectangle that changed, nil for the whole screen.
+	///
+	void PublishScreenBuffer(const SRect* inRect);
+
 	/// \name Variables
 	TLog* mLog; ///< Reference to the log.
 	TInterruptManager* mInterruptManager; ///< Reference to the interrupt mgr.
@@ -708,16 +886,29 @@ private:
 	Boolean mPenIsDown; ///< If pen is down.
 	KUInt32 mTabletSampleRate; ///< Sample rate (in ticks) of the
 							   ///< tablet.
-	KUInt32* mTabletBuffer; ///< (Circular) buffer for the
-							///< tablet samples.
-	KUInt32 mTabletBufCCrsr; ///< Consumer buffer cursor (Newton)
-	KUInt32 mTabletBufPCrsr; ///< Producer buffer cursor (Host)
+	TTabletSampleQueue* mTabletQueue; ///< Queue of the tablet samples.
+	TMutex* mPenMutex; ///< Serializes the host threads inserting samples.
 	EOrientation mTabletOrientation; ///< Current tablet orientation.
 	EOrientation mScreenOrientation; ///< Current screen orientation.
 	KUInt32 mContrast; ///< Current screen contrast.
 	Boolean mBacklight; ///< Current screen backlight.
 	Boolean mKbdIsConnected; ///< If keyboard is connected.
 	KUInt8* mScreenBuffer; ///< Buffer of the screen.
+	SRect mDamageRect; ///< Union of the rectangles not presented yet.
+	Boolean mDamaged; ///< Whether mDamageRect is pending.
+	std::atomic<KUInt32> mFrameRate; ///< Presents per second, 0 for every blit.
+	Boolean mFrameScheduled; ///< Whether the timer will call us back.
+	std::atomic<KUInt32> mLastPresentTime; ///< Timer value of the last present.
+	std::atomic<KUInt32> mBlitCount; ///< Number of blits.
+	std::atomic<KUInt32> mPresentCount; ///< Number of presents.
+	TMutex* mDamageMutex; ///< Mutex for the damage and the presents.
+	TMutex* mHashMutex; ///< Mutex for the tile hashes.
+	KUInt32 mHashWidth; ///< Width of the buffer when hashed.
+	KUInt32 mHashHeight; ///< Height of the buffer when hashed.
+	KUInt64 mHashSum; ///< Sum of the mixed tile hashes.
+	std::vector<KUInt64> mTileHashes; ///< Hash of each tile.
+	std::vector<Boolean> mDirtyTiles; ///< Tiles to hash again.
+	TSharedScreenBuffer* mSharedBuffer; ///< Region of the exported buffer.
 
 protected:
 	Boolean mOverlayIsOn; ///< Show overlay on screen
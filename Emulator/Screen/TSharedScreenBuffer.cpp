@@ -0,0 +1,185 @@
+// ==============================
+// File:			TSharedScreenBuffer.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "TSharedScreenBuffer.h"
+
+// ANSI C & POSIX
+#include <stdlib.h>
+#include <string.h>
+#if !TARGET_OS_WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// C++
+#include <atomic>
+
+// K
+#include <K/Threads/TMutex.h>
+
+// -------------------------------------------------------------------------- //
+//  * TSharedScreenBuffer( const char* )
+// -------------------------------------------------------------------------- //
+TSharedScreenBuffer::TSharedScreenBuffer(const char* inName) :
+		mName(::strdup(inName)),
+		mFD(-1),
+		mMapping(nil),
+		mMappingSize(0),
+		mMutex(new TMutex())
+{
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TSharedScreenBuffer( void )
+// -------------------------------------------------------------------------- //
+TSharedScreenBuffer::~TSharedScreenBuffer(void)
+{
+#if !TARGET_OS_WIN32
+	if (mMapping)
+	{
+		(void) ::munmap(mMapping, mMappingSize);
+	}
+	if (mFD >= 0)
+	{
+		(void) ::close(mFD);
+		(void) ::shm_unlink(mName);
+	}
+#endif
+	delete mMutex;
+	::free(mName);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Resize( KUInt32 )
+// -------------------------------------------------------------------------- //
+KUInt8*
+TSharedScreenBuffer::Resize(KUInt32 inBufferSize)
+{
+#if TARGET_OS_WIN32
+	(void) inBufferSize;
+	return nil;
+#else
+	mMutex->Lock();
+	if (mFD < 0)
+	{
+		// Remove a region left by a previous session.
+		(void) ::shm_unlink(mName);
+		mFD = ::shm_open(mName, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (mFD < 0)
+		{
+			mMutex->Unlock();
+			return nil;
+		}
+	}
+
+	// The region never shrinks: readers still map the old size, and pages
+	// past the end of the file would fault.
+	size_t theMappingSize = sizeof(SHeader) + inBufferSize;
+	if (theMappingSize > mMappingSize)
+	{
+		if (::ftruncate(mFD, (off_t) theMappingSize) < 0)
+		{
+			mMutex->Unlock();
+			return nil;
+		}
+		void* theMapping = ::mmap(
+			nil, theMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFD, 0);
+		if (theMapping == MAP_FAILED)
+		{
+			mMutex->Unlock();
+			return nil;
+		}
+		if (mMapping)
+		{
+			(void) ::munmap(mMapping, mMappingSize);
+		}
+		mMapping = theMapping;
+		mMappingSize = theMappingSize;
+	}
+
+	// The sequence stays odd until the caller publishes the geometry.
+	SHeader* theHeader = (SHeader*) mMapping;
+	KUInt8* theBuffer = ((KUInt8*) mMapping) + sizeof(SHeader);
+	theHeader->fSequence |= 1;
+	std::atomic_thread_fence(std::memory_order_release);
+	(void) ::memset(theBuffer, 0, inBufferSize);
+	theHeader->fSignature = kSignature;
+	theHeader->fVersion = kVersion;
+	theHeader->fHeaderSize = sizeof(SHeader);
+	theHeader->fBufferSize = inBufferSize;
+	theHeader->fBitsPerPixel = 4;
+	theHeader->fReserved[0] = 0;
+	theHeader->fReserved[1] = 0;
+	mMutex->Unlock();
+
+	return theBuffer;
+#endif
+}
+
+// -------------------------------------------------------------------------- //
+//  * Publish( KUInt32, KUInt32, KUInt32, KUInt32, KUInt32, KUInt32, ... )
+// -------------------------------------------------------------------------- //
+void
+TSharedScreenBuffer::Publish(
+	KUInt32 inWidth,
+	KUInt32 inHeight,
+	KUInt32 inOrientation,
+	KUInt32 inTop,
+	KUInt32 inLeft,
+	KUInt32 inBottom,
+	KUInt32 inRight)
+{
+	// The emulator thread and the host thread that sets the frame rate
+	// may both present.
+	mMutex->Lock();
+	if (mMapping == nil)
+	{
+		mMutex->Unlock();
+		return;
+	}
+
+	// Readers retry while the sequence is odd or changes.
+	volatile SHeader* theHeader = (volatile SHeader*) mMapping;
+	KUInt32 theSequence = theHeader->fSequence;
+	theHeader->fSequence = theSequence | 1;
+	std::atomic_thread_fence(std::memory_order_release);
+	theHeader->fWidth = inWidth;
+	theHeader->fHeight = inHeight;
+	theHeader->fRowBytes = inWidth * theHeader->fBitsPerPixel / 8;
+	theHeader->fOrientation = inOrientation;
+	theHeader->fDirtyTop = inTop;
+	theHeader->fDirtyLeft = inLeft;
+	theHeader->fDirtyBottom = inBottom;
+	theHeader->fDirtyRight = inRight;
+	std::atomic_thread_fence(std::memory_order_release);
+	theHeader->fSequence = (theSequence | 1) + 1;
+	mMutex->Unlock();
+}
+
+// ============================================================= //
+// It is easier to write an incorrect program than understand a  //
+// correct one.                                                  //
+// ============================================================= //
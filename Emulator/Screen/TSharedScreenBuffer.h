@@ -0,0 +1,161 @@
+// ==============================
+// File:			TSharedScreenBuffer.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _TSHAREDSCREENBUFFER_H
+#define _TSHAREDSCREENBUFFER_H
+
+#include <K/Defines/KDefinitions.h>
+
+#include <stddef.h>
+
+class TMutex;
+
+///
+/// Class for a screen buffer in a named shared memory region.
+///
+/// The region starts with an SHeader, followed by the screen buffer (4 bits
+/// per pixel, the left pixel in the high nibble, 0xF is white). Other
+/// processes open the region with shm_open and map it read only.
+///
+/// The header is published with a sequence counter: fSequence is odd while
+/// the header is being written. A reader copies the fields it needs and
+/// checks that fSequence was even and didn't change. The pixels are written
+/// before the sequence is bumped, and the dirty rectangle covers the pixels
+/// that changed since the previous sequence; a reader that missed sequences
+/// (fSequence moved by more than 2) should read the whole screen. The region
+/// never shrinks, so a mapping stays valid; when fBufferSize grows past the
+/// size a reader mapped, the region must be mapped again.
+///
+/// Shared memory isn't available on Windows: Resize fails there.
+///
+class TSharedScreenBuffer
+{
+public:
+	/// Region constants.
+	enum {
+		kSignature = 'ESCR',
+		kVersion = 1
+	};
+
+	/// Header of the region. Fields are in host byte order.
+	struct SHeader {
+		KUInt32 fSignature; ///< kSignature.
+		KUInt32 fVersion; ///< kVersion.
+		KUInt32 fHeaderSize; ///< Offset of the screen buffer.
+		KUInt32 fBufferSize; ///< Size of the screen buffer.
+		KUInt32 fSequence; ///< Odd while the header is written.
+		KUInt32 fWidth; ///< Width of the screen buffer, in pixels.
+		KUInt32 fHeight; ///< Height of the screen buffer, in pixels.
+		KUInt32 fRowBytes; ///< Bytes per row.
+		KUInt32 fBitsPerPixel; ///< Bits per pixel (4).
+		KUInt32 fOrientation; ///< TScreenManager::EOrientation.
+		KUInt32 fDirtyTop; ///< Top of the dirty rectangle.
+		KUInt32 fDirtyLeft; ///< Left of the dirty rectangle.
+		KUInt32 fDirtyBottom; ///< Bottom of the dirty rectangle (excluded).
+		KUInt32 fDirtyRight; ///< Right of the dirty rectangle (excluded).
+		KUInt32 fReserved[2]; ///< Zero.
+	};
+
+	///
+	/// Constructor from a name.
+	/// The region is created by Resize.
+	///
+	/// \param inName	name of the region (e.g. "/einstein-screen").
+	///
+	TSharedScreenBuffer(const char* inName);
+
+	///
+	/// Destructor.
+	/// Unmaps and removes the region.
+	///
+	~TSharedScreenBuffer(void);
+
+	///
+	/// Create or resize the region.
+	/// The screen buffer is cleared and its address may change. A smaller
+	/// size is only published in the header, the region keeps its size.
+	///
+	/// \param inBufferSize	size of the screen buffer.
+	/// \return the screen buffer, or nil if the region couldn't be mapped.
+	///
+	KUInt8* Resize(KUInt32 inBufferSize);
+
+	///
+	/// Publish the geometry of the screen and a dirty rectangle.
+	///
+	/// \param inWidth			width of the screen buffer.
+	/// \param inHeight			height of the screen buffer.
+	/// \param inOrientation	orientation of the screen.
+	/// \param inTop			top of the dirty rectangle.
+	/// \param inLeft			left of the dirty rectangle.
+	/// \param inBottom			bottom of the dirty rectangle (excluded).
+	/// \param inRight			right of the dirty rectangle (excluded).
+	///
+	void Publish(
+		KUInt32 inWidth,
+		KUInt32 inHeight,
+		KUInt32 inOrientation,
+		KUInt32 inTop,
+		KUInt32 inLeft,
+		KUInt32 inBottom,
+		KUInt32 inRight);
+
+	///
+	/// Accessor on the header (nil if the region isn't mapped).
+	///
+	const SHeader*
+	GetHeader(void) const
+	{
+		return (const SHeader*) mMapping;
+	}
+
+private:
+	///
+	/// Constructeur par copie volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TSharedScreenBuffer(const TSharedScreenBuffer& inCopy);
+
+	///
+	/// Opérateur d'assignation volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TSharedScreenBuffer& operator=(const TSharedScreenBuffer& inCopy);
+
+	/// \name Variables
+	char* mName; ///< Name of the region.
+	int mFD; ///< Descriptor of the region.
+	void* mMapping; ///< Address of the mapping.
+	size_t mMappingSize; ///< Size of the mapping.
+	TMutex* mMutex; ///< Serializes the writers of the header.
+};
+
+#endif
+// _TSHAREDSCREENBUFFER_H
+
+// ============================================================= //
+// Never trust a computer you can't throw out a window.          //
+//                 -- Steve Wozniak                              //
+// ============================================================= //
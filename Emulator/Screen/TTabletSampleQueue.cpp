@@ -0,0 +1,121 @@
+// ==============================
+// File:			TTabletSampleQueue.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "TTabletSampleQueue.h"
+
+// -------------------------------------------------------------------------- //
+//  * TTabletSampleQueue( void )
+// -------------------------------------------------------------------------- //
+TTabletSampleQueue::TTabletSampleQueue(void) :
+		mHead(nil),
+		mHeadIndex(0),
+		mTail(nil),
+		mTailIndex(0),
+		mSpare(nil),
+		mPushCount(0),
+		mPopCount(0)
+{
+	mHead = new SChunk;
+	mHead->fNext = nil;
+	mTail = mHead;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TTabletSampleQueue( void )
+// -------------------------------------------------------------------------- //
+TTabletSampleQueue::~TTabletSampleQueue(void)
+{
+	SChunk* theChunk = mHead;
+	while (theChunk)
+	{
+		SChunk* theNext = theChunk->fNext;
+		delete theChunk;
+		theChunk = theNext;
+	}
+	delete mSpare.load();
+}
+
+// -------------------------------------------------------------------------- //
+//  * Push( KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TTabletSampleQueue::Push(KUInt32 inPackedSample, KUInt32 inTimeInTicks)
+{
+	if (mTailIndex == kChunkSize)
+	{
+		// Link a new chunk. The consumer follows fNext only once the
+		// sample below is published.
+		SChunk* theChunk = mSpare.exchange(nil, std::memory_order_acq_rel);
+		if (theChunk == nil)
+		{
+			theChunk = new SChunk;
+		}
+		theChunk->fNext = nil;
+		mTail->fNext = theChunk;
+		mTail = theChunk;
+		mTailIndex = 0;
+	}
+
+	SSample* theSample = &mTail->fSamples[mTailIndex++];
+	theSample->fPackedSample = inPackedSample;
+	theSample->fTimeInTicks = inTimeInTicks;
+	mPushCount.store(
+		mPushCount.load(std::memory_order_relaxed) + 1,
+		std::memory_order_release);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Pop( KUInt32*, KUInt32* )
+// -------------------------------------------------------------------------- //
+Boolean
+TTabletSampleQueue::Pop(KUInt32* outPackedSample, KUInt32* outTimeInTicks)
+{
+	KUInt32 thePopCount = mPopCount.load(std::memory_order_relaxed);
+	if (thePopCount == mPushCount.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	if (mHeadIndex == kChunkSize)
+	{
+		// The producer linked the next chunk before pushing to it.
+		SChunk* theEmptyChunk = mHead;
+		mHead = mHead->fNext;
+		mHeadIndex = 0;
+		delete mSpare.exchange(theEmptyChunk, std::memory_order_acq_rel);
+	}
+
+	const SSample* theSample = &mHead->fSamples[mHeadIndex++];
+	*outPackedSample = theSample->fPackedSample;
+	*outTimeInTicks = theSample->fTimeInTicks;
+	mPopCount.store(thePopCount + 1, std::memory_order_release);
+
+	return true;
+}
+
+// ============================================================= //
+// The first rule of intelligent tinkering is to save all the    //
+// parts.                                                        //
+//                 -- Paul Erlich                                //
+// ============================================================= //
@@ -0,0 +1,130 @@
+// ==============================
+// File:			TTabletSampleQueue.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _TTABLETSAMPLEQUEUE_H
+#define _TTABLETSAMPLEQUEUE_H
+
+#include <K/Defines/KDefinitions.h>
+
+#include <atomic>
+
+///
+/// Class for the queue of tablet samples, from the host to the Newton.
+///
+/// The queue is a list of fixed size chunks: it grows instead of dropping
+/// samples and never locks. There must be a single producer thread (or
+/// producers must be serialized) and a single consumer thread. The consumer
+/// gives the last chunk it emptied back to the producer, so a queue that
+/// doesn't grow doesn't allocate.
+///
+class TTabletSampleQueue
+{
+public:
+	/// Constants.
+	enum {
+		kChunkSize = 256 ///< Samples per chunk.
+	};
+
+	///
+	/// Default constructor.
+	///
+	TTabletSampleQueue(void);
+
+	///
+	/// Destructor.
+	///
+	~TTabletSampleQueue(void);
+
+	///
+	/// Append a sample (producer).
+	///
+	/// \param inPackedSample	packed sample for the tablet journal.
+	/// \param inTimeInTicks	time of the sample.
+	///
+	void Push(KUInt32 inPackedSample, KUInt32 inTimeInTicks);
+
+	///
+	/// Remove the oldest sample (consumer).
+	///
+	/// \param outPackedSample	on output, packed sample.
+	/// \param outTimeInTicks	on output, time of the sample.
+	/// \return \c false if the queue was empty.
+	///
+	Boolean Pop(KUInt32* outPackedSample, KUInt32* outTimeInTicks);
+
+	///
+	/// Accessor on the number of samples in the queue.
+	/// The value may be stale when read from another thread.
+	///
+	KUInt32
+	GetCount(void) const
+	{
+		return mPushCount.load(std::memory_order_acquire)
+			- mPopCount.load(std::memory_order_acquire);
+	}
+
+private:
+	/// A sample.
+	struct SSample {
+		KUInt32 fPackedSample; ///< Packed sample.
+		KUInt32 fTimeInTicks; ///< Time of the sample.
+	};
+
+	/// A chunk of samples.
+	struct SChunk {
+		SSample fSamples[kChunkSize]; ///< Samples.
+		SChunk* fNext; ///< Next chunk, published by mPushCount.
+	};
+
+	///
+	/// Constructeur par copie volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TTabletSampleQueue(const TTabletSampleQueue& inCopy);
+
+	///
+	/// Opérateur d'assignation volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TTabletSampleQueue& operator=(const TTabletSampleQueue& inCopy);
+
+	/// \name Variables
+	SChunk* mHead; ///< Chunk of the next sample to pop (consumer).
+	KUInt32 mHeadIndex; ///< Index of the next sample to pop (consumer).
+	SChunk* mTail; ///< Chunk of the next sample to push (producer).
+	KUInt32 mTailIndex; ///< Index of the next sample to push (producer).
+	std::atomic<SChunk*> mSpare; ///< Chunk emptied by the consumer.
+	std::atomic<KUInt32> mPushCount; ///< Samples pushed so far.
+	std::atomic<KUInt32> mPopCount; ///< Samples popped so far.
+};
+
+#endif
+// _TTABLETSAMPLEQUEUE_H
+
+// ============================================================= //
+// Everything should be made as simple as possible, but not      //
+// simpler.                                                      //
+//                 -- Albert Einstein                            //
+// ============================================================= //
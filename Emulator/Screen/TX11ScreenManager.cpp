@@ -24,7 +24,7 @@
 #include <K/Defines/KDefinitions.h>
 #include "TX11ScreenManager.h"
 #include <Emulator/TMemory.h>
-#include <TEmulator.h>
+#include "Emulator/TEmulator.h"
 
 // X11 interface
 #if __QUICKDRAW__
@@ -33,8 +33,7 @@ namespace X11NameSpace {
 #include <X11/Xatom.h>
 #include <X11/Xos.h>
 #include <X11/Xutil.h>
-// I'll see later for SHM
-// #include <X11/extensions/XShm.h>
+#include <X11/extensions/XShm.h>
 #if __QUICKDRAW__
 };
 
@@ -43,14 +42,12 @@ using namespace X11NameSpace;
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-// I'll see later for SHM
-// #include <sys/ipc.h>
-// #include <sys/shm.h>
-
 // K
 #include <K/Defines/UByteSex.h>
 #include <K/Threads/TThread.h>
@@ -64,6 +61,23 @@ using namespace X11NameSpace;
 
 #define kBorderWidth 0
 
+// -------------------------------------------------------------------------- //
+// Statics
+// -------------------------------------------------------------------------- //
+
+// Set when the server refuses XShmAttach (the error is asynchronous).
+static Boolean gShmAttachFailed = false;
+
+// -------------------------------------------------------------------------- //
+//  * ShmAttachErrorHandler( Display*, XErrorEvent* )
+// -------------------------------------------------------------------------- //
+static int
+ShmAttachErrorHandler(Display* /* inDisplay */, XErrorEvent* /* inEvent */)
+{
+	gShmAttachFailed = true;
+	return 0;
+}
+
 // -------------------------------------------------------------------------- //
 //  * GetDisplaySize( void )
 // -------------------------------------------------------------------------- //
@@ -102,7 +116,9 @@ TX11ScreenManager::TX11ScreenManager(
 		mBitsPerPixel(0),
 		mDepth(0),
 		mAllocColor(false),
-		mImageBuffer(NULL)
+		mImageBuffer(NULL),
+		mUseShm(false),
+		mShmSize(0)
 {
 	// I'm doing things in a multi-threaded way.
 	(void) XInitThreads();
@@ -110,6 +126,13 @@ TX11ScreenManager::TX11ScreenManager(
 	// Connect to the display.
 	OpenDisplay();
 
+	// Share the image with the server if we can.
+	mShmInfo.shmseg = 0;
+	mShmInfo.shmid = -1;
+	mShmInfo.shmaddr = NULL;
+	mShmInfo.readOnly = False;
+	mUseShm = XShmQueryExtension(mDisplay);
+
 	// Create some atoms.
 	mWMDeleteWindow = XInternAtom(mDisplay, "WM_DELETE_WINDOW", false);
 	mWMState = XInternAtom(mDisplay, "_NET_WM_STATE", false);
@@ -146,7 +169,10 @@ TX11ScreenManager::~TX11ScreenManager(void)
 	}
 
 	// Free the image buffer.
-	if (mImageBuffer)
+	if (mUseShm)
+	{
+		DetachSharedMemory();
+	} else if (mImageBuffer)
 	{
 		::free(mImageBuffer);
 	}
@@ -247,27 +273,11 @@ TX11ScreenManager::Run(void)
 
 				case Expose:
 					// Redraw the bits that were lost.
-					{
-						int theErr = XPutImage(
-							mDisplay,
-							mWindow,
-							mGC,
-							mImage,
-							theEvent.xexpose.x,
-							theEvent.xexpose.y,
-							theEvent.xexpose.x,
-							theEvent.xexpose.y,
-							theEvent.xexpose.width,
-							theEvent.xexpose.height);
-						if (theErr != 0)
-						{
-							(void) ::fprintf(
-								stderr,
-								"XPutImage returned an error (%i)\n",
-								theErr);
-							::abort();
-						}
-					}
+					PutImage(
+						theEvent.xexpose.x,
+						theEvent.xexpose.y,
+						theEvent.xexpose.width,
+						theEvent.xexpose.height);
 					break;
 
 				case KeyPress: {
@@ -285,7 +295,7 @@ TX11ScreenManager::Run(void)
 					// We need to call X11ScreenManager::PowerOffScreen()
 					// Then mPlatform::Quit();
 					// and then we are still stuck in TCLIApp::AppMenuLoop oder MonitorMenuLoop
-					if (theEvent.xclient.data.l[0] == mWMDeleteWindow)
+					if ((Atom) theEvent.xclient.data.l[0] == mWMDeleteWindow)
 					{
 						GetMemory()->GetEmulator()->Quit();
 					}
@@ -439,25 +449,176 @@ TX11ScreenManager::SetupRotateWindow(void)
 	// Create a new image.
 	KUInt32 theWidth = GetActualScreenWidth();
 	KUInt32 theHeight = GetActualScreenHeight();
-	mImage = XCreateImage(
-		mDisplay,
-		mVisual,
-		mDepth /* depth */,
-		ZPixmap /* format */,
-		0 /* offset */,
-		mImageBuffer /* data */,
-		theWidth /* width */,
-		theHeight /* height */,
-		8 /* bitmap_pad */,
-		0 /* bytes per line -- let Xlib compute it */);
+	if (mUseShm)
+	{
+		mImage = XShmCreateImage(
+			mDisplay,
+			mVisual,
+			mDepth /* depth */,
+			ZPixmap /* format */,
+			NULL /* data */,
+			&mShmInfo,
+			theWidth /* width */,
+			theHeight /* height */);
+		if (mImage
+			&& AttachSharedMemory(mImage->bytes_per_line * mImage->height))
+		{
+			mImage->data = mShmInfo.shmaddr;
+		} else
+		{
+			// Fall back to XPutImage.
+			if (mImage)
+			{
+				XDestroyImage(mImage);
+			}
+			DetachSharedMemory();
+			mUseShm = false;
+		}
+	}
+	if (!mUseShm)
+	{
+		mImage = XCreateImage(
+			mDisplay,
+			mVisual,
+			mDepth /* depth */,
+			ZPixmap /* format */,
+			0 /* offset */,
+			mImageBuffer /* data */,
+			theWidth /* width */,
+			theHeight /* height */,
+			8 /* bitmap_pad */,
+			0 /* bytes per line -- let Xlib compute it */);
+	}
 	mBitsPerPixel = mImage->bits_per_pixel;
 	if (mImageBuffer == NULL)
 	{
-		mImageBuffer = (char*) ::malloc((theWidth * theHeight * mBitsPerPixel) / 8);
+		mImageBuffer = (char*) ::malloc(mImage->bytes_per_line * theHeight);
 		mImage->data = mImageBuffer;
 	}
 }
 
+// -------------------------------------------------------------------------- //
+//  * AttachSharedMemory( size_t )
+// -------------------------------------------------------------------------- //
+Boolean
+TX11ScreenManager::AttachSharedMemory(size_t inSize)
+{
+	if (mShmInfo.shmaddr != NULL)
+	{
+		if (inSize <= mShmSize)
+		{
+			return true;
+		}
+		DetachSharedMemory();
+	}
+
+	mShmInfo.shmid = ::shmget(IPC_PRIVATE, inSize, IPC_CREAT | 0600);
+	if (mShmInfo.shmid < 0)
+	{
+		return false;
+	}
+	mShmInfo.shmaddr = (char*) ::shmat(mShmInfo.shmid, NULL, 0);
+	if (mShmInfo.shmaddr == (char*) -1)
+	{
+		mShmInfo.shmaddr = NULL;
+		(void) ::shmctl(mShmInfo.shmid, IPC_RMID, NULL);
+		return false;
+	}
+	mShmInfo.readOnly = False;
+
+	// Servers on another host accept the extension query but refuse the
+	// segment, with an error that only comes back with the next reply.
+	XSync(mDisplay, False);
+	gShmAttachFailed = false;
+	XErrorHandler theOldHandler = XSetErrorHandler(ShmAttachErrorHandler);
+	Status theStatus = XShmAttach(mDisplay, &mShmInfo);
+	XSync(mDisplay, False);
+	(void) XSetErrorHandler(theOldHandler);
+
+	// The segment goes away once both of us have detached it.
+	(void) ::shmctl(mShmInfo.shmid, IPC_RMID, NULL);
+	if (!theStatus || gShmAttachFailed)
+	{
+		(void) ::shmdt(mShmInfo.shmaddr);
+		mShmInfo.shmaddr = NULL;
+		return false;
+	}
+
+	mImageBuffer = mShmInfo.shmaddr;
+	mShmSize = inSize;
+
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * DetachSharedMemory( void )
+// -------------------------------------------------------------------------- //
+void
+TX11ScreenManager::DetachSharedMemory(void)
+{
+	if (mShmInfo.shmaddr != NULL)
+	{
+		(void) XShmDetach(mDisplay, &mShmInfo);
+		XSync(mDisplay, False);
+		(void) ::shmdt(mShmInfo.shmaddr);
+		mShmInfo.shmaddr = NULL;
+		mShmSize = 0;
+		mImageBuffer = NULL;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * PutImage( int, int, unsigned int, unsigned int )
+// -------------------------------------------------------------------------- //
+void
+TX11ScreenManager::PutImage(
+	int inLeft,
+	int inTop,
+	unsigned int inWidth,
+	unsigned int inHeight)
+{
+	if (mUseShm)
+	{
+		// The server reads the pixels from the segment, no copy through the
+		// socket. We don't wait for completion: if the next frame is drawn
+		// while the server reads, it only gets newer pixels.
+		if (!XShmPutImage(
+				mDisplay,
+				mWindow,
+				mGC,
+				mImage,
+				inLeft,
+				inTop,
+				inLeft,
+				inTop,
+				inWidth,
+				inHeight,
+				False /* send_event */))
+		{
+			(void) ::fprintf(stderr, "XShmPutImage failed\n");
+			::abort();
+		}
+	} else
+	{
+		int theErr = XPutImage(
+			mDisplay,
+			mWindow,
+			mGC,
+			mImage,
+			inLeft,
+			inTop,
+			inLeft,
+			inTop,
+			inWidth,
+			inHeight);
+		if (theErr != 0)
+		{
+			(void) ::fprintf(stderr, "XPutImage returned an error (%i)\n", theErr);
+			::abort();
+		}
+	}
+}
+
 // -------------------------------------------------------------------------- //
 //  * FindVisual( void )
 // -------------------------------------------------------------------------- //
@@ -788,6 +949,9 @@ TX11ScreenManager::CreatePalette(void)
 			}
 		}
 	}
+
+	UPixelConversion::PrepareLUT32(&mPalette[0], &mLUT32[0]);
+	UPixelConversion::PrepareLUT32(&mPalette[16], &mLUT32[1]);
 }
 
 // -------------------------------------------------------------------------- //
@@ -988,7 +1152,8 @@ TX11ScreenManager::UpdateScreenRect(SRect* inUpdateRect)
 
 	KUInt8* theScreenBuffer = GetScreenBuffer();
 	KUInt32 theScreenWidth = GetScreenWidth();
-	KUInt32 dstRowBytes = theScreenWidth * mBitsPerPixel / 8;
+	// Rows of a shared image are padded to the scanline pad of the server.
+	KUInt32 dstRowBytes = (KUInt32) mImage->bytes_per_line;
 	KUInt32 srcRowBytes = theScreenWidth * kBitsPerPixel / 8;
 	KUInt32 srcWidthInBytes = width * kBitsPerPixel / 8;
 
@@ -1142,21 +1307,11 @@ TX11ScreenManager::UpdateScreenRect(SRect* inUpdateRect)
 	KUInt32* thePalette = mPalette;
 	if (mBitsPerPixel == 32)
 	{
+		const UPixelConversion::SLUT32& theLUT = mLUT32[paletteBase / 16];
 		for (indexRows = height; indexRows != 0; indexRows--)
 		{
-			KUInt8* srcCursor = srcRowPtr;
-			KUInt8* srcEnd = srcRowPtr + srcWidthInBytes;
-			KUInt32* dstCursor = (KUInt32*) dstRowPtr;
-			do
-			{
-				KUInt8 theByte = *srcCursor++;
-				// First pixel
-				KUInt32 thePixel = (theByte & 0xF0) >> 4;
-				*dstCursor++ = thePalette[paletteBase + thePixel];
-				// Second pixel
-				thePixel = (theByte & 0x0F);
-				*dstCursor++ = thePalette[paletteBase + thePixel];
-			} while (srcCursor < srcEnd);
+			UPixelConversion::Convert4To32(
+				srcRowPtr, (KUInt32*) dstRowPtr, srcWidthInBytes, theLUT);
 			srcRowPtr += srcRowBytes;
 			dstRowPtr += dstRowBytes;
 		}
@@ -1262,22 +1417,7 @@ TX11ScreenManager::UpdateScreenRect(SRect* inUpdateRect)
 #endif
 
 	// Put the image.
-	int theErr = XPutImage(
-		mDisplay,
-		mWindow,
-		mGC,
-		mImage,
-		left,
-		top,
-		left,
-		top,
-		width,
-		height);
-	if (theErr != 0)
-	{
-		(void) ::fprintf(stderr, "XPutImage returned an error (%i)\n", theErr);
-		::abort();
-	}
+	PutImage(left, top, width, height);
 	// Make sure that every rectangle of data is actually sent immediatly,
 	// (this can be optimized by merging multiple requests into a singel one that is
 	// sent no more than 50 times per second, for example)
@@ -1292,7 +1432,6 @@ static const KUInt8 none = 0x2f; // send a '.' for unexpected keycodes
 KUInt8
 TX11ScreenManager::TranslateKeyCode(XEvent inEvent)
 {
-	static int macKeycode = 0;
 	auto X11KeyCode = inEvent.xkey.keycode;
 	// printf("X11 Keycode 0x%08x %d\n", X11KeyCode, X11KeyCode);
 	if (X11KeyCode < sizeof(mKeycodes))
@@ -26,12 +26,14 @@
 
 #include <K/Defines/KDefinitions.h>
 #include "TScreenManager.h"
+#include "UPixelConversion.h"
 
 // X11 - conflict with Quickdraw.
 #ifdef __QUICKDRAW__
 namespace X11NameSpace {
 #endif
 #include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
 #ifdef __QUICKDRAW__
 };
 #endif
@@ -216,6 +218,26 @@ private:
 	///
 	void SetupRotateWindow(void);
 
+	///
+	/// Attach a shared memory segment to the display server.
+	/// The current segment is kept if it is large enough.
+	///
+	/// \param inSize	size of the image, in bytes.
+	/// \return \c false if the server cannot share memory with us
+	///			(e.g. remote displays).
+	///
+	Boolean AttachSharedMemory(size_t inSize);
+
+	///
+	/// Detach and release the shared memory segment, if any.
+	///
+	void DetachSharedMemory(void);
+
+	///
+	/// Send a rectangle of the image to the window.
+	///
+	void PutImage(int inLeft, int inTop, unsigned int inWidth, unsigned int inHeight);
+
 	///
 	/// Find the best visual for our needs.
 	///
@@ -260,8 +282,12 @@ private:
 	KUInt32 mGreenMask; ///< Green mask for the visual.
 	Boolean mAllocColor; ///< If we use a palette.
 	char* mImageBuffer; ///< Image buffer.
+	Boolean mUseShm; ///< If the image is in shared memory.
+	X11Prefix XShmSegmentInfo mShmInfo; ///< Shared memory segment.
+	size_t mShmSize; ///< Size of the shared memory segment.
 	X11Prefix XColor mColors[32]; ///< Grays & greens.
 	KUInt32 mPalette[32]; ///< Grays & greens, as stored.
+	UPixelConversion::SLUT32 mLUT32[2]; ///< Grays & greens, for 32 bits.
 	static const KUInt8 mKeycodes[128]; ///< Keycodes.
 };
 
@@ -0,0 +1,479 @@
+// ==============================
+// File:			UPixelConversion.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "UPixelConversion.h"
+
+// ANSI C & POSIX
+#include <string.h>
+
+// ISO C++
+#include <atomic>
+#include <mutex>
+
+// SSE2 is part of x86-64. AVX2 kernels are compiled with a target attribute
+// and only used if the processor supports them.
+#if defined(__x86_64__) || defined(_M_X64)
+#define PIXELCONVERSION_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define PIXELCONVERSION_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+namespace {
+
+typedef void (*ProcGray)(const KUInt8*, KUInt8*, KUInt32);
+typedef void (*Proc32)(const KUInt8*, KUInt32*, KUInt32, const UPixelConversion::SLUT32&);
+
+// -------------------------------------------------------------------------- //
+//  * Convert4To8GrayPortable( const KUInt8*, KUInt8*, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+Convert4To8GrayPortable(
+	const KUInt8* inSrc,
+	KUInt8* outDst,
+	KUInt32 inSrcBytes)
+{
+	const KUInt8* srcEnd = inSrc + inSrcBytes;
+	while (inSrc < srcEnd)
+	{
+		KUInt8 theByte = *inSrc++;
+		outDst[0] = (theByte & 0xF0) | (theByte >> 4);
+		outDst[1] = (KUInt8) (theByte << 4) | (theByte & 0x0F);
+		outDst += 2;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * Convert4To32Portable( const KUInt8*, KUInt32*, KUInt32, const SLUT32& )
+// -------------------------------------------------------------------------- //
+void
+Convert4To32Portable(
+	const KUInt8* inSrc,
+	KUInt32* outDst,
+	KUInt32 inSrcBytes,
+	const UPixelConversion::SLUT32& inLUT)
+{
+	const KUInt8* srcEnd = inSrc + inSrcBytes;
+	while (inSrc < srcEnd)
+	{
+		::memcpy(outDst, &inLUT.fPairs[*inSrc++], sizeof(KUInt64));
+		outDst += 2;
+	}
+}
+
+#if PIXELCONVERSION_SSE2
+// -------------------------------------------------------------------------- //
+//  * Convert4To8GraySSE2( const KUInt8*, KUInt8*, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+Convert4To8GraySSE2(
+	const KUInt8* inSrc,
+	KUInt8* outDst,
+	KUInt32 inSrcBytes)
+{
+	const __m128i theLowNibbles = _mm_set1_epi8(0x0F);
+	KUInt32 theChunks = inSrcBytes / 16;
+	while (theChunks--)
+	{
+		__m128i theBytes = _mm_loadu_si128((const __m128i*) inSrc);
+		__m128i theLeft = _mm_and_si128(_mm_srli_epi16(theBytes, 4), theLowNibbles);
+		__m128i theRight = _mm_and_si128(theBytes, theLowNibbles);
+		// Replicate each level in both nibbles. No carry crosses bytes.
+		theLeft = _mm_or_si128(theLeft, _mm_slli_epi16(theLeft, 4));
+		theRight = _mm_or_si128(theRight, _mm_slli_epi16(theRight, 4));
+		_mm_storeu_si128((__m128i*) outDst, _mm_unpacklo_epi8(theLeft, theRight));
+		_mm_storeu_si128((__m128i*) (outDst + 16), _mm_unpackhi_epi8(theLeft, theRight));
+		inSrc += 16;
+		outDst += 32;
+	}
+	Convert4To8GrayPortable(inSrc, outDst, inSrcBytes & 15);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Convert4To32SSE2( const KUInt8*, KUInt32*, KUInt32, const SLUT32& )
+// -------------------------------------------------------------------------- //
+void
+Convert4To32SSE2(
+	const KUInt8* inSrc,
+	KUInt32* outDst,
+	KUInt32 inSrcBytes,
+	const UPixelConversion::SLUT32& inLUT)
+{
+	// SSE2 has no byte shuffle: look two pixels up at once and store four.
+	const KUInt64* thePairs = inLUT.fPairs;
+	KUInt32 theChunks = inSrcBytes / 4;
+	while (theChunks--)
+	{
+		_mm_storeu_si128((__m128i*) outDst,
+			_mm_set_epi64x((long long) thePairs[inSrc[1]], (long long) thePairs[inSrc[0]]));
+		_mm_storeu_si128((__m128i*) (outDst + 4),
+			_mm_set_epi64x((long long) thePairs[inSrc[3]], (long long) thePairs[inSrc[2]]));
+		inSrc += 4;
+		outDst += 8;
+	}
+	Convert4To32Portable(inSrc, outDst, inSrcBytes & 3, inLUT);
+}
+#endif
+
+#if PIXELCONVERSION_AVX2
+// -------------------------------------------------------------------------- //
+//  * Convert4To8GrayAVX2( const KUInt8*, KUInt8*, KUInt32 )
+// -------------------------------------------------------------------------- //
+__attribute__((target("avx2"))) void
+Convert4To8GrayAVX2(
+	const KUInt8* inSrc,
+	KUInt8* outDst,
+	KUInt32 inSrcBytes)
+{
+	const __m256i theLowNibbles = _mm256_set1_epi8(0x0F);
+	KUInt32 theChunks = inSrcBytes / 32;
+	while (theChunks--)
+	{
+		__m256i theBytes = _mm256_loadu_si256((const __m256i*) inSrc);
+		__m256i theLeft = _mm256_and_si256(_mm256_srli_epi16(theBytes, 4), theLowNibbles);
+		__m256i theRight = _mm256_and_si256(theBytes, theLowNibbles);
+		theLeft = _mm256_or_si256(theLeft, _mm256_slli_epi16(theLeft, 4));
+		theRight = _mm256_or_si256(theRight, _mm256_slli_epi16(theRight, 4));
+		// Unpacks work within 128 bits lanes: bytes 0-7 & 16-23, 8-15 & 24-31.
+		__m256i theLow = _mm256_unpacklo_epi8(theLeft, theRight);
+		__m256i theHigh = _mm256_unpackhi_epi8(theLeft, theRight);
+		_mm256_storeu_si256((__m256i*) outDst,
+			_mm256_permute2x128_si256(theLow, theHigh, 0x20));
+		_mm256_storeu_si256((__m256i*) (outDst + 32),
+			_mm256_permute2x128_si256(theLow, theHigh, 0x31));
+		inSrc += 32;
+		outDst += 64;
+	}
+	Convert4To8GrayPortable(inSrc, outDst, inSrcBytes & 31);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Convert4To32AVX2( const KUInt8*, KUInt32*, KUInt32, const SLUT32& )
+// -------------------------------------------------------------------------- //
+__attribute__((target("avx2"))) void
+Convert4To32AVX2(
+	const KUInt8* inSrc,
+	KUInt32* outDst,
+	KUInt32 inSrcBytes,
+	const UPixelConversion::SLUT32& inLUT)
+{
+	const __m128i theLowNibbles = _mm_set1_epi8(0x0F);
+	// Each plane holds one byte of the 16 colors, in both lanes.
+	const __m256i thePlane0 = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i*) inLUT.fPlanes[0]));
+	const __m256i thePlane1 = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i*) inLUT.fPlanes[1]));
+	const __m256i thePlane2 = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i*) inLUT.fPlanes[2]));
+	const __m256i thePlane3 = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i*) inLUT.fPlanes[3]));
+	KUInt32 theChunks = inSrcBytes / 16;
+	while (theChunks--)
+	{
+		// 16 bytes are 32 levels, in pixel order.
+		__m128i theBytes = _mm_loadu_si128((const __m128i*) inSrc);
+		__m128i theLeft = _mm_and_si128(_mm_srli_epi16(theBytes, 4), theLowNibbles);
+		__m128i theRight = _mm_and_si128(theBytes, theLowNibbles);
+		__m256i theLevels = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_unpacklo_epi8(theLeft, theRight)),
+			_mm_unpackhi_epi8(theLeft, theRight), 1);
+		__m256i theBytes0 = _mm256_shuffle_epi8(thePlane0, theLevels);
+		__m256i theBytes1 = _mm256_shuffle_epi8(thePlane1, theLevels);
+		__m256i theBytes2 = _mm256_shuffle_epi8(thePlane2, theLevels);
+		__m256i theBytes3 = _mm256_shuffle_epi8(thePlane3, theLevels);
+		// Interleave the planes. Each lane then holds pixels 0-15 & 16-31.
+		__m256i the01Low = _mm256_unpacklo_epi8(theBytes0, theBytes1);
+		__m256i the01High = _mm256_unpackhi_epi8(theBytes0, theBytes1);
+		__m256i the23Low = _mm256_unpacklo_epi8(theBytes2, theBytes3);
+		__m256i the23High = _mm256_unpackhi_epi8(theBytes2, theBytes3);
+		__m256i thePixels0 = _mm256_unpacklo_epi16(the01Low, the23Low);
+		__m256i thePixels1 = _mm256_unpackhi_epi16(the01Low, the23Low);
+		__m256i thePixels2 = _mm256_unpacklo_epi16(the01High, the23High);
+		__m256i thePixels3 = _mm256_unpackhi_epi16(the01High, the23High);
+		_mm256_storeu_si256((__m256i*) outDst,
+			_mm256_permute2x128_si256(thePixels0, thePixels1, 0x20));
+		_mm256_storeu_si256((__m256i*) (outDst + 8),
+			_mm256_permute2x128_si256(thePixels2, thePixels3, 0x20));
+		_mm256_storeu_si256((__m256i*) (outDst + 16),
+			_mm256_permute2x128_si256(thePixels0, thePixels1, 0x31));
+		_mm256_storeu_si256((__m256i*) (outDst + 24),
+			_mm256_permute2x128_si256(thePixels2, thePixels3, 0x31));
+		inSrc += 16;
+		outDst += 32;
+	}
+	Convert4To32Portable(inSrc, outDst, inSrcBytes & 15, inLUT);
+}
+#endif
+
+// -------------------------------------------------------------------------- //
+//  * BestKernels( void )
+// -------------------------------------------------------------------------- //
+UPixelConversion::EKernels
+BestKernels(void)
+{
+	if (UPixelConversion::IsSupported(UPixelConversion::kAVX2Kernels))
+	{
+		return UPixelConversion::kAVX2Kernels;
+	} else if (UPixelConversion::IsSupported(UPixelConversion::kSSE2Kernels))
+	{
+		return UPixelConversion::kSSE2Kernels;
+	}
+	return UPixelConversion::kPortableKernels;
+}
+
+// Screen managers convert from their own threads: the kernels are picked
+// once, and may be changed while other threads convert.
+std::once_flag gKernelsSelected;
+std::atomic<UPixelConversion::EKernels> gKernels { UPixelConversion::kPortableKernels };
+std::atomic<ProcGray> gConvert4To8Gray { nullptr };
+std::atomic<Proc32> gConvert4To32 { nullptr };
+// Grays and greens, only written by the one-time selection.
+UPixelConversion::SLUT32 gRGBALUT32[2];
+
+// -------------------------------------------------------------------------- //
+//  * SelectKernels( EKernels )
+// -------------------------------------------------------------------------- //
+void
+SelectKernels(UPixelConversion::EKernels inKernels)
+{
+	gKernels = inKernels;
+	switch (inKernels)
+	{
+		case UPixelConversion::kScalarKernels:
+			gConvert4To8Gray = UPixelConversion::Convert4To8GrayScalar;
+			gConvert4To32 = UPixelConversion::Convert4To32Scalar;
+			break;
+#if PIXELCONVERSION_SSE2
+		case UPixelConversion::kSSE2Kernels:
+			gConvert4To8Gray = Convert4To8GraySSE2;
+			gConvert4To32 = Convert4To32SSE2;
+			break;
+#endif
+#if PIXELCONVERSION_AVX2
+		case UPixelConversion::kAVX2Kernels:
+			gConvert4To8Gray = Convert4To8GrayAVX2;
+			gConvert4To32 = Convert4To32AVX2;
+			break;
+#endif
+		default:
+			gConvert4To8Gray = Convert4To8GrayPortable;
+			gConvert4To32 = Convert4To32Portable;
+			break;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * PrepareRGBALUT32( Boolean, SLUT32* )
+// -------------------------------------------------------------------------- //
+void
+PrepareRGBALUT32(Boolean inBacklight, UPixelConversion::SLUT32* outLUT)
+{
+	// Red and blue are halved with the backlight.
+	KUInt8 theShift = inBacklight ? 1 : 0;
+	KUInt32 theColors[16];
+	for (int indexLevel = 0; indexLevel < 16; indexLevel++)
+	{
+		KUInt8 theLevel = indexLevel * 0x11;
+		KUInt8 theRGBA[4] = { (KUInt8) (theLevel >> theShift), theLevel,
+			(KUInt8) (theLevel >> theShift), 0 };
+		::memcpy(&theColors[indexLevel], theRGBA, sizeof(theRGBA));
+	}
+	UPixelConversion::PrepareLUT32(theColors, outLUT);
+}
+
+// -------------------------------------------------------------------------- //
+//  * SelectKernelsOnce( void )
+// -------------------------------------------------------------------------- //
+inline void
+SelectKernelsOnce(void)
+{
+	std::call_once(gKernelsSelected, []() {
+		PrepareRGBALUT32(false, &gRGBALUT32[0]);
+		PrepareRGBALUT32(true, &gRGBALUT32[1]);
+		SelectKernels(BestKernels());
+	});
+}
+
+} // namespace
+
+// -------------------------------------------------------------------------- //
+//  * PrepareLUT32( const KUInt32[16], SLUT32* )
+// -------------------------------------------------------------------------- //
+void
+UPixelConversion::PrepareLUT32(
+	const KUInt32 inColors[16],
+	SLUT32* outLUT)
+{
+	int index;
+	for (index = 0; index < 16; index++)
+	{
+		KUInt32 theColor = inColors[index];
+		outLUT->fEntries[index] = theColor;
+		// Planes are in memory order, whatever the host endianness.
+		KUInt8 theBytes[4];
+		::memcpy(theBytes, &theColor, sizeof(theBytes));
+		outLUT->fPlanes[0][index] = theBytes[0];
+		outLUT->fPlanes[1][index] = theBytes[1];
+		outLUT->fPlanes[2][index] = theBytes[2];
+		outLUT->fPlanes[3][index] = theBytes[3];
+	}
+	for (index = 0; index < 256; index++)
+	{
+		KUInt32 thePair[2];
+		thePair[0] = inColors[index >> 4];
+		thePair[1] = inColors[index & 0x0F];
+		::memcpy(&outLUT->fPairs[index], thePair, sizeof(KUInt64));
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * GetRGBALUT32( Boolean )
+// -------------------------------------------------------------------------- //
+const UPixelConversion::SLUT32&
+UPixelConversion::GetRGBALUT32(Boolean inBacklight)
+{
+	SelectKernelsOnce();
+	return gRGBALUT32[inBacklight ? 1 : 0];
+}
+
+// -------------------------------------------------------------------------- //
+//  * IsSupported( EKernels )
+// -------------------------------------------------------------------------- //
+Boolean
+UPixelConversion::IsSupported(EKernels inKernels)
+{
+	switch (inKernels)
+	{
+		case kScalarKernels:
+		case kPortableKernels:
+			return true;
+#if PIXELCONVERSION_SSE2
+		case kSSE2Kernels:
+			return true;
+#endif
+#if PIXELCONVERSION_AVX2
+		case kAVX2Kernels:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") != 0;
+#endif
+		default:
+			return false;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * GetKernels( void )
+// -------------------------------------------------------------------------- //
+UPixelConversion::EKernels
+UPixelConversion::GetKernels(void)
+{
+	SelectKernelsOnce();
+	return gKernels;
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetKernels( EKernels )
+// -------------------------------------------------------------------------- //
+Boolean
+UPixelConversion::SetKernels(EKernels inKernels)
+{
+	if (!IsSupported(inKernels))
+	{
+		return false;
+	}
+	// The first conversion must not pick the best kernels over these.
+	SelectKernelsOnce();
+	SelectKernels(inKernels);
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Convert4To8Gray( const KUInt8*, KUInt8*, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+UPixelConversion::Convert4To8Gray(
+	const KUInt8* inSrc,
+	KUInt8* outDst,
+	KUInt32 inSrcBytes)
+{
+	SelectKernelsOnce();
+	gConvert4To8Gray(inSrc, outDst, inSrcBytes);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Convert4To32( const KUInt8*, KUInt32*, KUInt32, const SLUT32& )
+// -------------------------------------------------------------------------- //
+void
+UPixelConversion::Convert4To32(
+	const KUInt8* inSrc,
+	KUInt32* outDst,
+	KUInt32 inSrcBytes,
+	const SLUT32& inLUT)
+{
+	SelectKernelsOnce();
+	gConvert4To32(inSrc, outDst, inSrcBytes, inLUT);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Convert4To8GrayScalar( const KUInt8*, KUInt8*, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+UPixelConversion::Convert4To8GrayScalar(
+	const KUInt8* inSrc,
+	KUInt8* outDst,
+	KUInt32 inSrcBytes)
+{
+	KUInt32 indexPixels;
+	for (indexPixels = 0; indexPixels < inSrcBytes * 2; indexPixels++)
+	{
+		KUInt8 theByte = inSrc[indexPixels / 2];
+		KUInt8 theLevel = (indexPixels & 1) ? (theByte & 0x0F) : (theByte >> 4);
+		outDst[indexPixels] = theLevel * 0x11;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * Convert4To32Scalar( const KUInt8*, KUInt32*, KUInt32, const SLUT32& )
+// -------------------------------------------------------------------------- //
+void
+UPixelConversion::Convert4To32Scalar(
+	const KUInt8* inSrc,
+	KUInt32* outDst,
+	KUInt32 inSrcBytes,
+	const SLUT32& inLUT)
+{
+	KUInt32 indexPixels;
+	for (indexPixels = 0; indexPixels < inSrcBytes * 2; indexPixels++)
+	{
+		KUInt8 theByte = inSrc[indexPixels / 2];
+		KUInt8 theLevel = (indexPixels & 1) ? (theByte & 0x0F) : (theByte >> 4);
+		outDst[indexPixels] = inLUT.fEntries[theLevel];
+	}
+}
+
+// ============================================================= //
+// The best way to accelerate a Macintosh is at 9.8 m/s^2.       //
+// ============================================================= //
@@ -0,0 +1,156 @@
+// ==============================
+// File:			UPixelConversion.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _UPIXELCONVERSION_H
+#define _UPIXELCONVERSION_H
+
+#include <K/Defines/KDefinitions.h>
+
+///
+/// Conversion of the 4 bits screen buffer to host pixels.
+///
+/// Rows of the screen buffer hold two pixels per byte, the left pixel in the
+/// high nibble, already inverted (0xF is white). Host screen managers expand
+/// these rows to 8 bits gray or to 32 bits pixels through a 16 entries color
+/// table (grays or greens depending on the backlight).
+///
+/// Every conversion has a scalar reference and vectorized kernels (SSE2 and
+/// AVX2 on x86-64). The best kernels supported by the host are selected on
+/// first use. All kernels produce the same pixels as the reference.
+///
+class UPixelConversion
+{
+public:
+	///
+	/// Kernel sets.
+	///
+	enum EKernels {
+		kScalarKernels, ///< Reference, one nibble at a time.
+		kPortableKernels, ///< One byte (two pixels) at a time.
+		kSSE2Kernels, ///< 16 bytes at a time.
+		kAVX2Kernels ///< 32 bytes at a time.
+	};
+
+	///
+	/// Color table for 4 to 32 bits conversions.
+	/// Prepared once from the 16 colors with PrepareLUT32.
+	///
+	struct SLUT32 {
+		KUInt32 fEntries[16]; ///< Color of each gray level.
+		KUInt64 fPairs[256]; ///< Two colors for each source byte.
+		KUInt8 fPlanes[4][16]; ///< Byte n of each color (for shuffles).
+	};
+
+	///
+	/// Prepare a color table.
+	///
+	/// \param inColors		host pixel for each of the 16 levels.
+	/// \param outLUT		table to fill.
+	///
+	static void PrepareLUT32(
+		const KUInt32 inColors[16],
+		SLUT32* outLUT);
+
+	///
+	/// Accessor on the color tables for R G B 0 pixels in memory order.
+	/// They are built once, with the kernel selection.
+	///
+	/// \param inBacklight	\c true for greens, \c false for grays.
+	/// \return the color table.
+	///
+	static const SLUT32& GetRGBALUT32(Boolean inBacklight);
+
+	///
+	/// Determine if a kernel set is supported by the host.
+	///
+	/// \param inKernels	kernel set to check.
+	/// \return \c true if the kernels can run on this host.
+	///
+	static Boolean IsSupported(EKernels inKernels);
+
+	///
+	/// Accessor on the kernel set in use.
+	///
+	/// \return the kernel set used by Convert4To8Gray and Convert4To32.
+	///
+	static EKernels GetKernels(void);
+
+	///
+	/// Select the kernel set (for tests and benchmarks).
+	///
+	/// \param inKernels	kernel set to use.
+	/// \return \c false if the kernels are not supported by the host.
+	///
+	static Boolean SetKernels(EKernels inKernels);
+
+	///
+	/// Expand a row to 8 bits gray (level n becomes n * 0x11).
+	///
+	/// \param inSrc		source row (4 bits).
+	/// \param outDst		destination, 2 * inSrcBytes bytes.
+	/// \param inSrcBytes	number of source bytes.
+	///
+	static void Convert4To8Gray(
+		const KUInt8* inSrc,
+		KUInt8* outDst,
+		KUInt32 inSrcBytes);
+
+	///
+	/// Expand a row to 32 bits pixels through a color table.
+	///
+	/// \param inSrc		source row (4 bits).
+	/// \param outDst		destination, 2 * inSrcBytes pixels.
+	/// \param inSrcBytes	number of source bytes.
+	/// \param inLUT		color table.
+	///
+	static void Convert4To32(
+		const KUInt8* inSrc,
+		KUInt32* outDst,
+		KUInt32 inSrcBytes,
+		const SLUT32& inLUT);
+
+	///
+	/// Reference implementation of Convert4To8Gray.
+	///
+	static void Convert4To8GrayScalar(
+		const KUInt8* inSrc,
+		KUInt8* outDst,
+		KUInt32 inSrcBytes);
+
+	///
+	/// Reference implementation of Convert4To32.
+	///
+	static void Convert4To32Scalar(
+		const KUInt8* inSrc,
+		KUInt32* outDst,
+		KUInt32 inSrcBytes,
+		const SLUT32& inLUT);
+};
+
+#endif
+// _UPIXELCONVERSION_H
+
+// ============================================================= //
+// Any sufficiently advanced bug is indistinguishable from a     //
+// feature.                                                      //
+// ============================================================= //
@@ -42,9 +42,11 @@
 
 #include "Emulator/TARMProcessor.h"
 #include "Emulator/TDMAManager.h"
+#include "Emulator/TEmulator.h"
 #include "Emulator/TInterruptManager.h"
 #include "Emulator/TMemory.h"
 #include "Emulator/Log/TLog.h"
+#include "Emulator/Serial/TSerialCapture.h"
 
 // --- include these to be able to patch the ROM before the emulator starts
 #include "Emulator/JIT/Generic/TJITGenericROMPatch.h"
@@ -459,6 +461,11 @@ TBasicSerialPortManager::WriteRegister(KUInt32 inOffset, KUInt8 inValue)
 			(unsigned int) inValue,
 			(unsigned int) inOffset);
 	}
+	if (mCapture)
+	{
+		mCapture->AddEvent(mInterruptManager ? mInterruptManager->GetTimer() : 0,
+			TSerialCapture::kRegisterRecord, (KUInt8) mNewtPortIndex, inOffset, inValue);
+	}
 	switch (inOffset)
 	{
 		case 0x2400:
@@ -538,6 +545,12 @@ TBasicSerialPortManager::ReadDMARegister(KUInt32 inBank, KUInt32 inChannel, KUIn
 void
 TBasicSerialPortManager::WriteDMARegister(KUInt32 inBank, KUInt32 inChannel, KUInt32 inRegister, KUInt32 inValue)
 {
+	if (mCapture)
+	{
+		mCapture->AddEvent(mInterruptManager ? mInterruptManager->GetTimer() : 0,
+			TSerialCapture::kDMARegisterRecord, (KUInt8) mNewtPortIndex,
+			(inBank << 16) | (inChannel << 8) | inRegister, inValue);
+	}
 	if (inChannel == TDMAManager::kSerialPort0Receive)
 	{
 		return WriteRxDMARegister(inBank, inRegister, inValue);
@@ -550,6 +563,35 @@ TBasicSerialPortManager::WriteDMARegister(KUInt32 inBank, KUInt32 inChannel, KUI
 	}
 }
 
+// -------------------------------------------------------------------------- //
+//  * CaptureData( bool, const KUInt8*, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TBasicSerialPortManager::CaptureData(bool inReceived, const KUInt8* inData, KUInt32 inCount)
+{
+	if (mCapture)
+	{
+		mCapture->AddData(mInterruptManager->GetTimer(),
+			inReceived ? TSerialCapture::kRxRecord : TSerialCapture::kTxRecord,
+			(KUInt8) mNewtPortIndex, inData, inCount);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * RaiseDMAInterrupt( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TBasicSerialPortManager::RaiseDMAInterrupt(KUInt32 inInterrupt)
+{
+	if (mCapture)
+	{
+		mCapture->AddEvent(mInterruptManager->GetTimer(),
+			TSerialCapture::kInterruptRecord, (KUInt8) mNewtPortIndex, inInterrupt,
+			(inInterrupt == 0x00000100) ? mTxDMAEvent : mRxDMAEvent);
+	}
+	mInterruptManager->RaiseInterrupt(inInterrupt);
+}
+
 // -------------------------------------------------------------------------- //
 //  * ReadRxDMARegister( KUInt32, KUInt32, KUInt32 )
 // -------------------------------------------------------------------------- //
@@ -805,6 +847,41 @@ TBasicSerialPortManager::WriteTxDMARegister(KUInt32 inBank, KUInt32 inRegister,
 	}
 }
 
+// -------------------------------------------------------------------------- //
+//  * TSerialChipVoyager::SetSpeed( BitRate )
+//		Drivers pace received data with the bit rate. Only the external port
+//		is emulated with DMA: the chip tells by its hardware base address.
+// -------------------------------------------------------------------------- //
+T_ROM_INJECTION(0x001D6FD4, kROMPatchVoid, kROMPatchVoid, kROMPatchVoid, "SetSpeed__18TSerialChipVoyagerFUl")
+{
+	TEmulator* theEmulator = ioCPU->GetEmulator();
+	TMemory* theMemory = ioCPU->GetMemory();
+	KUInt32 theBase = 0;
+	if (theEmulator && !theMemory->Read(ioCPU->GetRegister(0) + 36, theBase))
+	{
+		// The base may be a virtual address.
+		TMemory::PAddr thePhysicalBase = theBase;
+		if ((theBase < TMemoryConsts::kExternalSerialBase)
+			|| (theBase >= TMemoryConsts::kSerialEnd))
+		{
+			(void) theMemory->TranslateR(theBase, thePhysicalBase);
+		}
+		if ((thePhysicalBase < TMemoryConsts::kExternalSerialBase)
+			|| (thePhysicalBase >= TMemoryConsts::kInfraredSerialBase))
+		{
+			return ioUnit;
+		}
+
+		TBasicSerialPortManager* thePort = dynamic_cast<TBasicSerialPortManager*>(
+			theEmulator->SerialPorts.GetDriverFor(TSerialPorts::kExtr));
+		if (thePort)
+		{
+			thePort->SetBitRate(ioCPU->GetRegister(1));
+		}
+	}
+	return ioUnit;
+}
+
 // -------------------------------------------------------------------------- //
 // Enable the ROM patches below to get an overview of the calls related to
 // serial communication. I left those in for reference and if anyone feels like
@@ -924,12 +1001,6 @@ T_ROM_INJECTION(0x001D6FAC, kROMPatchVoid, kROMPatchVoid, kROMPatchVoid, "SetBre
 	return ioUnit;
 }
 
-T_ROM_INJECTION(0x001D6FD4, kROMPatchVoid, kROMPatchVoid, kROMPatchVoid, "SetSpeed__18TSerialChipVoyagerFUl") {
-	KUInt32 r1 = ioCPU->GetRegister(1);
-	KPrintf("0x001D6FD4: TSerialChipVoyager::SetSpeed(%d)\n", (unsigned)r1);
-	return ioUnit;
-}
-
 T_ROM_INJECTION(0x001D7148, kROMPatchVoid, kROMPatchVoid, kROMPatchVoid, "SetIOParms__18TSerialChipVoyagerFP17TCMOSerialIOParms") {
 	KPrintf("0x001D7148: TSerialChipVoyager::SetIOParms(TCMOSerialIOParms *)\n");
 	return ioUnit;
@@ -26,10 +26,13 @@
 
 #include "TSerialPortManager.h"
 
+#include <atomic>
+
 class TLog;
 class TInterruptManager;
 class TDMAManager;
 class TMemory;
+class TSerialCapture;
 
 ///
 /// Virtual base class to emulate a serial port.
@@ -89,6 +92,24 @@ public:
 	///
 	void WriteDMARegister(KUInt32 inBank, KUInt32 inChannel, KUInt32 inRegister, KUInt32 inValue) override;
 
+	///
+	/// Set the bit rate NewtonOS configured the serial chip for.
+	///
+	void
+	SetBitRate(KUInt32 inBitsPerSecond)
+	{
+		mBitRate.store(inBitsPerSecond, std::memory_order_relaxed);
+	}
+
+	///
+	/// Return the bit rate, or 0 if NewtonOS didn't set it yet.
+	///
+	KUInt32
+	GetBitRate()
+	{
+		return mBitRate.load(std::memory_order_relaxed);
+	}
+
 	///
 	/// DMA or interrupts trigger a command that must be handled by a derived class.
 	///
@@ -98,7 +119,32 @@ public:
 		(void) cmd;
 	}
 
+	///
+	/// Record the traffic of this port, or stop recording with nullptr.
+	/// The capture is not owned by the driver.
+	///
+	void
+	SetCapture(TSerialCapture* inCapture)
+	{
+		mCapture = inCapture;
+	}
+
 protected:
+	///
+	/// Record bytes that went through the port, if a capture is set.
+	///
+	/// \param inReceived	true for bytes received by the Newton.
+	/// \param inData		the bytes.
+	/// \param inCount		number of bytes.
+	///
+	void CaptureData(bool inReceived, const KUInt8* inData, KUInt32 inCount);
+
+	///
+	/// Raise the transmit (0x00000100) or receive (0x00000080) interrupt,
+	/// and record it if a capture is set.
+	///
+	void RaiseDMAInterrupt(KUInt32 inInterrupt);
+
 	///
 	/// Read receiving DMA register.
 	///
@@ -132,6 +178,9 @@ protected:
 	KUInt32 mRxDMABufferSize {}; ///< size of physical buffer
 	KUInt32 mRxDMAControl; ///< bit 1 enables the DMA port
 	KUInt32 mRxDMAEvent; ///< the event that triggered the interrupt?
+
+	std::atomic<KUInt32> mBitRate {}; ///< bits per second set by TSerialChipVoyager::SetSpeed
+	TSerialCapture* mCapture = nullptr; ///< records the traffic, or nullptr
 };
 
 #endif
@@ -356,6 +356,7 @@ TBasiliskIISerialPortManager::HandleDMA()
 				KUInt8 data = 0;
 				mMemory->ReadBP(mTxDMAPhysicalData, data);
 				write(pBasiliskLocalFD, &data, 1);
+				CaptureData(false, &data, 1);
 				mTxDMAPhysicalData++;
 				mTxDMABufferSize--;
 				if (mTxDMABufferSize == 0)
@@ -367,7 +368,7 @@ TBasiliskIISerialPortManager::HandleDMA()
 				{
 					// trigger a "send buffer empty" interrupt
 					mTxDMAEvent = 0x00000080;
-					mInterruptManager->RaiseInterrupt(0x00000100);
+					RaiseDMAInterrupt(0x00000100);
 				}
 			}
 		}
@@ -424,6 +425,7 @@ TBasiliskIISerialPortManager::HandleDMA()
 			} else
 			{
 				// handle incomming data (ignore buf[0]!)
+				CaptureData(true, buf + 1, n - 1);
 				for (int i = 1; i < n; i++)
 				{
 					KUInt8 data = buf[i];
@@ -441,7 +443,7 @@ TBasiliskIISerialPortManager::HandleDMA()
 					}
 				}
 				mRxDMAEvent = 0x00000040;
-				mInterruptManager->RaiseInterrupt(0x00000080); // 0x00000180
+				RaiseDMAInterrupt(0x00000080); // 0x00000180
 			}
 		}
 
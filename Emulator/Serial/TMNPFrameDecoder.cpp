@@ -0,0 +1,270 @@
+// ==============================
+// File:			TMNPFrameDecoder.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include "TMNPFrameDecoder.h"
+
+// ANSI C & POSIX
+#include <stdio.h>
+#include <string.h>
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+#define kSYN 0x16
+#define kDLE 0x10
+#define kSTX 0x02
+#define kETX 0x03
+
+// Dock commands start with this, followed by the command and its length.
+#define kDockSignature "newtdock"
+#define kDockHeaderSize 16
+
+// -------------------------------------------------------------------------- //
+//  * TMNPFrameDecoder( void )
+// -------------------------------------------------------------------------- //
+TMNPFrameDecoder::TMNPFrameDecoder(void) :
+		mState(kIdle),
+		mFrameSize(0),
+		mRawCount(0),
+		mCRC(0),
+		mCRCValid(false),
+		mDiscarded(0)
+{
+}
+
+// -------------------------------------------------------------------------- //
+//  * AddByte( KUInt8 )
+// -------------------------------------------------------------------------- //
+bool
+TMNPFrameDecoder::AddByte(KUInt8 inByte)
+{
+	switch (mState)
+	{
+		case kIdle:
+			if (inByte == kSYN)
+			{
+				mState = kSyn;
+				mRawCount = 1;
+			} else
+			{
+				mDiscarded++;
+			}
+			break;
+
+		case kSyn:
+			if (inByte == kDLE)
+			{
+				mState = kDle;
+				mRawCount++;
+			} else if (inByte == kSYN)
+			{
+				// Only the last SYN starts the frame.
+				mDiscarded++;
+			} else
+			{
+				Reset(mRawCount + 1);
+			}
+			break;
+
+		case kDle:
+			if (inByte == kSTX)
+			{
+				mState = kData;
+				mRawCount++;
+				mFrameSize = 0;
+			} else
+			{
+				Reset(mRawCount + 1);
+			}
+			break;
+
+		case kData:
+			mRawCount++;
+			if (inByte == kDLE)
+			{
+				mState = kDataDle;
+			} else if (mFrameSize < kMaxFrameSize)
+			{
+				mFrame[mFrameSize++] = inByte;
+			} else
+			{
+				Reset(mRawCount);
+			}
+			break;
+
+		case kDataDle:
+			mRawCount++;
+			if ((inByte == kDLE) && (mFrameSize < kMaxFrameSize))
+			{
+				mState = kData;
+				mFrame[mFrameSize++] = inByte;
+			} else if (inByte == kETX)
+			{
+				mState = kCRCLow;
+			} else
+			{
+				Reset(mRawCount);
+			}
+			break;
+
+		case kCRCLow:
+			mCRC = inByte;
+			mState = kCRCHigh;
+			break;
+
+		case kCRCHigh:
+		{
+			mCRC |= (KUInt16) (inByte << 8);
+			// The CRC covers the frame and ETX.
+			const KUInt8 theETX = kETX;
+			KUInt16 theCRC = ComputeCRC(mFrame, mFrameSize);
+			theCRC = ComputeCRC(&theETX, 1, theCRC);
+			mCRCValid = (theCRC == mCRC);
+			mState = kIdle;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Reset( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TMNPFrameDecoder::Reset(KUInt32 inCount)
+{
+	mDiscarded += inCount;
+	mState = kIdle;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Describe( char*, KUInt32 ) const
+// -------------------------------------------------------------------------- //
+void
+TMNPFrameDecoder::Describe(char* outText, KUInt32 inSize) const
+{
+	if (mFrameSize < 2)
+	{
+		(void) ::snprintf(outText, inSize, "short frame (%u bytes)",
+			(unsigned int) mFrameSize);
+		return;
+	}
+
+	int theLength = 0;
+	switch (mFrame[1])
+	{
+		case kLRFrame:
+			theLength = ::snprintf(outText, inSize, "LR");
+			break;
+
+		case kLDFrame:
+			theLength = ::snprintf(outText, inSize, "LD");
+			break;
+
+		case kLTFrame:
+		{
+			KUInt32 theSequence = (mFrameSize > 2) ? mFrame[2] : 0;
+			KUInt32 theOffset = mFrame[0] + 1;
+			KUInt32 theCount = (theOffset < mFrameSize) ? mFrameSize - theOffset : 0;
+			theLength = ::snprintf(outText, inSize, "LT seq %u, %u bytes",
+				(unsigned int) theSequence, (unsigned int) theCount);
+
+			// Dock commands may span several frames, only the first one
+			// has the header.
+			const KUInt8* thePayload = mFrame + theOffset;
+			if ((theCount >= kDockHeaderSize)
+				&& (::memcmp(thePayload, kDockSignature, 8) == 0)
+				&& (theLength >= 0) && ((KUInt32) theLength < inSize))
+			{
+				char theCommand[5];
+				for (int indexChar = 0; indexChar < 4; indexChar++)
+				{
+					KUInt8 theChar = thePayload[8 + indexChar];
+					theCommand[indexChar] = ((theChar >= 0x20) && (theChar < 0x7F)) ? (char) theChar : '.';
+				}
+				theCommand[4] = 0;
+				KUInt32 theCommandLength = ((KUInt32) thePayload[12] << 24)
+					| ((KUInt32) thePayload[13] << 16)
+					| ((KUInt32) thePayload[14] << 8) | (KUInt32) thePayload[15];
+				theLength += ::snprintf(outText + theLength, inSize - theLength,
+					", newtdock '%s' %u bytes", theCommand,
+					(unsigned int) theCommandLength);
+			}
+			break;
+		}
+
+		case kLAFrame:
+			theLength = ::snprintf(outText, inSize, "LA seq %u, credit %u",
+				(unsigned int) ((mFrameSize > 2) ? mFrame[2] : 0),
+				(unsigned int) ((mFrameSize > 3) ? mFrame[3] : 0));
+			break;
+
+		case kLNFrame:
+			theLength = ::snprintf(outText, inSize, "LN");
+			break;
+
+		case kLNAFrame:
+			theLength = ::snprintf(outText, inSize, "LNA");
+			break;
+
+		default:
+			theLength = ::snprintf(outText, inSize, "type 0x%02X, %u bytes",
+				(unsigned int) mFrame[1], (unsigned int) mFrameSize);
+			break;
+	}
+
+	if (!mCRCValid && (theLength >= 0) && ((KUInt32) theLength < inSize))
+	{
+		(void) ::snprintf(outText + theLength, inSize - theLength, ", bad CRC");
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * ComputeCRC( const KUInt8*, KUInt32, KUInt16 )
+// -------------------------------------------------------------------------- //
+KUInt16
+TMNPFrameDecoder::ComputeCRC(const KUInt8* inData, KUInt32 inCount, KUInt16 inCRC)
+{
+	KUInt16 theCRC = inCRC;
+	for (KUInt32 indexByte = 0; indexByte < inCount; indexByte++)
+	{
+		theCRC ^= inData[indexByte];
+		for (int indexBit = 0; indexBit < 8; indexBit++)
+		{
+			if (theCRC & 1)
+			{
+				theCRC = (theCRC >> 1) ^ 0xA001;
+			} else
+			{
+				theCRC >>= 1;
+			}
+		}
+	}
+	return theCRC;
+}
+
+// ============================================ //
+// It's not a bug, it's a feature.              //
+// ============================================ //
@@ -0,0 +1,158 @@
+// ==============================
+// File:			TMNPFrameDecoder.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _T_MNP_FRAME_DECODER_H
+#define _T_MNP_FRAME_DECODER_H
+
+#include <K/Defines/KDefinitions.h>
+
+///
+/// Find the MNP frames in a stream of serial bytes.
+///
+/// NewtonOS talks to the Dock and to NCU over MNP: frames start with
+/// SYN DLE STX, end with DLE ETX and a CRC-16, and DLE bytes inside the frame
+/// are doubled. The first byte of a frame is the length of the header, the
+/// second one the type of the frame.
+///
+class TMNPFrameDecoder
+{
+public:
+	enum {
+		kMaxFrameSize = 1024 ///< Longer frames are discarded.
+	};
+
+	/// Frame types.
+	enum EFrameType {
+		kLRFrame = 1, ///< Link request.
+		kLDFrame = 2, ///< Link disconnect.
+		kLTFrame = 4, ///< Link transfer (data).
+		kLAFrame = 5, ///< Link acknowledge.
+		kLNFrame = 6, ///< Link attention.
+		kLNAFrame = 7 ///< Link attention acknowledge.
+	};
+
+	///
+	/// Constructor.
+	///
+	TMNPFrameDecoder(void);
+
+	///
+	/// Feed the next byte of the stream.
+	///
+	/// \param inByte	byte sent or received.
+	/// \return \c true if the byte completed a frame.
+	///
+	bool AddByte(KUInt8 inByte);
+
+	///
+	/// Accessor on the frame completed by the last byte, without the framing
+	/// and the CRC. It is overwritten by the next frame.
+	///
+	const KUInt8*
+	GetFrame(void) const
+	{
+		return mFrame;
+	}
+
+	///
+	/// Accessor on the size of the last frame.
+	///
+	KUInt32
+	GetFrameSize(void) const
+	{
+		return mFrameSize;
+	}
+
+	///
+	/// Determine if the CRC of the last frame matched.
+	///
+	bool
+	IsCRCValid(void) const
+	{
+		return mCRCValid;
+	}
+
+	///
+	/// Accessor on the number of bytes found outside of frames so far.
+	///
+	KUInt32
+	GetDiscardedCount(void) const
+	{
+		return mDiscarded;
+	}
+
+	///
+	/// Describe the last frame in a line of text: type, sequence numbers
+	/// and, for data, the Dock command if the payload starts with one.
+	///
+	/// \param outText	buffer for the description.
+	/// \param inSize	size of the buffer.
+	///
+	void Describe(char* outText, KUInt32 inSize) const;
+
+	///
+	/// Compute the CRC-16 of MNP frames (polynomial 0xA001, reflected).
+	///
+	/// \param inData	bytes.
+	/// \param inCount	number of bytes.
+	/// \param inCRC	CRC of the previous bytes.
+	/// \return the new CRC.
+	///
+	static KUInt16 ComputeCRC(const KUInt8* inData, KUInt32 inCount, KUInt16 inCRC = 0);
+
+private:
+	/// States of the decoder.
+	enum EState {
+		kIdle, ///< Waiting for SYN.
+		kSyn, ///< Waiting for DLE.
+		kDle, ///< Waiting for STX.
+		kData, ///< In the frame.
+		kDataDle, ///< After a DLE in the frame.
+		kCRCLow, ///< Waiting for the low byte of the CRC.
+		kCRCHigh ///< Waiting for the high byte of the CRC.
+	};
+
+	///
+	/// Go back to waiting for a frame, counting the bytes of a partial frame.
+	///
+	/// \param inCount	bytes to count as discarded.
+	///
+	void Reset(KUInt32 inCount);
+
+	/// \name Variables
+	EState mState; ///< State of the decoder.
+	KUInt8 mFrame[kMaxFrameSize]; ///< Frame being read, or the last frame.
+	KUInt32 mFrameSize; ///< Bytes in mFrame.
+	KUInt32 mRawCount; ///< Bytes of the frame being read, with the framing.
+	KUInt16 mCRC; ///< CRC read after the frame.
+	bool mCRCValid; ///< If the CRC of the last frame matched.
+	KUInt32 mDiscarded; ///< Bytes found outside of frames.
+};
+
+#endif
+// _T_MNP_FRAME_DECODER_H
+
+// ============================================ //
+// Never trust a computer you can't throw out   //
+// a window.                                    //
+// ============================================ //
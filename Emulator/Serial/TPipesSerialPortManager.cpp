@@ -282,6 +282,7 @@ TPipesSerialPortManager::HandleDMA()
 				mMemory->ReadBP(mTxDMAPhysicalData, data);
 				// KPrintf(":::::>> TX: 0x%02X '%c'\n", data, isprint(data)?data:'.');
 				write(mTxPort, &data, 1);
+				CaptureData(false, &data, 1);
 				mTxDMAPhysicalData++;
 				mTxDMABufferSize--;
 				if (mTxDMABufferSize == 0)
@@ -295,7 +296,7 @@ TPipesSerialPortManager::HandleDMA()
 					// mDMAManager->WriteChannel2Register(1, 1, 0x00000080); // 0x80 = TxBufEmpty, 0x00000180
 					// KPrintf(":::::>> buffer is now empty\n");
 					mTxDMAEvent = 0x00000080;
-					mInterruptManager->RaiseInterrupt(0x00000100);
+					RaiseDMAInterrupt(0x00000100);
 				}
 			}
 		}
@@ -333,6 +334,7 @@ TPipesSerialPortManager::HandleDMA()
 			} else
 			{
 				// KPrintf("----> Received %d bytes data from NCX\n", n);
+				CaptureData(true, buf, n);
 				for (int i = 0; i < n; i++)
 				{
 					KUInt8 data = buf[i];
@@ -353,7 +355,7 @@ TPipesSerialPortManager::HandleDMA()
 				}
 				// KPrintf("===> Start Rx DMA\n");
 				mRxDMAEvent = 0x00000040;
-				mInterruptManager->RaiseInterrupt(0x00000080); // 0x00000180
+				RaiseDMAInterrupt(0x00000080); // 0x00000180
 				// KPrintf("===> End Rx DMA\n");
 			}
 		}
@@ -227,6 +227,7 @@ TPtySerialPortManager::HandleDMA()
 				mMemory->ReadBP(mTxDMAPhysicalData, data);
 				// KPrintf(":::::>> TX: 0x%02X '%c'\n", data, isprint(data)?data:'.');
 				write(mPtyPort, &data, 1);
+				CaptureData(false, &data, 1);
 				mTxDMAPhysicalData++;
 				mTxDMABufferSize--;
 				if (mTxDMABufferSize == 0)
@@ -240,7 +241,7 @@ TPtySerialPortManager::HandleDMA()
 					// mDMAManager->WriteChannel2Register(1, 1, 0x00000080); // 0x80 = TxBufEmpty, 0x00000180
 					// KPrintf(":::::>> buffer is now empty\n");
 					mTxDMAEvent = 0x00000080;
-					mInterruptManager->RaiseInterrupt(0x00000100);
+					RaiseDMAInterrupt(0x00000100);
 				}
 			}
 		}
@@ -279,6 +280,7 @@ TPtySerialPortManager::HandleDMA()
 			} else
 			{
 				// KPrintf("----> Received %d bytes data from NCX\n", n);
+				CaptureData(true, buf, n);
 				for (int i = 0; i < n; i++)
 				{
 					KUInt8 data = buf[i];
@@ -299,7 +301,7 @@ TPtySerialPortManager::HandleDMA()
 				}
 				// KPrintf("===> Start Rx DMA\n");
 				mRxDMAEvent = 0x00000040;
-				mInterruptManager->RaiseInterrupt(0x00000080); // 0x00000180
+				RaiseDMAInterrupt(0x00000080); // 0x00000180
 				// KPrintf("===> End Rx DMA\n");
 			}
 		}
@@ -0,0 +1,286 @@
+// ==============================
+// File:			TSerialCapture.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include "TSerialCapture.h"
+
+// ANSI C & POSIX
+#include <string.h>
+
+// C++
+#include <chrono>
+
+#include "Emulator/TInterruptManager.h"
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+// How often the thread writes the records to the file.
+#define kFlushMilliseconds 10
+
+// -------------------------------------------------------------------------- //
+//  * WriteSerialCapture16( FILE*, KUInt32 )
+// -------------------------------------------------------------------------- //
+static inline void
+WriteSerialCapture16(FILE* inFile, KUInt32 inValue)
+{
+	(void) ::fputc((inValue >> 8) & 0xFF, inFile);
+	(void) ::fputc(inValue & 0xFF, inFile);
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteSerialCapture32( FILE*, KUInt32 )
+// -------------------------------------------------------------------------- //
+static inline void
+WriteSerialCapture32(FILE* inFile, KUInt32 inValue)
+{
+	WriteSerialCapture16(inFile, inValue >> 16);
+	WriteSerialCapture16(inFile, inValue);
+}
+
+// -------------------------------------------------------------------------- //
+//  * TSerialCapture( const char* )
+// -------------------------------------------------------------------------- //
+TSerialCapture::TSerialCapture(const char* inPath) :
+		mFile(nullptr),
+		mSlots(nullptr),
+		mHead(0),
+		mTail(0),
+		mDropped(0),
+		mDroppedTotal(0),
+		mLastTime(0),
+		mQuit(false),
+		mThread(nullptr)
+{
+	mFile = ::fopen(inPath, "wb");
+	if (mFile == nullptr)
+	{
+		return;
+	}
+	WriteSerialCapture32(mFile, kSignature);
+	WriteSerialCapture16(mFile, kVersion);
+	WriteSerialCapture16(mFile, 0);
+	WriteSerialCapture32(mFile, TInterruptManager::kTicksPerSecond);
+
+	// A slot may be filled when its sequence is the index of the record.
+	mSlots = new SSlot[kRingSize];
+	for (KUInt32 indexSlot = 0; indexSlot < kRingSize; indexSlot++)
+	{
+		mSlots[indexSlot].fSequence.store(indexSlot, std::memory_order_relaxed);
+	}
+
+	mThread = new std::thread(&TSerialCapture::Run, this);
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TSerialCapture( void )
+// -------------------------------------------------------------------------- //
+TSerialCapture::~TSerialCapture(void)
+{
+	if (mThread)
+	{
+		mQuit = true;
+		mThread->join();
+		delete mThread;
+	}
+	if (mFile)
+	{
+		(void) ::fclose(mFile);
+	}
+	delete[] mSlots;
+}
+
+// -------------------------------------------------------------------------- //
+//  * AddData( KUInt32, ERecord, KUInt8, const KUInt8*, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TSerialCapture::AddData(
+	KUInt32 inTime,
+	ERecord inType,
+	KUInt8 inPort,
+	const KUInt8* inData,
+	KUInt32 inCount)
+{
+	SRecord theRecord;
+	theRecord.fTime = inTime;
+	theRecord.fType = (KUInt8) inType;
+	theRecord.fPort = inPort;
+	theRecord.fArg[0] = 0;
+	theRecord.fArg[1] = 0;
+	while (inCount > 0)
+	{
+		KUInt32 theCount = inCount;
+		if (theCount > kMaxDataPerRecord)
+		{
+			theCount = kMaxDataPerRecord;
+		}
+		theRecord.fCount = (KUInt8) theCount;
+		(void) ::memcpy(theRecord.fData, inData, theCount);
+		Push(theRecord);
+		inData += theCount;
+		inCount -= theCount;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * AddEvent( KUInt32, ERecord, KUInt8, KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TSerialCapture::AddEvent(
+	KUInt32 inTime,
+	ERecord inType,
+	KUInt8 inPort,
+	KUInt32 inArg0,
+	KUInt32 inArg1)
+{
+	SRecord theRecord {};
+	theRecord.fTime = inTime;
+	theRecord.fType = (KUInt8) inType;
+	theRecord.fPort = inPort;
+	theRecord.fCount = 0;
+	theRecord.fArg[0] = inArg0;
+	theRecord.fArg[1] = inArg1;
+	Push(theRecord);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Push( const SRecord& )
+//		The emulator and the driver threads both add records: each claims a
+//		slot by moving the head, and publishes the record with the sequence
+//		of the slot.
+// -------------------------------------------------------------------------- //
+void
+TSerialCapture::Push(const SRecord& inRecord)
+{
+	if (mSlots == nullptr)
+	{
+		return;
+	}
+
+	KUInt32 thePosition = mHead.load(std::memory_order_relaxed);
+	SSlot* theSlot;
+	for (;;)
+	{
+		theSlot = &mSlots[thePosition & (kRingSize - 1)];
+		KUInt32 theSequence = theSlot->fSequence.load(std::memory_order_acquire);
+		KSInt32 theDifference = (KSInt32) (theSequence - thePosition);
+		if (theDifference == 0)
+		{
+			if (mHead.compare_exchange_weak(
+					thePosition, thePosition + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		} else if (theDifference < 0)
+		{
+			// The ring is full: never wait for the thread.
+			mDropped++;
+			mDroppedTotal++;
+			return;
+		} else
+		{
+			thePosition = mHead.load(std::memory_order_relaxed);
+		}
+	}
+	theSlot->fRecord = inRecord;
+	theSlot->fSequence.store(thePosition + 1, std::memory_order_release);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Drain( void )
+// -------------------------------------------------------------------------- //
+KUInt32
+TSerialCapture::Drain(void)
+{
+	KUInt32 theCount = 0;
+	for (;;)
+	{
+		SSlot* theSlot = &mSlots[mTail & (kRingSize - 1)];
+		if (theSlot->fSequence.load(std::memory_order_acquire) != mTail + 1)
+		{
+			break;
+		}
+		Write(theSlot->fRecord);
+		// The slot is free for the next turn of the ring.
+		theSlot->fSequence.store(mTail + kRingSize, std::memory_order_release);
+		mTail++;
+		theCount++;
+	}
+
+	KUInt32 theDropped = mDropped.exchange(0);
+	if (theDropped)
+	{
+		SRecord theRecord {};
+		theRecord.fTime = mLastTime;
+		theRecord.fType = kDroppedRecord;
+		theRecord.fPort = 0;
+		theRecord.fCount = 0;
+		theRecord.fArg[0] = theDropped;
+		theRecord.fArg[1] = 0;
+		Write(theRecord);
+	}
+
+	return theCount;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Write( const SRecord& )
+// -------------------------------------------------------------------------- //
+void
+TSerialCapture::Write(const SRecord& inRecord)
+{
+	mLastTime = inRecord.fTime;
+	WriteSerialCapture32(mFile, inRecord.fTime);
+	(void) ::fputc(inRecord.fType, mFile);
+	(void) ::fputc(inRecord.fPort, mFile);
+	(void) ::fputc(inRecord.fCount, mFile);
+	(void) ::fputc(0, mFile);
+	WriteSerialCapture32(mFile, inRecord.fArg[0]);
+	WriteSerialCapture32(mFile, inRecord.fArg[1]);
+	KUInt8 theData[kMaxDataPerRecord] = { 0 };
+	(void) ::memcpy(theData, inRecord.fData, inRecord.fCount);
+	(void) ::fwrite(theData, 1, kMaxDataPerRecord, mFile);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Run( void )
+// -------------------------------------------------------------------------- //
+void
+TSerialCapture::Run(void)
+{
+	while (!mQuit)
+	{
+		if (Drain())
+		{
+			(void) ::fflush(mFile);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(kFlushMilliseconds));
+	}
+	(void) Drain();
+	(void) ::fflush(mFile);
+}
+
+// ============================================ //
+// Bugs, bugs everywhere, and not a drop to     //
+// drink.                                       //
+// ============================================ //
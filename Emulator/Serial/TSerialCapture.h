@@ -0,0 +1,208 @@
+// ==============================
+// File:			TSerialCapture.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _T_SERIAL_CAPTURE_H
+#define _T_SERIAL_CAPTURE_H
+
+#include <K/Defines/KDefinitions.h>
+
+#include <atomic>
+#include <stdio.h>
+#include <thread>
+
+///
+/// Record the traffic of the serial ports into a file.
+///
+/// The serial drivers and the emulator add records to a lock-free ring
+/// without ever waiting, and a thread writes them to the file. If the ring is
+/// full, records are lost and a kDroppedRecord tells how many.
+///
+/// The file starts with kSignature (32 bits), kVersion (16 bits), 16
+/// reserved bits and the number of timer ticks per second (32 bits),
+/// followed by 32 bytes records: time in timer ticks (32 bits), ERecord
+/// (8 bits), TSerialPorts::EPortIndex (8 bits), number of bytes (8 bits),
+/// 8 reserved bits, two arguments (32 bits each) and 16 bytes of data.
+/// Values are big endian.
+///
+/// Longer transfers are split into several records.
+///
+class TSerialCapture
+{
+public:
+	/// File constants.
+	enum {
+		kSignature = 'ESER',
+		kVersion = 1,
+		kHeaderSize = 12,
+		kRecordSize = 32,
+		kMaxDataPerRecord = 16,
+		kRingSize = 8192 ///< Records in the ring, a power of two.
+	};
+
+	/// Record types.
+	enum ERecord {
+		kTxRecord = 0, ///< Bytes sent by the Newton.
+		kRxRecord = 1, ///< Bytes received by the Newton.
+		kRegisterRecord = 2, ///< Register write: offset, value.
+		kDMARegisterRecord = 3, ///< DMA register write: bank << 16 | channel << 8 | register, value.
+		kInterruptRecord = 4, ///< Interrupt raised by the driver: mask, DMA event.
+		kDroppedRecord = 5 ///< Records lost because the ring was full: count.
+	};
+
+	/// A record, in host byte order.
+	struct SRecord {
+		KUInt32 fTime; ///< Timer ticks.
+		KUInt8 fType; ///< ERecord.
+		KUInt8 fPort; ///< TSerialPorts::EPortIndex.
+		KUInt8 fCount; ///< Bytes in fData.
+		KUInt32 fArg[2]; ///< Arguments.
+		KUInt8 fData[kMaxDataPerRecord]; ///< Bytes sent or received.
+	};
+
+	///
+	/// Constructor from a path.
+	/// The file is created and the writing thread started.
+	///
+	/// \param inPath	path of the capture file.
+	///
+	TSerialCapture(const char* inPath);
+
+	///
+	/// Destructor.
+	/// Writes the pending records and closes the file.
+	///
+	~TSerialCapture(void);
+
+	///
+	/// Determine if the file could be created.
+	///
+	/// \return \c true if records are written.
+	///
+	bool
+	IsOpen(void) const
+	{
+		return mFile != nullptr;
+	}
+
+	///
+	/// Record bytes sent or received.
+	///
+	/// \param inTime	timer ticks.
+	/// \param inType	kTxRecord or kRxRecord.
+	/// \param inPort	serial port.
+	/// \param inData	bytes.
+	/// \param inCount	number of bytes.
+	///
+	void AddData(
+		KUInt32 inTime,
+		ERecord inType,
+		KUInt8 inPort,
+		const KUInt8* inData,
+		KUInt32 inCount);
+
+	///
+	/// Record a register write or an interrupt.
+	///
+	/// \param inTime	timer ticks.
+	/// \param inType	type of the record.
+	/// \param inPort	serial port.
+	/// \param inArg0	first argument.
+	/// \param inArg1	second argument.
+	///
+	void AddEvent(
+		KUInt32 inTime,
+		ERecord inType,
+		KUInt8 inPort,
+		KUInt32 inArg0,
+		KUInt32 inArg1);
+
+	///
+	/// Accessor on the number of records lost so far.
+	///
+	KUInt32
+	GetDroppedCount(void) const
+	{
+		return mDroppedTotal;
+	}
+
+private:
+	/// A slot of the ring. fSequence tells who may use the slot next.
+	struct SSlot {
+		std::atomic<KUInt32> fSequence;
+		SRecord fRecord;
+	};
+
+	///
+	/// Add a record to the ring, or count it as lost.
+	///
+	void Push(const SRecord& inRecord);
+
+	///
+	/// Write the records in the ring to the file.
+	///
+	/// \return the number of records written.
+	///
+	KUInt32 Drain(void);
+
+	///
+	/// Write a record to the file.
+	///
+	void Write(const SRecord& inRecord);
+
+	///
+	/// Loop of the writing thread.
+	///
+	void Run(void);
+
+	///
+	/// Constructeur par copie volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TSerialCapture(const TSerialCapture& inCopy);
+
+	///
+	/// Opérateur d'assignation volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TSerialCapture& operator=(const TSerialCapture& inCopy);
+
+	/// \name Variables
+	FILE* mFile; ///< Capture file.
+	SSlot* mSlots; ///< The ring.
+	std::atomic<KUInt32> mHead; ///< Next slot to fill, shared by the producers.
+	KUInt32 mTail; ///< Next slot to write, owned by the thread.
+	std::atomic<KUInt32> mDropped; ///< Records lost since the last kDroppedRecord.
+	std::atomic<KUInt32> mDroppedTotal; ///< Records lost since the start.
+	KUInt32 mLastTime; ///< Time of the last record written.
+	std::atomic<bool> mQuit; ///< The thread must end.
+	std::thread* mThread; ///< The writing thread.
+};
+
+#endif
+// _T_SERIAL_CAPTURE_H
+
+// ============================================ //
+// Trust, but verify.                           //
+// ============================================ //
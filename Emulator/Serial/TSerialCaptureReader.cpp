@@ -0,0 +1,116 @@
+// ==============================
+// File:			TSerialCaptureReader.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include "TSerialCaptureReader.h"
+
+// ANSI C & POSIX
+#include <string.h>
+
+// -------------------------------------------------------------------------- //
+//  * ReadSerialCapture32( const KUInt8* )
+// -------------------------------------------------------------------------- //
+static inline KUInt32
+ReadSerialCapture32(const KUInt8* inBytes)
+{
+	return ((KUInt32) inBytes[0] << 24) | ((KUInt32) inBytes[1] << 16)
+		| ((KUInt32) inBytes[2] << 8) | (KUInt32) inBytes[3];
+}
+
+// -------------------------------------------------------------------------- //
+//  * TSerialCaptureReader( const char* )
+// -------------------------------------------------------------------------- //
+TSerialCaptureReader::TSerialCaptureReader(const char* inPath) :
+		mFile(nullptr),
+		mTicksPerSecond(0),
+		mHasTimer(false),
+		mTimer(0),
+		mTime(0)
+{
+	mFile = ::fopen(inPath, "rb");
+	if (mFile == nullptr)
+	{
+		return;
+	}
+
+	KUInt8 theHeader[TSerialCapture::kHeaderSize];
+	if ((::fread(theHeader, 1, sizeof(theHeader), mFile) != sizeof(theHeader))
+		|| (ReadSerialCapture32(theHeader) != (KUInt32) TSerialCapture::kSignature)
+		|| (((theHeader[4] << 8) | theHeader[5]) != TSerialCapture::kVersion)
+		|| ((mTicksPerSecond = ReadSerialCapture32(theHeader + 8)) == 0))
+	{
+		(void) ::fclose(mFile);
+		mFile = nullptr;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TSerialCaptureReader( void )
+// -------------------------------------------------------------------------- //
+TSerialCaptureReader::~TSerialCaptureReader(void)
+{
+	if (mFile)
+	{
+		(void) ::fclose(mFile);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * ReadRecord( TSerialCapture::SRecord* )
+// -------------------------------------------------------------------------- //
+bool
+TSerialCaptureReader::ReadRecord(TSerialCapture::SRecord* outRecord)
+{
+	KUInt8 theBytes[TSerialCapture::kRecordSize];
+	if ((mFile == nullptr)
+		|| (::fread(theBytes, 1, sizeof(theBytes), mFile) != sizeof(theBytes)))
+	{
+		return false;
+	}
+
+	outRecord->fTime = ReadSerialCapture32(theBytes);
+	outRecord->fType = theBytes[4];
+	outRecord->fPort = theBytes[5];
+	outRecord->fCount = theBytes[6];
+	if (outRecord->fCount > TSerialCapture::kMaxDataPerRecord)
+	{
+		return false;
+	}
+	outRecord->fArg[0] = ReadSerialCapture32(theBytes + 8);
+	outRecord->fArg[1] = ReadSerialCapture32(theBytes + 12);
+	(void) ::memcpy(outRecord->fData, theBytes + 16, TSerialCapture::kMaxDataPerRecord);
+
+	// The timer wraps around every 20 minutes or so.
+	if (mHasTimer)
+	{
+		mTime += (KUInt32) (outRecord->fTime - mTimer);
+	}
+	mTimer = outRecord->fTime;
+	mHasTimer = true;
+
+	return true;
+}
+
+// ============================================ //
+// Real programmers can write assembly code in  //
+// any language.                                //
+// ============================================ //
@@ -0,0 +1,117 @@
+// ==============================
+// File:			TSerialCaptureReader.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _T_SERIAL_CAPTURE_READER_H
+#define _T_SERIAL_CAPTURE_READER_H
+
+#include <K/Defines/KDefinitions.h>
+
+#include <stdio.h>
+
+#include "Emulator/Serial/TSerialCapture.h"
+
+///
+/// Read a file written by TSerialCapture.
+///
+class TSerialCaptureReader
+{
+public:
+	///
+	/// Constructor from a path.
+	///
+	/// \param inPath	path of the capture file.
+	///
+	TSerialCaptureReader(const char* inPath);
+
+	///
+	/// Destructor.
+	///
+	~TSerialCaptureReader(void);
+
+	///
+	/// Determine if the file could be opened and has a valid header.
+	///
+	/// \return \c true if records can be read.
+	///
+	bool
+	IsOpen(void) const
+	{
+		return mFile != nullptr;
+	}
+
+	///
+	/// Read the next record.
+	///
+	/// \param outRecord	on output, the record.
+	/// \return \c false at the end of the file (or if it is truncated).
+	///
+	bool ReadRecord(TSerialCapture::SRecord* outRecord);
+
+	///
+	/// Accessor on the number of timer ticks per second.
+	///
+	KUInt32
+	GetTicksPerSecond(void) const
+	{
+		return mTicksPerSecond;
+	}
+
+	///
+	/// Accessor on the time of the last record, in ticks since the first
+	/// record. Unlike the timer, it doesn't wrap around.
+	///
+	KUInt64
+	GetTime(void) const
+	{
+		return mTime;
+	}
+
+private:
+	///
+	/// Constructeur par copie volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TSerialCaptureReader(const TSerialCaptureReader& inCopy);
+
+	///
+	/// Opérateur d'assignation volontairement indisponible.
+	///
+	/// \param inCopy		objet à copier
+	///
+	TSerialCaptureReader& operator=(const TSerialCaptureReader& inCopy);
+
+	/// \name Variables
+	FILE* mFile; ///< Capture file.
+	KUInt32 mTicksPerSecond; ///< Timer ticks per second.
+	bool mHasTimer; ///< If a record was read (mTimer is valid).
+	KUInt32 mTimer; ///< Timer value of the last record.
+	KUInt64 mTime; ///< Time of the last record.
+};
+
+#endif
+// _T_SERIAL_CAPTURE_READER_H
+
+// ============================================ //
+// Read the source, Luke.                       //
+// ============================================ //
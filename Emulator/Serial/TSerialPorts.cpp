@@ -40,6 +40,7 @@
 #include "Emulator/TEmulator.h"
 
 #include "Emulator/Serial/TBasicSerialPortManager.h"
+#include "Emulator/Serial/TSerialCapture.h"
 #if (TARGET_OS_MAC && !TARGET_IOS) || TARGET_OS_LINUX
 #include "Emulator/Serial/TBasiliskIISerialPortManager.h"
 #include "Emulator/Serial/TPipesSerialPortManager.h"
@@ -50,6 +51,10 @@
 #if TARGET_OS_MAC || TARGET_OS_ANDROID || TARGET_OS_LINUX || TARGET_OS_WIN32
 #include "Emulator/Serial/TTcpClientSerialPortManager.h"
 #endif
+#if TARGET_OS_LINUX
+#include "Emulator/Serial/TSharedMemorySerialPortManager.h"
+#include "Emulator/Serial/TTcpServerSerialPortManager.h"
+#endif
 
 /**
  Create a serial port supervisor.
@@ -69,6 +74,7 @@ TSerialPorts::~TSerialPorts()
 {
 	for (auto& i : mDriver)
 		delete i;
+	delete mCapture;
 }
 
 /**
@@ -152,6 +158,14 @@ TSerialPorts::ReplaceDriver(EPortIndex inPort, EDriverID inDriverId)
 		case kTcpClientDriver:
 			currentDriver = new TTcpClientSerialPortManager(mLog, inPort);
 			break;
+#endif
+#if TARGET_OS_LINUX
+		case kTcpServerDriver:
+			currentDriver = new TTcpServerSerialPortManager(mLog, inPort);
+			break;
+		case kSharedMemoryDriver:
+			currentDriver = new TSharedMemorySerialPortManager(mLog, inPort);
+			break;
 #endif
 		default:
 			currentDriver = new TBasicSerialPortManager(mLog, inPort);
@@ -162,6 +176,10 @@ TSerialPorts::ReplaceDriver(EPortIndex inPort, EDriverID inDriverId)
 	}
 	mDriver[inPort] = currentDriver;
 
+	auto basicDriver = dynamic_cast<TBasicSerialPortManager*>(currentDriver);
+	if (basicDriver)
+		basicDriver->SetCapture(mCapture);
+
 	currentDriver->run(mEmulator->GetInterruptManager(),
 		mEmulator->GetDMAManager(),
 		mEmulator->GetMemory());
@@ -169,6 +187,28 @@ TSerialPorts::ReplaceDriver(EPortIndex inPort, EDriverID inDriverId)
 	return currentDriver;
 }
 
+/**
+ Record the traffic of all ports.
+
+ The capture is owned by the supervisor and given to every driver, including
+ the drivers that replace the current ones.
+
+ \param inCapture the capture, or nullptr to stop recording
+ */
+void
+TSerialPorts::SetCapture(TSerialCapture* inCapture)
+{
+	TSerialCapture* oldCapture = mCapture;
+	mCapture = inCapture;
+	for (auto& i : mDriver)
+	{
+		auto basicDriver = dynamic_cast<TBasicSerialPortManager*>(i);
+		if (basicDriver)
+			basicDriver->SetCapture(mCapture);
+	}
+	delete oldCapture;
+}
+
 /**
  Set the driver for a given hardware location (any location can be used). The NewtonOS
  will see this as a serial chip at the location. Any serial chip such as the Voyager chip
@@ -265,7 +305,8 @@ KUInt32 TSerialPorts::NDrivers = kNDriverID;
 
 std::vector<const char*> TSerialPorts::DriverNames = /* NOLINT */
 	{
-		"None", "Named Pipes", "Pseudoterminal", "BasiliskII", "Network Client"
+		"None", "Named Pipes", "Pseudoterminal", "BasiliskII", "Network Client",
+		"Host Serial Port", "Network Server", "Emulator Link"
 	};
 
 KUInt32 TSerialPorts::NPorts = kNPortIndex;
@@ -281,7 +322,9 @@ std::vector<const char*> TSerialPorts::ShortPortNames = /* NOLINT */
 	};
 
 TSerialPorts::EDriverID TSerialPorts::ValidDrivers[] = {
-#if TARGET_OS_MAC || TARGET_OS_LINUX
+#if TARGET_OS_LINUX
+	kNullDriver, kPipesDriver, kPtyDriver, kBasiliskIIDriver, kTcpClientDriver, kTcpServerDriver, kSharedMemoryDriver, (EDriverID) -1
+#elif TARGET_OS_MAC
 	kNullDriver, kPipesDriver, kPtyDriver, kBasiliskIIDriver, kTcpClientDriver, (EDriverID) -1
 #elif TARGET_OS_ANDROID || TARGET_OS_WIN32
 	kNullDriver, kTcpClientDriver, (EDriverID) -1
@@ -368,7 +411,9 @@ TSerialPorts::NSGetDriverList(TNewt::RefArg arg)
  \param arg is an integer with the index of the serial port that we find interesting
  \return the minimal return value is the frame { driver: ix }; where ix is an integre
 	index into the list of available drivers. Individual drivers may add more optiosns
-	The TCP Client adds { tcpServer: "address", tcpPort: "numberAsText" };
+	The TCP Client adds { tcpServer: "address", tcpPort: "numberAsText", tcpSlowReceive: 0 or 1 };
+	The TCP Server uses the same slots for the address and port it listens on.
+	The Emulator Link adds { linkName: "name" };
  */
 NewtRef
 TSerialPorts::NSGetDriverAndOptions(TNewt::RefArg arg)
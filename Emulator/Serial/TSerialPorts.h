@@ -36,6 +36,7 @@ class TLog;
 class TEmulator;
 class TSerialPortManager;
 class TSerialHostPort;
+class TSerialCapture;
 
 /**
  The serial port superviser manages the four port of the MessagePad and their respective drivers.
@@ -64,6 +65,8 @@ public:
 		kBasiliskIIDriver,
 		kTcpClientDriver,
 		kDirectDriver,
+		kTcpServerDriver,
+		kSharedMemoryDriver,
 		kNDriverID
 	};
 
@@ -129,6 +132,11 @@ public:
 	void
 	SetHostPortSettings(KUInt32 inLocation, std::pair<EDriverID, std::string> inSettings);
 
+	// Record the traffic of all ports, now and after drivers are replaced.
+	// We take ownership of the capture. Set it before the emulator runs:
+	// the drivers don't wait for a previous capture to be unused.
+	void SetCapture(TSerialCapture* inCapture);
+
 private:
 	TSerialPortManager* mDriver[4] = { nullptr, nullptr, nullptr, nullptr };
 	TLog* mLog = nullptr;
@@ -136,6 +144,7 @@ private:
 	std::function<void(int)> mPortChangedCallback;
 	std::map<KUInt32, TSerialHostPort*> mHostPorts;
 	std::map<KUInt32, std::pair<EDriverID, std::string>> mHostPortSettings;
+	TSerialCapture* mCapture = nullptr;
 };
 
 #endif
@@ -0,0 +1,784 @@
+// ==============================
+// File:			TSharedMemorySerialPortManager.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include "TSharedMemorySerialPortManager.h"
+
+// POSIX & Linux
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// C++
+#include <utility>
+
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "Emulator/Log/TLog.h"
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+// Largest span copied to NewtonOS at once, as with the TCP client.
+#define kMaxDMAReceiveBatch 1024
+
+// How long to wait before trying to find the other emulator again.
+#define kRendezvousRetryMilliseconds 100
+
+// How long the other emulator may take to answer while linking, in seconds.
+#define kHandshakeTimeout 1
+
+static_assert(std::atomic<KUInt32>::is_always_lock_free,
+	"the rings are shared between processes");
+
+// -------------------------------------------------------------------------- //
+//  * SendDescriptors( int, const int*, int )
+//		Send descriptors to the other end of a Unix socket.
+// -------------------------------------------------------------------------- //
+static bool
+SendDescriptors(int inSocket, const int* inFDs, int inCount)
+{
+	char theByte = 'L';
+	struct iovec theVec = { &theByte, 1 };
+	char theControl[CMSG_SPACE(2 * sizeof(int))] = { 0 };
+	struct msghdr theMessage {
+	};
+	theMessage.msg_iov = &theVec;
+	theMessage.msg_iovlen = 1;
+	theMessage.msg_control = theControl;
+	theMessage.msg_controllen = CMSG_SPACE(inCount * sizeof(int));
+	struct cmsghdr* theHeader = CMSG_FIRSTHDR(&theMessage);
+	theHeader->cmsg_level = SOL_SOCKET;
+	theHeader->cmsg_type = SCM_RIGHTS;
+	theHeader->cmsg_len = CMSG_LEN(inCount * sizeof(int));
+	(void) ::memcpy(CMSG_DATA(theHeader), inFDs, inCount * sizeof(int));
+	return ::sendmsg(inSocket, &theMessage, MSG_NOSIGNAL) == 1;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ReceiveDescriptors( int, int*, int )
+//		Receive descriptors from the other end of a Unix socket.
+//		Returns the number of descriptors received.
+// -------------------------------------------------------------------------- //
+static int
+ReceiveDescriptors(int inSocket, int* outFDs, int inCount)
+{
+	char theByte = 0;
+	struct iovec theVec = { &theByte, 1 };
+	char theControl[CMSG_SPACE(2 * sizeof(int))] = { 0 };
+	struct msghdr theMessage {
+	};
+	theMessage.msg_iov = &theVec;
+	theMessage.msg_iovlen = 1;
+	theMessage.msg_control = theControl;
+	theMessage.msg_controllen = sizeof(theControl);
+	if (::recvmsg(inSocket, &theMessage, MSG_CMSG_CLOEXEC) != 1)
+	{
+		return 0;
+	}
+	struct cmsghdr* theHeader = CMSG_FIRSTHDR(&theMessage);
+	if ((theHeader == nullptr) || (theHeader->cmsg_level != SOL_SOCKET)
+		|| (theHeader->cmsg_type != SCM_RIGHTS))
+	{
+		return 0;
+	}
+	int theCount = (int) ((theHeader->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+	int theFDs[2];
+	(void) ::memcpy(theFDs, CMSG_DATA(theHeader), theCount * sizeof(int));
+	if (theCount != inCount)
+	{
+		for (int i = 0; i < theCount; i++)
+			::close(theFDs[i]);
+		return 0;
+	}
+	(void) ::memcpy(outFDs, theFDs, theCount * sizeof(int));
+	return theCount;
+}
+
+// -------------------------------------------------------------------------- //
+//  * TSharedMemorySerialPortManager()
+// Emulate a serial connection to another emulator through shared memory.
+// -------------------------------------------------------------------------- //
+TSharedMemorySerialPortManager::TSharedMemorySerialPortManager(
+	TLog* inLog,
+	TSerialPorts::EPortIndex inPortIx) :
+		TBasicSerialPortManager(inLog, inPortIx)
+{
+	mLinkName = strdup("einstein");
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TSharedMemorySerialPortManager( void )
+// -------------------------------------------------------------------------- //
+TSharedMemorySerialPortManager::~TSharedMemorySerialPortManager()
+{
+	if (mWorkerThread)
+	{
+		TriggerEvent('q');
+		mWorkerThread->join();
+		delete mWorkerThread;
+		mWorkerThread = nullptr;
+	}
+	CloseLink();
+	if (mEpoll != -1)
+		::close(mEpoll);
+	if (mEventFD != -1)
+		::close(mEventFD);
+	if (mLinkName)
+		free(mLinkName);
+}
+
+void
+TSharedMemorySerialPortManager::LogError(const char* text, bool systemError)
+{
+	if (systemError)
+	{
+		const char* errorText = strerror(errno);
+		if (mLog)
+			mLog->FLogLine("TSharedMemorySerialPortManager::%s: %s (%d)\n", text, errorText, errno);
+		else
+			KPrintf("TSharedMemorySerialPortManager::%s: %s (%d)\n", text, errorText, errno);
+	} else
+	{
+		if (mLog)
+			mLog->FLogLine("TSharedMemorySerialPortManager::%s\n", text);
+		else
+			KPrintf("TSharedMemorySerialPortManager::%s\n", text);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * run( TInterruptManager*, TDMAManager*, TMemory* )
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::run(TInterruptManager* inInterruptManager,
+	TDMAManager* inDMAManager,
+	TMemory* inMemory)
+{
+	mInterruptManager = inInterruptManager;
+	mDMAManager = inDMAManager;
+	mMemory = inMemory;
+
+	if (mEpoll != -1)
+	{
+		LogError("run: trying to start the link again.");
+		return;
+	}
+
+	mEventFD = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (mEventFD == -1)
+	{
+		LogError("run: Error creating eventfd", true);
+		return;
+	}
+	mEpoll = ::epoll_create1(EPOLL_CLOEXEC);
+	if (mEpoll == -1)
+	{
+		LogError("run: Error creating epoll", true);
+		return;
+	}
+	struct epoll_event event {
+	};
+	event.events = EPOLLIN;
+	event.data.fd = mEventFD;
+	if (::epoll_ctl(mEpoll, EPOLL_CTL_ADD, mEventFD, &event) == -1)
+	{
+		LogError("run: Error watching eventfd", true);
+		return;
+	}
+
+	// create the thread and let it run until we send it the quit signal
+	mWorkerThread = new std::thread(&TSharedMemorySerialPortManager::HandleDMA, this);
+}
+
+// -------------------------------------------------------------------------- //
+// DMA or interrupts trigger a command that must be handled by a derived class.
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::TriggerEvent(KUInt8 cmd)
+{
+	if (mEventFD == -1)
+	{
+		LogError("TriggerEvent: called without eventfd.");
+		return;
+	}
+	if (cmd == 'q')
+	{
+		mQuit = true;
+	}
+	// Commands are flags: several events may wake the thread once.
+	uint64_t one = 1;
+	(void) ::write(mEventFD, &one, sizeof(one));
+}
+
+// -------------------------------------------------------------------------- //
+//  * SignalPeer()
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::SignalPeer()
+{
+	uint64_t one = 1;
+	(void) ::write(mPeerEventFD, &one, sizeof(one));
+}
+
+// -------------------------------------------------------------------------- //
+//  * MapLink( int )
+// -------------------------------------------------------------------------- //
+bool
+TSharedMemorySerialPortManager::MapLink(int inFD)
+{
+	void* theMapping = ::mmap(
+		nullptr, sizeof(SLink), PROT_READ | PROT_WRITE, MAP_SHARED, inFD, 0);
+	if (theMapping == MAP_FAILED)
+	{
+		LogError("MapLink: can't map the shared memory", true);
+		return false;
+	}
+	mLinkFD = inFD;
+	mLink = (SLink*) theMapping;
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+// * Unlink
+//		Forget the other emulator. The shared memory stays for the next one.
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::Unlink()
+{
+	// This is no error: the other emulator may quit at any time.
+	if (mIsLinked && mLog)
+	{
+		mLog->LogLine("TSharedMemorySerialPortManager::Unlink: the other emulator is gone.");
+	}
+	mIsLinked = false;
+	if (mPeerSocket != -1)
+	{
+		// Closing also removes it from epoll.
+		::close(mPeerSocket);
+		mPeerSocket = -1;
+	}
+	if (mPeerEventFD != -1)
+	{
+		::close(mPeerEventFD);
+		mPeerEventFD = -1;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+// * CloseLink
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::CloseLink()
+{
+	Unlink();
+	if (mListenSocket != -1)
+	{
+		::close(mListenSocket);
+		mListenSocket = -1;
+	}
+	if (mLink)
+	{
+		(void) ::munmap(mLink, sizeof(SLink));
+		mLink = nullptr;
+	}
+	if (mLinkFD != -1)
+	{
+		::close(mLinkFD);
+		mLinkFD = -1;
+	}
+	mTxRing = nullptr;
+	mRxRing = nullptr;
+}
+
+// -------------------------------------------------------------------------- //
+// * Rendezvous
+//		The first emulator to bind the name of the link waits for the second
+//		one, which connects to it.
+// -------------------------------------------------------------------------- //
+bool
+TSharedMemorySerialPortManager::Rendezvous()
+{
+	CloseLink();
+
+	// Abstract socket names start with a zero byte and go away with the
+	// socket: there is nothing to clean up after a crash.
+	struct sockaddr_un address {
+	};
+	address.sun_family = AF_UNIX;
+	int theLength;
+	{
+		std::lock_guard<std::mutex> lock(mLinkNameMutex);
+		theLength = snprintf(address.sun_path + 1, sizeof(address.sun_path) - 1,
+			"einstein-serial-%s", mLinkName);
+	}
+	if ((theLength < 0) || (theLength >= (int) sizeof(address.sun_path) - 1))
+	{
+		LogError("Rendezvous: the link name is too long.");
+		return true;
+	}
+	socklen_t theAddressLength = (socklen_t) (offsetof(struct sockaddr_un, sun_path) + 1 + theLength);
+
+	int theSocket = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (theSocket == -1)
+	{
+		LogError("Rendezvous: error creating socket", true);
+		return false;
+	}
+	struct timeval theTimeout = { kHandshakeTimeout, 0 };
+	(void) ::setsockopt(theSocket, SOL_SOCKET, SO_RCVTIMEO, &theTimeout, sizeof(theTimeout));
+
+	if (::bind(theSocket, (struct sockaddr*) &address, theAddressLength) == 0)
+	{
+		// We are first: create the rings and wait.
+		int theFD = ::memfd_create("einstein-serial", MFD_CLOEXEC);
+		if ((theFD == -1) || (::ftruncate(theFD, sizeof(SLink)) == -1) || (::listen(theSocket, 1) == -1))
+		{
+			LogError("Rendezvous: can't create the link", true);
+			if (theFD != -1)
+				::close(theFD);
+			::close(theSocket);
+			return false;
+		}
+		if (!MapLink(theFD))
+		{
+			::close(theFD);
+			::close(theSocket);
+			return false;
+		}
+		mTxRing = &mLink->fRing[0];
+		mRxRing = &mLink->fRing[1];
+		mListenSocket = theSocket;
+		struct epoll_event event {
+		};
+		event.events = EPOLLIN;
+		event.data.fd = mListenSocket;
+		(void) ::epoll_ctl(mEpoll, EPOLL_CTL_ADD, mListenSocket, &event);
+		return true;
+	}
+
+	// The other emulator is first: get the rings from it.
+	int theFDs[2];
+	if ((::connect(theSocket, (struct sockaddr*) &address, theAddressLength) == -1)
+		|| (ReceiveDescriptors(theSocket, theFDs, 2) != 2))
+	{
+		// It may be going away, leaving the place to us.
+		::close(theSocket);
+		return false;
+	}
+	if (!SendDescriptors(theSocket, &mEventFD, 1) || !MapLink(theFDs[0]))
+	{
+		::close(theFDs[0]);
+		::close(theFDs[1]);
+		::close(theSocket);
+		return false;
+	}
+	mTxRing = &mLink->fRing[1];
+	mRxRing = &mLink->fRing[0];
+	mPeerEventFD = theFDs[1];
+	mPeerSocket = theSocket;
+	struct epoll_event event {
+	};
+	event.events = EPOLLIN | EPOLLRDHUP;
+	event.data.fd = mPeerSocket;
+	(void) ::epoll_ctl(mEpoll, EPOLL_CTL_ADD, mPeerSocket, &event);
+	mIsLinked = true;
+
+	// The other emulator may have been waiting for room.
+	SignalPeer();
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+// * Accept
+//		Give the rings to the second emulator. A third one is turned away.
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::Accept()
+{
+	int theSocket = ::accept4(mListenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+	if (theSocket == -1)
+	{
+		LogError("Accept: can't accept the other emulator", true);
+		return;
+	}
+	if (mPeerSocket != -1)
+	{
+		LogError("Accept: the link is busy.");
+		::close(theSocket);
+		return;
+	}
+
+	// Whatever the previous peer left in the rings is lost.
+	for (SRing& theRing : mLink->fRing)
+	{
+		theRing.fHead.store(0, std::memory_order_relaxed);
+		theRing.fTail.store(0, std::memory_order_relaxed);
+		theRing.fProducerWaiting.store(0, std::memory_order_relaxed);
+	}
+
+	struct timeval theTimeout = { kHandshakeTimeout, 0 };
+	(void) ::setsockopt(theSocket, SOL_SOCKET, SO_RCVTIMEO, &theTimeout, sizeof(theTimeout));
+	int theFDs[2] = { mLinkFD, mEventFD };
+	int thePeerEventFD = -1;
+	if (!SendDescriptors(theSocket, theFDs, 2)
+		|| (ReceiveDescriptors(theSocket, &thePeerEventFD, 1) != 1))
+	{
+		LogError("Accept: the other emulator didn't answer.");
+		::close(theSocket);
+		return;
+	}
+	mPeerEventFD = thePeerEventFD;
+	mPeerSocket = theSocket;
+	struct epoll_event event {
+	};
+	event.events = EPOLLIN | EPOLLRDHUP;
+	event.data.fd = mPeerSocket;
+	(void) ::epoll_ctl(mEpoll, EPOLL_CTL_ADD, mPeerSocket, &event);
+	mIsLinked = true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * HandleDMA()
+//		This endless loop waits for the emulator and the peer, and moves
+//		data between the rings and the DMA buffers.
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::HandleDMA()
+{
+	for (;;)
+	{
+		if (mMustRendezvous.exchange(false) && !Rendezvous())
+		{
+			mMustRendezvous = true;
+		}
+
+		// Transmission waits for the peer to make room, which wakes us up.
+		// Reception may have to wait for the emulated line.
+		int timeout = -1;
+		if (mMustRendezvous)
+		{
+			timeout = kRendezvousRetryMilliseconds;
+		} else if (mIsLinked
+			&& (mRxRing->fHead.load(std::memory_order_acquire)
+				!= mRxRing->fTail.load(std::memory_order_relaxed)))
+		{
+			timeout = 0;
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (mBitRate && (mRxLineFree > now))
+			{
+				auto theDelay = std::chrono::duration_cast<std::chrono::microseconds>(mRxLineFree - now);
+				timeout = (int) ((theDelay.count() + 999) / 1000);
+			}
+		}
+
+		struct epoll_event events[4];
+		int n = ::epoll_wait(mEpoll, events, 4, timeout);
+		if (n == -1)
+		{
+			if (errno != EINTR)
+				LogError("HandleDMA: error waiting for events", true);
+			continue;
+		}
+
+		Boolean mustAccept = false;
+		for (int i = 0; i < n; i++)
+		{
+			int fd = events[i].data.fd;
+			if (fd == mEventFD)
+			{
+				uint64_t count;
+				(void) ::read(mEventFD, &count, sizeof(count));
+			} else if (fd == mListenSocket)
+			{
+				mustAccept = true;
+			} else if (fd == mPeerSocket)
+			{
+				// Nothing is sent after linking: the peer is gone. If it was
+				// the first emulator, we take its place.
+				Unlink();
+				if (mListenSocket == -1)
+				{
+					mMustRendezvous = true;
+				}
+			}
+		}
+		if (mQuit)
+		{
+			CloseLink();
+			return;
+		}
+		if (mustAccept)
+		{
+			Accept();
+		}
+
+		HandleDMAReceive();
+		HandleDMASend();
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * HandleDMASend()
+//		Copy the pending bytes from memory to the ring, as much as fits.
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::HandleDMASend()
+{
+	if (!(mTxDMAControl & 0x00000002) || !mTxDMADataCountdown)
+	{
+		return;
+	}
+
+	KUInt32 theCount = mTxDMADataCountdown;
+	KUInt32 theHead = 0;
+	bool isLinked = mIsLinked;
+	if (isLinked)
+	{
+		theHead = mTxRing->fHead.load(std::memory_order_relaxed);
+		KUInt32 theFree = kRingSize - (theHead - mTxRing->fTail.load(std::memory_order_acquire));
+		if (theCount > theFree)
+		{
+			// Ask the peer to wake us up when it makes room, then look
+			// again in case it made room before it could see the flag.
+			mTxRing->fProducerWaiting.store(1, std::memory_order_seq_cst);
+			theFree = kRingSize - (theHead - mTxRing->fTail.load(std::memory_order_seq_cst));
+			if (theCount > theFree)
+			{
+				theCount = theFree;
+			}
+		}
+		if (theCount == 0)
+		{
+			return;
+		}
+	}
+
+	// Both the DMA buffer and the ring wrap around.
+	KUInt32 theDone = 0;
+	while (theDone < theCount)
+	{
+		KUInt32 theSpan = theCount - theDone;
+		if (mTxDMABufferSize && (mTxDMABufferSize < theSpan))
+		{
+			theSpan = mTxDMABufferSize;
+		}
+		if (isLinked)
+		{
+			KUInt32 theIndex = (theHead + theDone) & (kRingSize - 1);
+			if (kRingSize - theIndex < theSpan)
+			{
+				theSpan = kRingSize - theIndex;
+			}
+			(void) mMemory->FastReadBufferP(mTxDMAPhysicalData, theSpan, mTxRing->fData + theIndex);
+			CaptureData(false, mTxRing->fData + theIndex, theSpan);
+		}
+		if (mTxDMABufferSize == theSpan)
+		{
+			mTxDMAPhysicalData = mTxDMAPhysicalBufferStart;
+		} else
+		{
+			mTxDMAPhysicalData += theSpan;
+		}
+		mTxDMABufferSize -= theSpan;
+		theDone += theSpan;
+	}
+	if (isLinked)
+	{
+		mTxRing->fHead.store(theHead + theCount, std::memory_order_release);
+		SignalPeer();
+	}
+
+	mTxDMADataCountdown -= theCount;
+	if (mTxDMADataCountdown == 0)
+	{
+		// trigger a "send buffer empty" interrupt
+		mTxDMAEvent = 0x00000080;
+		RaiseDMAInterrupt(0x00000100);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * HandleDMAReceive()
+//		Copy bytes from the ring to memory, no faster than the emulated line.
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::HandleDMAReceive()
+{
+	if (!mIsLinked)
+	{
+		return;
+	}
+	KUInt32 theTail = mRxRing->fTail.load(std::memory_order_relaxed);
+	KUInt32 theAvailable = mRxRing->fHead.load(std::memory_order_acquire) - theTail;
+	if (theAvailable == 0)
+	{
+		return;
+	}
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (mBitRate && (mRxLineFree > now))
+	{
+		return;
+	}
+
+	// Don't copy more than NewtonOS has room for before it expects a
+	// notification. The rest waits in the ring.
+	KUInt32 theCount = kMaxDMAReceiveBatch;
+	if (mRxDMADataCountdown && (mRxDMADataCountdown < theCount))
+	{
+		theCount = mRxDMADataCountdown;
+	}
+	if (theAvailable < theCount)
+	{
+		theCount = theAvailable;
+	}
+
+	// Both the ring and the DMA buffer wrap around.
+	KUInt32 theDone = 0;
+	while (theDone < theCount)
+	{
+		KUInt32 theIndex = (theTail + theDone) & (kRingSize - 1);
+		KUInt32 theSpan = theCount - theDone;
+		if (kRingSize - theIndex < theSpan)
+		{
+			theSpan = kRingSize - theIndex;
+		}
+		if (mRxDMABufferSize && (mRxDMABufferSize < theSpan))
+		{
+			theSpan = mRxDMABufferSize;
+		}
+		(void) mMemory->FastWriteBufferP(mRxDMAPhysicalData, theSpan, mRxRing->fData + theIndex);
+		CaptureData(true, mRxRing->fData + theIndex, theSpan);
+		if (mRxDMABufferSize == theSpan)
+		{
+			mRxDMAPhysicalData = mRxDMAPhysicalBufferStart;
+		} else
+		{
+			mRxDMAPhysicalData += theSpan;
+		}
+		mRxDMABufferSize -= theSpan;
+		theDone += theSpan;
+	}
+	mRxRing->fTail.store(theTail + theCount, std::memory_order_seq_cst);
+	if (mRxRing->fProducerWaiting.exchange(0, std::memory_order_seq_cst))
+	{
+		// The peer waits for room.
+		SignalPeer();
+	}
+
+	KUInt32 theBitRate = GetBitRate();
+	if (theBitRate)
+	{
+		// A byte is 10 bits with the start and stop bits. Data that was late
+		// is not delayed.
+		if (mRxLineFree < now)
+		{
+			mRxLineFree = now;
+		}
+		mRxLineFree += std::chrono::microseconds(((KUInt64) theCount) * 10 * 1000000 / theBitRate);
+	}
+
+	if (mRxDMADataCountdown && (theCount >= mRxDMADataCountdown))
+	{
+		// buffer overflow?
+		LogError("HandleDMAReceive: DMA Overflow on Receive?");
+	}
+	mRxDMADataCountdown -= theCount;
+	mRxDMAEvent = 0x00000040;
+	RaiseDMAInterrupt(0x00000080); // 0x00000180
+}
+
+///
+/// Give NewtonScript access to our list of options
+///
+void
+TSharedMemorySerialPortManager::NSGetOptions(TNewt::RefArg frame)
+{
+	using namespace TNewt;
+	char* name = GetLinkNameDup();
+	SetFrameSlot(frame, RefVar(MakeSymbol("linkName")), RefVar(MakeString(name)));
+	::free(name);
+}
+
+///
+/// Set options from NewtonScript
+///
+void
+TSharedMemorySerialPortManager::NSSetOptions(TNewt::RefArg inFrame)
+{
+	using namespace TNewt;
+	char name[80] = { 0 };
+
+	NewtRef frame = inFrame.Ref();
+	NewtRef linkNameRef = GetFrameSlotRef(frame, MakeSymbol("linkName"));
+	if (RefIsString(linkNameRef))
+	{
+		RefToString(linkNameRef, name, sizeof(name));
+		char* linkName = GetLinkNameDup();
+		if (strcmp(linkName, name) != 0)
+		{
+			SetLinkName(name);
+		}
+		::free(linkName);
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetLinkName( const char* )
+// -------------------------------------------------------------------------- //
+void
+TSharedMemorySerialPortManager::SetLinkName(const char* inName)
+{
+	// The DMA thread may be formatting the old name: swap it under the lock.
+	char* oldName = strdup(inName);
+	{
+		std::lock_guard<std::mutex> lock(mLinkNameMutex);
+		std::swap(mLinkName, oldName);
+	}
+	if (oldName)
+		::free(oldName);
+	mMustRendezvous = true;
+	if (mEventFD != -1)
+		TriggerEvent('c');
+}
+
+char*
+TSharedMemorySerialPortManager::GetLinkNameDup()
+{
+	std::lock_guard<std::mutex> lock(mLinkNameMutex);
+	return strdup(mLinkName);
+}
+
+// ================================================================== //
+// A distributed system is one in which the failure of a computer you //
+// didn't even know existed can render your own computer unusable.    //
+//  - Leslie Lamport                                                  //
+// ================================================================== //
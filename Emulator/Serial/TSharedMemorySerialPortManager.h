@@ -0,0 +1,217 @@
+// ==============================
+// File:			TSharedMemorySerialPortManager.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _T_SHARED_MEMORY_SERIAL_PORT_MANAGER_H
+#define _T_SHARED_MEMORY_SERIAL_PORT_MANAGER_H
+
+#include "TBasicSerialPortManager.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+///
+/// Emulate a serial cable between two emulators in Linux
+///
+/// Two emulators that use the same link name share two lock-free rings, one
+/// per direction, each with a single producer and a single consumer. The DMA
+/// engines copy between the emulated RAM and the rings directly, and an
+/// eventfd wakes the other side up when there is something to do.
+///
+/// The first emulator listens on an abstract Unix socket named after the
+/// link. The second one connects and receives the shared memory and the
+/// eventfd of the first, and answers with its own eventfd. After that, the
+/// socket only tells when the other side is gone. If the first emulator
+/// quits, the second one takes its place and waits for another peer.
+///
+/// With no peer, sent bytes are lost like on a cable that is plugged in
+/// nowhere.
+///
+class TSharedMemorySerialPortManager : public TBasicSerialPortManager
+{
+public:
+	/// Link constants.
+	enum {
+		kRingSize = 0x10000 ///< Bytes in a ring, a power of two.
+	};
+
+	///
+	/// One direction of the link.
+	///
+	/// The indices count bytes since the link was made and wrap at 2^32:
+	/// the ring holds fHead - fTail bytes.
+	///
+	struct SRing {
+		alignas(64) std::atomic<KUInt32> fHead; ///< Bytes written by the producer.
+		alignas(64) std::atomic<KUInt32> fTail; ///< Bytes read by the consumer.
+		std::atomic<KUInt32> fProducerWaiting; ///< The producer waits for room.
+		alignas(64) KUInt8 fData[kRingSize]; ///< The bytes.
+	};
+
+	/// Layout of the shared memory.
+	struct SLink {
+		SRing fRing[2]; ///< The first emulator sends on ring 0.
+	};
+
+	///
+	/// Constructor.
+	///
+	TSharedMemorySerialPortManager(TLog* inLog,
+		TSerialPorts::EPortIndex inPortIx);
+
+	///
+	/// Destructor.
+	///
+	~TSharedMemorySerialPortManager() override;
+
+	///
+	/// Return the Identification of this driver
+	///
+	TSerialPorts::EDriverID
+	GetID() override
+	{
+		return TSerialPorts::kSharedMemoryDriver;
+	}
+
+	///
+	/// Start emulation.
+	///
+	void run(TInterruptManager* inInterruptManager,
+		TDMAManager* inDMAManager,
+		TMemory* inMemory) override;
+
+	///
+	/// DMA or interrupts trigger a command that must be handled by a derived class.
+	///
+	void TriggerEvent(KUInt8 cmd) override;
+
+	///
+	/// Give NewtonScript access to our list of options
+	///
+	void NSGetOptions(TNewt::RefArg frame) override;
+
+	///
+	/// Set options from NewtonScript
+	///
+	void NSSetOptions(TNewt::RefArg frame) override;
+
+	///
+	/// Set the name of the link. Emulators with the same name are connected.
+	///
+	void SetLinkName(const char* inName);
+
+	///
+	/// Return a copy of the name of the link, to be freed by the caller.
+	///
+	char* GetLinkNameDup();
+
+	///
+	/// Return true if another emulator is at the other end of the link.
+	///
+	bool
+	IsLinked()
+	{
+		return mIsLinked;
+	}
+
+protected:
+	///
+	/// Host user interface error message
+	///
+	void LogError(const char* text, bool systemError = false);
+
+	///
+	/// Emulate the DMA hardware
+	///
+	void HandleDMA();
+
+	///
+	/// Copy data pending in memory to the transmit ring.
+	///
+	void HandleDMASend();
+
+	///
+	/// Copy data from the receive ring to memory.
+	///
+	void HandleDMAReceive();
+
+	///
+	/// Listen on the link, or connect to the emulator that does.
+	///
+	/// \return false if it must be tried again later.
+	///
+	bool Rendezvous();
+
+	///
+	/// Accept another emulator on the link we listen on.
+	///
+	void Accept();
+
+	///
+	/// Map the shared memory of the link.
+	///
+	/// \param inFD		descriptor of the shared memory.
+	/// \return true if the memory was mapped.
+	///
+	bool MapLink(int inFD);
+
+	///
+	/// Forget the other emulator.
+	///
+	void Unlink();
+
+	///
+	/// Forget the other emulator, the shared memory and the listening socket.
+	///
+	void CloseLink();
+
+	///
+	/// Wake the other emulator up.
+	///
+	void SignalPeer();
+
+	char* mLinkName = nullptr; ///< emulators with the same name are connected
+	std::mutex mLinkNameMutex; ///< the name is set while the DMA thread reads it
+	int mEventFD = -1; ///< wakes the DMA thread for the emulator and the peer
+	int mEpoll = -1; ///< waits for the sockets and mEventFD
+	int mListenSocket = -1; ///< Unix socket waiting for a peer, in the first emulator
+	int mPeerSocket = -1; ///< Unix socket to the peer, closed when it goes away
+	int mPeerEventFD = -1; ///< wakes the DMA thread of the peer
+	int mLinkFD = -1; ///< shared memory of the link
+	SLink* mLink = nullptr; ///< mapping of the shared memory
+	SRing* mTxRing = nullptr; ///< ring we produce
+	SRing* mRxRing = nullptr; ///< ring we consume
+	std::thread* mWorkerThread = nullptr; ///< the thread that does all the work
+	std::atomic<bool> mIsLinked { false }; ///< a peer is connected
+	std::atomic<bool> mMustRendezvous { true }; ///< the link name changed or the peer quit
+	std::atomic<bool> mQuit { false }; ///< the DMA thread must end
+	std::chrono::steady_clock::time_point mRxLineFree {}; ///< when the emulated line can take more data
+};
+
+#endif
+// _T_SHARED_MEMORY_SERIAL_PORT_MANAGER_H
+
+// ============================================ //
+// Two heads are better than one.               //
+// ============================================ //
@@ -40,15 +40,32 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 #endif
 
+#include <K/Defines/UByteSex.h>
+
 #include "Emulator/TInterruptManager.h"
 #include "Emulator/TMemory.h"
 #include "Emulator/Log/TLog.h"
 
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+// Largest span sent at once. Bigger transfers take several turns of the loop.
+#define kMaxDMASendBatch 4096
+
+// A peer that hangs up while we send must not raise SIGPIPE.
+#if defined(MSG_NOSIGNAL)
+#define kSendFlags MSG_NOSIGNAL
+#else
+#define kSendFlags 0
+#endif
+
 /*
  The TCP Client class emulates a serial port by connecting to the server
  whenever needed through a TCP network connection.
@@ -389,7 +406,20 @@ TTcpClientSerialPortManager::HandleDMA()
 				WSASetEvent(mTcpEvent);
 		}
 
+		// Reception waits for the emulated line.
 		int nEvent = (mTcpEvent == INVALID_HANDLE_VALUE) ? 2 : 3;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if ((nEvent == 3) && (mRxLineFree > now))
+		{
+			nEvent = 2;
+			auto theDelay = std::chrono::duration_cast<std::chrono::microseconds>(mRxLineFree - now);
+			DWORD theDelayMilliseconds = (DWORD) ((theDelay.count() + 999) / 1000);
+			if (!needTimer || (theDelayMilliseconds < timeout))
+			{
+				needTimer = true;
+				timeout = theDelayMilliseconds;
+			}
+		}
 		HANDLE watchFDs[] = { mQuitEvent, mOtherEvent, mTcpEvent };
 		DWORD ret = WSAWaitForMultipleEvents(nEvent, watchFDs, FALSE, needTimer ? timeout : WSA_INFINITE, FALSE);
 		if (ret == WSA_WAIT_FAILED)
@@ -409,9 +439,6 @@ TTcpClientSerialPortManager::HandleDMA()
 		}
 
 		// handle transmitting DMA
-		HandleDMASend(); // timer resolution is too coarse, so send up to 4 bytes now
-		HandleDMASend();
-		HandleDMASend();
 		HandleDMASend();
 
 		// handle commands from mQuitEvent
@@ -443,7 +470,11 @@ TTcpClientSerialPortManager::HandleDMA()
 
 		FD_ZERO(&watchFDs);
 		FD_SET(mCommandPipe[0], &watchFDs);
-		if (IsConnected())
+
+		// Reception waits for the emulated line.
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		Boolean isLineBusy = (mRxLineFree > now);
+		if (IsConnected() && !isLineBusy)
 			FD_SET(mTcpSocket, &watchFDs);
 
 		if (mTxDMAControl & 0x00000002)
@@ -452,7 +483,17 @@ TTcpClientSerialPortManager::HandleDMA()
 			{
 				needTimer = true;
 				timeout.tv_sec = 0;
-				timeout.tv_usec = 260; // one byte at 38400bps serial port speed
+				timeout.tv_usec = 260; // one byte at 38400bps serial port speed, then the rest at once
+			}
+		}
+		if (IsConnected() && isLineBusy)
+		{
+			auto theDelay = std::chrono::duration_cast<std::chrono::microseconds>(mRxLineFree - now);
+			if (!needTimer || (theDelay.count() < timeout.tv_usec))
+			{
+				needTimer = true;
+				timeout.tv_sec = (time_t) (theDelay.count() / 1000000);
+				timeout.tv_usec = (suseconds_t) (theDelay.count() % 1000000);
 			}
 		}
 
@@ -494,8 +535,8 @@ TTcpClientSerialPortManager::HandleDMA()
 
 // -------------------------------------------------------------------------- //
 //  * HandleDMASend()
-//		Send a single byte. We are throtteling data transfor to match a
-//		maximum of 38400bps which is the maximum that NewtonSO can handle.
+//		Send all the pending bytes with a single call. Connected tools read
+//		from a socket and don't need the 38400bps of a real serial port.
 // -------------------------------------------------------------------------- //
 void
 TTcpClientSerialPortManager::HandleDMASend()
@@ -504,47 +545,154 @@ TTcpClientSerialPortManager::HandleDMASend()
 	{ // DMA is enabled
 		if (mTxDMADataCountdown)
 		{
-			// write a byte
-			KUInt8 data = 0;
-			mMemory->ReadBP(mTxDMAPhysicalData, data);
+			KUInt32 theCount = mTxDMADataCountdown;
+			if (theCount > kMaxDMASendBatch)
+			{
+				theCount = kMaxDMASendBatch;
+			}
+			// The buffer is a ring: the pointer goes back to the start
+			// when the size drops to zero.
+			KUInt32 theFirstCount = theCount;
+			if (mTxDMABufferSize && (mTxDMABufferSize < theCount))
+			{
+				theFirstCount = mTxDMABufferSize;
+			}
+			KUInt32 theSecondCount = theCount - theFirstCount;
+			KUInt8 theBuffer[kMaxDMASendBatch];
+			const KUInt8* theFirst = GetDMASendSpan(mTxDMAPhysicalData, theFirstCount, theBuffer);
+			const KUInt8* theSecond = GetDMASendSpan(
+				mTxDMAPhysicalBufferStart, theSecondCount, theBuffer + theFirstCount);
+
 			if (!IsConnected())
 				Connect();
-			// TODO: if we can't get a connection at this point, should we flush the entire buffer?
+			// Without a server, the bytes are lost like on a cable that is
+			// plugged in nowhere. theDone bytes leave the DMA buffer, of
+			// which theSent went to the server.
+			KUInt32 theDone = theCount;
+			KUInt32 theSent = 0;
 			if (IsConnected())
 			{
 #if TARGET_OS_WIN32
-				WSABUF buf = { 1, (CHAR*) &data };
+				WSABUF bufs[2] = {
+					{ theFirstCount, (CHAR*) theFirst },
+					{ theSecondCount, (CHAR*) theSecond }
+				};
 				DWORD nSent = 0;
-				if (WSASend(mTcpSocket, &buf, 1, &nSent, 0, nullptr, nullptr) != 0)
+				if (WSASend(mTcpSocket, bufs, theSecondCount ? 2 : 1, &nSent, 0, nullptr, nullptr) == 0)
 				{
-					// FIXME: WSAGetLastError()==10053: connection aborted by host
+					theSent = nSent;
+					theDone = theSent;
+				} else if (WSAGetLastError() == WSAEWOULDBLOCK)
+				{
+					// Try again on the next turn of the loop.
+					theDone = 0;
+				} else
+				{
+					// The next batch connects again.
 					LogError("HandleDMASend: Can't write to TCP/IP socket!", true);
+					Disconnect();
+					theDone = 0;
 				}
 #else
-				::write(mTcpSocket, &data, 1);
+				struct iovec vecs[2] = {
+					{ (void*) theFirst, theFirstCount },
+					{ (void*) theSecond, theSecondCount }
+				};
+				struct msghdr msg {
+				};
+				msg.msg_iov = vecs;
+				msg.msg_iovlen = theSecondCount ? 2 : 1;
+				ssize_t nSent = ::sendmsg(mTcpSocket, &msg, kSendFlags);
+				if (nSent >= 0)
+				{
+					// What wasn't written goes with the next batch.
+					theSent = (KUInt32) nSent;
+					theDone = theSent;
+				} else if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+				{
+					// Try again on the next turn of the loop.
+					theDone = 0;
+				} else
+				{
+					// The next batch connects again.
+					LogError("HandleDMASend: Can't write to TCP/IP socket!", true);
+					Disconnect();
+					theDone = 0;
+				}
 #endif
-				// KPrintf("Sending 0x%02x\n", data);
-			} else
+			}
+			if (theSent > theFirstCount)
+			{
+				CaptureData(false, theFirst, theFirstCount);
+				CaptureData(false, theSecond, theSent - theFirstCount);
+			} else if (theSent)
 			{
-				// KPrintf("Sending to null 0x%02x\n", data);
+				CaptureData(false, theFirst, theSent);
 			}
-			mTxDMAPhysicalData++;
-			mTxDMABufferSize--;
-			if (mTxDMABufferSize == 0)
+			if (mTxDMABufferSize && (theDone >= mTxDMABufferSize))
 			{
-				mTxDMAPhysicalData = mTxDMAPhysicalBufferStart;
+				mTxDMAPhysicalData = mTxDMAPhysicalBufferStart + (theDone - mTxDMABufferSize);
+			} else
+			{
+				mTxDMAPhysicalData += theDone;
 			}
-			mTxDMADataCountdown--;
+			mTxDMABufferSize -= theDone;
+			mTxDMADataCountdown -= theDone;
 			if (mTxDMADataCountdown == 0)
 			{
 				// trigger a "send buffer empty" interrupt
 				mTxDMAEvent = 0x00000080;
-				mInterruptManager->RaiseInterrupt(0x00000100);
+				RaiseDMAInterrupt(0x00000100);
 			}
 		}
 	}
 }
 
+// -------------------------------------------------------------------------- //
+//  * GetDMASendSpan( KUInt32, KUInt32, KUInt8* )
+// -------------------------------------------------------------------------- //
+const KUInt8*
+TTcpClientSerialPortManager::GetDMASendSpan(KUInt32 inAddress, KUInt32 inCount, KUInt8* ioBuffer)
+{
+	KUInt32 indexByte;
+	if ((inAddress >= TMemoryConsts::kRAMStart)
+		&& (inAddress - TMemoryConsts::kRAMStart + inCount <= mMemory->GetRAMSize()))
+	{
+		const KUInt8* theRAM = (const KUInt8*) mMemory->GetRAMOffset();
+#if TARGET_RT_LITTLE_ENDIAN
+		// RAM is stored as host words, so the bytes are not in order there:
+		// copy them, a word at a time where the span is aligned.
+		indexByte = 0;
+		while ((indexByte < inCount) && ((inAddress + indexByte) & 0x3))
+		{
+			ioBuffer[indexByte] = theRAM[(inAddress + indexByte) ^ 0x3];
+			indexByte++;
+		}
+		while (indexByte + 4 <= inCount)
+		{
+			KUInt32 theWord = UByteSex_ToBigEndian(
+				*(const KUInt32*) (theRAM + inAddress + indexByte));
+			memcpy(ioBuffer + indexByte, &theWord, sizeof(theWord));
+			indexByte += 4;
+		}
+		while (indexByte < inCount)
+		{
+			ioBuffer[indexByte] = theRAM[(inAddress + indexByte) ^ 0x3];
+			indexByte++;
+		}
+		return ioBuffer;
+#else
+		return theRAM + inAddress;
+#endif
+	}
+
+	for (indexByte = 0; indexByte < inCount; indexByte++)
+	{
+		(void) mMemory->ReadBP(inAddress + indexByte, ioBuffer[indexByte]);
+	}
+	return ioBuffer;
+}
+
 // -------------------------------------------------------------------------- //
 //  * HandleDMAReceive()
 // -------------------------------------------------------------------------- //
@@ -556,18 +704,33 @@ TTcpClientSerialPortManager::HandleDMAReceive()
 	// expected in the year 1996, which leaconnecting to d to CPU cycle burning software
 	// like "slowdown.exe".
 
+	// The rest waits in the socket until the emulated line is free.
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (mRxLineFree > now)
+	{
+		return;
+	}
+
+	// Don't read more than NewtonOS has room for before it expects a
+	// notification. The rest waits in the socket.
+	KUInt32 theRoom = 1024;
+	if (!mSlowReceive && mRxDMADataCountdown && (mRxDMADataCountdown < theRoom))
+	{
+		theRoom = mRxDMADataCountdown;
+	}
+
 	// read up to 1024 bytes that come in through the serial port
 	KUInt8 buf[1026];
 #if TARGET_OS_WIN32
-	DWORD nRequested = 32;
+	DWORD nRequested = (theRoom < 32) ? theRoom : 32;
 	DWORD nReceived = 0;
 	DWORD flags = 0;
 	WSABUF abuf = { nRequested, (CHAR*) buf };
-	// FIXME: WSABUF abuf = { 1024, (CHAR*)buf };
+	// FIXME: WSABUF abuf = { theRoom, (CHAR*)buf };
 	int ret = WSARecv(mTcpSocket, &abuf, 1, &nReceived, &flags, nullptr, nullptr);
 	int n = (ret == 0) ? nReceived : -1;
 #else
-	int n = (int) ::read(mTcpSocket, buf, 1024);
+	int n = (int) ::read(mTcpSocket, buf, theRoom);
 #endif
 	if (n == -1)
 	{
@@ -579,28 +742,50 @@ TTcpClientSerialPortManager::HandleDMAReceive()
 		Disconnect();
 	} else
 	{
-		// delay up to 1/10th of a second, so that we do not overwhelm the Newton
-		std::this_thread::sleep_for(std::chrono::microseconds(n * 100));
-		for (int i = 0; i < n; i++)
+		KUInt32 theBitRate = GetBitRate();
+		if (mSlowReceive)
 		{
-			KUInt8 data = buf[i];
-			// KPrintf("Received 0x%02x\n", data);
-			mMemory->WriteBP(mRxDMAPhysicalData, data);
-			mRxDMAPhysicalData++;
-			mRxDMABufferSize--;
-			if (mRxDMABufferSize == 0)
-			{
-				mRxDMAPhysicalData = mRxDMAPhysicalBufferStart;
-			}
-			mRxDMADataCountdown--;
-			if (mRxDMADataCountdown == 0)
-			{
-				// buffer overflow?
-				LogError("HandleDMAReceive: DMA Overflow on Receive?");
-			}
+			// delay up to 1/10th of a second, so that we do not overwhelm the Newton
+			std::this_thread::sleep_for(std::chrono::microseconds(n * 100));
+		} else if (theBitRate)
+		{
+			// Deliver no faster than the emulated line: a byte is 10 bits
+			// with the start and stop bits. Data that was late is not delayed.
+			// HandleDMA() waits for the line before reading again.
+			mRxLineFree = now + std::chrono::microseconds(((KUInt64) n) * 10 * 1000000 / theBitRate);
+		}
+
+		// The buffer is a ring: the pointer goes back to the start when the
+		// size drops to zero.
+		KUInt32 theCount = (KUInt32) n;
+		CaptureData(true, buf, theCount);
+		KUInt32 theFirstCount = theCount;
+		if (mRxDMABufferSize && (mRxDMABufferSize < theCount))
+		{
+			theFirstCount = mRxDMABufferSize;
+		}
+		(void) mMemory->FastWriteBufferP(mRxDMAPhysicalData, theFirstCount, buf);
+		if (theFirstCount < theCount)
+		{
+			(void) mMemory->FastWriteBufferP(
+				mRxDMAPhysicalBufferStart, theCount - theFirstCount, buf + theFirstCount);
+		}
+		if (mRxDMABufferSize && (theCount >= mRxDMABufferSize))
+		{
+			mRxDMAPhysicalData = mRxDMAPhysicalBufferStart + (theCount - mRxDMABufferSize);
+		} else
+		{
+			mRxDMAPhysicalData += theCount;
+		}
+		mRxDMABufferSize -= theCount;
+		if (mRxDMADataCountdown && (theCount >= mRxDMADataCountdown))
+		{
+			// buffer overflow?
+			LogError("HandleDMAReceive: DMA Overflow on Receive?");
 		}
+		mRxDMADataCountdown -= theCount;
 		mRxDMAEvent = 0x00000040;
-		mInterruptManager->RaiseInterrupt(0x00000080); // 0x00000180
+		RaiseDMAInterrupt(0x00000080); // 0x00000180
 	}
 }
 
@@ -615,6 +800,7 @@ TTcpClientSerialPortManager::NSGetOptions(TNewt::RefArg frame)
 	snprintf(buf, 30, "%d", mPort);
 	SetFrameSlot(frame, RefVar(MakeSymbol("tcpServer")), RefVar(MakeString(mServer)));
 	SetFrameSlot(frame, RefVar(MakeSymbol("tcpPort")), RefVar(MakeString(buf)));
+	SetFrameSlot(frame, RefVar(MakeSymbol("tcpSlowReceive")), RefVar(MakeInt(mSlowReceive ? 1 : 0)));
 }
 
 ///
@@ -647,6 +833,12 @@ TTcpClientSerialPortManager::NSSetOptions(TNewt::RefArg inFrame)
 			port = 3679;
 		setPort = true;
 	}
+	// Leave the setting alone if the slot is missing.
+	NewtRef tcpSlowReceiveRef = GetFrameSlotRef(frame, MakeSymbol("tcpSlowReceive"));
+	if (RefIsInt(tcpSlowReceiveRef))
+	{
+		SetSlowReceive(RefToInt(tcpSlowReceiveRef) != 0);
+	}
 
 	// KPrintf("INFO: TTcpClientSerialPortManager::NSSetOptions: (\"%s\", %d)\n", mServer, mPort);
 	if (setServer)
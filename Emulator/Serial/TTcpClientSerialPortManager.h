@@ -30,6 +30,7 @@
 #include <Windows.h>
 #include <Winsock2.h>
 #endif
+#include <chrono>
 #include <thread>
 
 class TLog;
@@ -87,13 +88,26 @@ public:
 	///
 	void NSSetOptions(TNewt::RefArg frame) override;
 
-	void SetServerAddress(const char* inAddress);
+	virtual void SetServerAddress(const char* inAddress);
 
-	void SetServerPort(int inPort);
+	virtual void SetServerPort(int inPort);
 
 	char* GetServerAddressDup();
 
-	int GetServerPort();
+	virtual int GetServerPort();
+
+	///
+	/// Deliver received data as slowly as older versions did.
+	///
+	/// Some older software can't keep up otherwise. By default, received
+	/// data is paced with the bit rate NewtonOS set. NewtonScript reads and
+	/// sets it in the tcpSlowReceive option.
+	///
+	void
+	SetSlowReceive(bool inSlowReceive)
+	{
+		mSlowReceive = inSlowReceive;
+	}
 
 protected:
 	///
@@ -104,13 +118,26 @@ protected:
 	///
 	/// Emulate the DMA hardware
 	///
-	void HandleDMA();
+	virtual void HandleDMA();
 
 	///
 	/// Send data pending in memory to the server.
 	///
 	void HandleDMASend();
 
+	///
+	/// Get the bytes of a span of the transmit buffer in host order.
+	/// They are only sent from RAM directly on big-endian hosts. On
+	/// little-endian hosts, RAM holds byte-swapped words, and the bytes are
+	/// copied to ioBuffer, as are bytes outside of RAM.
+	///
+	/// \param inAddress	physical address of the span.
+	/// \param inCount		number of bytes.
+	/// \param ioBuffer		buffer of at least inCount bytes.
+	/// \return a pointer to the bytes, in RAM or in ioBuffer.
+	///
+	const KUInt8* GetDMASendSpan(KUInt32 inAddress, KUInt32 inCount, KUInt8* ioBuffer);
+
 	///
 	/// Receive data from the server.
 	///
@@ -119,7 +146,7 @@ protected:
 	///
 	/// Create a socket and try to connect it to the server.
 	///
-	bool Connect();
+	virtual bool Connect();
 
 	///
 	/// Disconnect from teh server.
@@ -150,6 +177,8 @@ protected:
 	std::thread* mWorkerThread = nullptr; ///< the thread that does all the work
 	bool mIsConnected = false; ///< set to true if there is a connection to a server
 	time_t mReconnectTimeout = 0; ///< next time we allow another connection attempt
+	bool mSlowReceive = false; ///< wait 100us per received byte, like older versions
+	std::chrono::steady_clock::time_point mRxLineFree {}; ///< when the emulated line can take more data
 };
 
 #endif
@@ -0,0 +1,430 @@
+// ==============================
+// File:			TTcpServerSerialPortManager.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include "TTcpServerSerialPortManager.h"
+
+// POSIX & Linux
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Emulator/Log/TLog.h"
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+// How long to wait before trying to listen again, in milliseconds, when the
+// address or the port can't be used.
+#define kListenRetryMilliseconds 1000
+
+// -------------------------------------------------------------------------- //
+//  * TTcpServerSerialPortManager()
+// Emulate a serial connection using a TCP server socket.
+// -------------------------------------------------------------------------- //
+TTcpServerSerialPortManager::TTcpServerSerialPortManager(
+	TLog* inLog,
+	TSerialPorts::EPortIndex inPortIx) :
+		TTcpClientSerialPortManager(inLog, inPortIx),
+		mListenAddress(mServer),
+		mListenPort(mPort)
+{
+}
+
+// -------------------------------------------------------------------------- //
+//  * ~TTcpServerSerialPortManager( void )
+// -------------------------------------------------------------------------- //
+TTcpServerSerialPortManager::~TTcpServerSerialPortManager()
+{
+	if (mWorkerThread)
+	{
+		TriggerEvent('q');
+		mWorkerThread->join();
+		delete mWorkerThread;
+		mWorkerThread = nullptr;
+	}
+	if (mListenSocket != -1)
+		::close(mListenSocket);
+	if (mEpoll != -1)
+		::close(mEpoll);
+	if (mEventFD != -1)
+		::close(mEventFD);
+}
+
+// -------------------------------------------------------------------------- //
+//  * run( TInterruptManager*, TDMAManager*, TMemory* )
+// -------------------------------------------------------------------------- //
+void
+TTcpServerSerialPortManager::run(TInterruptManager* inInterruptManager,
+	TDMAManager* inDMAManager,
+	TMemory* inMemory)
+{
+	mInterruptManager = inInterruptManager;
+	mDMAManager = inDMAManager;
+	mMemory = inMemory;
+
+	if (mEpoll != -1)
+	{
+		LogError("run: trying to start the server again.");
+		return;
+	}
+
+	mEventFD = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (mEventFD == -1)
+	{
+		LogError("run: Error creating eventfd", true);
+		return;
+	}
+	mEpoll = ::epoll_create1(EPOLL_CLOEXEC);
+	if (mEpoll == -1)
+	{
+		LogError("run: Error creating epoll", true);
+		return;
+	}
+	struct epoll_event event {
+	};
+	event.events = EPOLLIN;
+	event.data.fd = mEventFD;
+	if (::epoll_ctl(mEpoll, EPOLL_CTL_ADD, mEventFD, &event) == -1)
+	{
+		LogError("run: Error watching eventfd", true);
+		return;
+	}
+
+	// create the thread and let it run until we send it the quit signal
+	mWorkerThread = new std::thread(&TTcpServerSerialPortManager::HandleDMA, this);
+}
+
+// -------------------------------------------------------------------------- //
+// DMA or interrupts trigger a command that must be handled by a derived class.
+// -------------------------------------------------------------------------- //
+void
+TTcpServerSerialPortManager::TriggerEvent(KUInt8 cmd)
+{
+	if (mEventFD == -1)
+	{
+		LogError("TriggerEvent: called without eventfd.");
+		return;
+	}
+	if (cmd == 'q')
+	{
+		mQuit = true;
+	}
+	// Commands are flags: several events may wake the thread once.
+	uint64_t one = 1;
+	(void) ::write(mEventFD, &one, sizeof(one));
+}
+
+// -------------------------------------------------------------------------- //
+//  * NSSetOptions( TNewt::RefArg )
+// -------------------------------------------------------------------------- //
+void
+TTcpServerSerialPortManager::NSSetOptions(TNewt::RefArg inFrame)
+{
+	int oldPort = mPort;
+	char* oldServer = strdup(mServer);
+	TTcpClientSerialPortManager::NSSetOptions(inFrame);
+	if ((oldPort != mPort) || (strcmp(oldServer, mServer) != 0))
+	{
+		ListenAgain();
+	}
+	::free(oldServer);
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetServerAddress( const char* )
+// -------------------------------------------------------------------------- //
+void
+TTcpServerSerialPortManager::SetServerAddress(const char* inAddress)
+{
+	TTcpClientSerialPortManager::SetServerAddress(inAddress);
+	ListenAgain();
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetServerPort( int )
+// -------------------------------------------------------------------------- //
+void
+TTcpServerSerialPortManager::SetServerPort(int inPort)
+{
+	TTcpClientSerialPortManager::SetServerPort(inPort);
+	ListenAgain();
+}
+
+// -------------------------------------------------------------------------- //
+//  * GetServerPort( void )
+// -------------------------------------------------------------------------- //
+int
+TTcpServerSerialPortManager::GetServerPort()
+{
+	int thePort = mListeningPort;
+	return thePort ? thePort : mPort;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ListenAgain( void )
+//		mServer and mPort belong to the emulator thread.
+// -------------------------------------------------------------------------- //
+void
+TTcpServerSerialPortManager::ListenAgain()
+{
+	{
+		std::lock_guard<std::mutex> lock(mListenMutex);
+		mListenAddress = mServer;
+		mListenPort = mPort;
+		mListeningPort = 0;
+	}
+	mMustListen = true;
+	if (mEventFD != -1)
+		TriggerEvent('c');
+}
+
+// -------------------------------------------------------------------------- //
+// * Connect
+//		Clients connect to us, there is nothing to do until one does.
+// -------------------------------------------------------------------------- //
+bool
+TTcpServerSerialPortManager::Connect()
+{
+	return IsConnected();
+}
+
+// -------------------------------------------------------------------------- //
+// * Listen
+//		Open a socket on the server address and port and wait for clients.
+// -------------------------------------------------------------------------- //
+bool
+TTcpServerSerialPortManager::Listen()
+{
+	Disconnect();
+	if (mListenSocket != -1)
+	{
+		::close(mListenSocket);
+		mListenSocket = -1;
+	}
+
+	// The emulator thread may change them meanwhile.
+	std::string theServer;
+	int thePort;
+	{
+		std::lock_guard<std::mutex> lock(mListenMutex);
+		theServer = mListenAddress;
+		thePort = mListenPort;
+	}
+
+	struct sockaddr_in address {
+	};
+	memset(&address, 0, sizeof(struct sockaddr_in));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(thePort));
+	if (inet_pton(AF_INET, theServer.c_str(), &address.sin_addr) <= 0)
+	{
+		LogError("Listen: Error in inet_pton", true);
+		return false;
+	}
+
+	mListenSocket = ::socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (mListenSocket == -1)
+	{
+		LogError("Listen: error creating socket", true);
+		return false;
+	}
+	// Don't wait for the connections of a previous run to time out.
+	int yes = 1;
+	(void) ::setsockopt(mListenSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	if ((::bind(mListenSocket, (struct sockaddr*) &address, sizeof(address)) == -1)
+		|| (::listen(mListenSocket, 1) == -1))
+	{
+		LogError("Listen: can't listen on port", true);
+		::close(mListenSocket);
+		mListenSocket = -1;
+		return false;
+	}
+
+	struct epoll_event event {
+	};
+	event.events = EPOLLIN;
+	event.data.fd = mListenSocket;
+	(void) ::epoll_ctl(mEpoll, EPOLL_CTL_ADD, mListenSocket, &event);
+
+	// Tell the user which port the system picked.
+	socklen_t length = sizeof(address);
+	if (::getsockname(mListenSocket, (struct sockaddr*) &address, &length) == 0)
+	{
+		{
+			// Unless we must listen elsewhere already.
+			std::lock_guard<std::mutex> lock(mListenMutex);
+			if ((thePort == mListenPort) && (theServer == mListenAddress))
+				mListeningPort = ntohs(address.sin_port);
+		}
+		if (mLog)
+			mLog->FLogLine("TTcpServerSerialPortManager: listening on %s:%d", theServer.c_str(), ntohs(address.sin_port));
+		else
+			KPrintf("TTcpServerSerialPortManager: listening on %s:%d\n", theServer.c_str(), ntohs(address.sin_port));
+	}
+
+	return true;
+}
+
+// -------------------------------------------------------------------------- //
+// * Accept
+//		A new client replaces the previous one, which may be gone already.
+// -------------------------------------------------------------------------- //
+void
+TTcpServerSerialPortManager::Accept()
+{
+	// Sends must not block the thread: it waits for the socket instead.
+	int theSocket = ::accept4(mListenSocket, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (theSocket == -1)
+	{
+		LogError("Accept: can't accept the client", true);
+		return;
+	}
+	Disconnect();
+
+	// Small messages of the Newton protocols must go out right away.
+	int yes = 1;
+	(void) ::setsockopt(theSocket, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	struct epoll_event event {
+	};
+	event.events = EPOLLIN;
+	event.data.fd = theSocket;
+	(void) ::epoll_ctl(mEpoll, EPOLL_CTL_ADD, theSocket, &event);
+	mTcpSocket = theSocket;
+	mIsConnected = true;
+}
+
+// -------------------------------------------------------------------------- //
+//  * HandleDMA()
+//		This endless loop waits for the sockets and the emulator, and moves
+//		data between the client and the DMA buffers.
+// -------------------------------------------------------------------------- //
+void
+TTcpServerSerialPortManager::HandleDMA()
+{
+	// The client socket that is watched for other events than input, if
+	// any, and these events.
+	int watchedSocket = -1;
+	uint32_t watchedEvents = EPOLLIN;
+	for (;;)
+	{
+		int timeout = -1;
+		if (mMustListen.exchange(false) && !Listen())
+		{
+			// The address may become available later.
+			mMustListen = true;
+			timeout = kListenRetryMilliseconds;
+		}
+
+		// Reception waits for the emulated line.
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		Boolean isLineBusy = IsConnected() && (mRxLineFree > now);
+		if (isLineBusy)
+		{
+			auto theDelay = std::chrono::duration_cast<std::chrono::microseconds>(mRxLineFree - now);
+			int theDelayMilliseconds = (int) ((theDelay.count() + 999) / 1000);
+			if ((timeout == -1) || (theDelayMilliseconds < timeout))
+			{
+				timeout = theDelayMilliseconds;
+			}
+		}
+
+		// Bytes the client couldn't take yet are sent when it can.
+		Boolean mustWatchTx = IsConnected()
+			&& (mTxDMAControl & 0x00000002) && mTxDMADataCountdown;
+		uint32_t theEvents = (isLineBusy ? 0 : EPOLLIN) | (mustWatchTx ? EPOLLOUT : 0);
+		if (theEvents == 0)
+		{
+			// A hang up is still reported, but only once.
+			theEvents = EPOLLONESHOT;
+		}
+		if (IsConnected()
+			&& (theEvents != ((watchedSocket == mTcpSocket) ? watchedEvents : EPOLLIN)))
+		{
+			struct epoll_event event {
+			};
+			event.events = theEvents;
+			event.data.fd = mTcpSocket;
+			(void) ::epoll_ctl(mEpoll, EPOLL_CTL_MOD, mTcpSocket, &event);
+			watchedSocket = mTcpSocket;
+			watchedEvents = theEvents;
+		}
+
+		struct epoll_event events[4];
+		int n = ::epoll_wait(mEpoll, events, 4, timeout);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			// Waiting again would fail the same way.
+			LogError("HandleDMA: error waiting for sockets", true);
+			Disconnect();
+			return;
+		}
+
+		// Handle the client before accepting another one, which could get
+		// the same descriptor.
+		Boolean mustAccept = false;
+		for (int i = 0; i < n; i++)
+		{
+			int fd = events[i].data.fd;
+			if (fd == mEventFD)
+			{
+				uint64_t count;
+				(void) ::read(mEventFD, &count, sizeof(count));
+			} else if (fd == mListenSocket)
+			{
+				mustAccept = true;
+			} else if (IsConnected() && (fd == mTcpSocket)
+				&& (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+			{
+				HandleDMAReceive();
+			}
+		}
+		if (mQuit)
+		{
+			Disconnect();
+			return;
+		}
+		if (mustAccept)
+		{
+			Accept();
+			// The new client is only watched for input.
+			watchedSocket = -1;
+		}
+
+		// handle transmitting DMA
+		HandleDMASend();
+	}
+}
+
+// ================================================================== //
+// The best way to predict the future is to invent it.                //
+//  - Alan Kay                                                        //
+// ================================================================== //
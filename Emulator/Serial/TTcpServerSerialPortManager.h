@@ -0,0 +1,145 @@
+// ==============================
+// File:			TTcpServerSerialPortManager.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _T_TCP_SERVER_SERIAL_PORT_MANAGER_H
+#define _T_TCP_SERVER_SERIAL_PORT_MANAGER_H
+
+#include "TTcpClientSerialPortManager.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+///
+/// Emulate a serial port with a TCP server in Linux
+///
+/// The server listens on a port and the Newton talks to the last client that
+/// connected. A client may come and go without restarting the emulator, and
+/// each emulator on a host can listen on its own port.
+///
+/// The worker thread waits with epoll for the sockets and for an eventfd
+/// that the emulator signals when the DMA registers change. The client
+/// socket doesn't block: when it can't take all the bytes to send, the
+/// thread also waits for it to have room.
+///
+class TTcpServerSerialPortManager : public TTcpClientSerialPortManager
+{
+public:
+	///
+	/// Constructor.
+	///
+	TTcpServerSerialPortManager(TLog* inLog,
+		TSerialPorts::EPortIndex inPortIx);
+
+	///
+	/// Destructor.
+	///
+	~TTcpServerSerialPortManager() override;
+
+	///
+	/// Return the Identification of this driver
+	///
+	TSerialPorts::EDriverID
+	GetID() override
+	{
+		return TSerialPorts::kTcpServerDriver;
+	}
+
+	///
+	/// Start emulation.
+	///
+	void run(TInterruptManager* inInterruptManager,
+		TDMAManager* inDMAManager,
+		TMemory* inMemory) override;
+
+	///
+	/// DMA or interrupts trigger a command that must be handled by a derived class.
+	///
+	void TriggerEvent(KUInt8 cmd) override;
+
+	///
+	/// Set options from NewtonScript
+	///
+	void NSSetOptions(TNewt::RefArg frame) override;
+
+	///
+	/// Set the address to listen on, 0.0.0.0 for all interfaces.
+	///
+	void SetServerAddress(const char* inAddress) override;
+
+	///
+	/// Set the port to listen on, 0 for any free port. GetServerPort returns
+	/// the port that was picked once the server listens.
+	///
+	void SetServerPort(int inPort) override;
+
+	///
+	/// Return the port that the server listens on, or the port to listen on
+	/// until it does.
+	///
+	int GetServerPort() override;
+
+protected:
+	///
+	/// Emulate the DMA hardware
+	///
+	void HandleDMA() override;
+
+	///
+	/// There is no server to connect to: wait for a client instead.
+	///
+	bool Connect() override;
+
+	///
+	/// Open the listening socket, closing the previous one.
+	///
+	bool Listen();
+
+	///
+	/// Accept a client, replacing the current one.
+	///
+	void Accept();
+
+	///
+	/// Hand a copy of the address and the port to the DMA thread, which
+	/// listens again.
+	///
+	void ListenAgain();
+
+	int mEventFD = -1; ///< signals commands from the emulator to the DMA thread
+	int mEpoll = -1; ///< waits for the sockets and mEventFD
+	int mListenSocket = -1; ///< TCP socket waiting for clients
+	std::atomic<bool> mMustListen { true }; ///< address or port changed
+	std::mutex mListenMutex; ///< the address and port are set while the DMA thread listens
+	std::string mListenAddress; ///< copy of mServer for the DMA thread
+	int mListenPort = 0; ///< copy of mPort for the DMA thread
+	std::atomic<int> mListeningPort { 0 }; ///< port picked by the system, 0 until listening
+	std::atomic<bool> mQuit { false }; ///< the DMA thread must end
+};
+
+#endif
+// _T_TCP_SERVER_SERIAL_PORT_MANAGER_H
+
+// ======================================== //
+// Any port in a storm.                     //
+// ======================================== //
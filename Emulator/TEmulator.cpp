@@ -64,6 +64,7 @@
 //#define kMyNewtonIDLow		0x020207A5
 #define kMyNewtonIDHigh 0x00004E65
 #define kMyNewtonIDLow 0x77746F6E
+#define kVirtualTimeSliceUnits 4096
 
 // -------------------------------------------------------------------------- //
 //  * TEmulator( void )
@@ -183,6 +184,8 @@ TEmulator::TEmulator(
 // -------------------------------------------------------------------------- //
 TEmulator::~TEmulator(void)
 {
+	if (mScreenManager)
+		mScreenManager->SetInterruptManager(nil);
 	if (mInterruptManager)
 		delete mInterruptManager;
 	if (mDMAManager)
@@ -206,6 +209,11 @@ TEmulator::Run(void)
 	{
 		if (mPaused)
 		{
+			// The system is idle: show what it drew.
+			if (mScreenManager)
+			{
+				mScreenManager->FlushDamage();
+			}
 			KUInt32 theCPSR = mProcessor.GetCPSR();
 			mInterruptManager->WaitUntilInterrupt(
 				!(theCPSR & TARMProcessor::kPSR_IBit),
@@ -223,10 +231,23 @@ TEmulator::Run(void)
 			mSignal = true;
 		}
 		// We can insert a try....catch block here to trace all CPU mode changes
-		mMemory.GetJITObject()->Run(&mProcessor, &mSignal);
+		if (mInterruptManager->IsVirtualTime())
+		{
+			// Time advances with the instructions we executed.
+			KUInt32 theUnits = mMemory.GetJITObject()->RunUnits(
+				&mProcessor, &mSignal, kVirtualTimeSliceUnits);
+			mInterruptManager->AdvanceVirtualTime(theUnits);
+		} else
+		{
+			mMemory.GetJITObject()->Run(&mProcessor, &mSignal);
+		}
 	}
 
 	mInterruptManager->SuspendTimer();
+	if (mScreenManager)
+	{
+		mScreenManager->FlushDamage();
+	}
 
 	// FIXME: The code below may be harmful when we call the emulator through the monitor!
 	// Instead, the caller of this function, or of TMonitor::run() should call the Quit function.
@@ -250,6 +271,10 @@ TEmulator::Step(void)
 
 	// Execute 1 instruction
 	mMemory.GetJITObject()->Step(&mProcessor, 1);
+	if (mInterruptManager->IsVirtualTime())
+	{
+		mInterruptManager->AdvanceVirtualTime(1);
+	}
 
 	mInterruptManager->SuspendTimer();
 }
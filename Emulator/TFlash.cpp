@@ -336,6 +336,21 @@ TFlash::PowerOff(void) const
 	Save();
 }
 
+// -------------------------------------------------------------------------- //
+//  * MakePrivate( void )
+// -------------------------------------------------------------------------- //
+void
+TFlash::MakePrivate(void)
+{
+	if (mFlashFile.MakePrivate() < 0)
+	{
+		if (mLog)
+		{
+			mLog->LogLine("Couldn't make the flash private, it is still shared");
+		}
+	}
+}
+
 // =================================== //
 // The world is not octal despite DEC. //
 // =================================== //
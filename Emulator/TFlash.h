@@ -124,6 +124,12 @@ public:
 	///
 	void PowerOff(void) const;
 
+	///
+	/// Stop sharing the flash with the flash file.
+	/// Further writes only affect this process (used by forked sessions).
+	///
+	void MakePrivate(void);
+
 	///
 	/// Additional constants related to the memory space.
 	///
@@ -34,6 +34,13 @@
 #include <time.h>
 #else
 #include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#if TARGET_OS_LINUX
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #endif
 
 // Mach
@@ -49,10 +56,6 @@
 // Einstein
 #include "Log/TLog.h"
 
-// -------------------------------------------------------------------------- //
-// Constantes
-// -------------------------------------------------------------------------- //
-
 // -------------------------------------------------------------------------- //
 //  * TInterruptManager( TLog*, TARMProcessor* )
 // -------------------------------------------------------------------------- //
@@ -74,7 +77,24 @@ TInterruptManager::TInterruptManager(TLog* inLog, TARMProcessor* inProcessor) :
 		mCalendarDelta(GetSyncedCalendarDelta()),
 		mAlarmRegister(0),
 		mTimerDelta(0),
-		mTimer(0)
+		mTimer(0),
+		mVirtualTime(false),
+		mWakeRequested(false),
+		mVirtualTicksPerKUnits(kDefaultVirtualTicksPerKUnits),
+		mVirtualTicksFraction(0),
+		mVirtualTicks(0),
+		mVirtualRTCBase(0),
+		mWarpMaxTicks(0),
+		mWarpRTCFraction(0),
+		mWarpedTicks(0),
+		mRunningCallback(nil),
+		mTimerFd(-1),
+		mWakeFd(-1),
+		mTimerCondVar(nil),
+		mEmulatorCondVar(nil),
+		mCallbackCondVar(nil),
+		mMutex(nil),
+		mThread(nil)
 {
 	// Start the thread.
 	Init();
@@ -105,8 +125,21 @@ TInterruptManager::TInterruptManager(
 		mAlarmRegister(0),
 		mTimerDelta(0),
 		mTimer(inTimer),
+		mVirtualTime(false),
+		mWakeRequested(false),
+		mVirtualTicksPerKUnits(kDefaultVirtualTicksPerKUnits),
+		mVirtualTicksFraction(0),
+		mVirtualTicks(0),
+		mVirtualRTCBase(0),
+		mWarpMaxTicks(0),
+		mWarpRTCFraction(0),
+		mWarpedTicks(0),
+		mRunningCallback(nil),
+		mTimerFd(-1),
+		mWakeFd(-1),
 		mTimerCondVar(nil),
 		mEmulatorCondVar(nil),
+		mCallbackCondVar(nil),
 		mMutex(nil),
 		mThread(nil)
 {
@@ -120,19 +153,15 @@ TInterruptManager::TInterruptManager(
 TInterruptManager::~TInterruptManager(void)
 {
 	// Stop the timer thread.
-	mMutex->Lock();
-
-	mExiting = true;
-	mTimerCondVar->Signal();
-
-	mMutex->Unlock();
+	StopTimerThread();
 
-	// Wait for the thread to finish.
-	while (mExiting) { };
-
-	if (mThread)
+	if (mTimerFd >= 0)
 	{
-		delete mThread;
+		(void) ::close(mTimerFd);
+	}
+	if (mWakeFd >= 0)
+	{
+		(void) ::close(mWakeFd);
 	}
 	if (mTimerCondVar)
 	{
@@ -142,6 +171,10 @@ TInterruptManager::~TInterruptManager(void)
 	{
 		delete mEmulatorCondVar;
 	}
+	if (mCallbackCondVar)
+	{
+		delete mCallbackCondVar;
+	}
 	if (mMutex)
 	{
 		delete mMutex;
@@ -160,10 +193,48 @@ TInterruptManager::Init(void)
 	mMatchRegisters[2] = 0;
 	mMatchRegisters[3] = 0;
 
+	ResetLatenessHistogram();
+
 	mTimerCondVar = new TCondVar();
 	mEmulatorCondVar = new TCondVar();
+	mCallbackCondVar = new TCondVar();
 	mMutex = new TMutex();
 
+#if TARGET_OS_LINUX
+	// Sleep on a monotonic timerfd rather than on the condition variable.
+	mTimerFd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	mWakeFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if ((mTimerFd < 0) || (mWakeFd < 0))
+	{
+		// Fall back to the condition variable.
+		if (mTimerFd >= 0)
+		{
+			(void) ::close(mTimerFd);
+			mTimerFd = -1;
+		}
+		if (mWakeFd >= 0)
+		{
+			(void) ::close(mWakeFd);
+			mWakeFd = -1;
+		}
+	}
+#endif
+
+	StartTimerThread();
+}
+
+// -------------------------------------------------------------------------- //
+//  * StartTimerThread( void )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::StartTimerThread(void)
+{
+	if (mThread || mVirtualTime)
+	{
+		// Already running, or not needed.
+		return;
+	}
+
 	mMutex->Lock();
 
 	// The timer isn't running.
@@ -181,12 +252,44 @@ TInterruptManager::Init(void)
 	mMutex->Unlock();
 }
 
+// -------------------------------------------------------------------------- //
+//  * StopTimerThread( void )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::StopTimerThread(void)
+{
+	if (mThread == nil)
+	{
+		return;
+	}
+
+	mMutex->Lock();
+
+	mExiting = true;
+	SignalTimerThread();
+
+	mMutex->Unlock();
+
+	// Wait for the thread to finish.
+	while (mExiting) { };
+
+	delete mThread;
+	mThread = nil;
+}
+
 // -------------------------------------------------------------------------- //
 //  * ResumeTimer( void )
 // -------------------------------------------------------------------------- //
 void
 TInterruptManager::ResumeTimer(void)
 {
+	if (mVirtualTime)
+	{
+		// Time only advances when the emulator calls AdvanceVirtualTime.
+		mRunning = true;
+		return;
+	}
+
 	// Is the timer indeed suspended?
 	if (!mRunning)
 	{
@@ -197,8 +300,11 @@ TInterruptManager::ResumeTimer(void)
 		// Say the timer is running.
 		mRunning = true;
 
+		// New run, new warp accounting.
+		mWarpedTicks = 0;
+
 		// Signal the condition variable to wake the timer thread.
-		mTimerCondVar->Signal();
+		SignalTimerThread();
 
 		// Wait for the thread to have been resumed.
 		//		KPrintf("%i-Emulator-Sleep-2\n", (int) time(NULL));
@@ -216,6 +322,12 @@ TInterruptManager::ResumeTimer(void)
 void
 TInterruptManager::SuspendTimer(void)
 {
+	if (mVirtualTime)
+	{
+		mRunning = false;
+		return;
+	}
+
 	// Is the timer indeed running?
 	if (mRunning)
 	{
@@ -226,8 +338,16 @@ TInterruptManager::SuspendTimer(void)
 		// Say the timer is not running.
 		mRunning = false;
 
+		if (mWarpMaxTicks && mLog)
+		{
+			mLog->FLogLine(
+				"Warped %llu ticks (%llu s) during this run",
+				(unsigned long long) mWarpedTicks,
+				(unsigned long long) (mWarpedTicks / kTicksPerSecond));
+		}
+
 		// Signal the condition variable to wake the timer thread.
-		mTimerCondVar->Signal();
+		SignalTimerThread();
 
 		// Wait for the thread to have been suspended.
 		//		KPrintf("%i-Emulator-Sleep-3\n", (int) time(NULL));
@@ -250,19 +370,28 @@ TInterruptManager::WaitUntilInterrupt(Boolean inMaskIRQ, Boolean inMaskFIQ)
 		//		mLog->LogLine( "Wait until interrupt" );
 	}
 
+	if (mVirtualTime)
+	{
+		mMaskIRQ = inMaskIRQ;
+		mMaskFIQ = inMaskFIQ;
+		VirtualWaitUntilInterrupt();
+		return;
+	}
+
 	mMutex->Lock();
 
 	// Here the timer is waiting (since we have the mutex).
 
 	// Say we're waiting.
 	mWaiting = true;
+	mWakeRequested = false;
 
 	// Note what we are waiting for.
 	mMaskIRQ = inMaskIRQ;
 	mMaskFIQ = inMaskFIQ;
 
 	// Wake the thread now, but it will actually wait until we go to sleep.
-	mTimerCondVar->Signal();
+	SignalTimerThread();
 
 	// Wait for the thread to signal us.
 	//	KPrintf("%i-Emulator-Sleep-4\n", (int) time(NULL));
@@ -277,31 +406,448 @@ TInterruptManager::WaitUntilInterrupt(Boolean inMaskIRQ, Boolean inMaskFIQ)
 }
 
 // -------------------------------------------------------------------------- //
-//  * RaiseInterrupt( KUInt32 )
+//  * WakeEmulatorThread( void )
 // -------------------------------------------------------------------------- //
 void
-TInterruptManager::RaiseInterrupt(KUInt32 inIntMask)
+TInterruptManager::WakeEmulatorThread(void)
+{
+	mWakeRequested = true;
+	if (mVirtualTime)
+	{
+		// The emulator thread may be about to wait in
+		// VirtualWaitUntilInterrupt, which holds the mutex until then.
+		mMutex->Lock();
+		mEmulatorCondVar->Signal();
+		mMutex->Unlock();
+	} else
+	{
+		mEmulatorCondVar->Signal();
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * EnableVirtualTime( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::EnableVirtualTime(KUInt32 inTicksPerKUnits)
 {
+	if (mVirtualTime)
+	{
+		return;
+	}
+
+	// The calendar starts where it is now, then follows virtual time.
+	mVirtualRTCBase = GetRealTimeClock();
+
+	// Timers will be fired by the emulator thread.
+	StopTimerThread();
+
 	mMutex->Lock();
+	mVirtualTicksPerKUnits = inTicksPerKUnits;
+	mVirtualTicksFraction = 0;
+	mVirtualTicks = 0;
+	// mTimer is the current (frozen) timer, use it as the virtual clock
+	// (host = newton).
+	mTimerDelta = 0;
+	mVirtualTime = true;
+	mMutex->Unlock();
+}
 
-	// Here the timer is waiting (since we have the mutex).
+// -------------------------------------------------------------------------- //
+//  * AdvanceVirtualTime( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::AdvanceVirtualTime(KUInt32 inUnits)
+{
+	// ticks = units * rate / 1024, the remainder is kept for next time.
+	KUInt64 theScaled = ((KUInt64) inUnits * mVirtualTicksPerKUnits) + mVirtualTicksFraction;
+	mVirtualTicksFraction = (KUInt32) (theScaled & 0x3FF);
+
+	mMutex->Lock();
+
+	SetVirtualTimer(mTimer + (KUInt32) (theScaled >> 10));
+	if (IsCallbackDue(mTimer))
+	{
+		RunDueCallbacks(mTimer);
+	}
+	(void) SignalProcessor();
+
+	mMutex->Unlock();
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetVirtualTimer( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::SetVirtualTimer(KUInt32 inNewTimer)
+{
+	KUInt32 theNextMatch;
+	(void) FireTimersAndFindNext(mTimer, inNewTimer, &theNextMatch);
+	mVirtualTicks += (KUInt32) (inNewTimer - mTimer);
+	mTimer = inNewTimer;
+}
+
+// -------------------------------------------------------------------------- //
+//  * VirtualWaitUntilInterrupt( void )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::VirtualWaitUntilInterrupt(void)
+{
+	mMutex->Lock();
+
+	mWaiting = true;
+	mWakeRequested = false;
+
+	while (!SignalProcessor() && !mWakeRequested)
+	{
+		KUInt32 theNextMatch;
+		if (IsCallbackDue(mTimer))
+		{
+			RunDueCallbacks(mTimer);
+		} else if (FindNextVirtualWakeMatch(&theNextMatch))
+		{
+			// The CPU is idle: jump to the next timer match. The disabled
+			// timers in between fire too.
+			SetVirtualTimer(theNextMatch);
+		} else
+		{
+			// No timer will wake us, only a device thread can. It signals
+			// us with the mutex, so the signal can't be lost.
+			mEmulatorCondVar->Wait(mMutex);
+		}
+	}
+
+	mWaiting = false;
+
+	mMutex->Unlock();
+}
+
+// -------------------------------------------------------------------------- //
+//  * FindNextVirtualWakeMatch( KUInt32* )
+// -------------------------------------------------------------------------- //
+Boolean
+TInterruptManager::FindNextVirtualWakeMatch(KUInt32* outNextMatch)
+{
+	KUInt32 theWakeMask = mIntCtrlReg & ~mIntRaised;
+	if (mMaskFIQ)
+	{
+		theWakeMask &= ~mFIQMask;
+	}
+	if (mMaskIRQ)
+	{
+		theWakeMask &= mFIQMask;
+	}
+
+	Boolean hasNextTimer = false;
+	KUInt32 nextTicksValue = 0;
+	for (KUInt32 indexTimer = 0; indexTimer < 4; indexTimer++)
+	{
+		if (theWakeMask & (kTimer0IntMask << indexTimer))
+		{
+			KUInt32 ticksValue = mMatchRegisters[indexTimer] + mTimerDelta;
+			if (hasNextTimer)
+			{
+				nextTicksValue = GetNextTimer(mTimer, ticksValue, nextTicksValue);
+			} else
+			{
+				nextTicksValue = ticksValue;
+				hasNextTimer = true;
+			}
+		}
+	}
+
+	// The callbacks may raise interrupts.
+	KUInt32 theCallbackDue;
+	if (FindNextCallback(mTimer, &theCallbackDue))
+	{
+		nextTicksValue = hasNextTimer
+			? GetNextTimer(mTimer, theCallbackDue, nextTicksValue)
+			: theCallbackDue;
+		hasNextTimer = true;
+	}
+
+	*outNextMatch = nextTicksValue;
+	return hasNextTimer;
+}
+
+// -------------------------------------------------------------------------- //
+//  * ScheduleCallback( TTimerCallback*, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::ScheduleCallback(TTimerCallback* inCallback, KUInt32 inDelay)
+{
+	mMutex->Lock();
+
+	// Don't change the due time while the callback is called.
+	while (mRunningCallback == inCallback)
+	{
+		mCallbackCondVar->Wait(mMutex);
+	}
+
+	KUInt32 theDue = GetTimer() + inDelay;
+	Boolean isScheduled = false;
+	for (SCallback& theScheduled : mCallbacks)
+	{
+		if (theScheduled.fCallback == inCallback)
+		{
+			theScheduled.fDue = theDue;
+			isScheduled = true;
+		}
+	}
+	if (!isScheduled)
+	{
+		SCallback theScheduled;
+		theScheduled.fCallback = inCallback;
+		theScheduled.fDue = theDue;
+		mCallbacks.push_back(theScheduled);
+	}
+
+	// Whoever fires the timers must look at the callback.
+	if (mVirtualTime)
+	{
+		mEmulatorCondVar->Signal();
+	} else
+	{
+		SignalTimerThread();
+	}
+
+	mMutex->Unlock();
+}
+
+// -------------------------------------------------------------------------- //
+//  * CancelCallback( TTimerCallback* )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::CancelCallback(TTimerCallback* inCallback)
+{
+	mMutex->Lock();
+
+	while (mRunningCallback == inCallback)
+	{
+		mCallbackCondVar->Wait(mMutex);
+	}
+	for (auto theIterator = mCallbacks.begin(); theIterator != mCallbacks.end(); theIterator++)
+	{
+		if (theIterator->fCallback == inCallback)
+		{
+			(void) mCallbacks.erase(theIterator);
+			break;
+		}
+	}
+
+	mMutex->Unlock();
+}
+
+// -------------------------------------------------------------------------- //
+//  * FindNextCallback( KUInt32, KUInt32* ) const
+// -------------------------------------------------------------------------- //
+Boolean
+TInterruptManager::FindNextCallback(KUInt32 inTimer, KUInt32* outDue) const
+{
+	Boolean hasNextCallback = false;
+	KUInt32 theNextDue = 0;
+	for (const SCallback& theScheduled : mCallbacks)
+	{
+		// A late callback is due now.
+		KUInt32 theDue = ((KSInt32) (inTimer - theScheduled.fDue) >= 0)
+			? inTimer
+			: theScheduled.fDue;
+		theNextDue = hasNextCallback
+			? GetNextTimer(inTimer, theDue, theNextDue)
+			: theDue;
+		hasNextCallback = true;
+	}
+
+	*outDue = theNextDue;
+	return hasNextCallback;
+}
+
+// -------------------------------------------------------------------------- //
+//  * IsCallbackDue( KUInt32 ) const
+// -------------------------------------------------------------------------- //
+Boolean
+TInterruptManager::IsCallbackDue(KUInt32 inTimer) const
+{
+	for (const SCallback& theScheduled : mCallbacks)
+	{
+		if ((KSInt32) (inTimer - theScheduled.fDue) >= 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// -------------------------------------------------------------------------- //
+//  * RunDueCallbacks( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::RunDueCallbacks(KUInt32 inTimer)
+{
+	size_t theIndex = 0;
+	while (theIndex < mCallbacks.size())
+	{
+		if ((KSInt32) (inTimer - mCallbacks[theIndex].fDue) < 0)
+		{
+			theIndex++;
+			continue;
+		}
 
-	// Raise the interrupt.
-	mIntRaised |= inIntMask;
+		TTimerCallback* theCallback = mCallbacks[theIndex].fCallback;
+		mRunningCallback = theCallback;
+		mMutex->Unlock();
+
+		KUInt32 theDelay = theCallback->TimerCallback(inTimer);
+
+		mMutex->Lock();
+		mRunningCallback = nil;
+		mCallbackCondVar->Broadcast();
+
+		// Other callbacks may have come and gone meanwhile, but this one
+		// couldn't be cancelled.
+		theIndex = 0;
+		while (mCallbacks[theIndex].fCallback != theCallback)
+		{
+			theIndex++;
+		}
+		if (theDelay)
+		{
+			// Keep it in the future half of the timer.
+			if (theDelay > 0x7FFFFFFF)
+			{
+				theDelay = 0x7FFFFFFF;
+			}
+			mCallbacks[theIndex].fDue = inTimer + theDelay;
+		} else
+		{
+			(void) mCallbacks.erase(mCallbacks.begin() + theIndex);
+		}
+
+		// Start over, the vector may have changed.
+		theIndex = 0;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * SetWarp( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::SetWarp(KUInt32 inMaxTicks)
+{
+	mMutex->Lock();
+
+	mWarpMaxTicks = inMaxTicks;
 
 	// Signal the condition variable to wake the timer thread.
-	mTimerCondVar->Signal();
+	SignalTimerThread();
 
-	// Release the mutex, so the timer thread will get it back.
 	mMutex->Unlock();
 }
 
+// -------------------------------------------------------------------------- //
+//  * Warp( KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+KUInt32
+TInterruptManager::Warp(KUInt32 inNow, KUInt32 inNextMatch)
+{
+	KUInt32 theSkip = inNextMatch - inNow;
+	if (theSkip > mWarpMaxTicks)
+	{
+		theSkip = mWarpMaxTicks;
+	}
+
+	// Don't jump over the RTC alarm either.
+	if (mIntCtrlReg & kRTCAlarmIntMask)
+	{
+		KUInt32 theRTC = GetRealTimeClock();
+		if (mAlarmRegister > theRTC)
+		{
+			KUInt64 theAlarmTicks
+				= ((KUInt64) (mAlarmRegister - theRTC)) * kTicksPerSecond
+				- mWarpRTCFraction;
+			if (theAlarmTicks < theSkip)
+			{
+				theSkip = (KUInt32) theAlarmTicks;
+			}
+		}
+	}
+
+	// newton = host - delta: shift the delta to move the timer forward.
+	mTimerDelta -= theSkip;
+	mWarpedTicks += theSkip;
+
+	// The calendar moves forward as well.
+	mWarpRTCFraction += theSkip;
+	mCalendarDelta -= (KSInt32) (mWarpRTCFraction / kTicksPerSecond);
+	mWarpRTCFraction %= kTicksPerSecond;
+
+	return inNextMatch - theSkip;
+}
+
+// -------------------------------------------------------------------------- //
+//  * SignalProcessor( void )
+// -------------------------------------------------------------------------- //
+Boolean
+TInterruptManager::SignalProcessor(void)
+{
+	Boolean gotAnInterrupt = false;
+	if (mIntRaised & mIntCtrlReg & mFIQMask)
+	{
+		mProcessor->FIQInterrupt();
+		if ((!mWaiting) || (!mMaskFIQ))
+		{
+			gotAnInterrupt = true;
+		}
+	} else
+	{
+		mProcessor->ClearFIQInterrupt();
+	}
+
+	if (mIntRaised & mIntCtrlReg & ~mFIQMask)
+	{
+		mProcessor->IRQInterrupt();
+		if ((!mWaiting) || (!mMaskIRQ))
+		{
+			gotAnInterrupt = true;
+		}
+	} else
+	{
+		mProcessor->ClearIRQInterrupt();
+	}
+
+	return gotAnInterrupt;
+}
+
+// -------------------------------------------------------------------------- //
+//  * RaiseInterrupt( KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::RaiseInterrupt(KUInt32 inIntMask)
+{
+	// Raise the interrupt (atomically, device threads don't take the mutex).
+	KUInt32 theRaisedBefore = mIntRaised.fetch_or(inIntMask);
+
+	// Only wake the timer thread if an enabled interrupt is now pending.
+	// SetIntCtrlReg wakes it when the enabled interrupts change.
+	if (inIntMask & ~theRaisedBefore
+		& mIntCtrlReg.load(std::memory_order_relaxed))
+	{
+		WakeTimerThread();
+	}
+}
+
 // -------------------------------------------------------------------------- //
 //  * GetRealTimeClock( void ) const
 // -------------------------------------------------------------------------- //
 KUInt32
 TInterruptManager::GetRealTimeClock(void) const
 {
+	if (mVirtualTime)
+	{
+		return mVirtualRTCBase + (KUInt32) (mVirtualTicks / kTicksPerSecond);
+	}
+
 	time_t now = time(NULL);
 
 	return (KUInt32) (now - mCalendarDelta);
@@ -317,6 +863,11 @@ TInterruptManager::SetRealTimeClock(KUInt32 inValue)
 
 	// Here the timer is waiting (since we have the mutex).
 
+	if (mVirtualTime)
+	{
+		mVirtualRTCBase = inValue - (KUInt32) (mVirtualTicks / kTicksPerSecond);
+	}
+
 	// newton = host - delta
 	// delta = host - newton
 	//  KPrintf("mCalendarDelta was %i\n", (int) mCalendarDelta);
@@ -324,7 +875,7 @@ TInterruptManager::SetRealTimeClock(KUInt32 inValue)
 	//  KPrintf("mCalendarDelta now is %i\n", (int) mCalendarDelta);
 
 	// Signal the condition variable to wake the timer thread.
-	mTimerCondVar->Signal();
+	SignalTimerThread();
 
 	// Release the mutex, so the timer thread will get it back.
 	mMutex->Unlock();
@@ -345,7 +896,7 @@ TInterruptManager::SetAlarm(KUInt32 inValue)
 	if (mIntCtrlReg & kRTCAlarmIntMask)
 	{
 		// Signal the condition variable to wake the timer thread.
-		mTimerCondVar->Signal();
+		SignalTimerThread();
 	}
 
 	// Release the mutex, so the timer thread will get it back.
@@ -376,7 +927,7 @@ TInterruptManager::SetTimerMatchRegister(KUInt32 inMatchReg, KUInt32 inValue)
 	if (mIntCtrlReg & (kTimer0IntMask << inMatchReg))
 	{
 		// Signal the condition variable to wake the timer thread.
-		mTimerCondVar->Signal();
+		SignalTimerThread();
 	}
 
 	// Release the mutex, so the timer thread will get it back.
@@ -399,7 +950,7 @@ TInterruptManager::SetIntCtrlReg(KUInt32 inValue)
 		mIntCtrlReg = inValue;
 
 		// Signal the condition variable to wake the timer thread.
-		mTimerCondVar->Signal();
+		SignalTimerThread();
 	}
 
 	// Release the mutex, so the timer thread will get it back.
@@ -422,7 +973,7 @@ TInterruptManager::SetIntEDReg1(KUInt32 inValue)
 		mIntEDReg1 = inValue;
 
 		// Signal the condition variable to wake the timer thread.
-		mTimerCondVar->Signal();
+		SignalTimerThread();
 	}
 
 	// Release the mutex, so the timer thread will get it back.
@@ -445,7 +996,7 @@ TInterruptManager::SetIntEDReg2(KUInt32 inValue)
 		mIntEDReg2 = inValue;
 
 		// Signal the condition variable to wake the timer thread.
-		mTimerCondVar->Signal();
+		SignalTimerThread();
 	}
 
 	// Release the mutex, so the timer thread will get it back.
@@ -468,7 +1019,7 @@ TInterruptManager::SetIntEDReg3(KUInt32 inValue)
 		mIntEDReg3 = inValue;
 
 		// Signal the condition variable to wake the timer thread.
-		mTimerCondVar->Signal();
+		SignalTimerThread();
 	}
 
 	// Release the mutex, so the timer thread will get it back.
@@ -481,18 +1032,16 @@ TInterruptManager::SetIntEDReg3(KUInt32 inValue)
 void
 TInterruptManager::ClearInterrupts(KUInt32 inMask)
 {
-	mMutex->Lock();
-
-	// Here the timer is waiting (since we have the mutex).
-
-	// Clear the interrupts.
-	mIntRaised &= ~inMask;
+	// Clear the interrupts (atomically).
+	KUInt32 theRaisedBefore = mIntRaised.fetch_and(~inMask);
 
-	// Signal the condition variable to wake the timer thread.
-	mTimerCondVar->Signal();
-
-	// Release the mutex, so the timer thread will get it back.
-	mMutex->Unlock();
+	// Only wake the timer thread if an enabled pending interrupt was
+	// cleared.
+	if (inMask & theRaisedBefore
+		& mIntCtrlReg.load(std::memory_order_relaxed))
+	{
+		WakeTimerThread();
+	}
 }
 
 // -------------------------------------------------------------------------- //
@@ -594,82 +1143,61 @@ TInterruptManager::Run(void)
 		while (mRunning)
 		{
 			// We are running.
+			if (IsCallbackDue(newTicks - mTimerDelta))
+			{
+				// The mutex was released during the calls: start over.
+				RunDueCallbacks(newTicks - mTimerDelta);
+				newTicks = GetTimeInTicks();
+				continue;
+			}
+
 			// How long should we sleep?
-			if (FireTimersAndFindNext(ticks, newTicks, &nextMatch))
+			KUInt32 previouslyRaised = mIntRaised;
+			Boolean hasNextMatch = FireTimersAndFindNext(ticks, newTicks, &nextMatch);
+			RecordLateness(mIntRaised & ~previouslyRaised, newTicks);
+			KUInt32 theCallbackDue;
+			if (FindNextCallback(newTicks - mTimerDelta, &theCallbackDue))
+			{
+				// Callbacks are due like timer matches.
+				KUInt32 theCallbackMatch = theCallbackDue + mTimerDelta;
+				nextMatch = hasNextMatch
+					? GetNextTimer(newTicks, theCallbackMatch, nextMatch)
+					: theCallbackMatch;
+				hasNextMatch = true;
+			}
+			if (hasNextMatch)
 			{
 				// Shift the ticks.
 				ticks = newTicks;
 
 				// Raise the interrupts.
-				Boolean gotAnInterrupt = false;
-				if (mIntRaised & mIntCtrlReg & mFIQMask)
-				{
-					mProcessor->FIQInterrupt();
-					if ((!mWaiting) || (!mMaskFIQ))
-					{
-						gotAnInterrupt = true;
-					}
-				} else
-				{
-					mProcessor->ClearFIQInterrupt();
-				}
-
-				if (mIntRaised & mIntCtrlReg & ~mFIQMask)
-				{
-					mProcessor->IRQInterrupt();
-					if ((!mWaiting) || (!mMaskIRQ))
-					{
-						gotAnInterrupt = true;
-					}
-				} else
-				{
-					mProcessor->ClearIRQInterrupt();
-				}
-
-				if (gotAnInterrupt && mWaiting)
+				if (SignalProcessor() && mWaiting)
 				{
 					// Resume the processor if it was waiting in our
 					// WaitUntilInterrupt loop.
 					mEmulatorCondVar->Signal();
+				} else if (mWarpMaxTicks && mWaiting && !mWakeRequested)
+				{
+					// The CPU is idle: don't wait for the next match. The
+					// matches that were skipped, including the one we
+					// jumped to, fire next time around.
+					KUInt32 theWarpedMatch = Warp(newTicks, nextMatch);
+					ticks -= nextMatch - theWarpedMatch;
+					nextMatch = theWarpedMatch;
 				}
 
 				// Save the timer value.
 				mTimer = newTicks - mTimerDelta;
 
 				// Wait.
-				TicksWaitOnCondVar(nextMatch - newTicks);
+				TicksWaitOnCondVar(newTicks, nextMatch);
 			} else
 			{
 				// Shift the ticks.
 				ticks = newTicks;
 
 				// Raise the interrupts.
-				Boolean gotAnInterrupt = false;
-				if (mIntRaised & mIntCtrlReg & mFIQMask)
-				{
-					mProcessor->FIQInterrupt();
-					if ((!mWaiting) || (!mMaskFIQ))
-					{
-						gotAnInterrupt = true;
-					}
-				} else
-				{
-					mProcessor->ClearFIQInterrupt();
-				}
-
-				if (mIntRaised & mIntCtrlReg & ~mFIQMask)
-				{
-					mProcessor->IRQInterrupt();
-					if ((!mWaiting) || (!mMaskIRQ))
-					{
-						gotAnInterrupt = true;
-					}
-				} else
-				{
-					mProcessor->ClearIRQInterrupt();
-				}
-
-				if (gotAnInterrupt && mWaiting)
+				if (SignalProcessor() && mWaiting)
 				{
 					// Resume the processor if it was waiting in our
 					// WaitUntilInterrupt loop.
@@ -681,7 +1209,7 @@ TInterruptManager::Run(void)
 
 				// No interrupt is planned.
 				// Wait forever on the condition variable.
-				mTimerCondVar->Wait(mMutex);
+				TimerThreadWait();
 				//				KPrintf("%i-Timer-WakeUp-1\n", (int) time(NULL));
 			}
 
@@ -718,7 +1246,7 @@ TInterruptManager::Run(void)
 		mEmulatorCondVar->Signal();
 
 		// Then wait forever on the condition variable.
-		mTimerCondVar->Wait(mMutex);
+		TimerThreadWait();
 		//		KPrintf("%i-Timer-WakeUp-2\n", (int) time(NULL));
 
 		if (mExiting)
@@ -770,9 +1298,10 @@ TInterruptManager::GetTimeInTicks(void)
 		return theResult;
 	}
 #else
-	// Get the time now.
-	struct timeval now;
-	(void) gettimeofday(&now, NULL);
+	// Get the time now. Unlike the time of day, the monotonic clock doesn't
+	// jump when the host clock is set.
+	struct timespec now;
+	(void) clock_gettime(CLOCK_MONOTONIC, &now);
 
 	//	kern_return_t ret;
 	//	clock_serv_t aClock;
@@ -794,14 +1323,14 @@ TInterruptManager::GetTimeInTicks(void)
 	// slower and accurate
 	// 3.6864 MHz -> 3686400 per seconds.
 	KUInt32 theResult = (KUInt32) now.tv_sec * 3686400;
-	// theResult += (KUInt32) (now.tv_usec * 3.6864);
-	theResult += (KUInt32) ((((KUInt64) now.tv_usec) * 36864) / 10000);
+	// theResult += (KUInt32) (now.tv_nsec * 0.0036864);
+	theResult += (KUInt32) ((((KUInt64) now.tv_nsec) * 36864) / 10000000);
 #else
 	// faster and inaccurate
 	// We simply multiply with 4000000 to avoid the expensive float to int
 	// conversion.
 	KUInt32 theResult = now.tv_sec * 4000000;
-	theResult += (KUInt32) (now.tv_usec * 4);
+	theResult += (KUInt32) (now.tv_nsec / 250);
 #endif
 	return theResult;
 #endif
@@ -813,6 +1342,12 @@ TInterruptManager::GetTimeInTicks(void)
 KUInt32
 TInterruptManager::GetTimer(void) const
 {
+	if (mVirtualTime)
+	{
+		// The virtual clock only moves at safe points.
+		return mTimer;
+	}
+
 	// Get the time now and substract with the correction.
 	KUInt32 theResult = GetTimeInTicks() - mTimerDelta;
 	//	if (mLog)
@@ -827,17 +1362,27 @@ TInterruptManager::GetTimer(void) const
 }
 
 // -------------------------------------------------------------------------- //
-//  * TimedWaitOnCondVar( KUInt32 )
+//  * TicksWaitOnCondVar( KUInt32, KUInt32 )
 // -------------------------------------------------------------------------- //
 inline void
-TInterruptManager::TicksWaitOnCondVar(KUInt32 inTicks)
+TInterruptManager::TicksWaitOnCondVar(KUInt32 inNow, KUInt32 inMatch)
 {
+#if TARGET_OS_LINUX
+	if (mTimerFd >= 0)
+	{
+		FdWait(inNow, inMatch, true);
+		return;
+	}
+#endif
+
+	KUInt32 theTicks = inMatch - inNow;
+
 	// Translate from ticks:
 #if 1
 	// slower and accurate
 	// 3.6864 MHz -> 3686400 per seconds.
-	KUInt32 sec = inTicks / 3686400;
-	KUInt32 rem = inTicks - (sec * 3686400);
+	KUInt32 sec = theTicks / 3686400;
+	KUInt32 rem = theTicks - (sec * 3686400);
 	struct timespec amount;
 	amount.tv_nsec = rem * 271; // (1000000000/3686400)
 	amount.tv_sec = sec;
@@ -846,16 +1391,193 @@ TInterruptManager::TicksWaitOnCondVar(KUInt32 inTicks)
 	// We simply divide with 4000000 to avoid the expensive float to int
 	// conversion.
 	struct timespec amount;
-	amount.tv_nsec = (inTicks * 250) % 1000000000;
-	amount.tv_sec = inTicks / 4000000;
+	amount.tv_nsec = (theTicks * 250) % 1000000000;
+	amount.tv_sec = theTicks / 4000000;
 #endif
 
-	//	KPrintf("TicksWaitOnCondVar begin (%f)\n", inTicks/4000000.0f);
+	//	KPrintf("TicksWaitOnCondVar begin (%f)\n", theTicks/4000000.0f);
 	mTimerCondVar->TimedWaitRelative(mMutex, &amount);
 	//	KPrintf("TicksWaitOnCondVar\n" );
 	//	KPrintf("%i-Timer-WakeUp-3\n", (int) time(NULL));
 }
 
+// -------------------------------------------------------------------------- //
+//  * TimerThreadWait( void )
+// -------------------------------------------------------------------------- //
+inline void
+TInterruptManager::TimerThreadWait(void)
+{
+#if TARGET_OS_LINUX
+	if (mWakeFd >= 0)
+	{
+		FdWait(0, 0, false);
+		return;
+	}
+#endif
+
+	mTimerCondVar->Wait(mMutex);
+}
+
+// -------------------------------------------------------------------------- //
+//  * SignalTimerThread( void )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::SignalTimerThread(void)
+{
+#if TARGET_OS_LINUX
+	if (mWakeFd >= 0)
+	{
+		// The event stays set until the timer thread reads it, whatever it
+		// is doing now.
+		KUInt64 theValue = 1;
+		(void) ::write(mWakeFd, &theValue, sizeof(theValue));
+		return;
+	}
+#endif
+
+	mTimerCondVar->Signal();
+}
+
+// -------------------------------------------------------------------------- //
+//  * WakeTimerThread( void )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::WakeTimerThread(void)
+{
+	if (mVirtualTime)
+	{
+		// There is no timer thread to update the processor lines: do it
+		// now, so that a cleared interrupt isn't taken again. The
+		// emulator thread may be waiting in VirtualWaitUntilInterrupt.
+		mMutex->Lock();
+		(void) SignalProcessor();
+		mEmulatorCondVar->Signal();
+		mMutex->Unlock();
+	} else if (mWakeFd >= 0)
+	{
+		// No need for the mutex, the signal cannot be lost.
+		SignalTimerThread();
+	} else
+	{
+		// We need the mutex to make sure the timer thread is waiting on
+		// the condition variable.
+		mMutex->Lock();
+		mTimerCondVar->Signal();
+		mMutex->Unlock();
+	}
+}
+
+#if TARGET_OS_LINUX
+// -------------------------------------------------------------------------- //
+//  * FdWait( KUInt32, KUInt32, Boolean )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::FdWait(KUInt32 inNow, KUInt32 inMatch, Boolean inTimed)
+{
+	if (inTimed)
+	{
+		// Host ticks count the monotonic clock (see GetTimeInTicks): the
+		// deadline is the time the clock read inNow, plus the ticks to the
+		// match. The ticks that went by since inNow aren't slept again.
+		struct timespec now;
+		(void) ::clock_gettime(CLOCK_MONOTONIC, &now);
+		KUInt64 theNowTicks = ((KUInt64) now.tv_sec) * kTicksPerSecond
+			+ (((KUInt64) now.tv_nsec) * kTicksPerSecond) / 1000000000ULL;
+		KUInt32 theElapsed = (KUInt32) theNowTicks - inNow;
+		KUInt32 theDelay = inMatch - inNow;
+		KUInt64 theMatchTicks = theNowTicks;
+		if (theElapsed < theDelay)
+		{
+			theMatchTicks += theDelay - theElapsed;
+		}
+		KUInt64 theSeconds = theMatchTicks / kTicksPerSecond;
+		KUInt64 theNanosecs
+			= ((theMatchTicks % kTicksPerSecond) * 1000000000ULL + kTicksPerSecond - 1)
+			/ kTicksPerSecond;
+		struct itimerspec theSpec;
+		theSpec.it_interval.tv_sec = 0;
+		theSpec.it_interval.tv_nsec = 0;
+		theSpec.it_value.tv_sec = (time_t) theSeconds;
+		theSpec.it_value.tv_nsec = (long) theNanosecs;
+		(void) ::timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &theSpec, NULL);
+	}
+
+	// Release the mutex while we sleep.
+	mMutex->Unlock();
+
+	struct pollfd theFds[2];
+	theFds[0].fd = mWakeFd;
+	theFds[0].events = POLLIN;
+	theFds[0].revents = 0;
+	theFds[1].fd = mTimerFd;
+	theFds[1].events = POLLIN;
+	theFds[1].revents = 0;
+	while ((::poll(theFds, inTimed ? 2 : 1, -1) < 0) && (errno == EINTR))
+	{
+	}
+
+	KUInt64 theValue;
+	if (theFds[0].revents & POLLIN)
+	{
+		(void) ::read(mWakeFd, &theValue, sizeof(theValue));
+	}
+	if (theFds[1].revents & POLLIN)
+	{
+		(void) ::read(mTimerFd, &theValue, sizeof(theValue));
+	}
+
+	mMutex->Lock();
+}
+#endif
+
+// -------------------------------------------------------------------------- //
+//  * RecordLateness( KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::RecordLateness(KUInt32 inFired, KUInt32 inNow)
+{
+	for (int indexTimer = 0; indexTimer < 4; indexTimer++)
+	{
+		if (inFired & (kTimer0IntMask << indexTimer))
+		{
+			// host = newton + delta
+			KUInt32 theLateTicks = inNow - (mMatchRegisters[indexTimer] + mTimerDelta);
+			KUInt64 theMicrosecs = (((KUInt64) theLateTicks) * 1000000) / kTicksPerSecond;
+			int theBucket = 0;
+			while ((theMicrosecs > 0) && (theBucket < kLatenessBuckets - 1))
+			{
+				theMicrosecs >>= 1;
+				theBucket++;
+			}
+			mLatenessHistogram[theBucket]++;
+		}
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * GetLatenessHistogram( KUInt32[] ) const
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::GetLatenessHistogram(KUInt32 outBuckets[kLatenessBuckets]) const
+{
+	for (int indexBucket = 0; indexBucket < kLatenessBuckets; indexBucket++)
+	{
+		outBuckets[indexBucket] = mLatenessHistogram[indexBucket];
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * ResetLatenessHistogram( void )
+// -------------------------------------------------------------------------- //
+void
+TInterruptManager::ResetLatenessHistogram(void)
+{
+	for (int indexBucket = 0; indexBucket < kLatenessBuckets; indexBucket++)
+	{
+		mLatenessHistogram[indexBucket] = 0;
+	}
+}
+
 // -------------------------------------------------------------------------- //
 //  * FireTimersAndFindNext( KUInt32, KUInt32 )
 // -------------------------------------------------------------------------- //
@@ -868,6 +1590,7 @@ TInterruptManager::FireTimersAndFindNext(
 	Boolean hasNextTimer = false;
 	KUInt32 nextTicksValue = 0;
 	KUInt32 intRaised = mIntRaised;
+	KUInt32 theRaisedBefore = intRaised;
 	KUInt32 ticksValue;
 	KUInt32 delta = mTimerDelta;
 
@@ -1088,7 +1811,9 @@ TInterruptManager::FireTimersAndFindNext(
 	}
 
 	*outNextMatch = nextTicksValue;
-	mIntRaised = intRaised;
+	// Only add the timers we fired, other threads may have changed the
+	// other bits in the meantime.
+	mIntRaised |= (intRaised & ~theRaisedBefore);
 
 	return hasNextTimer;
 }
@@ -1156,21 +1881,24 @@ TInterruptManager::TransferState(TStream* inStream)
 	KUInt32 t;
 
 	// Interrupt manager specific stuff.
+	// These flags describe the handshake with the timer thread and are only
+	// kept in the stream for compatibility: restoring them would desync the
+	// live thread (e.g. ResumeTimer would think the timer is already running).
 	t = mRunning;
 	inStream->TransferInt32BE(t);
-	mRunning = t;
 	t = mExiting;
 	inStream->TransferInt32BE(t);
-	mExiting = t;
-
 	t = mWaiting;
 	inStream->TransferInt32BE(t);
-	mWaiting = t;
 
 	inStream->TransferInt32BE(mMaskIRQ);
 	inStream->TransferInt32BE(mMaskFIQ);
-	inStream->TransferInt32BE(mIntRaised);
-	inStream->TransferInt32BE(mIntCtrlReg);
+	t = mIntRaised;
+	inStream->TransferInt32BE(t);
+	mIntRaised = t;
+	t = mIntCtrlReg;
+	inStream->TransferInt32BE(t);
+	mIntCtrlReg = t;
 	inStream->TransferInt32BE(mFIQMask);
 	inStream->TransferInt32BE(mIntEDReg1);
 	inStream->TransferInt32BE(mIntEDReg2);
@@ -1185,6 +1913,17 @@ TInterruptManager::TransferState(TStream* inStream)
 	inStream->TransferInt32ArrayBE(
 		mMatchRegisters,
 		sizeof(mMatchRegisters) / sizeof(KUInt32));
+
+	if (inStream->IsReading() && mVirtualTime)
+	{
+		// The saved delta is the one of the host clock at the time. The
+		// virtual clock goes on from the saved timer, and the calendar from
+		// the restored one.
+		mTimerDelta = 0;
+		time_t now = time(NULL);
+		mVirtualRTCBase = (KUInt32) (now - mCalendarDelta)
+			- (KUInt32) (mVirtualTicks / kTicksPerSecond);
+	}
 }
 
 // ======================================== //
@@ -29,6 +29,10 @@
 // ANSI C & POSIX
 #include <stdio.h>
 
+// C++
+#include <atomic>
+#include <vector>
+
 // K
 #include <K/Threads/TCondVar.h>
 
@@ -38,6 +42,32 @@ class TThread;
 class TMutex;
 class TStream;
 
+///
+/// Interface of objects the timer calls back at a given time.
+///
+/// Callbacks are due like timer matches: they are called by the timer
+/// thread, or by the emulator thread in virtual time, when the timer
+/// reaches them, and they take part in warp and virtual time jumps.
+///
+class TTimerCallback
+{
+public:
+	///
+	/// Destructor.
+	///
+	virtual ~TTimerCallback(void) {}
+
+	///
+	/// Called when the timer reaches the time the callback is due at.
+	/// The interrupt manager's mutex isn't held, so this can raise
+	/// interrupts, but it can't schedule or cancel itself.
+	///
+	/// \param inTimer	current value of the timer.
+	/// \return the number of ticks until the next call, 0 to be forgotten.
+	///
+	virtual KUInt32 TimerCallback(KUInt32 inTimer) = 0;
+};
+
 ///
 /// Class for the interrupt manager.
 /// The interrupt manager is a thread that waits most of the time for the next
@@ -96,6 +126,20 @@ public:
 #endif
 	};
 
+	enum {
+		kLatenessBuckets = 24 ///< Buckets of the lateness histogram:
+							  ///< bucket 0 is < 1 us, bucket i is
+							  ///< [2^(i-1), 2^i[ us, the last one
+							  ///< collects everything above.
+	};
+
+	enum {
+		kTicksPerSecond = 3686400, ///< Timer frequency (3.6864 MHz).
+		kDefaultVirtualTicksPerKUnits = 23 ///< Default virtual time rate:
+										   ///< ticks per 1024 JIT units
+										   ///< (a 162 MHz StrongARM).
+	};
+
 	///
 	/// Constructor from the processor.
 	/// Initializes the timer to 0.
@@ -150,6 +194,19 @@ public:
 	///
 	void ResumeTimer(void);
 
+	///
+	/// Stop the timer thread.
+	/// The timer should be suspended first. This is required before the
+	/// process forks, as the child would not inherit the thread.
+	///
+	void StopTimerThread(void);
+
+	///
+	/// (Re)start the timer thread, after StopTimerThread.
+	/// The timer remains suspended (resume it with ResumeTimer).
+	///
+	void StartTimerThread(void);
+
 	///
 	/// Wait until next interrupt.
 	/// This method allows the emulator thread to pause until an interrupt
@@ -164,10 +221,108 @@ public:
 	///
 	/// Wake the emulator, if it's waiting in the loop.
 	///
-	void
-	WakeEmulatorThread(void)
+	void WakeEmulatorThread(void);
+
+	///
+	/// Switch to virtual time.
+	/// Emulated time no longer follows the host clock but advances with the
+	/// number of JIT units executed by the emulator thread. The timer thread
+	/// is stopped and timers are fired by AdvanceVirtualTime, so identical
+	/// inputs give identical runs. When the CPU waits for an interrupt, time
+	/// jumps to the next timer match.
+	/// The timer must be suspended.
+	///
+	/// \param inTicksPerKUnits	timer ticks per 1024 JIT units.
+	///
+	void EnableVirtualTime(
+		KUInt32 inTicksPerKUnits = kDefaultVirtualTicksPerKUnits);
+
+	///
+	/// Determine if we're in virtual time mode.
+	///
+	/// \return \c true if time advances with executed code.
+	///
+	Boolean
+	IsVirtualTime(void) const
+	{
+		return mVirtualTime;
+	}
+
+	///
+	/// Advance the virtual time after the emulator executed some code, fire
+	/// the timers that matched and raise the interrupts.
+	/// This is the safe point for timers in virtual time mode and must be
+	/// called from the emulator thread.
+	///
+	/// \param inUnits	number of JIT units that were executed.
+	///
+	void AdvanceVirtualTime(KUInt32 inUnits);
+
+	///
+	/// Have the timer call an object back.
+	/// If the callback is scheduled already, its due time changes. This
+	/// waits until the callback isn't being called.
+	///
+	/// \param inCallback	object to call back.
+	/// \param inDelay		ticks from now until the call.
+	///
+	void ScheduleCallback(TTimerCallback* inCallback, KUInt32 inDelay = 0);
+
+	///
+	/// Forget a callback, if it is scheduled. This waits until the callback
+	/// isn't being called, so it can be deleted then.
+	///
+	/// \param inCallback	callback to forget.
+	///
+	void CancelCallback(TTimerCallback* inCallback);
+
+	///
+	/// Enable or disable warp mode.
+	/// When the CPU waits for an interrupt, no interrupt is pending and the
+	/// host did not ask the emulator thread to wake, the timer is moved
+	/// straight to the next timer match (or RTC alarm) instead of sleeping.
+	///
+	/// \param inMaxTicks	maximum number of ticks skipped at once, 0 to
+	///						disable warp mode.
+	///
+	void SetWarp(KUInt32 inMaxTicks);
+
+	///
+	/// Accessor on the time skipped by warp mode since the timer was last
+	/// resumed, i.e. during the current or last run of the emulator.
+	///
+	/// \return the number of ticks that were skipped.
+	///
+	KUInt64
+	GetWarpedTicks(void) const
+	{
+		return mWarpedTicks;
+	}
+
+	///
+	/// Get the histogram of the lateness of timer matches, i.e. how long
+	/// after the match register value the timer thread actually raised the
+	/// interrupt.
+	///
+	/// \param outBuckets	on output, number of matches per bucket.
+	///
+	void GetLatenessHistogram(KUInt32 outBuckets[kLatenessBuckets]) const;
+
+	///
+	/// Reset the histogram of the lateness of timer matches.
+	///
+	void ResetLatenessHistogram(void);
+
+	///
+	/// Determine if the timer thread sleeps on a timerfd rather than on the
+	/// condition variable.
+	///
+	/// \return \c true on Linux, unless the timerfd couldn't be created.
+	///
+	Boolean
+	IsUsingTimerFd(void) const
 	{
-		mEmulatorCondVar->Signal();
+		return mTimerFd >= 0;
 	}
 
 	///
@@ -225,6 +380,8 @@ public:
 
 	///
 	/// Raise an interrupt.
+	/// This doesn't take the mutex and can be called from any thread. The
+	/// timer thread is only woken if an enabled interrupt becomes pending.
 	///
 	/// \param inIntMask	mask of the interrupt to raise.
 	///
@@ -396,6 +553,12 @@ public:
 	void Run(void);
 
 private:
+	/// A callback scheduled with the timer.
+	struct SCallback {
+		TTimerCallback* fCallback; ///< Object to call back.
+		KUInt32 fDue; ///< Timer value it is due at.
+	};
+
 	///
 	/// Constructeur par copie volontairement indisponible.
 	///
@@ -438,14 +601,122 @@ private:
 		KUInt32 inTimerA,
 		KUInt32 inTimerB);
 
+	///
+	/// Assert or clear the FIQ and IRQ lines of the processor according to
+	/// the raised and enabled interrupts.
+	///
+	/// \return \c true if a thread waiting in WaitUntilInterrupt should
+	///			resume.
+	///
+	Boolean SignalProcessor(void);
+
+	///
+	/// Set the virtual timer to a new value, firing the timers in between.
+	/// The mutex must be held.
+	///
+	/// \param inNewTimer	new value of the timer.
+	///
+	void SetVirtualTimer(KUInt32 inNewTimer);
+
+	///
+	/// Find the next match of a timer that can wake the waiting processor,
+	/// i.e. a timer that is enabled, not raised yet, and not masked, or the
+	/// time a callback is due at. The mutex must be held.
+	///
+	/// \param outNextMatch	on output, the next match.
+	/// \return \c true if there is such a timer.
+	///
+	Boolean FindNextVirtualWakeMatch(KUInt32* outNextMatch);
+
+	///
+	/// Find the time the next callback is due at. The mutex must be held.
+	///
+	/// \param inTimer	current value of the timer.
+	/// \param outDue	on output, the time the next callback is due at.
+	/// \return \c true if there is any scheduled callback.
+	///
+	Boolean FindNextCallback(KUInt32 inTimer, KUInt32* outDue) const;
+
+	///
+	/// Determine if a callback is due.
+	///
+	/// \param inTimer	current value of the timer.
+	/// \return \c true if RunDueCallbacks should be called.
+	///
+	Boolean IsCallbackDue(KUInt32 inTimer) const;
+
+	///
+	/// Call the callbacks that are due and note when they are due next.
+	/// The mutex must be held. It is released during the calls, as the
+	/// callbacks may raise interrupts.
+	///
+	/// \param inTimer	current value of the timer.
+	///
+	void RunDueCallbacks(KUInt32 inTimer);
+
+	///
+	/// WaitUntilInterrupt in virtual time mode.
+	/// Time jumps to the next timer that can wake the processor. Without
+	/// one, the thread waits for RaiseInterrupt or WakeEmulatorThread.
+	///
+	void VirtualWaitUntilInterrupt(void);
+
+	///
+	/// Skip time while the CPU is idle (warp mode).
+	/// The mutex must be held.
+	///
+	/// \param inNow		current host ticks.
+	/// \param inNextMatch	host ticks of the next timer match.
+	/// \return the host ticks of the next timer match after the skip.
+	///
+	KUInt32 Warp(KUInt32 inNow, KUInt32 inNextMatch);
+
 	/// \name Platform threading primitives
 
 	///
-	/// Wait for some ticks on the condition variable.
+	/// Wait on the condition variable until a timer match.
+	///
+	/// \param inNow		host ticks when the match was computed.
+	/// \param inMatch	host ticks of the match.
+	///
+	void TicksWaitOnCondVar(KUInt32 inNow, KUInt32 inMatch);
+
+	///
+	/// Wait on the condition variable until the timer thread is signaled.
+	///
+	void TimerThreadWait(void);
+
+	///
+	/// Signal the timer thread. The mutex may be held.
+	///
+	void SignalTimerThread(void);
+
+	///
+	/// Signal the timer thread from a thread that doesn't hold the mutex.
+	/// In virtual time, update the processor lines and signal the emulator
+	/// thread that fires the timers.
+	///
+	void WakeTimerThread(void);
+
+#if TARGET_OS_LINUX
+	///
+	/// Wait with timerfd/eventfd until a timer match or until the timer
+	/// thread is signaled. The mutex is released while waiting.
+	///
+	/// \param inNow		host ticks when the match was computed.
+	/// \param inMatch	host ticks of the match.
+	/// \param inTimed	whether inNow and inMatch should be used.
+	///
+	void FdWait(KUInt32 inNow, KUInt32 inMatch, Boolean inTimed);
+#endif
+
+	///
+	/// Record the lateness of timers that were just fired.
 	///
-	/// \param inTicks	number of ticks to sleep.
+	/// \param inFired	mask of the timer interrupts that were fired.
+	/// \param inNow		current host ticks.
 	///
-	void TicksWaitOnCondVar(KUInt32 inTicks);
+	void RecordLateness(KUInt32 inFired, KUInt32 inNow);
 
 	///
 	/// Accessor on the time in ticks.
@@ -472,8 +743,8 @@ private:
 							   ///< in WaitUntilInterrupt.
 	KUInt32 mMaskIRQ; ///< Whether the processor masks IRQ.
 	KUInt32 mMaskFIQ; ///< Whether the processor masks FIQ.
-	KUInt32 mIntRaised; ///< Interrupts that were raised.
-	KUInt32 mIntCtrlReg; ///< Interrupts that are enabled.
+	std::atomic<KUInt32> mIntRaised; ///< Interrupts that were raised.
+	std::atomic<KUInt32> mIntCtrlReg; ///< Interrupts that are enabled.
 	KUInt32 mFIQMask; ///< Mask for FIQ
 	KUInt32 mIntEDReg1; ///< Int. register at 0x0F184000
 	KUInt32 mIntEDReg2; ///< Int. register at 0x0F184400
@@ -487,8 +758,23 @@ private:
 						 ///< newton = host - delta.
 	KUInt32 mTimer; ///< Saved value of the timer (host based).
 	KUInt32 mMatchRegisters[4]; ///< Timer match registers (newton).
+	Boolean mVirtualTime; ///< Whether time advances with executed code.
+	volatile Boolean mWakeRequested; ///< WakeEmulatorThread was called.
+	KUInt32 mVirtualTicksPerKUnits; ///< Virtual ticks per 1024 units.
+	KUInt32 mVirtualTicksFraction; ///< Remainder of units*rate/1024.
+	KUInt64 mVirtualTicks; ///< Virtual ticks since virtual time began.
+	KUInt32 mVirtualRTCBase; ///< RTC when virtual time began (seconds).
+	KUInt32 mWarpMaxTicks; ///< Max ticks skipped at once, 0 = no warp.
+	KUInt32 mWarpRTCFraction; ///< Skipped ticks not yet applied to RTC.
+	KUInt64 mWarpedTicks; ///< Ticks skipped since the timer was resumed.
+	std::vector<SCallback> mCallbacks; ///< Scheduled callbacks.
+	TTimerCallback* mRunningCallback; ///< Callback being called (or nil).
+	int mTimerFd; ///< timerfd of the timer thread (or -1).
+	int mWakeFd; ///< eventfd to wake the timer thread (or -1).
+	KUInt32 mLatenessHistogram[kLatenessBuckets]; ///< Lateness of matches.
 	TCondVar* mTimerCondVar; ///< Condition variable (timer thread).
 	TCondVar* mEmulatorCondVar; ///< Condition variable (emulator).
+	TCondVar* mCallbackCondVar; ///< Signaled when a callback returns.
 	TMutex* mMutex; ///< Mutex of the thread.
 	TThread* mThread; ///< The actual thread.
 };
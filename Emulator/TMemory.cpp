@@ -296,7 +296,7 @@ TMemory::FastReadBuffer(VAddr inAddress, KUInt32 inAmount, KUInt8* outBuffer)
 
 	if (addr & 0x3)
 	{
-		int bytes = min(addr & 0x3, len);
+		int bytes = min(4 - (addr & 0x3), len);
 		// Quickly skip to aligned accesses
 		while (bytes-- > 0)
 		{
@@ -321,6 +321,8 @@ TMemory::FastReadBuffer(VAddr inAddress, KUInt32 inAmount, KUInt8* outBuffer)
 			*dst32++ = UByteSex_FromBigEndian(word);
 			addr += 4;
 		}
+		dst = (KUInt8*) dst32;
+		len &= 0x3;
 	} else
 	{
 		KUInt32 base = inAddress & TMemoryConsts::kMMUSmallestPageMask;
@@ -542,7 +544,7 @@ TMemory::FastWriteBuffer(VAddr inAddress, KUInt32 inAmount, const KUInt8* inBuff
 	if (addr & 0x3)
 	{
 		// Quickly skip to aligned accesses
-		int bytes = min(addr & 0x3, len);
+		int bytes = min(4 - (addr & 0x3), len);
 		while (bytes-- > 0)
 		{
 			KUInt8 byte = *src++;
@@ -563,6 +565,8 @@ TMemory::FastWriteBuffer(VAddr inAddress, KUInt32 inAmount, const KUInt8* inBuff
 				return true;
 			addr += 4;
 		}
+		src = (const KUInt8*) src32;
+		len &= 0x3;
 	} else
 	{
 		KUInt32 base = inAddress & TMemoryConsts::kMMUSmallestPageMask;
@@ -614,6 +618,91 @@ TMemory::FastWriteBuffer(VAddr inAddress, KUInt32 inAmount, const KUInt8* inBuff
 	return false;
 }
 
+// -------------------------------------------------------------------------- //
+//  * FastWriteBufferP( PAddr, KUInt32, const KUInt8* )
+// -------------------------------------------------------------------------- //
+Boolean
+TMemory::FastWriteBufferP(PAddr inAddress, KUInt32 inAmount, const KUInt8* inBuffer)
+{
+	const KUInt8* src = inBuffer;
+	KUInt32 len = inAmount;
+	PAddr addr = inAddress;
+
+	while (len > 0)
+	{
+		if ((addr < TMemoryConsts::kRAMStart) || (addr >= mRAMEnd))
+		{
+			// Not RAM: let WriteBP sort it out.
+			if (WriteBP(addr++, *src++))
+				return true;
+			len--;
+			continue;
+		}
+
+		// Copy up to the end of the page.
+		KUInt32 amount = (addr & TMemoryConsts::kMMUSmallestPageMask)
+			+ TMemoryConsts::kMMUSmallestPageSize - addr;
+		amount = min(amount, len);
+		amount = min(amount, mRAMEnd - addr);
+#if TARGET_RT_LITTLE_ENDIAN
+		{
+			// Swap the endianness of the addresses.
+			KUInt8* dst = (KUInt8*) mRAMOffset;
+			for (KUInt32 index = 0; index < amount; index++)
+			{
+				dst[(addr + index) ^ 0x3] = src[index];
+			}
+		}
+#else
+		(void) ::memcpy((KUInt8*) (mRAMOffset + addr), src, amount);
+#endif
+
+		// Invalidate JIT.
+		mJIT.Invalidate(addr);
+		len -= amount;
+		src += amount;
+		addr += amount;
+	}
+
+	return false;
+}
+
+// -------------------------------------------------------------------------- //
+//  * FastReadBufferP( PAddr, KUInt32, KUInt8* )
+// -------------------------------------------------------------------------- //
+Boolean
+TMemory::FastReadBufferP(PAddr inAddress, KUInt32 inAmount, KUInt8* outBuffer)
+{
+	KUInt8* dst = outBuffer;
+	KUInt32 len = inAmount;
+	PAddr addr = inAddress;
+
+	if ((addr < TMemoryConsts::kRAMStart) || (addr >= mRAMEnd)
+		|| (mRAMEnd - addr < len))
+	{
+		// Not RAM: let ReadBP sort it out.
+		while (len-- > 0)
+		{
+			if (ReadBP(addr++, *dst++))
+				return true;
+		}
+		return false;
+	}
+
+#if TARGET_RT_LITTLE_ENDIAN
+	// Swap the endianness of the addresses.
+	const KUInt8* src = (const KUInt8*) mRAMOffset;
+	for (KUInt32 index = 0; index < len; index++)
+	{
+		dst[index] = src[(addr + index) ^ 0x3];
+	}
+#else
+	(void) ::memcpy(dst, (const KUInt8*) (mRAMOffset + addr), len);
+#endif
+
+	return false;
+}
+
 // -------------------------------------------------------------------------- //
 //  * FastWriteString( VAddr, KUInt32*, const char* )
 // -------------------------------------------------------------------------- //
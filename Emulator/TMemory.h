@@ -172,6 +172,15 @@ public:
 		mFlash.PowerOn();
 	}
 
+	///
+	/// Detach the flash from the flash file (copy-on-write).
+	///
+	void
+	MakeFlashPrivate(void)
+	{
+		mFlash.MakePrivate();
+	}
+
 	///
 	/// Get a direct pointer to a buffer in RAM
 	///
@@ -218,6 +227,18 @@ public:
 		KUInt32 inAmount,
 		KUInt8* outBuffer);
 
+	///
+	/// Fast read data at a physical address, a page at a time.
+	/// This is how DMA reads from memory.
+	///
+	/// \param inAddress		physical address.
+	/// \return true if reading failed.
+	///
+	Boolean FastReadBufferP(
+		PAddr inAddress,
+		KUInt32 inAmount,
+		KUInt8* outBuffer);
+
 	///
 	/// Fast read string, with allocation (with malloc).
 	///
@@ -250,6 +271,18 @@ public:
 		KUInt32 inAmount,
 		const KUInt8* inBuffer);
 
+	///
+	/// Fast write data at a physical address, a page at a time.
+	/// This is how DMA writes to memory.
+	///
+	/// \param inAddress		physical address.
+	/// \return true if writing failed.
+	///
+	Boolean FastWriteBufferP(
+		PAddr inAddress,
+		KUInt32 inAmount,
+		const KUInt8* inBuffer);
+
 	///
 	/// Fast write string.
 	///
@@ -3113,18 +3113,14 @@ TNativePrimitives::ExecuteNetworkManagerNative(KUInt32 inInstruction)
 		case 0x15: {
 			// Copy the next available packet into the buffer pointed to by R1
 			KUInt32 dst = mProcessor->GetRegister(1);
-			KUInt32 i, n = mProcessor->GetRegister(2);
+			KUInt32 n = mProcessor->GetRegister(2);
 			if (LOG_NETWORKMANAGER)
 			{
 				mLog->FLogLine("TNetworkManager::ReceiveData (buffer=0x%08x, size=%d", (unsigned int) dst, (int) n);
 			}
 			if (mNetworkManager && n)
 			{
-				KUInt8* buffer = (KUInt8*) malloc(n);
-				mNetworkManager->ReceiveData(buffer, n);
-				for (i = 0; i < n; i++)
-					mMemory->WriteB(dst + i, buffer[i]);
-				free(buffer);
+				mNetworkManager->ReceiveDataToMemory(dst, n);
 			}
 			break;
 		}
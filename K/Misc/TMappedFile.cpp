@@ -296,6 +296,48 @@ TMappedFile::Sync(void) const
 	}
 }
 
+// -------------------------------------------------------------------------- //
+//  * MakePrivate( void )
+// -------------------------------------------------------------------------- //
+int
+TMappedFile::MakePrivate(void)
+{
+	if ((mBuffer == nullptr) || (!mMapped) || mReadOnly)
+	{
+		// Nothing is shared with the file until we write it back.
+		return 0;
+	}
+
+#if _MSC_VER
+	// The file isn't really mapped on WIN32, see Map().
+	return 0;
+#else
+	int theFlags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_FILE
+	theFlags |= MAP_FILE;
+#endif
+	// Mapping over the existing region replaces it atomically and the
+	// private mapping starts with the current content of the file.
+	void* theBuffer = ::mmap(
+		mBuffer,
+		mSize,
+		PROT_READ | PROT_WRITE,
+		theFlags,
+		mFileFd,
+		0);
+	if (theBuffer == (void*) -1)
+	{
+		(void) ::fprintf(
+			stderr,
+			"Error with mmap (%i) - %s:%i\n",
+			errno, __FILE__, __LINE__);
+		return -1;
+	}
+
+	return 0;
+#endif // _MSC_VER
+}
+
 // ============================= //
 // Disk crisis, please clean up! //
 // ============================= //
@@ -141,6 +141,16 @@ public:
 	///
 	void Sync(void) const;
 
+	///
+	/// Turn a shared mapping into a private, copy-on-write one.
+	/// The buffer keeps its address and its current content, but further
+	/// changes are no longer written to the file. This is used by processes
+	/// forked from a common parent that must not share the file.
+	///
+	/// \return 0 if the mapping was changed, -1 if an error occured
+	///
+	int MakePrivate(void);
+
 private:
 	///
 	/// Constructeur par copie volontairement indisponible.
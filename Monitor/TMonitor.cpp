@@ -1163,6 +1163,53 @@ TMonitor::ExecuteCommand(const char* inCommand)
 			theLine, "RaiseGPIO %.8X",
 			(int) theArgInt);
 		PrintLine(theLine, MONITOR_LOG_INFO);
+	} else if (::strcmp(inCommand, "timers") == 0)
+	{
+		KUInt32 theBuckets[TInterruptManager::kLatenessBuckets];
+		mInterruptManager->GetLatenessHistogram(theBuckets);
+		PrintLine("Timer match lateness:", MONITOR_LOG_INFO);
+		for (int indexBucket = 0; indexBucket < TInterruptManager::kLatenessBuckets; indexBucket++)
+		{
+			if (theBuckets[indexBucket] == 0)
+			{
+				continue;
+			}
+			if (indexBucket == 0)
+			{
+				(void) ::sprintf(theLine, "       < 1 us: %u",
+					(unsigned int) theBuckets[indexBucket]);
+			} else if (indexBucket == TInterruptManager::kLatenessBuckets - 1)
+			{
+				(void) ::sprintf(theLine, " >= %8u us: %u",
+					(unsigned int) (1 << (indexBucket - 1)),
+					(unsigned int) theBuckets[indexBucket]);
+			} else
+			{
+				(void) ::sprintf(theLine, " < %9u us: %u",
+					(unsigned int) (1 << indexBucket),
+					(unsigned int) theBuckets[indexBucket]);
+			}
+			PrintLine(theLine, MONITOR_LOG_INFO);
+		}
+	} else if (::strcmp(inCommand, "timers reset") == 0)
+	{
+		mInterruptManager->ResetLatenessHistogram();
+	} else if (::strcmp(inCommand, "screen") == 0)
+	{
+		TScreenManager* theScreenManager = mEmulator->GetScreenManager();
+		(void) ::sprintf(theLine, "Blits: %u, presents: %u (%u fps max)",
+			(unsigned int) theScreenManager->GetBlitCount(),
+			(unsigned int) theScreenManager->GetPresentCount(),
+			(unsigned int) theScreenManager->GetFrameRate());
+		PrintLine(theLine, MONITOR_LOG_INFO);
+	} else if (::strcmp(inCommand, "screen reset") == 0)
+	{
+		mEmulator->GetScreenManager()->ResetDamageCounters();
+	} else if (::strcmp(inCommand, "screen hash") == 0)
+	{
+		(void) ::sprintf(theLine, "Screen hash: %016llX",
+			(unsigned long long) mEmulator->GetScreenManager()->GetScreenHash());
+		PrintLine(theLine, MONITOR_LOG_INFO);
 	} else if (::sscanf(inCommand, "watch %i %X", &theArgInt2, &theArgInt) == 2)
 	{
 		if ((theArgInt2 >= 0) && (theArgInt2 <= 3))
@@ -1409,6 +1456,9 @@ TMonitor::PrintHelp()
 	PrintLine(" po **<addr>        print NS object handle at address (RefVar)", MONITOR_LOG_INFO);
 	PrintLine(" raise <val>        raise the interrupts", MONITOR_LOG_INFO);
 	PrintLine(" gpio <val>         raise the gpio interrupts", MONITOR_LOG_INFO);
+	PrintLine(" timers [reset]     timer match lateness histogram", MONITOR_LOG_INFO);
+	PrintLine(" screen [reset]     screen blits and host presents", MONITOR_LOG_INFO);
+	PrintLine(" screen hash        hash of the screen contents", MONITOR_LOG_INFO);
 	PrintLine(" load|save path     load or save the emulator state", MONITOR_LOG_INFO);
 	PrintLine(" snap|revert        (re)store machine state while running", MONITOR_LOG_INFO);
 	PrintLine(" help log           help with logging", MONITOR_LOG_INFO);
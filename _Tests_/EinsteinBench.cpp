@@ -0,0 +1,140 @@
+// ==============================
+// File:			EinsteinBench.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+// Runs the benchmarks that the unit tests leave out: their timings depend
+// on the host, so they are printed for a person to compare, not checked.
+
+#include <K/Defines/KDefinitions.h>
+#include "EinsteinBench.h"
+
+// ANSI C & POSIX
+#include <stdio.h>
+#include <string.h>
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+struct SBench
+{
+	const char* fName;
+	const char* fDescription;
+	bool (*fRun)(void);
+};
+
+static const SBench kBenches[] = {
+	{ "raise-storm", "interrupts raised by device threads",
+		InterruptManagerRaiseStormBench },
+	{ "checksum", "Internet checksums of full size frames",
+		NetworkChecksumKernelBench },
+	{ "pixel-conversion", "4 bits to host pixel conversion kernels",
+		ScreenConversionKernelsBench },
+	{ "network-receive", "usermode network receive latency and throughput",
+		UsermodeNetworkReceiveBench },
+	{ "network-flows", "usermode network packets sent over 128 flows",
+		UsermodeNetworkFlowsBench },
+	{ "network-bulk", "usermode network download throughput",
+		UsermodeNetworkBulkBench },
+};
+
+// -------------------------------------------------------------------------- //
+//  * Usage( const char* )
+// -------------------------------------------------------------------------- //
+static int
+Usage(const char* inProgramName)
+{
+	(void) ::fprintf(stderr,
+		"%s [--list] [benchmark...]\n"
+		"  Run the named benchmarks, or all of them.\n"
+		"  With --list, print the benchmarks and exit.\n",
+		inProgramName);
+	return 1;
+}
+
+// -------------------------------------------------------------------------- //
+//  * RunBench( const SBench& )
+// -------------------------------------------------------------------------- //
+static bool
+RunBench(const SBench& inBench)
+{
+	(void) ::printf("%s: %s\n", inBench.fName, inBench.fDescription);
+	(void) ::fflush(stdout);
+	bool theResult = inBench.fRun();
+	if (!theResult)
+	{
+		(void) ::printf("%s: FAILED\n", inBench.fName);
+	}
+	return theResult;
+}
+
+// -------------------------------------------------------------------------- //
+// main
+// -------------------------------------------------------------------------- //
+int
+main(int argc, char** argv)
+{
+	const size_t kBenchCount = sizeof(kBenches) / sizeof(kBenches[0]);
+	if ((argc == 2) && (::strcmp(argv[1], "--list") == 0))
+	{
+		for (size_t indexBench = 0; indexBench < kBenchCount; indexBench++)
+		{
+			(void) ::printf("%-16s %s\n",
+				kBenches[indexBench].fName, kBenches[indexBench].fDescription);
+		}
+		return 0;
+	}
+
+	bool theResult = true;
+	if (argc == 1)
+	{
+		for (size_t indexBench = 0; indexBench < kBenchCount; indexBench++)
+		{
+			theResult = RunBench(kBenches[indexBench]) && theResult;
+		}
+	} else
+	{
+		for (int indexArgs = 1; indexArgs < argc; indexArgs++)
+		{
+			const SBench* theBench = nullptr;
+			for (size_t indexBench = 0; indexBench < kBenchCount; indexBench++)
+			{
+				if (::strcmp(argv[indexArgs], kBenches[indexBench].fName) == 0)
+				{
+					theBench = &kBenches[indexBench];
+				}
+			}
+			if (theBench == nullptr)
+			{
+				(void) ::fprintf(stderr, "Unknown benchmark %s\n", argv[indexArgs]);
+				return Usage(argv[0]);
+			}
+			theResult = RunBench(*theBench) && theResult;
+		}
+	}
+
+	return theResult ? 0 : 1;
+}
+
+// ============================================================= //
+// If it can't be measured, it isn't science, it's an opinion.   //
+// ============================================================= //
@@ -0,0 +1,69 @@
+// ==============================
+// File:			EinsteinBench.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _EINSTEINBENCH_H
+#define _EINSTEINBENCH_H
+
+#include <K/Defines/KDefinitions.h>
+
+// The benchmarks of EinsteinBench. Each one prints what it measured and
+// returns false if it couldn't run or its results were wrong.
+
+///
+/// Device threads raise and clear interrupts while the timer thread runs.
+///
+bool InterruptManagerRaiseStormBench(void);
+
+///
+/// The Internet checksum kernel against the byte by byte sum, and the
+/// incremental ACK rewrite.
+///
+bool NetworkChecksumKernelBench(void);
+
+///
+/// Every 4 bits to host pixel conversion kernel the host supports.
+///
+bool ScreenConversionKernelsBench(void);
+
+///
+/// Data from host sockets queued for the Newton, with concurrent connections.
+///
+bool UsermodeNetworkReceiveBench(void);
+
+///
+/// Packets from the Newton dispatched to many connections.
+///
+bool UsermodeNetworkFlowsBench(void);
+
+///
+/// A download from a local HTTP stand-in, with and without a window.
+///
+bool UsermodeNetworkBulkBench(void);
+
+#endif
+// _EINSTEINBENCH_H
+
+// ============================================================= //
+// Premature optimization is the root of all evil.               //
+//                 -- Donald Knuth                               //
+// ============================================================= //
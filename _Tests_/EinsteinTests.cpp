@@ -6,5 +6,22 @@
 #include "_Tests_/ExecuteInstructionState2Tests.t"
 #include "_Tests_/ExecuteInstructionTests.t"
 #include "_Tests_/ExecuteTwoInstructionsTests.t"
+#include "_Tests_/ForkServerTests.t"
+#include "_Tests_/InkBenchmarkTests.t"
+#include "_Tests_/InputReplayTests.t"
+#include "_Tests_/InterruptManagerTests.t"
 #include "_Tests_/MemoryTests.t"
+#include "_Tests_/NetworkChecksumTests.t"
 #include "_Tests_/RunCodeTests.t"
+#include "_Tests_/ScreenCaptureTests.t"
+#include "_Tests_/ScreenConversionTests.t"
+#include "_Tests_/ScreenDamageTests.t"
+#include "_Tests_/ScreenHashTests.t"
+#include "_Tests_/ScreenRFBTests.t"
+#include "_Tests_/ScreenRotationTests.t"
+#include "_Tests_/ScreenSharedBufferTests.t"
+#include "_Tests_/SerialCaptureTests.t"
+#include "_Tests_/SerialSharedMemoryTests.t"
+#include "_Tests_/SerialTcpClientTests.t"
+#include "_Tests_/SerialTcpServerTests.t"
+#include "_Tests_/UsermodeNetworkTests.t"
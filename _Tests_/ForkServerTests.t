@@ -0,0 +1,128 @@
+#if TARGET_OS_LINUX
+#include "Emulator/Network/TUsermodeNetwork.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <chrono>
+#include <dirent.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// The number of threads of this process.
+static int
+ForkServerTestsThreadCount(void)
+{
+	int theCount = 0;
+	DIR* theDir = ::opendir("/proc/self/task");
+	if (theDir == nullptr)
+	{
+		return -1;
+	}
+	struct dirent* theEntry;
+	while ((theEntry = ::readdir(theDir)) != nullptr)
+	{
+		if (theEntry->d_name[0] != '.')
+		{
+			theCount++;
+		}
+	}
+	(void) ::closedir(theDir);
+	return theCount;
+}
+
+// Stopped threads may take a moment to exit.
+static bool
+ForkServerTestsWaitForThreads(int inCount)
+{
+	for (int i = 0; i < 1000; i++)
+	{
+		if (ForkServerTestsThreadCount() == inCount)
+		{
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+TEST(ForkServerTests, OnlyMainThreadWhenForking)
+{
+	// Other tests may leave threads of their own: count from here.
+	int theThreadCount = ForkServerTestsThreadCount();
+	ASSERT_GT(theThreadCount, 0);
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theManager = new TInterruptManager(nullptr, &theProcessor);
+	TNullNetworkManager* theNullNet = new TNullNetworkManager(nullptr);
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+
+	// The timer, a select thread per manager and the epoll reader.
+	EXPECT_EQ(ForkServerTestsThreadCount(), theThreadCount + 4);
+
+	// What RunForkServer does before forking.
+	theManager->StopTimerThread();
+	EXPECT_TRUE(theNullNet->StopThreads());
+	EXPECT_TRUE(theNet->StopThreads());
+	ASSERT_TRUE(ForkServerTestsWaitForThreads(theThreadCount));
+
+	pid_t thePID = ::fork();
+	if (thePID == 0)
+	{
+		// A mutex left locked by a thread would hang the child.
+		(void) ::alarm(5);
+		theManager->StartTimerThread();
+		theNullNet->StartThreads();
+		theNet->StartThreads();
+		// The child only has the thread that forked.
+		int theStatus = (ForkServerTestsThreadCount() == 1 + 4) ? 0 : 1;
+		theManager->StopTimerThread();
+		if (!theNullNet->StopThreads() || !theNet->StopThreads())
+		{
+			theStatus = 2;
+		}
+		::_exit(theStatus);
+	}
+	ASSERT_GT(thePID, 0);
+	int theStatus = 0;
+	ASSERT_EQ(::waitpid(thePID, &theStatus, 0), thePID);
+	EXPECT_TRUE(WIFEXITED(theStatus));
+	EXPECT_EQ(WEXITSTATUS(theStatus), 0);
+
+	// The parent resumes serving.
+	theManager->StartTimerThread();
+	theNullNet->StartThreads();
+	theNet->StartThreads();
+	EXPECT_EQ(ForkServerTestsThreadCount(), theThreadCount + 4);
+
+	delete theNet;
+	delete theNullNet;
+	delete theManager;
+}
+
+TEST(ForkServerTests, StopThreadsAfterSelectFailed)
+{
+	int theThreadCount = ForkServerTestsThreadCount();
+	TNullNetworkManager* theNullNet = new TNullNetworkManager(nullptr);
+	EXPECT_EQ(ForkServerTestsThreadCount(), theThreadCount + 1);
+
+	// select() fails on a closed descriptor, and the thread leaves.
+	int thePipe[2];
+	ASSERT_EQ(::pipe(thePipe), 0);
+	(void) ::close(thePipe[0]);
+	(void) ::close(thePipe[1]);
+	fd_set theSet;
+	FD_ZERO(&theSet);
+	FD_SET(thePipe[0], &theSet);
+	theNullNet->AsyncWaitForReadyToRead(thePipe[0] + 1, &theSet);
+	ASSERT_TRUE(ForkServerTestsWaitForThreads(theThreadCount));
+
+	// Stopping doesn't wait for it again, and the manager can serve again.
+	EXPECT_TRUE(theNullNet->StopThreads());
+	theNullNet->StartThreads();
+	EXPECT_EQ(ForkServerTestsThreadCount(), theThreadCount + 1);
+
+	delete theNullNet;
+}
+#endif
@@ -0,0 +1,97 @@
+#include "Emulator/Screen/TInkBenchmark.h"
+#include "Emulator/Screen/TNullScreenManager.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#define kInkBenchmarkTestsStrokePath "/tmp/EinsteinInkBenchmarkTests.log"
+#define kInkBenchmarkTestsReportPath "/tmp/EinsteinInkBenchmarkTests.json"
+
+TEST(InkBenchmarkTests, RecognitionLatency)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	TNullScreenManager* theScreenManager = new TNullScreenManager(nullptr);
+	theScreenManager->SetMemory(&theMem);
+	theScreenManager->SetInterruptManager(theInterruptManager);
+	theScreenManager->SetFrameRate(0);
+	KUInt32 rowBytes = theScreenManager->GetScreenWidth() * TScreenManager::kBitsPerPixel / 8;
+	KUInt32 baseAddy = TTestsFixture::kPixmapBaseAddr;
+	theFixture.WritePixmap(rowBytes);
+	for (KUInt32 offset = 0; offset < rowBytes * 64; offset += 4)
+	{
+		(void) theMem.WriteP(baseAddy + offset, 0x12345678);
+	}
+
+	// A fake recognizer shows a word 20 ms after the pen is lifted. The
+	// second time, the word is already there.
+	std::atomic<bool> theQuit(false);
+	std::thread theRecognizer(
+		[&]() {
+			while (!theQuit)
+			{
+				KUInt32 theSample;
+				KUInt32 theTime;
+				if (theScreenManager->GetSample(&theSample, &theTime) && (theSample == 0x0000000E))
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(20));
+					TScreenManager::SRect theRect;
+					theRect.fTop = 0;
+					theRect.fLeft = 0;
+					theRect.fBottom = 64;
+					theRect.fRight = 64;
+					theScreenManager->Blit(TTestsFixture::kPixmapAddr, &theRect, &theRect, 0 /* srcCopy */);
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		});
+
+	FILE* theFile = ::fopen(kInkBenchmarkTestsStrokePath, "w");
+	ASSERT_NE(theFile, nullptr);
+	(void) ::fprintf(theFile, "0 down 10 10\n1 down 12 14\n2 up\n");
+	(void) ::fclose(theFile);
+
+	// The timer thread plays the strokes.
+	theInterruptManager->ResumeTimer();
+	TInkBenchmark theBenchmark(nullptr, theScreenManager, theInterruptManager, nullptr);
+	theBenchmark.SetSettleTime(60);
+	EXPECT_FALSE(theBenchmark.RunStroke("/nonexistent/stroke.log"));
+	EXPECT_TRUE(theBenchmark.RunStroke(kInkBenchmarkTestsStrokePath));
+	EXPECT_TRUE(theBenchmark.RunStroke(kInkBenchmarkTestsStrokePath));
+	theQuit = true;
+	theRecognizer.join();
+
+	EXPECT_EQ(theBenchmark.GetStrokeCount(), 2u);
+	EXPECT_EQ(theBenchmark.GetTimeoutCount(), 0u);
+	EXPECT_EQ(theBenchmark.GetUnchangedCount(), 1u);
+	ASSERT_EQ(theBenchmark.GetLatencies().size(), 1u);
+	EXPECT_GE(theBenchmark.GetLatencies()[0], 15.0);
+	EXPECT_LT(theBenchmark.GetLatencies()[0], 60.0);
+
+	// The report is JSON with the distribution.
+	theFile = ::fopen(kInkBenchmarkTestsReportPath, "w+");
+	ASSERT_NE(theFile, nullptr);
+	theBenchmark.WriteReport(theFile);
+	::rewind(theFile);
+	char theReport[2048];
+	size_t theSize = ::fread(theReport, 1, sizeof(theReport) - 1, theFile);
+	theReport[theSize] = 0;
+	(void) ::fclose(theFile);
+	EXPECT_NE(::strstr(theReport, "\"strokes\": 2,"), nullptr);
+	EXPECT_NE(::strstr(theReport, "\"recognized\": 1,"), nullptr);
+	EXPECT_NE(::strstr(theReport, "\"strokes_per_second\": "), nullptr);
+	EXPECT_NE(::strstr(theReport, "\"latency_ms\": { \"count\": 1,"), nullptr);
+	EXPECT_EQ(theReport[0], '{');
+	EXPECT_EQ(::strcmp(&theReport[theSize - 2], "}\n"), 0);
+
+	(void) ::unlink(kInkBenchmarkTestsStrokePath);
+	(void) ::unlink(kInkBenchmarkTestsReportPath);
+	theInterruptManager->SuspendTimer();
+	delete theScreenManager;
+	delete theInterruptManager;
+}
@@ -0,0 +1,276 @@
+#include "Emulator/Platform/TPlatformManager.h"
+#include "Emulator/Screen/TInputReplay.h"
+#include "Emulator/Screen/TNullScreenManager.h"
+#include "Emulator/Screen/TTabletSampleQueue.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <thread>
+#define kInputReplayTestsLogPath "/tmp/EinsteinInputReplayTests.log"
+
+TEST(InputReplayTests, SampleQueueGrows)
+{
+	TTabletSampleQueue theQueue;
+	KUInt32 theSample;
+	KUInt32 theTime;
+	EXPECT_FALSE(theQueue.Pop(&theSample, &theTime));
+
+	// Nothing is dropped, across several chunks and once the chunks are
+	// recycled.
+	for (KUInt32 indexPass = 0; indexPass < 2; indexPass++)
+	{
+		KUInt32 theCount = 3 * TTabletSampleQueue::kChunkSize + 7;
+		for (KUInt32 indexSample = 0; indexSample < theCount; indexSample++)
+		{
+			theQueue.Push(indexSample, ~indexSample);
+		}
+		EXPECT_EQ(theQueue.GetCount(), theCount);
+		for (KUInt32 indexSample = 0; indexSample < theCount; indexSample++)
+		{
+			ASSERT_TRUE(theQueue.Pop(&theSample, &theTime));
+			EXPECT_EQ(theSample, indexSample);
+			EXPECT_EQ(theTime, ~indexSample);
+		}
+		EXPECT_EQ(theQueue.GetCount(), 0u);
+		EXPECT_FALSE(theQueue.Pop(&theSample, &theTime));
+	}
+}
+
+TEST(InputReplayTests, SampleQueueThreads)
+{
+	TTabletSampleQueue theQueue;
+	const KUInt32 theCount = 200000;
+	std::thread theProducer(
+		[&theQueue, theCount]() {
+			for (KUInt32 indexSample = 0; indexSample < theCount; indexSample++)
+			{
+				theQueue.Push(indexSample, indexSample * 3);
+			}
+		});
+	KUInt32 theNext = 0;
+	Boolean inOrder = true;
+	while (theNext < theCount)
+	{
+		KUInt32 theSample;
+		KUInt32 theTime;
+		if (theQueue.Pop(&theSample, &theTime))
+		{
+			inOrder = inOrder && (theSample == theNext) && (theTime == theNext * 3);
+			theNext++;
+		} else
+		{
+			std::this_thread::yield();
+		}
+	}
+	theProducer.join();
+	EXPECT_TRUE(inOrder);
+	EXPECT_EQ(theQueue.GetCount(), 0u);
+}
+
+TEST(InputReplayTests, TextLog)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	TNullScreenManager* theScreenManager = new TNullScreenManager(nullptr);
+	theScreenManager->SetInterruptManager(theInterruptManager);
+	TPlatformManager* thePlatformManager = new TPlatformManager(nullptr, theScreenManager);
+	thePlatformManager->SetInterruptManager(theInterruptManager);
+	thePlatformManager->SetMemory(&theMem);
+	theScreenManager->SetPlatformManager(thePlatformManager);
+
+	FILE* theFile = ::fopen(kInputReplayTestsLogPath, "w");
+	ASSERT_NE(theFile, nullptr);
+	(void) ::fprintf(theFile,
+		"# A stroke and a key\n"
+		"\n"
+		"1 down 10 20\n"
+		"  1.5 down 11 21 6\n"
+		"2 up\n"
+		"10 keydown 0x24\n"
+		"10 keyup 36\n");
+	(void) ::fclose(theFile);
+
+	TInputReplay theReplay(nullptr, theScreenManager, theInterruptManager, thePlatformManager);
+	ASSERT_TRUE(theReplay.Load(kInputReplayTestsLogPath));
+	EXPECT_EQ(theReplay.GetEventCount(), 5u);
+
+	// Events are due relative to the first timer value, which may wrap.
+	auto theTicks = [](double inMilliseconds) {
+		return (KUInt32) (inMilliseconds * (TInterruptManager::kTicksPerSecond / 1000.0) + 0.5);
+	};
+	KUInt32 theBase = 0xFFFFF000;
+	EXPECT_EQ(theReplay.Play(theBase), theTicks(1));
+	EXPECT_EQ(theReplay.Play(theBase + theTicks(1) - 1), 1u);
+	EXPECT_EQ(theReplay.GetPlayedCount(), 0u);
+	EXPECT_GT(theReplay.Play(theBase + theTicks(2)), 0u);
+	EXPECT_EQ(theReplay.GetPlayedCount(), 3u);
+	EXPECT_EQ(theScreenManager->GetPendingSampleCount(), 4u);
+
+	// Samples are stamped with their due time, not the time they were sent.
+	KUInt32 theSample;
+	KUInt32 theTime;
+	ASSERT_TRUE(theScreenManager->GetSample(&theSample, &theTime));
+	EXPECT_EQ(theSample, 0x0000000Du);
+	EXPECT_EQ(theTime, theBase + theTicks(1));
+	ASSERT_TRUE(theScreenManager->GetSample(&theSample, &theTime));
+	EXPECT_EQ(theSample, (10u << 21) | (20u << 7) | 4u);
+	ASSERT_TRUE(theScreenManager->GetSample(&theSample, &theTime));
+	EXPECT_EQ(theSample, (11u << 21) | (21u << 7) | 6u);
+	EXPECT_EQ(theTime, theBase + theTicks(1.5));
+	ASSERT_TRUE(theScreenManager->GetSample(&theSample, &theTime));
+	EXPECT_EQ(theSample, 0x0000000Eu);
+	EXPECT_EQ(theTime, theBase + theTicks(2));
+	EXPECT_FALSE(theScreenManager->GetSample(&theSample, &theTime));
+
+	EXPECT_EQ(theReplay.Play(theBase + theTicks(10)), 0u);
+	EXPECT_TRUE(theReplay.IsDone());
+	EXPECT_EQ(thePlatformManager->GetPendingEventCount(), 2u);
+
+	// Invalid logs are rejected.
+	theFile = ::fopen(kInputReplayTestsLogPath, "w");
+	(void) ::fprintf(theFile, "2 up\n1 up\n");
+	(void) ::fclose(theFile);
+	EXPECT_FALSE(theReplay.Load(kInputReplayTestsLogPath));
+	theFile = ::fopen(kInputReplayTestsLogPath, "w");
+	(void) ::fprintf(theFile, "1 hover 10 10\n");
+	(void) ::fclose(theFile);
+	EXPECT_FALSE(theReplay.Load(kInputReplayTestsLogPath));
+	EXPECT_EQ(theReplay.GetEventCount(), 0u);
+
+	(void) ::unlink(kInputReplayTestsLogPath);
+	delete thePlatformManager;
+	delete theScreenManager;
+	delete theInterruptManager;
+}
+
+TEST(InputReplayTests, BinaryLogBackPressure)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	TNullScreenManager* theScreenManager = new TNullScreenManager(nullptr);
+	theScreenManager->SetInterruptManager(theInterruptManager);
+	TPlatformManager* thePlatformManager = new TPlatformManager(nullptr, theScreenManager);
+	thePlatformManager->SetInterruptManager(theInterruptManager);
+	thePlatformManager->SetMemory(&theMem);
+	theScreenManager->SetPlatformManager(thePlatformManager);
+
+	// A 1 kHz stroke of 1000 samples, then 40 keys, all at once.
+	const KUInt32 theStrokeCount = 1000;
+	const KUInt32 theKeyCount = 40;
+	FILE* theFile = ::fopen(kInputReplayTestsLogPath, "wb");
+	ASSERT_NE(theFile, nullptr);
+	const KUInt8 theHeader[] = { 'E', 'I', 'N', 'P', 0, 1, 0, 0, 0, 0, 0x03, 0xE8 };
+	(void) ::fwrite(theHeader, 1, sizeof(theHeader), theFile);
+	for (KUInt32 indexEvent = 0; indexEvent < theStrokeCount + 1 + theKeyCount; indexEvent++)
+	{
+		KUInt32 theTime = (indexEvent < theStrokeCount) ? indexEvent : theStrokeCount;
+		KUInt8 theType = (indexEvent < theStrokeCount) ? TInputReplay::kPenDownEvent
+			: (indexEvent == theStrokeCount) ? TInputReplay::kPenUpEvent
+											 : TInputReplay::kKeyDownEvent;
+		KUInt8 theRecord[10] = {
+			(KUInt8) (theTime >> 24), (KUInt8) (theTime >> 16),
+			(KUInt8) (theTime >> 8), (KUInt8) theTime,
+			theType, 4,
+			0, (KUInt8) (indexEvent & 0xFF),
+			0, 100
+		};
+		(void) ::fwrite(theRecord, 1, sizeof(theRecord), theFile);
+	}
+	(void) ::fclose(theFile);
+
+	TInputReplay theReplay(nullptr, theScreenManager, theInterruptManager, thePlatformManager);
+	ASSERT_TRUE(theReplay.Load(kInputReplayTestsLogPath));
+	EXPECT_EQ(theReplay.GetEventCount(), theStrokeCount + 1 + theKeyCount);
+
+	// The replay waits for the tablet driver instead of dropping samples.
+	KUInt32 theBase = 1000;
+	(void) theReplay.Play(theBase);
+	KUInt32 theLate = theBase + 2 * TInterruptManager::kTicksPerSecond;
+	KUInt32 theReceived = 0;
+	KUInt32 theLastTime = 0;
+	Boolean inOrder = true;
+	for (KUInt32 indexPoll = 0; (indexPoll < 100) && !theReplay.IsDone(); indexPoll++)
+	{
+		(void) theReplay.Play(theLate);
+		EXPECT_LE(theScreenManager->GetPendingSampleCount(),
+			(KUInt32) TInputReplay::kMaxPendingSamples);
+		EXPECT_LE(thePlatformManager->GetPendingEventCount(),
+			(KUInt32) TInputReplay::kMaxPendingEvents);
+		KUInt32 theSample;
+		KUInt32 theTime;
+		while (theScreenManager->GetSample(&theSample, &theTime))
+		{
+			inOrder = inOrder && ((KSInt32) (theTime - theLastTime) >= 0);
+			theLastTime = theTime;
+			theReceived++;
+		}
+		while (thePlatformManager->GetNextEvent(TMemoryConsts::kRAMStart))
+		{
+		}
+	}
+	EXPECT_TRUE(theReplay.IsDone());
+	EXPECT_GT(theReplay.GetStallCount(), 0u);
+	EXPECT_TRUE(inOrder);
+	// Pen down, the samples and pen up.
+	EXPECT_EQ(theReceived, theStrokeCount + 2);
+	EXPECT_EQ(theLastTime, theBase + TInterruptManager::kTicksPerSecond);
+
+	// Truncated records are rejected.
+	theFile = ::fopen(kInputReplayTestsLogPath, "ab");
+	(void) ::fwrite(theHeader, 1, 3, theFile);
+	(void) ::fclose(theFile);
+	EXPECT_FALSE(theReplay.Load(kInputReplayTestsLogPath));
+
+	(void) ::unlink(kInputReplayTestsLogPath);
+	delete thePlatformManager;
+	delete theScreenManager;
+	delete theInterruptManager;
+}
+
+TEST(InputReplayTests, PlayedInVirtualTime)
+{
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	// One tick per JIT unit.
+	theInterruptManager->EnableVirtualTime(1024);
+	theInterruptManager->SetIntCtrlReg(TInterruptManager::kTabletIntMask);
+	TNullScreenManager* theScreenManager = new TNullScreenManager(nullptr);
+	theScreenManager->SetInterruptManager(theInterruptManager);
+
+	FILE* theFile = ::fopen(kInputReplayTestsLogPath, "w");
+	ASSERT_NE(theFile, nullptr);
+	(void) ::fprintf(theFile, "5 down 10 20\n6 up\n");
+	(void) ::fclose(theFile);
+	auto theTicks = [](double inMilliseconds) {
+		return (KUInt32) (inMilliseconds * (TInterruptManager::kTicksPerSecond / 1000.0) + 0.5);
+	};
+
+	TInputReplay theReplay(nullptr, theScreenManager, theInterruptManager, nullptr);
+	ASSERT_TRUE(theReplay.Load(kInputReplayTestsLogPath));
+	KUInt32 theStart = theInterruptManager->GetTimer();
+	theReplay.Start();
+
+	// The idle CPU wakes up when the pen goes down, not earlier.
+	theInterruptManager->WaitUntilInterrupt(false, false);
+	EXPECT_EQ(theInterruptManager->GetTimer(), theStart + theTicks(5));
+	EXPECT_EQ(theReplay.GetPlayedCount(), 1u);
+	theInterruptManager->ClearInterrupts(TInterruptManager::kTabletIntMask);
+
+	// The busy CPU sees the pen go up when the code reaches the event.
+	theInterruptManager->AdvanceVirtualTime(theTicks(6) - theTicks(5) - 1);
+	EXPECT_EQ(theReplay.GetPlayedCount(), 1u);
+	theInterruptManager->AdvanceVirtualTime(1);
+	EXPECT_TRUE(theReplay.IsDone());
+	EXPECT_TRUE(theProcessor.IsThereAnyHardwareInterruptAsserted());
+	theReplay.Stop();
+
+	(void) ::unlink(kInputReplayTestsLogPath);
+	delete theScreenManager;
+	delete theInterruptManager;
+}
@@ -0,0 +1,110 @@
+// ==============================
+// File:			InterruptManagerBench.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "EinsteinBench.h"
+
+// ANSI C & POSIX
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// C++
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Einstein
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+
+// -------------------------------------------------------------------------- //
+//  * InterruptManagerRaiseStormBench( void )
+// -------------------------------------------------------------------------- //
+bool
+InterruptManagerRaiseStormBench(void)
+{
+	// A machine without a ROM, like the unit tests use.
+	const char* kFlashPath = "/tmp/EinsteinInterruptManagerBench.flash";
+	KUInt8* theROM = (KUInt8*) ::calloc(8 * 1024 * 1024, 1);
+	TMemory* theMemory = new TMemory(nullptr, theROM, kFlashPath);
+	TARMProcessor* theProcessor = new TARMProcessor(nullptr, theMemory);
+	theProcessor->SetCPSR(TARMProcessor::kSupervisorMode
+		| TARMProcessor::kPSR_IBit | TARMProcessor::kPSR_FBit);
+	TInterruptManager* theManager = new TInterruptManager(nullptr, theProcessor);
+
+	// Serial DMA and network (platform) interrupts are enabled, the OS
+	// only clears them from time to time.
+	KUInt32 theDeviceMask = TInterruptManager::kDMAChannel0IntMask
+		| TInterruptManager::kPlatformIntMask;
+	theManager->SetIntCtrlReg(theDeviceMask);
+	theManager->ResumeTimer();
+
+	const int kThreads = 4;
+	const int kRaisesPerThread = 200000;
+	auto theStart = std::chrono::steady_clock::now();
+	std::vector<std::thread> theDevices;
+	for (int indexThread = 0; indexThread < kThreads; indexThread++)
+	{
+		theDevices.emplace_back([theManager, indexThread]() {
+			KUInt32 theMask = (indexThread & 1)
+				? TInterruptManager::kDMAChannel0IntMask
+				: TInterruptManager::kPlatformIntMask;
+			for (int indexRaise = 0; indexRaise < kRaisesPerThread; indexRaise++)
+			{
+				theManager->RaiseInterrupt(theMask);
+				if ((indexRaise & 0xFF) == 0)
+				{
+					// The OS acknowledges the interrupt.
+					theManager->ClearInterrupts(theMask);
+				}
+			}
+		});
+	}
+	for (auto& theDevice : theDevices)
+	{
+		theDevice.join();
+	}
+	double theSeconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - theStart)
+							.count();
+	(void) ::printf("  %.0f raises/s (%d threads, %d raises each)\n",
+		(kThreads * kRaisesPerThread) / theSeconds, kThreads, kRaisesPerThread);
+
+	// The last raise of each device stays pending until the OS clears it.
+	bool theResult = (theManager->GetIntRaised() & theDeviceMask) == theDeviceMask;
+
+	theManager->SuspendTimer();
+	delete theManager;
+	delete theProcessor;
+	delete theMemory;
+	(void) ::unlink(kFlashPath);
+	::free(theROM);
+
+	return theResult;
+}
+
+// ============================================================= //
+// The fastest I/O is the I/O you don't do.                      //
+// ============================================================= //
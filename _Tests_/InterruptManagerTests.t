@@ -0,0 +1,397 @@
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "K/Streams/TFileStream.h"
+#include "_Tests_/TTestsFixture.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#define kInterruptTestsStatePath "/tmp/EinsteinInterruptTests.state"
+
+TEST(InterruptManagerTests, RaiseWakesWaitingProcessor)
+{
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theManager = new TInterruptManager(nullptr, &theProcessor);
+#if TARGET_OS_LINUX
+	// The timer thread sleeps in poll(), the device wakes it with the
+	// eventfd.
+	EXPECT_TRUE(theManager->IsUsingTimerFd());
+#endif
+	theManager->SetIntCtrlReg(TInterruptManager::kDMAChannel0IntMask);
+	theManager->ResumeTimer();
+
+	std::thread theDevice([theManager]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		// Not enabled: doesn't wake the processor.
+		theManager->RaiseInterrupt(TInterruptManager::kTabletIntMask);
+		theManager->RaiseInterrupt(TInterruptManager::kDMAChannel0IntMask);
+	});
+	theManager->WaitUntilInterrupt(false, false);
+	theDevice.join();
+
+	// Timers may also have been raised as their match registers are 0.
+	KUInt32 theDeviceMask = TInterruptManager::kTabletIntMask
+		| TInterruptManager::kDMAChannel0IntMask;
+	EXPECT_EQ(theManager->GetIntRaised() & theDeviceMask, theDeviceMask);
+	EXPECT_TRUE(theProcessor.IsThereAnyHardwareInterruptAsserted());
+
+	theManager->ClearInterrupts(TInterruptManager::kDMAChannel0IntMask);
+	EXPECT_EQ(theManager->GetIntRaised() & theDeviceMask,
+		(KUInt32) TInterruptManager::kTabletIntMask);
+
+	theManager->SuspendTimer();
+	delete theManager;
+}
+
+// Keeps the timer thread busy, like a host that is slow to schedule it.
+class TInterruptManagerTestsStall : public TTimerCallback
+{
+public:
+	virtual KUInt32
+	TimerCallback(KUInt32 /* inTimer */) override
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(6));
+		return 0;
+	}
+};
+
+TEST(InterruptManagerTests, LatenessHistogram)
+{
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theManager = new TInterruptManager(nullptr, &theProcessor);
+	theManager->ResumeTimer();
+	KUInt32 theStart = theManager->GetTimer();
+	theManager->SetTimerMatchRegister(1, theStart + 30 * TInterruptManager::kTicksPerSecond);
+	theManager->SetTimerMatchRegister(2, theStart + 30 * TInterruptManager::kTicksPerSecond);
+	theManager->SetTimerMatchRegister(3, theStart + 30 * TInterruptManager::kTicksPerSecond);
+	theManager->SetTimerMatchRegister(0, theStart + 30 * TInterruptManager::kTicksPerSecond);
+	theManager->ClearInterrupts(0xFFFFFFFF);
+	theManager->ResetLatenessHistogram();
+
+	// Timer 0 is due 1 ms from now, the timer thread is busy for 6 ms.
+	TInterruptManagerTestsStall theStall;
+	theManager->ScheduleCallback(&theStall);
+	theManager->SetTimerMatchRegister(0,
+		theManager->GetTimer() + TInterruptManager::kTicksPerSecond / 1000);
+	theManager->SetIntCtrlReg(TInterruptManager::kTimer0IntMask);
+	theManager->WaitUntilInterrupt(false, false);
+
+	// Bucket i counts the matches [2^(i-1), 2^i[ us late: this one is
+	// more than 4 ms late.
+	KUInt32 theBuckets[TInterruptManager::kLatenessBuckets];
+	theManager->GetLatenessHistogram(theBuckets);
+	KUInt32 theCount = 0;
+	for (int indexBucket = 0; indexBucket < TInterruptManager::kLatenessBuckets; indexBucket++)
+	{
+		if (indexBucket < 13)
+		{
+			EXPECT_EQ(theBuckets[indexBucket], 0u) << "bucket " << indexBucket;
+		}
+		theCount += theBuckets[indexBucket];
+	}
+	EXPECT_EQ(theCount, 1u);
+
+	theManager->ResetLatenessHistogram();
+	theManager->GetLatenessHistogram(theBuckets);
+	for (int indexBucket = 0; indexBucket < TInterruptManager::kLatenessBuckets; indexBucket++)
+	{
+		EXPECT_EQ(theBuckets[indexBucket], 0u);
+	}
+
+	theManager->SuspendTimer();
+	delete theManager;
+}
+
+TEST(InterruptManagerTests, VirtualWaitSkipsDisabledTimers)
+{
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theManager = new TInterruptManager(nullptr, &theProcessor);
+	theManager->EnableVirtualTime(1024);
+	KUInt32 theStart = theManager->GetTimer();
+
+	// Time jumps to timer 0, past the match of timer 1 which is disabled.
+	theManager->SetTimerMatchRegister(0, theStart + 1000);
+	theManager->SetTimerMatchRegister(1, theStart + 500);
+	theManager->SetTimerMatchRegister(2, theStart + 2000);
+	theManager->SetTimerMatchRegister(3, theStart + 3000);
+	theManager->SetIntCtrlReg(TInterruptManager::kTimer0IntMask
+		| TInterruptManager::kDMAChannel0IntMask);
+	theManager->WaitUntilInterrupt(false, false);
+	EXPECT_EQ(theManager->GetTimer(), theStart + 1000);
+	EXPECT_EQ(theManager->GetIntRaised() & TInterruptManager::kTimer1IntMask,
+		(KUInt32) TInterruptManager::kTimer1IntMask);
+
+	// No enabled timer left: time stands still until a device raises an
+	// interrupt.
+	theManager->ClearInterrupts(TInterruptManager::kTimer0IntMask);
+	theManager->SetIntCtrlReg(TInterruptManager::kDMAChannel0IntMask);
+	auto theWaitStart = std::chrono::steady_clock::now();
+	std::thread theDevice([theManager]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		theManager->RaiseInterrupt(TInterruptManager::kDMAChannel0IntMask);
+	});
+	theManager->WaitUntilInterrupt(false, false);
+	theDevice.join();
+	EXPECT_GE(std::chrono::steady_clock::now() - theWaitStart, std::chrono::milliseconds(15));
+	EXPECT_EQ(theManager->GetTimer(), theStart + 1000);
+	EXPECT_TRUE(theProcessor.IsThereAnyHardwareInterruptAsserted());
+
+	// The line goes down with the interrupt, without a timer thread.
+	theManager->ClearInterrupts(TInterruptManager::kDMAChannel0IntMask);
+	EXPECT_FALSE(theProcessor.IsThereAnyHardwareInterruptAsserted());
+
+	delete theManager;
+}
+
+// Run a fixed sequence in virtual time: the OS programs the timers, runs
+// slices of instructions, idles and acknowledges the interrupts. Each step
+// records the timer and the raised interrupts.
+static std::vector<KUInt32>
+RunInterruptManagerTestsSequence(TARMProcessor* inProcessor)
+{
+	std::vector<KUInt32> theTrace;
+	TInterruptManager* theManager = new TInterruptManager(nullptr, inProcessor);
+	// Three ticks per JIT unit.
+	theManager->EnableVirtualTime(3 * 1024);
+	KUInt32 theStart = theManager->GetTimer();
+	theManager->SetTimerMatchRegister(0, theStart + 5000);
+	theManager->SetTimerMatchRegister(1, theStart + 1234);
+	theManager->SetTimerMatchRegister(2, theStart + 20000);
+	theManager->SetTimerMatchRegister(3, theStart + 40000);
+	theManager->SetIntCtrlReg(TInterruptManager::kTimer0IntMask
+		| TInterruptManager::kTimer2IntMask);
+
+	KUInt32 theUnits = 1;
+	for (int indexStep = 0; indexStep < 200; indexStep++)
+	{
+		if ((indexStep % 7) == 6)
+		{
+			theManager->WaitUntilInterrupt(false, false);
+		} else
+		{
+			// Slices of various lengths, the same on every run.
+			theUnits = (theUnits * 75 + 74) % 1021;
+			theManager->AdvanceVirtualTime(theUnits);
+		}
+		KUInt32 theRaised = theManager->GetIntRaised();
+		theTrace.push_back(theManager->GetTimer() - theStart);
+		theTrace.push_back(theRaised);
+
+		// The OS acknowledges the timers and programs the next matches.
+		KUInt32 theNow = theManager->GetTimer();
+		if (theRaised & TInterruptManager::kTimer0IntMask)
+		{
+			theManager->ClearInterrupts(TInterruptManager::kTimer0IntMask);
+			theManager->SetTimerMatchRegister(0, theNow + 5000);
+		}
+		if (theRaised & TInterruptManager::kTimer1IntMask)
+		{
+			theManager->ClearInterrupts(TInterruptManager::kTimer1IntMask);
+			theManager->SetTimerMatchRegister(1, theNow + 1234);
+		}
+		if (theRaised & TInterruptManager::kTimer2IntMask)
+		{
+			theManager->ClearInterrupts(TInterruptManager::kTimer2IntMask);
+			theManager->SetTimerMatchRegister(2, theNow + 20000);
+		}
+	}
+
+	delete theManager;
+	return theTrace;
+}
+
+TEST(InterruptManagerTests, VirtualTimeIsDeterministic)
+{
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	std::vector<KUInt32> theFirstTrace = RunInterruptManagerTestsSequence(&theProcessor);
+	std::vector<KUInt32> theSecondTrace = RunInterruptManagerTestsSequence(&theProcessor);
+	EXPECT_EQ(theFirstTrace, theSecondTrace);
+
+	// The timers did fire, and time went forward.
+	KUInt32 theTimer0Count = 0;
+	for (size_t indexStep = 0; indexStep < theFirstTrace.size(); indexStep += 2)
+	{
+		if (theFirstTrace[indexStep + 1] & TInterruptManager::kTimer0IntMask)
+		{
+			theTimer0Count++;
+		}
+	}
+	EXPECT_GT(theTimer0Count, 10u);
+	EXPECT_GT(theFirstTrace[theFirstTrace.size() - 2], 100000u);
+}
+
+TEST(InterruptManagerTests, WarpSkipsIdleTime)
+{
+	const KUInt32 kTicksPerSecond = TInterruptManager::kTicksPerSecond;
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theManager = new TInterruptManager(nullptr, &theProcessor);
+	theManager->ResumeTimer();
+	theManager->SetWarp(60 * kTicksPerSecond);
+	KUInt32 theStart = theManager->GetTimer();
+	theManager->SetTimerMatchRegister(1, theStart + 30 * kTicksPerSecond);
+	theManager->SetTimerMatchRegister(2, theStart + 30 * kTicksPerSecond);
+	theManager->SetTimerMatchRegister(3, theStart + 30 * kTicksPerSecond);
+
+	// The idle CPU doesn't wait 10 seconds for timer 0. The timers may have
+	// been raised as their matches were 0.
+	theManager->SetTimerMatchRegister(0, theStart + 10 * kTicksPerSecond);
+	theManager->ClearInterrupts(0xFFFFFFFF);
+	theManager->SetIntCtrlReg(TInterruptManager::kTimer0IntMask);
+	auto theWaitStart = std::chrono::steady_clock::now();
+	theManager->WaitUntilInterrupt(false, false);
+	EXPECT_LT(std::chrono::steady_clock::now() - theWaitStart, std::chrono::seconds(5));
+	EXPECT_EQ(theManager->GetIntRaised() & TInterruptManager::kTimer0IntMask,
+		(KUInt32) TInterruptManager::kTimer0IntMask);
+	EXPECT_GE(theManager->GetTimer() - theStart, 10 * kTicksPerSecond);
+	KUInt64 theWarped = theManager->GetWarpedTicks();
+	EXPECT_GT(theWarped, 9 * (KUInt64) kTicksPerSecond);
+	EXPECT_LE(theWarped, 10 * (KUInt64) kTicksPerSecond);
+
+	// The skipped ticks add up.
+	theManager->ClearInterrupts(TInterruptManager::kTimer0IntMask);
+	theManager->SetTimerMatchRegister(0, theManager->GetTimer() + 5 * kTicksPerSecond);
+	theManager->WaitUntilInterrupt(false, false);
+	EXPECT_GT(theManager->GetWarpedTicks(), theWarped + 4 * (KUInt64) kTicksPerSecond);
+	EXPECT_LE(theManager->GetWarpedTicks(), theWarped + 5 * (KUInt64) kTicksPerSecond);
+
+	// No more than the maximum is skipped at once: the rest is waited for.
+	theManager->SetWarp(kTicksPerSecond / 2);
+	theManager->ClearInterrupts(TInterruptManager::kTimer0IntMask);
+	theWarped = theManager->GetWarpedTicks();
+	theManager->SetTimerMatchRegister(0,
+		theManager->GetTimer() + (kTicksPerSecond / 2) + (kTicksPerSecond / 20));
+	theManager->WaitUntilInterrupt(false, false);
+	EXPECT_EQ(theManager->GetIntRaised() & TInterruptManager::kTimer0IntMask,
+		(KUInt32) TInterruptManager::kTimer0IntMask);
+	EXPECT_GE(theManager->GetWarpedTicks(), theWarped + (kTicksPerSecond / 2));
+	EXPECT_LE(theManager->GetWarpedTicks(),
+		theWarped + (kTicksPerSecond / 2) + (kTicksPerSecond / 20));
+
+	// Time doesn't jump over the RTC alarm. The alarm isn't raised by the
+	// timer: a device wakes the CPU.
+	theManager->SetWarp(60 * kTicksPerSecond);
+	theManager->ClearInterrupts(TInterruptManager::kTimer0IntMask);
+	theWarped = theManager->GetWarpedTicks();
+	KUInt32 theAlarmStart = theManager->GetTimer();
+	theManager->SetTimerMatchRegister(0, theAlarmStart + 20 * kTicksPerSecond);
+	theManager->SetIntCtrlReg(TInterruptManager::kTimer0IntMask
+		| TInterruptManager::kRTCAlarmIntMask
+		| TInterruptManager::kDMAChannel0IntMask);
+	theManager->SetAlarm(theManager->GetRealTimeClock() + 2);
+	// Once the alarm time is reached, it no longer stops the warp: let the
+	// timer thread handle the changes first, so that it only warps once.
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	std::thread theDevice([theManager]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		theManager->RaiseInterrupt(TInterruptManager::kDMAChannel0IntMask);
+	});
+	theManager->WaitUntilInterrupt(false, false);
+	theDevice.join();
+	EXPECT_GT(theManager->GetWarpedTicks(), theWarped);
+	EXPECT_LE(theManager->GetWarpedTicks(), theWarped + 2 * kTicksPerSecond);
+	EXPECT_LT(theManager->GetTimer() - theAlarmStart, 3 * kTicksPerSecond);
+	EXPECT_EQ(theManager->GetIntRaised() & TInterruptManager::kTimer0IntMask, 0u);
+
+	theManager->SuspendTimer();
+	delete theManager;
+}
+
+TEST(InterruptManagerTests, RestoreInVirtualTime)
+{
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+
+	// Save a session that ran on the host clock.
+	TInterruptManager* theHostManager = new TInterruptManager(nullptr, &theProcessor);
+	theHostManager->ResumeTimer();
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	theHostManager->SuspendTimer();
+	KUInt32 theRTC = theHostManager->GetRealTimeClock();
+	{
+		TFileStream theStream(kInterruptTestsStatePath, "wb");
+		theHostManager->TransferState(&theStream);
+	}
+	delete theHostManager;
+
+	// Restore it in virtual time, like the command line does with -r.
+	TInterruptManager* theManager = new TInterruptManager(nullptr, &theProcessor);
+	theManager->EnableVirtualTime(1024);
+	{
+		TFileStream theStream(kInterruptTestsStatePath, "rb");
+		theManager->TransferState(&theStream);
+	}
+	theManager->ResumeTimer();
+	KUInt32 theStart = theManager->GetTimer();
+	EXPECT_NE(theStart, 0u);
+	EXPECT_LE(theManager->GetRealTimeClock() - theRTC, 1u);
+
+	// Matches are reached in virtual ticks from the restored timer. The
+	// saved session may have raised the timers as their matches were 0.
+	theManager->ClearInterrupts(0xFFFFFFFF);
+	theManager->SetTimerMatchRegister(0, theStart + 1000);
+	theManager->SetIntCtrlReg(TInterruptManager::kTimer0IntMask);
+	theManager->WaitUntilInterrupt(false, false);
+	EXPECT_EQ(theManager->GetTimer(), theStart + 1000);
+	EXPECT_EQ(theManager->GetIntRaised() & TInterruptManager::kTimer0IntMask,
+		(KUInt32) TInterruptManager::kTimer0IntMask);
+	theManager->ClearInterrupts(TInterruptManager::kTimer0IntMask);
+	theManager->SetTimerMatchRegister(0, theStart + 2000);
+	theManager->AdvanceVirtualTime(999);
+	EXPECT_EQ(theManager->GetIntRaised() & TInterruptManager::kTimer0IntMask, 0u);
+	theManager->AdvanceVirtualTime(1);
+	EXPECT_EQ(theManager->GetIntRaised() & TInterruptManager::kTimer0IntMask,
+		(KUInt32) TInterruptManager::kTimer0IntMask);
+
+	delete theManager;
+	(void) ::unlink(kInterruptTestsStatePath);
+}
+
+TEST(InterruptManagerTests, ConcurrentRaises)
+{
+	TTestsFixture theFixture;
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theManager = new TInterruptManager(nullptr, &theProcessor);
+	// Serial DMA and network (platform) interrupts are enabled, the OS
+	// only clears them from time to time.
+	theManager->SetIntCtrlReg(TInterruptManager::kDMAChannel0IntMask
+		| TInterruptManager::kPlatformIntMask);
+	theManager->ResumeTimer();
+
+	const int kThreads = 4;
+	const int kRaisesPerThread = 10000;
+	std::vector<std::thread> theDevices;
+	for (int indexThread = 0; indexThread < kThreads; indexThread++)
+	{
+		theDevices.emplace_back([theManager, indexThread]() {
+			KUInt32 theMask = (indexThread & 1)
+				? TInterruptManager::kDMAChannel0IntMask
+				: TInterruptManager::kPlatformIntMask;
+			for (int indexRaise = 0; indexRaise < kRaisesPerThread; indexRaise++)
+			{
+				theManager->RaiseInterrupt(theMask);
+				if ((indexRaise & 0xFF) == 0)
+				{
+					// The OS acknowledges the interrupt.
+					theManager->ClearInterrupts(theMask);
+				}
+			}
+		});
+	}
+	for (auto& theDevice : theDevices)
+	{
+		theDevice.join();
+	}
+
+	// The last raise of each device stays pending until the OS clears it.
+	KUInt32 theDeviceMask = TInterruptManager::kDMAChannel0IntMask
+		| TInterruptManager::kPlatformIntMask;
+	EXPECT_EQ(theManager->GetIntRaised() & theDeviceMask, theDeviceMask);
+
+	theManager->SuspendTimer();
+	delete theManager;
+}
@@ -132,3 +132,85 @@ TEST(MemoryTests, ReadWriteRAMTest)
 	(void) ::unlink(kTempFlashPath);
 	::free(romBuffer);
 }
+
+TEST(MemoryTests, FastWriteBufferPTest)
+{
+	KUInt8* romBuffer = (KUInt8*) calloc(TMemoryConsts::kLowROMEnd, 1);
+	TMemory theMem(nullptr, romBuffer, kTempFlashPath);
+	KUInt8 theData[3000];
+	int index;
+	for (index = 0; index < 3000; index++)
+	{
+		theData[index] = (KUInt8) (index * 7);
+	}
+
+	// Unaligned, across three pages.
+	Boolean fault = theMem.FastWriteBufferP(0x04000000 + 0x3FD, 3000, theData);
+	EXPECT_EQ(fault, false);
+	KUInt8 theByte;
+	for (index = 0; index < 3000; index++)
+	{
+		fault = theMem.ReadBP(0x04000000 + 0x3FD + index, theByte);
+		EXPECT_EQ(fault, false);
+		EXPECT_EQ(theByte, theData[index]);
+	}
+	KUInt32 theWord = theMem.ReadP(0x04000000 + 0x3FC, fault);
+	EXPECT_EQ(fault, false);
+	EXPECT_EQ(theWord, 0x0000070E);
+
+	(void) ::unlink(kTempFlashPath);
+	::free(romBuffer);
+}
+
+TEST(MemoryTests, FastReadBufferPTest)
+{
+	KUInt8* romBuffer = (KUInt8*) calloc(TMemoryConsts::kLowROMEnd, 1);
+	TMemory theMem(nullptr, romBuffer, kTempFlashPath);
+	KUInt8 theData[3000];
+	int index;
+	Boolean fault;
+	for (index = 0; index < 3000; index++)
+	{
+		fault = theMem.WriteBP(0x04000000 + 0x3FD + index, (KUInt8) (index * 7));
+		EXPECT_EQ(fault, false);
+	}
+
+	// Unaligned, across three pages.
+	fault = theMem.FastReadBufferP(0x04000000 + 0x3FD, 3000, theData);
+	EXPECT_EQ(fault, false);
+	for (index = 0; index < 3000; index++)
+	{
+		EXPECT_EQ(theData[index], (KUInt8) (index * 7));
+	}
+
+	(void) ::unlink(kTempFlashPath);
+	::free(romBuffer);
+}
+
+TEST(MemoryTests, FastReadBufferFlashTest)
+{
+	KUInt8* romBuffer = (KUInt8*) calloc(TMemoryConsts::kLowROMEnd, 1);
+	TMemory theMem(nullptr, romBuffer, kTempFlashPath);
+	Boolean fault = theMem.EraseFlash(TMemoryConsts::kFlashBank1, 0x10000);
+	EXPECT_EQ(fault, false);
+	int index;
+	for (index = 0; index < 16; index++)
+	{
+		fault = theMem.WriteToFlash32Bits(
+			0x00010203 + (index * 0x04040404), 0xFFFFFFFF, TMemoryConsts::kFlashBank1 + (index * 4));
+		EXPECT_EQ(fault, false);
+	}
+
+	// Flash is read word by word, from an unaligned address, with an
+	// unaligned tail.
+	KUInt8 theData[50];
+	fault = theMem.FastReadBuffer(TMemoryConsts::kFlashBank1 + 3, 50, theData);
+	EXPECT_EQ(fault, false);
+	for (index = 0; index < 50; index++)
+	{
+		EXPECT_EQ(theData[index], (KUInt8) (index + 3));
+	}
+
+	(void) ::unlink(kTempFlashPath);
+	::free(romBuffer);
+}
@@ -0,0 +1,125 @@
+// ==============================
+// File:			NetworkChecksumBench.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "EinsteinBench.h"
+
+// ANSI C & POSIX
+#include <stdio.h>
+
+// C++
+#include <chrono>
+#include <vector>
+
+// Einstein
+#include "Emulator/Network/TNetworkManager.h"
+
+// -------------------------------------------------------------------------- //
+//  * NetworkChecksumBenchReferenceSum( const KUInt8*, ssize_t )
+// -------------------------------------------------------------------------- //
+static KUInt16
+NetworkChecksumBenchReferenceSum(const KUInt8* d, ssize_t n)
+{
+	// The byte by byte sum that TNetworkManager used before the kernel.
+	KUInt32 s = 0;
+	for (ssize_t i = 0; i < n; i += 2)
+	{
+		s += (d[i] << 8);
+		if (i + 1 < n)
+			s += d[i + 1];
+	}
+	while (s >> 16)
+		s = (s & 0xFFFF) + (s >> 16);
+	return s;
+}
+
+// -------------------------------------------------------------------------- //
+//  * NetworkChecksumKernelBench( void )
+// -------------------------------------------------------------------------- //
+bool
+NetworkChecksumKernelBench(void)
+{
+	// A few thousand full size ethernet frames, with an IPv4 header and a
+	// TCP header.
+	const ssize_t kFrameSize = 1514;
+	const int kIterations = 20000;
+	std::vector<KUInt8> theFrame(kFrameSize);
+	KUInt32 theSeed = 42;
+	for (KUInt8& theByte : theFrame)
+	{
+		theSeed = theSeed * 1103515245 + 12345;
+		theByte = (KUInt8) (theSeed >> 16);
+	}
+	theFrame[12] = 0x08;
+	theFrame[13] = 0x00;
+	theFrame[14] = 0x45;
+	theFrame[16] = (KUInt8) ((kFrameSize - 14) >> 8);
+	theFrame[17] = (KUInt8) (kFrameSize - 14);
+	theFrame[23] = 6; // TCP
+	theFrame[46] = 0x50;
+	TNetworkManager::SetIPv4Checksum(theFrame.data(), kFrameSize);
+
+	KUInt32 theCheck = 0;
+	auto theStart = std::chrono::steady_clock::now();
+	for (int indexIteration = 0; indexIteration < kIterations; indexIteration++)
+	{
+		theFrame[60] = (KUInt8) indexIteration;
+		theCheck += NetworkChecksumBenchReferenceSum(theFrame.data() + 34, kFrameSize - 34);
+	}
+	double theReferenceSeconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - theStart)
+									 .count();
+	theStart = std::chrono::steady_clock::now();
+	for (int indexIteration = 0; indexIteration < kIterations; indexIteration++)
+	{
+		theFrame[60] = (KUInt8) indexIteration;
+		theCheck -= TNetworkManager::OnesComplementSum(theFrame.data() + 34, kFrameSize - 34);
+	}
+	double theKernelSeconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - theStart)
+								  .count();
+	TNetworkManager::SetTCPChecksum(theFrame.data(), kFrameSize);
+	theStart = std::chrono::steady_clock::now();
+	for (int indexIteration = 0; indexIteration < kIterations; indexIteration++)
+	{
+		TNetworkManager::RewriteTCPAck(theFrame.data(), (KUInt32) indexIteration);
+	}
+	double theRewriteSeconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - theStart)
+								   .count();
+	(void) ::printf("  bytewise %7.0f MB/s, kernel %7.0f MB/s, ack rewrite %5.1f ns\n",
+		(kFrameSize * (double) kIterations) / theReferenceSeconds / 1e6,
+		(kFrameSize * (double) kIterations) / theKernelSeconds / 1e6,
+		theRewriteSeconds / kIterations * 1e9);
+
+	// The kernel sums like the reference, and the rewritten ACKs keep the
+	// checksum right.
+	return (theCheck == 0)
+		&& (TNetworkManager::GetTCPChecksum(theFrame.data(), kFrameSize) == 0);
+}
+
+// ============================================================= //
+// Never test for an error condition you don't know how to       //
+// handle.                                                       //
+//                 -- Steinbach                                  //
+// ============================================================= //
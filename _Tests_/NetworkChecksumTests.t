@@ -0,0 +1,113 @@
+#include "Emulator/Network/TNetworkManager.h"
+#include <vector>
+
+// The byte by byte sum that TNetworkManager used before the kernel.
+static KUInt16
+NetworkChecksumReferenceSum(const KUInt8* d, ssize_t n)
+{
+	KUInt32 s = 0;
+	for (ssize_t i = 0; i < n; i += 2)
+	{
+		s += (d[i] << 8);
+		if (i + 1 < n)
+			s += d[i + 1];
+	}
+	while (s >> 16)
+		s = (s & 0xFFFF) + (s >> 16);
+	return s;
+}
+
+// An ethernet frame with an IPv4 header and a TCP header for inSize bytes.
+static void
+PrepareNetworkChecksumFrame(KUInt8* d, ssize_t inSize, KUInt32 inSeed)
+{
+	for (ssize_t i = 0; i < inSize; i++)
+	{
+		inSeed = inSeed * 1103515245 + 12345;
+		d[i] = (KUInt8) (inSeed >> 16);
+	}
+	d[12] = 0x08;
+	d[13] = 0x00;
+	d[14] = 0x45;
+	d[16] = (KUInt8) ((inSize - 14) >> 8);
+	d[17] = (KUInt8) (inSize - 14);
+	d[23] = 6; // TCP
+	d[46] = 0x50;
+	TNetworkManager::SetIPv4Checksum(d, inSize);
+	TNetworkManager::SetTCPChecksum(d, inSize);
+}
+
+TEST(NetworkChecksumTests, SumMatchesReference)
+{
+	std::vector<KUInt8> theData(256 + 16);
+	KUInt32 theSeed = 0x12345678;
+	for (KUInt8& theByte : theData)
+	{
+		theSeed = theSeed * 1103515245 + 12345;
+		theByte = (KUInt8) (theSeed >> 16);
+	}
+	// Any length and alignment.
+	for (ssize_t offset = 0; offset < 16; offset++)
+	{
+		for (ssize_t size = 0; size <= 256; size++)
+		{
+			EXPECT_EQ(TNetworkManager::OnesComplementSum(theData.data() + offset, size),
+				NetworkChecksumReferenceSum(theData.data() + offset, size));
+		}
+	}
+	// Chained blocks give the same sum as one.
+	for (ssize_t split = 0; split <= 254; split += 2)
+	{
+		KUInt16 theSum = TNetworkManager::OnesComplementSum(theData.data(), split);
+		theSum = TNetworkManager::OnesComplementSum(theData.data() + split, 255 - split, theSum);
+		EXPECT_EQ(theSum, NetworkChecksumReferenceSum(theData.data(), 255));
+	}
+	// Large blocks of 0xFF don't overflow the accumulators.
+	std::vector<KUInt8> theOnes(200000, 0xFF);
+	EXPECT_EQ(TNetworkManager::OnesComplementSum(theOnes.data(), theOnes.size()), 0xFFFF);
+	EXPECT_EQ(TNetworkManager::OnesComplementSum(theOnes.data(), 0), 0);
+}
+
+TEST(NetworkChecksumTests, ChecksumsVerify)
+{
+	KUInt8 theFrame[1514];
+	for (ssize_t size = 54; size <= 1514; size += 73)
+	{
+		PrepareNetworkChecksumFrame(theFrame, size, (KUInt32) size);
+		// Summing the packet with its checksum gives zero.
+		EXPECT_EQ(TNetworkManager::GetIPv4Checksum(theFrame, size), 0);
+		EXPECT_EQ(TNetworkManager::GetTCPChecksum(theFrame, size), 0);
+	}
+}
+
+TEST(NetworkChecksumTests, IncrementalUpdates)
+{
+	KUInt8 theFrame[1514];
+	KUInt8 theCopy[1514];
+	KUInt32 theSeed = 0xCAFEBABE;
+	for (int indexRound = 0; indexRound < 1000; indexRound++)
+	{
+		ssize_t theSize = 54 + (indexRound % 1461);
+		PrepareNetworkChecksumFrame(theFrame, theSize, theSeed);
+		theSeed = theSeed * 1103515245 + 12345;
+		KUInt32 theAck = theSeed;
+		if (indexRound & 2)
+		{
+			theAck = (indexRound & 1) ? 0xFFFFFFFF : 0;
+		}
+
+		TNetworkManager::RewriteTCPAck(theFrame, theAck);
+		EXPECT_EQ(TNetworkManager::GetTCPChecksum(theFrame, theSize), 0);
+
+		// Same fields as computing the checksum again, modulo the two
+		// representations of zero.
+		::memcpy(theCopy, theFrame, theSize);
+		TNetworkManager::SetTCPChecksum(theCopy, theSize);
+		EXPECT_EQ(::memcmp(theCopy, theFrame, 50), 0);
+		KUInt16 theIncremental = (theFrame[50] << 8) | theFrame[51];
+		KUInt16 theFull = (theCopy[50] << 8) | theCopy[51];
+		EXPECT_TRUE((theIncremental == theFull)
+			|| ((theIncremental | theFull) == 0xFFFF && (theIncremental & theFull) == 0));
+	}
+	EXPECT_EQ(TNetworkManager::UpdateChecksum16(0xDD2F, 0x5555, 0x3285), 0x0000);
+}
@@ -0,0 +1,216 @@
+#include "Emulator/Log/TRAMLog.h"
+#include "Emulator/Screen/TCaptureScreenManager.h"
+#include "Emulator/Screen/TCaptureStreamReader.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <sys/stat.h>
+#include <vector>
+#if TARGET_OS_WIN32
+#define kScreenCaptureTestsStreamPath "c:/EinsteinScreenCaptureTests.capture"
+#else
+#define kScreenCaptureTestsStreamPath "/tmp/EinsteinScreenCaptureTests.capture"
+#endif
+
+static long
+GetScreenCaptureTestsStreamSize(void)
+{
+	struct stat theStat;
+	if (::stat(kScreenCaptureTestsStreamPath, &theStat) != 0)
+	{
+		return -1;
+	}
+	return (long) theStat.st_size;
+}
+
+TEST(ScreenCaptureTests, PackBitsRoundTrip)
+{
+	std::vector<KUInt8> theData;
+	KUInt32 theSeed = 0x2468ACE0;
+	for (KUInt32 index = 0; index < 1000; index++)
+	{
+		theSeed = theSeed * 1103515245 + 12345;
+		theData.push_back((KUInt8) (theSeed >> 24));
+	}
+	theData.insert(theData.end(), 300, 0xFF);
+	theData.insert(theData.end(), 2, 0x12);
+	theData.push_back(0x34);
+	theData.insert(theData.end(), 129, 0x00);
+	theData.push_back(0x56);
+
+	const KUInt32 kSizes[] = { 1, 2, 3, 127, 128, 129, 1000, 1300, (KUInt32) theData.size() };
+	for (KUInt32 theSize : kSizes)
+	{
+		std::vector<KUInt8> thePacked(theSize + ((theSize + 127) / 128));
+		KUInt32 thePackedSize = TCaptureScreenManager::PackBits(
+			theData.data(), theSize, thePacked.data());
+		EXPECT_LE(thePackedSize, thePacked.size());
+		std::vector<KUInt8> theUnpacked(theSize);
+		EXPECT_TRUE(TCaptureStreamReader::UnpackBits(
+			thePacked.data(), thePackedSize, theUnpacked.data(), theSize))
+			<< "size " << theSize;
+		EXPECT_EQ(0, ::memcmp(theData.data(), theUnpacked.data(), theSize))
+			<< "size " << theSize;
+	}
+
+	// Runs are compressed.
+	std::vector<KUInt8> thePacked(400);
+	EXPECT_EQ(TCaptureScreenManager::PackBits(&theData[1000], 300, thePacked.data()), 6u);
+}
+
+TEST(ScreenCaptureTests, StreamReplaysScreen)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	theInterruptManager->EnableVirtualTime(1024);
+	TRAMLog theLog;
+
+	TCaptureScreenManager* theScreenManager
+		= new TCaptureScreenManager(&theLog, kScreenCaptureTestsStreamPath);
+	ASSERT_TRUE(theScreenManager->IsCapturing());
+	theScreenManager->SetMemory(&theMem);
+	theScreenManager->SetInterruptManager(theInterruptManager);
+	theScreenManager->SetFrameRate(0);
+	KUInt32 theWidth = theScreenManager->GetScreenWidth();
+	KUInt32 theHeight = theScreenManager->GetScreenHeight();
+	KUInt32 baseAddy = TTestsFixture::kPixmapBaseAddr;
+	KUInt32 rowBytes = theWidth * TScreenManager::kBitsPerPixel / 8;
+	theFixture.WritePixmap(rowBytes);
+	KUInt32 theSeed = 0x13579BDF;
+	for (KUInt32 offset = 0; offset < rowBytes * theHeight; offset += 4)
+	{
+		// Mostly white, with some noise.
+		theSeed = theSeed * 1103515245 + 12345;
+		(void) theMem.WriteP(baseAddy + offset, (theSeed & 0x7000) ? 0 : theSeed);
+	}
+
+	// Odd rectangles, at different times.
+	TTestsFixture::BlitRect(theScreenManager, 0, 0, theHeight, theWidth);
+	theInterruptManager->AdvanceVirtualTime(1000);
+	TTestsFixture::BlitRect(theScreenManager, 13, 7, 131, 203);
+	theInterruptManager->AdvanceVirtualTime(2000);
+	theScreenManager->SetBacklight(true);
+	TTestsFixture::BlitRect(theScreenManager, 300, 1, 301, 2);
+	std::vector<KUInt8> thePortraitScreen(theScreenManager->GetScreenBuffer(),
+		theScreenManager->GetScreenBuffer() + (rowBytes * theHeight));
+
+	for (int indexBlit = 0; indexBlit < 100; indexBlit++)
+	{
+		TTestsFixture::BlitRect(theScreenManager, 40, 41, 48, 48);
+	}
+
+	// Rotation changes the dimensions of the screen.
+	theScreenManager->SetScreenOrientation(TScreenManager::kOrientation_AppleRight);
+	KUInt32 theLandscapeWidth = theScreenManager->GetScreenWidth();
+	KUInt32 theLandscapeHeight = theScreenManager->GetScreenHeight();
+	delete theScreenManager;
+
+	TCaptureStreamReader theReader(kScreenCaptureTestsStreamPath);
+	ASSERT_TRUE(theReader.IsOpen());
+	EXPECT_EQ(theReader.GetTicksPerSecond(), (KUInt32) TInterruptManager::kTicksPerSecond);
+	EXPECT_EQ(theReader.GetWidth(), theWidth);
+	EXPECT_EQ(theReader.GetHeight(), theHeight);
+
+	ASSERT_TRUE(theReader.ReadRecord());
+	EXPECT_EQ(theReader.GetRecordType(), (KUInt32) TCaptureScreenManager::kFrameRecord);
+	EXPECT_EQ(theReader.GetTime(), 0u);
+	ASSERT_TRUE(theReader.ReadRecord());
+	EXPECT_EQ(theReader.GetTime(), 1000u);
+	KUInt32 theTop, theLeft, theBottom, theRight;
+	theReader.GetRect(&theTop, &theLeft, &theBottom, &theRight);
+	EXPECT_EQ(theTop, 13u);
+	EXPECT_EQ(theLeft, 6u);
+	EXPECT_EQ(theBottom, 131u);
+	EXPECT_EQ(theRight, 204u);
+	ASSERT_TRUE(theReader.ReadRecord());
+	EXPECT_EQ(theReader.GetRecordType(), (KUInt32) TCaptureScreenManager::kBacklightRecord);
+	EXPECT_TRUE(theReader.GetBacklight());
+	EXPECT_EQ(theReader.GetTime(), 3000u);
+	ASSERT_TRUE(theReader.ReadRecord());
+	EXPECT_EQ(0, ::memcmp(theReader.GetScreenBuffer(), thePortraitScreen.data(),
+					 thePortraitScreen.size()));
+
+	int theFrameCount = 0;
+	while (theReader.ReadRecord()
+		&& (theReader.GetRecordType() == TCaptureScreenManager::kFrameRecord))
+	{
+		theFrameCount++;
+	}
+	EXPECT_EQ(theFrameCount, 100);
+	EXPECT_EQ(theReader.GetRecordType(), (KUInt32) TCaptureScreenManager::kGeometryRecord);
+	EXPECT_EQ(theReader.GetWidth(), theLandscapeWidth);
+	EXPECT_EQ(theReader.GetHeight(), theLandscapeHeight);
+	EXPECT_FALSE(theReader.ReadRecord());
+
+	delete theInterruptManager;
+	(void) ::unlink(kScreenCaptureTestsStreamPath);
+}
+
+TEST(ScreenCaptureTests, StreamSizeFollowsDamage)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TCaptureScreenManager* theScreenManager
+		= new TCaptureScreenManager(nullptr, kScreenCaptureTestsStreamPath);
+	theScreenManager->SetMemory(&theMem);
+	theScreenManager->SetFrameRate(0);
+	KUInt32 rowBytes = theScreenManager->GetScreenWidth() * TScreenManager::kBitsPerPixel / 8;
+	theFixture.WritePixmap(rowBytes);
+	for (KUInt32 offset = 0; offset < 0x10000; offset += 4)
+	{
+		(void) theMem.WriteP(TTestsFixture::kPixmapBaseAddr + offset, offset * 0x01010101);
+	}
+
+	// 8x8 pixels are 32 bytes, and at most 33 bytes once compressed.
+	for (int indexBlit = 0; indexBlit < 100; indexBlit++)
+	{
+		TTestsFixture::BlitRect(theScreenManager, 40, 41, 48, 48);
+	}
+	delete theScreenManager;
+	EXPECT_LE(GetScreenCaptureTestsStreamSize(),
+		TCaptureScreenManager::kCaptureHeaderSize + (100 * (1 + 4 + 8 + 4 + 33)));
+
+	(void) ::unlink(kScreenCaptureTestsStreamPath);
+}
+
+TEST(ScreenCaptureTests, OddWidthKeepsLastColumn)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TCaptureScreenManager* theScreenManager
+		= new TCaptureScreenManager(nullptr, kScreenCaptureTestsStreamPath, 321, 481);
+	theScreenManager->SetMemory(&theMem);
+	theScreenManager->SetFrameRate(0);
+	KUInt32 theWidth = theScreenManager->GetScreenWidth();
+	KUInt32 theHeight = theScreenManager->GetScreenHeight();
+	ASSERT_EQ(theWidth & 1, 1u);
+	KUInt32 rowBytes = ((theWidth + 7) & ~7) * TScreenManager::kBitsPerPixel / 8;
+	theFixture.WritePixmap(rowBytes);
+
+	// The whole screen, and the last column alone.
+	TTestsFixture::BlitRect(theScreenManager, 0, 0, theHeight, theWidth);
+	TTestsFixture::BlitRect(theScreenManager, 10, theWidth - 1, 20, theWidth);
+	delete theScreenManager;
+
+	TCaptureStreamReader theReader(kScreenCaptureTestsStreamPath);
+	ASSERT_TRUE(theReader.IsOpen());
+	EXPECT_EQ(theReader.GetWidth(), theWidth);
+	ASSERT_TRUE(theReader.ReadRecord());
+	EXPECT_EQ(theReader.GetRecordType(), (KUInt32) TCaptureScreenManager::kFrameRecord);
+	KUInt32 theTop, theLeft, theBottom, theRight;
+	theReader.GetRect(&theTop, &theLeft, &theBottom, &theRight);
+	EXPECT_EQ(theLeft, 0u);
+	EXPECT_EQ(theRight, theWidth + 1);
+	ASSERT_TRUE(theReader.ReadRecord());
+	theReader.GetRect(&theTop, &theLeft, &theBottom, &theRight);
+	EXPECT_EQ(theTop, 10u);
+	EXPECT_EQ(theLeft, theWidth - 1);
+	EXPECT_EQ(theBottom, 20u);
+	EXPECT_EQ(theRight, theWidth + 1);
+	EXPECT_FALSE(theReader.ReadRecord());
+
+	(void) ::unlink(kScreenCaptureTestsStreamPath);
+}
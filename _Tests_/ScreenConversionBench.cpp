@@ -0,0 +1,118 @@
+// ==============================
+// File:			ScreenConversionBench.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "EinsteinBench.h"
+
+// ANSI C & POSIX
+#include <stdio.h>
+#include <string.h>
+
+// C++
+#include <chrono>
+#include <vector>
+
+// Einstein
+#include "Emulator/Screen/UPixelConversion.h"
+
+// -------------------------------------------------------------------------- //
+//  * ScreenConversionKernelsBench( void )
+// -------------------------------------------------------------------------- //
+bool
+ScreenConversionKernelsBench(void)
+{
+	// A full 480x320 screen, converted a few hundred times.
+	const KUInt32 kScreenBytes = 480 * 320 / 2;
+	const int kIterations = 200;
+	std::vector<KUInt8> theScreen(kScreenBytes);
+	for (KUInt32 index = 0; index < kScreenBytes; index++)
+	{
+		theScreen[index] = (KUInt8) (index * 37);
+	}
+	const UPixelConversion::SLUT32& theLUT = UPixelConversion::GetRGBALUT32(false);
+
+	// What every kernel set must produce.
+	std::vector<KUInt8> theExpectedGray(kScreenBytes * 2);
+	std::vector<KUInt32> theExpectedPixels(kScreenBytes * 2);
+	UPixelConversion::Convert4To8GrayScalar(theScreen.data(), theExpectedGray.data(), kScreenBytes);
+	UPixelConversion::Convert4To32Scalar(theScreen.data(), theExpectedPixels.data(), kScreenBytes, theLUT);
+
+	std::vector<KUInt8> theGray(kScreenBytes * 2);
+	std::vector<KUInt32> thePixels(kScreenBytes * 2);
+	UPixelConversion::EKernels theKernels = UPixelConversion::GetKernels();
+	const UPixelConversion::EKernels kAllKernels[] = {
+		UPixelConversion::kScalarKernels,
+		UPixelConversion::kPortableKernels,
+		UPixelConversion::kSSE2Kernels,
+		UPixelConversion::kAVX2Kernels
+	};
+	const char* kNames[] = { "scalar", "portable", "sse2", "avx2" };
+	bool theResult = true;
+	for (UPixelConversion::EKernels theTested : kAllKernels)
+	{
+		if (!UPixelConversion::SetKernels(theTested))
+		{
+			(void) ::printf("  %-8s not supported by this host\n", kNames[theTested]);
+			continue;
+		}
+		auto theStart = std::chrono::steady_clock::now();
+		for (int indexIteration = 0; indexIteration < kIterations; indexIteration++)
+		{
+			UPixelConversion::Convert4To8Gray(theScreen.data(), theGray.data(), kScreenBytes);
+		}
+		double theGraySeconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - theStart)
+									.count();
+		theStart = std::chrono::steady_clock::now();
+		for (int indexIteration = 0; indexIteration < kIterations; indexIteration++)
+		{
+			UPixelConversion::Convert4To32(theScreen.data(), thePixels.data(), kScreenBytes, theLUT);
+		}
+		double the32Seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - theStart)
+								  .count();
+		(void) ::printf("  %-8s 4->8 gray: %7.0f MB/s, 4->32: %7.0f MB/s (source)%s\n",
+			kNames[theTested],
+			(kScreenBytes * (double) kIterations) / theGraySeconds / 1e6,
+			(kScreenBytes * (double) kIterations) / the32Seconds / 1e6,
+			(theTested == theKernels) ? ", selected" : "");
+
+		if ((::memcmp(theGray.data(), theExpectedGray.data(), theGray.size()) != 0)
+			|| (::memcmp(thePixels.data(), theExpectedPixels.data(),
+					thePixels.size() * sizeof(KUInt32))
+				!= 0))
+		{
+			(void) ::printf("  %-8s doesn't match the scalar kernels\n", kNames[theTested]);
+			theResult = false;
+		}
+	}
+	(void) UPixelConversion::SetKernels(theKernels);
+
+	return theResult;
+}
+
+// ============================================================= //
+// Simple things should be simple, and complex things should be  //
+// possible.                                                     //
+//                 -- Alan Kay                                   //
+// ============================================================= //
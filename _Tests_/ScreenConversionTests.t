@@ -0,0 +1,124 @@
+#include "Emulator/Screen/TNullScreenManager.h"
+#include "Emulator/Screen/UPixelConversion.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <vector>
+
+static const UPixelConversion::EKernels kScreenConversionKernels[] = {
+	UPixelConversion::kPortableKernels,
+	UPixelConversion::kSSE2Kernels,
+	UPixelConversion::kAVX2Kernels
+};
+
+static void
+PrepareTestLUT32(UPixelConversion::SLUT32* outLUT)
+{
+	// Distinct bytes in every channel, to catch interleaving mistakes.
+	KUInt32 theColors[16];
+	for (KUInt32 index = 0; index < 16; index++)
+	{
+		theColors[index] = 0xFF000000 | (index * 0x00110000)
+			| ((15 - index) * 0x00001100) | (index * 7);
+	}
+	UPixelConversion::PrepareLUT32(theColors, outLUT);
+}
+
+TEST(ScreenConversionTests, KernelsMatchBlit0)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TNullScreenManager theScreenManager;
+	theScreenManager.SetMemory(&theMem);
+
+	// A pixmap with every level, in RAM.
+	KUInt32 theWidth = theScreenManager.GetScreenWidth();
+	KUInt32 theHeight = theScreenManager.GetScreenHeight();
+	KUInt32 rowBytes = theWidth * TScreenManager::kBitsPerPixel / 8;
+	KUInt32 baseAddy = TTestsFixture::kPixmapBaseAddr;
+	theFixture.WritePixmap(rowBytes);
+	KUInt32 theSeed = 0x12345678;
+	for (KUInt32 offset = 0; offset < rowBytes * theHeight; offset += 4)
+	{
+		theSeed = theSeed * 1103515245 + 12345;
+		(void) theMem.WriteP(baseAddy + offset, theSeed);
+	}
+
+	TScreenManager::SRect theRect;
+	theRect.fTop = 0;
+	theRect.fLeft = 0;
+	theRect.fBottom = theHeight;
+	theRect.fRight = theWidth;
+	theScreenManager.Blit(TTestsFixture::kPixmapAddr, &theRect, &theRect, 0 /* srcCopy */);
+	const KUInt8* theScreen = theScreenManager.GetScreenBuffer();
+
+	// Blit_0 stored the inverted levels, left pixel in the high nibble.
+	UPixelConversion::SLUT32 theLUT;
+	PrepareTestLUT32(&theLUT);
+	std::vector<KUInt8> theGray(theWidth);
+	std::vector<KUInt32> thePixels(theWidth);
+	UPixelConversion::Convert4To8GrayScalar(theScreen, theGray.data(), rowBytes);
+	UPixelConversion::Convert4To32Scalar(theScreen, thePixels.data(), rowBytes, theLUT);
+	Boolean theFault;
+	KUInt32 theFirstWord = theMem.ReadP(baseAddy, theFault);
+	for (KUInt32 indexPixel = 0; indexPixel < 8; indexPixel++)
+	{
+		KUInt32 theLevel = 15 - ((theFirstWord >> (28 - (indexPixel * 4))) & 0x0F);
+		EXPECT_EQ(theGray[indexPixel], theLevel * 0x11);
+		EXPECT_EQ(thePixels[indexPixel], theLUT.fEntries[theLevel]);
+	}
+
+	// Every kernel matches the reference, for any width and alignment.
+	UPixelConversion::EKernels theKernels = UPixelConversion::GetKernels();
+	std::vector<KUInt8> theExpectedGray(theWidth + 64);
+	std::vector<KUInt32> theExpectedPixels(theWidth + 64);
+	std::vector<KUInt8> theActualGray(theWidth + 64);
+	std::vector<KUInt32> theActualPixels(theWidth + 64);
+	for (UPixelConversion::EKernels theTested : kScreenConversionKernels)
+	{
+		if (!UPixelConversion::SetKernels(theTested))
+		{
+			continue;
+		}
+		for (KUInt32 indexRow = 0; indexRow < theHeight; indexRow += 7)
+		{
+			const KUInt8* theRow = theScreen + (indexRow * rowBytes);
+			KUInt32 theStart = indexRow % 17;
+			KUInt32 theBytes = rowBytes - theStart - (indexRow % 5);
+			UPixelConversion::Convert4To8GrayScalar(
+				theRow + theStart, theExpectedGray.data(), theBytes);
+			UPixelConversion::Convert4To32Scalar(
+				theRow + theStart, theExpectedPixels.data(), theBytes, theLUT);
+			// Guard bytes past the end must be left alone.
+			std::fill(theActualGray.begin(), theActualGray.end(), 0xA5);
+			std::fill(theActualPixels.begin(), theActualPixels.end(), 0xA5A5A5A5);
+			UPixelConversion::Convert4To8Gray(
+				theRow + theStart, theActualGray.data(), theBytes);
+			UPixelConversion::Convert4To32(
+				theRow + theStart, theActualPixels.data(), theBytes, theLUT);
+			EXPECT_EQ(0, ::memcmp(theExpectedGray.data(), theActualGray.data(), theBytes * 2))
+				<< "kernels " << theTested << " row " << indexRow;
+			EXPECT_EQ(0, ::memcmp(theExpectedPixels.data(), theActualPixels.data(), theBytes * 8))
+				<< "kernels " << theTested << " row " << indexRow;
+			EXPECT_EQ(theActualGray[theBytes * 2], 0xA5);
+			EXPECT_EQ(theActualPixels[theBytes * 2], 0xA5A5A5A5);
+		}
+	}
+	(void) UPixelConversion::SetKernels(theKernels);
+}
+
+TEST(ScreenConversionTests, RGBATablesAreShared)
+{
+	// R G B 0 in memory: white, then green with the backlight.
+	const UPixelConversion::SLUT32& theGrays = UPixelConversion::GetRGBALUT32(false);
+	const UPixelConversion::SLUT32& theGreens = UPixelConversion::GetRGBALUT32(true);
+	const KUInt8 kWhite[4] = { 0xFF, 0xFF, 0xFF, 0x00 };
+	const KUInt8 kGreen[4] = { 0x7F, 0xFF, 0x7F, 0x00 };
+	EXPECT_EQ(0, ::memcmp(&theGrays.fEntries[15], kWhite, 4));
+	EXPECT_EQ(0, ::memcmp(&theGreens.fEntries[15], kGreen, 4));
+	EXPECT_EQ(theGrays.fEntries[0], 0u);
+	EXPECT_EQ(theGreens.fEntries[0], 0u);
+
+	// The same tables for every update.
+	EXPECT_EQ(&theGrays, &UPixelConversion::GetRGBALUT32(false));
+	EXPECT_EQ(&theGreens, &UPixelConversion::GetRGBALUT32(true));
+}
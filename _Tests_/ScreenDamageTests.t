@@ -0,0 +1,148 @@
+#include "Emulator/Screen/TNullScreenManager.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+class TScreenDamageTestsManager : public TNullScreenManager
+{
+public:
+	virtual void
+	UpdateScreenRect(SRect* inUpdatedRect)
+	{
+		if (mPresenting.fetch_add(1) != 0)
+		{
+			mOverlaps++;
+		}
+		mLastRect = *inUpdatedRect;
+		std::this_thread::yield();
+		mPresenting--;
+	}
+
+	SRect mLastRect = { 0, 0, 0, 0 };
+	std::atomic<int> mPresenting { 0 };
+	std::atomic<int> mOverlaps { 0 };
+};
+
+TEST(ScreenDamageTests, BlitsAreCoalescedPerFrame)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	// One tick per JIT unit.
+	theInterruptManager->EnableVirtualTime(1024);
+
+	TScreenDamageTestsManager theScreenManager;
+	theScreenManager.SetMemory(&theMem);
+	theScreenManager.SetInterruptManager(theInterruptManager);
+	KUInt32 rowBytes = theScreenManager.GetScreenWidth() * TScreenManager::kBitsPerPixel / 8;
+	theFixture.WritePixmap(rowBytes);
+
+	// Every blit is presented unless the front-end sets a frame rate.
+	EXPECT_EQ(theScreenManager.GetFrameRate(), 0u);
+	theScreenManager.SetFrameRate(60);
+	const KUInt32 kFrameTicks = TInterruptManager::kTicksPerSecond / 60;
+	theInterruptManager->AdvanceVirtualTime(kFrameTicks);
+
+	// The first blit of a frame is presented at once.
+	TTestsFixture::BlitRect(&theScreenManager, 10, 10, 20, 20);
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 1u);
+
+	// The following ones are merged until the end of the frame.
+	TTestsFixture::BlitRect(&theScreenManager, 30, 40, 35, 48);
+	TTestsFixture::BlitRect(&theScreenManager, 100, 8, 101, 16);
+	theInterruptManager->AdvanceVirtualTime(kFrameTicks - 1);
+	TTestsFixture::BlitRect(&theScreenManager, 50, 60, 52, 64);
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 1u);
+	theInterruptManager->AdvanceVirtualTime(1);
+	TTestsFixture::BlitRect(&theScreenManager, 70, 24, 72, 32);
+	EXPECT_EQ(theScreenManager.GetBlitCount(), 5u);
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 2u);
+	EXPECT_EQ(theScreenManager.mLastRect.fTop, 30);
+	EXPECT_EQ(theScreenManager.mLastRect.fLeft, 8);
+	EXPECT_EQ(theScreenManager.mLastRect.fBottom, 101);
+	EXPECT_EQ(theScreenManager.mLastRect.fRight, 64);
+
+	// The last blits are presented by the timer at the end of the frame,
+	// even if nothing else is blitted.
+	TTestsFixture::BlitRect(&theScreenManager, 80, 16, 90, 24);
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 2u);
+	theInterruptManager->AdvanceVirtualTime(kFrameTicks - 1);
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 2u);
+	theInterruptManager->AdvanceVirtualTime(1);
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 3u);
+	EXPECT_EQ(theScreenManager.mLastRect.fTop, 70);
+	EXPECT_EQ(theScreenManager.mLastRect.fBottom, 90);
+
+	// Pending damage is presented when the emulator idles.
+	TTestsFixture::BlitRect(&theScreenManager, 200, 100, 210, 110);
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 3u);
+	theScreenManager.FlushDamage();
+	theScreenManager.FlushDamage();
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 4u);
+	EXPECT_EQ(theScreenManager.mLastRect.fTop, 200);
+
+	// A rate of 0 presents every blit.
+	theScreenManager.SetFrameRate(0);
+	theScreenManager.ResetDamageCounters();
+	TTestsFixture::BlitRect(&theScreenManager, 10, 10, 20, 20);
+	TTestsFixture::BlitRect(&theScreenManager, 30, 40, 35, 48);
+	EXPECT_EQ(theScreenManager.GetBlitCount(), 2u);
+	EXPECT_EQ(theScreenManager.GetPresentCount(), 2u);
+
+	theScreenManager.SetInterruptManager(nil);
+	delete theInterruptManager;
+}
+
+TEST(ScreenDamageTests, TimerPresentsWhileBlitting)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	theInterruptManager->ResumeTimer();
+
+	TScreenDamageTestsManager theScreenManager;
+	theScreenManager.SetMemory(&theMem);
+	theScreenManager.SetInterruptManager(theInterruptManager);
+	KUInt32 rowBytes = theScreenManager.GetScreenWidth() * TScreenManager::kBitsPerPixel / 8;
+	theFixture.WritePixmap(rowBytes);
+	theScreenManager.SetFrameRate(1000);
+
+	// The timer thread presents the end of the frames while we blit, and
+	// the front-end changes the rate from its own thread.
+	std::thread theFrontEnd([&theScreenManager]() {
+		for (int indexCall = 0; indexCall < 2000; indexCall++)
+		{
+			theScreenManager.SetFrameRate(1000);
+		}
+	});
+	for (int indexBlit = 0; indexBlit < 2000; indexBlit++)
+	{
+		TTestsFixture::BlitRect(&theScreenManager, 10, 10, 20, 20);
+		std::this_thread::yield();
+	}
+	theFrontEnd.join();
+	TTestsFixture::BlitRect(&theScreenManager, 30, 30, 40, 40);
+
+	// The last blit is presented without the emulator.
+	for (int indexWait = 0; indexWait < 1000; indexWait++)
+	{
+		if (theScreenManager.mLastRect.fBottom == 40)
+		{
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	EXPECT_EQ(theScreenManager.mLastRect.fBottom, 40);
+	EXPECT_EQ(theScreenManager.mOverlaps, 0);
+	EXPECT_LT(theScreenManager.GetPresentCount(), theScreenManager.GetBlitCount());
+
+	theInterruptManager->SuspendTimer();
+	theScreenManager.SetInterruptManager(nil);
+	delete theInterruptManager;
+}
@@ -0,0 +1,71 @@
+#include "Emulator/Log/TRAMLog.h"
+#include "Emulator/Screen/TNullScreenManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+
+TEST(ScreenHashTests, IncrementalHashMatchesFullHash)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TRAMLog theLog;
+	TNullScreenManager theScreenManager(&theLog);
+	TNullScreenManager theOtherScreenManager(&theLog);
+	theScreenManager.SetMemory(&theMem);
+	theOtherScreenManager.SetMemory(&theMem);
+
+	KUInt32 theWidth = theScreenManager.GetScreenWidth();
+	KUInt32 theHeight = theScreenManager.GetScreenHeight();
+	KUInt32 rowBytes = theWidth * TScreenManager::kBitsPerPixel / 8;
+	KUInt32 baseAddy = TTestsFixture::kPixmapBaseAddr;
+	theFixture.WritePixmap(rowBytes);
+	KUInt32 theSeed = 0xCAFEF00D;
+	for (KUInt32 offset = 0; offset < rowBytes * theHeight; offset += 4)
+	{
+		theSeed = theSeed * 1103515245 + 12345;
+		(void) theMem.WriteP(baseAddy + offset, theSeed);
+	}
+
+	// The same screen has the same hash, whichever way it was drawn.
+	KUInt64 theEmptyHash = theScreenManager.GetScreenHash();
+	TTestsFixture::BlitRect(&theScreenManager, 0, 0, theHeight, theWidth);
+	KUInt64 theFullHash = theScreenManager.GetScreenHash();
+	EXPECT_NE(theFullHash, theEmptyHash);
+	TTestsFixture::BlitRect(&theOtherScreenManager, 0, 0, theHeight / 2, theWidth);
+	EXPECT_NE(theOtherScreenManager.GetScreenHash(), theFullHash);
+	TTestsFixture::BlitRect(&theOtherScreenManager, theHeight / 2, 0, theHeight, theWidth);
+	EXPECT_EQ(theOtherScreenManager.GetScreenHash(), theFullHash);
+
+	// A single pixel changes the hash, wherever it is.
+	KUInt32 theOriginalWord;
+	Boolean theFault;
+	const KUInt32 kPixels[][2] = { { 0, 0 }, { 31, 31 }, { 32, 0 }, { 200, 301 },
+		{ theWidth - 1, theHeight - 1 } };
+	for (const KUInt32* thePixel : kPixels)
+	{
+		KUInt32 theX = thePixel[0];
+		KUInt32 theY = thePixel[1];
+		KUInt32 theAddy = baseAddy + (theY * rowBytes) + ((theX / 8) * 4);
+		theOriginalWord = theMem.ReadP(theAddy, theFault);
+		(void) theMem.WriteP(theAddy, theOriginalWord ^ (0x80000000 >> ((theX % 8) * 4)));
+		TTestsFixture::BlitRect(&theScreenManager,
+			(KUInt16) theY, (KUInt16) theX, (KUInt16) (theY + 1), (KUInt16) (theX + 1));
+		KUInt64 theChangedHash = theScreenManager.GetScreenHash();
+		EXPECT_NE(theChangedHash, theFullHash) << theX << "," << theY;
+
+		// Hashing everything again gives the same result.
+		theScreenManager.InvalidateScreenHash();
+		EXPECT_EQ(theScreenManager.GetScreenHash(), theChangedHash);
+
+		// And the original pixel gives the original hash.
+		(void) theMem.WriteP(theAddy, theOriginalWord);
+		TTestsFixture::BlitRect(&theScreenManager,
+			(KUInt16) theY, (KUInt16) theX, (KUInt16) (theY + 1), (KUInt16) (theX + 1));
+		EXPECT_EQ(theScreenManager.GetScreenHash(), theFullHash);
+	}
+
+	// The dimensions are part of the hash.
+	theScreenManager.SetScreenOrientation(TScreenManager::kOrientation_AppleRight);
+	EXPECT_NE(theScreenManager.GetScreenHash(), theFullHash);
+	theScreenManager.SetScreenOrientation(TScreenManager::kOrientation_AppleTop);
+	EXPECT_EQ(theScreenManager.GetScreenHash(), theFullHash);
+}
@@ -0,0 +1,359 @@
+#if !TARGET_OS_WIN32
+#include "Emulator/Log/TRAMLog.h"
+#include "Emulator/Screen/TRFBScreenManager.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+struct SScreenRFBTestsRect {
+	KUInt32 fLeft;
+	KUInt32 fTop;
+	KUInt32 fWidth;
+	KUInt32 fHeight;
+};
+
+static int
+ConnectScreenRFBTests(KUInt16 inPort)
+{
+	int theSocket = ::socket(AF_INET, SOCK_STREAM, 0);
+	struct timeval theTimeout = { 5, 0 };
+	(void) ::setsockopt(theSocket, SOL_SOCKET, SO_RCVTIMEO, &theTimeout, sizeof(theTimeout));
+	struct sockaddr_in theAddress;
+	(void) ::memset(&theAddress, 0, sizeof(theAddress));
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	theAddress.sin_port = htons(inPort);
+	if (::connect(theSocket, (struct sockaddr*) &theAddress, sizeof(theAddress)) < 0)
+	{
+		(void) ::close(theSocket);
+		return -1;
+	}
+	return theSocket;
+}
+
+static bool
+ReadScreenRFBTests(int inSocket, void* outBuffer, size_t inCount)
+{
+	KUInt8* theCursor = (KUInt8*) outBuffer;
+	while (inCount > 0)
+	{
+		ssize_t theResult = ::recv(inSocket, theCursor, inCount, 0);
+		if (theResult <= 0)
+		{
+			return false;
+		}
+		theCursor += theResult;
+		inCount -= (size_t) theResult;
+	}
+	return true;
+}
+
+static KUInt32
+ReadScreenRFBTestsValue(int inSocket, size_t inSize)
+{
+	KUInt8 theBytes[4] = { 0, 0, 0, 0 };
+	EXPECT_TRUE(ReadScreenRFBTests(inSocket, theBytes, inSize));
+	KUInt32 theValue = 0;
+	for (size_t indexByte = 0; indexByte < inSize; indexByte++)
+	{
+		theValue = (theValue << 8) | theBytes[indexByte];
+	}
+	return theValue;
+}
+
+static void
+WriteScreenRFBTests(int inSocket, const std::vector<KUInt8>& inBytes)
+{
+	EXPECT_EQ(::send(inSocket, inBytes.data(), inBytes.size(), 0), (ssize_t) inBytes.size());
+}
+
+// Pixels are little endian, as requested by the tests.
+static KUInt32
+ReadScreenRFBTestsPixel(int inSocket, KUInt32 inBytesPerPixel)
+{
+	KUInt8 theBytes[4] = { 0, 0, 0, 0 };
+	EXPECT_TRUE(ReadScreenRFBTests(inSocket, theBytes, inBytesPerPixel));
+	return theBytes[0] | (theBytes[1] << 8) | (theBytes[2] << 16) | ((KUInt32) theBytes[3] << 24);
+}
+
+static void
+FillScreenRFBTests(std::vector<KUInt32>* ioFrame, KUInt32 inFrameWidth,
+	KUInt32 inLeft, KUInt32 inTop, KUInt32 inWidth, KUInt32 inHeight, KUInt32 inPixel)
+{
+	for (KUInt32 indexY = inTop; indexY < inTop + inHeight; indexY++)
+	{
+		for (KUInt32 indexX = inLeft; indexX < inLeft + inWidth; indexX++)
+		{
+			(*ioFrame)[(indexY * inFrameWidth) + indexX] = inPixel;
+		}
+	}
+}
+
+// Read a framebuffer update, as a client would.
+static void
+ReadScreenRFBTestsUpdate(int inSocket, KUInt32 inBytesPerPixel,
+	std::vector<KUInt32>* ioFrame, KUInt32 inFrameWidth,
+	std::vector<SScreenRFBTestsRect>* outRects)
+{
+	ASSERT_EQ(ReadScreenRFBTestsValue(inSocket, 1), 0u);
+	(void) ReadScreenRFBTestsValue(inSocket, 1);
+	KUInt32 theRectCount = ReadScreenRFBTestsValue(inSocket, 2);
+	for (KUInt32 indexRect = 0; indexRect < theRectCount; indexRect++)
+	{
+		SScreenRFBTestsRect theRect;
+		theRect.fLeft = ReadScreenRFBTestsValue(inSocket, 2);
+		theRect.fTop = ReadScreenRFBTestsValue(inSocket, 2);
+		theRect.fWidth = ReadScreenRFBTestsValue(inSocket, 2);
+		theRect.fHeight = ReadScreenRFBTestsValue(inSocket, 2);
+		KSInt32 theEncoding = (KSInt32) ReadScreenRFBTestsValue(inSocket, 4);
+		outRects->push_back(theRect);
+		ASSERT_LE(theRect.fLeft + theRect.fWidth, inFrameWidth);
+		ASSERT_LE(((theRect.fTop + theRect.fHeight) * inFrameWidth), ioFrame->size());
+		if (theEncoding == TRFBScreenManager::kRawEncoding)
+		{
+			for (KUInt32 indexY = 0; indexY < theRect.fHeight; indexY++)
+			{
+				for (KUInt32 indexX = 0; indexX < theRect.fWidth; indexX++)
+				{
+					(*ioFrame)[((theRect.fTop + indexY) * inFrameWidth) + theRect.fLeft + indexX]
+						= ReadScreenRFBTestsPixel(inSocket, inBytesPerPixel);
+				}
+			}
+			continue;
+		}
+		ASSERT_EQ(theEncoding, TRFBScreenManager::kHextileEncoding);
+		KUInt32 theBackground = 0;
+		KUInt32 theForeground = 0;
+		for (KUInt32 theTop = theRect.fTop; theTop < theRect.fTop + theRect.fHeight; theTop += 16)
+		{
+			for (KUInt32 theLeft = theRect.fLeft; theLeft < theRect.fLeft + theRect.fWidth; theLeft += 16)
+			{
+				KUInt32 theWidth = std::min<KUInt32>(16, theRect.fLeft + theRect.fWidth - theLeft);
+				KUInt32 theHeight = std::min<KUInt32>(16, theRect.fTop + theRect.fHeight - theTop);
+				KUInt32 theSubencoding = ReadScreenRFBTestsValue(inSocket, 1);
+				if (theSubencoding & 1)
+				{
+					for (KUInt32 indexY = 0; indexY < theHeight; indexY++)
+					{
+						for (KUInt32 indexX = 0; indexX < theWidth; indexX++)
+						{
+							(*ioFrame)[((theTop + indexY) * inFrameWidth) + theLeft + indexX]
+								= ReadScreenRFBTestsPixel(inSocket, inBytesPerPixel);
+						}
+					}
+					continue;
+				}
+				if (theSubencoding & 2)
+				{
+					theBackground = ReadScreenRFBTestsPixel(inSocket, inBytesPerPixel);
+				}
+				FillScreenRFBTests(ioFrame, inFrameWidth, theLeft, theTop, theWidth, theHeight, theBackground);
+				if (theSubencoding & 4)
+				{
+					theForeground = ReadScreenRFBTestsPixel(inSocket, inBytesPerPixel);
+				}
+				if (theSubencoding & 8)
+				{
+					KUInt32 theSubrectCount = ReadScreenRFBTestsValue(inSocket, 1);
+					for (KUInt32 indexSubrect = 0; indexSubrect < theSubrectCount; indexSubrect++)
+					{
+						KUInt32 thePixel = theForeground;
+						if (theSubencoding & 16)
+						{
+							thePixel = ReadScreenRFBTestsPixel(inSocket, inBytesPerPixel);
+						}
+						KUInt32 theXY = ReadScreenRFBTestsValue(inSocket, 1);
+						KUInt32 theWH = ReadScreenRFBTestsValue(inSocket, 1);
+						ASSERT_LE((theXY >> 4) + (theWH >> 4) + 1, theWidth);
+						ASSERT_LE((theXY & 15) + (theWH & 15) + 1, theHeight);
+						FillScreenRFBTests(ioFrame, inFrameWidth,
+							theLeft + (theXY >> 4), theTop + (theXY & 15),
+							(theWH >> 4) + 1, (theWH & 15) + 1, thePixel);
+					}
+				}
+			}
+		}
+	}
+}
+
+static void
+RequestScreenRFBTestsUpdate(int inSocket, KUInt8 inIncremental, KUInt32 inWidth, KUInt32 inHeight)
+{
+	std::vector<KUInt8> theRequest = { 3, inIncremental, 0, 0, 0, 0,
+		(KUInt8) (inWidth >> 8), (KUInt8) inWidth, (KUInt8) (inHeight >> 8), (KUInt8) inHeight };
+	WriteScreenRFBTests(inSocket, theRequest);
+}
+
+// The levels of the screen buffer, in the 32 bits format of the tests.
+static std::vector<KUInt32>
+GetScreenRFBTestsScreen(TScreenManager* inScreenManager, Boolean inTrueColor)
+{
+	KUInt32 theWidth = inScreenManager->GetScreenWidth();
+	KUInt32 theHeight = inScreenManager->GetScreenHeight();
+	const KUInt8* theScreen = inScreenManager->GetScreenBuffer();
+	std::vector<KUInt32> theFrame;
+	for (KUInt32 indexPixel = 0; indexPixel < theWidth * theHeight; indexPixel++)
+	{
+		KUInt8 theByte = theScreen[indexPixel / 2];
+		KUInt32 theLevel = (indexPixel & 1) ? (theByte & 0x0F) : (theByte >> 4);
+		theFrame.push_back(inTrueColor ? (theLevel * 0x111111) : theLevel);
+	}
+	return theFrame;
+}
+
+TEST(ScreenRFBTests, TranslateKeysym)
+{
+	EXPECT_EQ(TRFBScreenManager::TranslateKeysym('a'), 0);
+	EXPECT_EQ(TRFBScreenManager::TranslateKeysym('A'), 0);
+	EXPECT_EQ(TRFBScreenManager::TranslateKeysym(' '), 49);
+	EXPECT_EQ(TRFBScreenManager::TranslateKeysym('~'), 50);
+	EXPECT_EQ(TRFBScreenManager::TranslateKeysym(0xFF0D), 36);
+	EXPECT_EQ(TRFBScreenManager::TranslateKeysym(0xFFFF), 0x75);
+	EXPECT_EQ(TRFBScreenManager::TranslateKeysym(0x1234), 0xFF);
+}
+
+TEST(ScreenRFBTests, LoopbackClient)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	TRAMLog theLog;
+
+	TRFBScreenManager* theScreenManager = new TRFBScreenManager(&theLog, 0);
+	ASSERT_TRUE(theScreenManager->IsListening());
+	theScreenManager->SetMemory(&theMem);
+	theScreenManager->SetInterruptManager(theInterruptManager);
+	theScreenManager->SetFrameRate(0);
+	KUInt32 theWidth = theScreenManager->GetScreenWidth();
+	KUInt32 theHeight = theScreenManager->GetScreenHeight();
+	KUInt32 baseAddy = TTestsFixture::kPixmapBaseAddr;
+	KUInt32 rowBytes = theWidth * TScreenManager::kBitsPerPixel / 8;
+	theFixture.WritePixmap(rowBytes);
+	KUInt32 theSeed = 0x2468ACE0;
+	for (KUInt32 offset = 0; offset < rowBytes * theHeight; offset += 4)
+	{
+		// White, some text-like lines and a noisy area.
+		theSeed = theSeed * 1103515245 + 12345;
+		KUInt32 theWord = 0;
+		if ((offset / rowBytes) % 12 == 3)
+		{
+			theWord = (theSeed & 0x100) ? 0xFF00FF00 : 0x0FF000FF;
+		} else if ((offset / rowBytes) > 400)
+		{
+			theWord = theSeed;
+		}
+		(void) theMem.WriteP(baseAddy + offset, theWord);
+	}
+	TTestsFixture::BlitRect(theScreenManager, 0, 0, theHeight, theWidth);
+
+	// Handshake.
+	int theSocket = ConnectScreenRFBTests(theScreenManager->GetPort());
+	ASSERT_GE(theSocket, 0);
+	char theVersion[13] = { 0 };
+	ASSERT_TRUE(ReadScreenRFBTests(theSocket, theVersion, 12));
+	EXPECT_STREQ(theVersion, "RFB 003.008\n");
+	WriteScreenRFBTests(theSocket, std::vector<KUInt8>(theVersion, theVersion + 12));
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 1), 1u);
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 1), 1u);
+	WriteScreenRFBTests(theSocket, { 1 });
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 4), 0u);
+	WriteScreenRFBTests(theSocket, { 1 });
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), theWidth);
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), theHeight);
+	KUInt8 theFormat[16];
+	ASSERT_TRUE(ReadScreenRFBTests(theSocket, theFormat, 16));
+	EXPECT_EQ(theFormat[0], 8);
+	EXPECT_EQ(theFormat[3], 0); // color map
+	KUInt32 theNameLength = ReadScreenRFBTestsValue(theSocket, 4);
+	std::vector<KUInt8> theName(theNameLength);
+	ASSERT_TRUE(ReadScreenRFBTests(theSocket, theName.data(), theNameLength));
+
+	// 32 bits little endian xRGB, Hextile and DesktopSize.
+	WriteScreenRFBTests(theSocket, { 0, 0, 0, 0, 32, 24, 0, 1, 0, 255, 0, 255, 0, 255, 16, 8, 0, 0, 0, 0 });
+	WriteScreenRFBTests(theSocket, { 2, 0, 0, 2, 0, 0, 0, 5, 0xFF, 0xFF, 0xFF, 0x21 });
+	std::vector<KUInt32> theFrame(theWidth * theHeight, 0xDEADBEEF);
+	std::vector<SScreenRFBTestsRect> theRects;
+	RequestScreenRFBTestsUpdate(theSocket, 0, theWidth, theHeight);
+	ReadScreenRFBTestsUpdate(theSocket, 4, &theFrame, theWidth, &theRects);
+	EXPECT_TRUE(theFrame == GetScreenRFBTestsScreen(theScreenManager, true));
+
+	// Only the tiles of the damaged rectangle are sent.
+	RequestScreenRFBTestsUpdate(theSocket, 1, theWidth, theHeight);
+	for (KUInt32 offset = 0; offset < 0x1000; offset += 4)
+	{
+		(void) theMem.WriteP(baseAddy + offset, offset * 0x01010101);
+	}
+	TTestsFixture::BlitRect(theScreenManager, 20, 40, 30, 50);
+	theRects.clear();
+	ReadScreenRFBTestsUpdate(theSocket, 4, &theFrame, theWidth, &theRects);
+	EXPECT_TRUE(theFrame == GetScreenRFBTestsScreen(theScreenManager, true));
+	KUInt32 theArea = 0;
+	for (const SScreenRFBTestsRect& theRect : theRects)
+	{
+		EXPECT_GE(theRect.fLeft, 32u);
+		EXPECT_GE(theRect.fTop, 16u);
+		EXPECT_LE(theRect.fLeft + theRect.fWidth, 64u);
+		EXPECT_LE(theRect.fTop + theRect.fHeight, 32u);
+		theArea += theRect.fWidth * theRect.fHeight;
+	}
+	EXPECT_EQ(theArea, 32u * 16u);
+
+	// The pointer drives the pen.
+	WriteScreenRFBTests(theSocket, { 5, 1, 0, 10, 0, 20 });
+	WriteScreenRFBTests(theSocket, { 5, 0, 0, 10, 0, 20 });
+	std::vector<KUInt32> theSamples;
+	for (int indexPoll = 0; (indexPoll < 500) && (theSamples.size() < 3); indexPoll++)
+	{
+		KUInt32 theSample;
+		KUInt32 theTime;
+		while (theScreenManager->GetSample(&theSample, &theTime))
+		{
+			theSamples.push_back(theSample);
+		}
+		(void) ::usleep(10000);
+	}
+	ASSERT_EQ(theSamples.size(), 3u);
+	EXPECT_EQ((theSamples[1] >> 21) & 0x7FF, 10u);
+	EXPECT_EQ((theSamples[1] >> 7) & 0x7FF, 20u);
+	(void) ::close(theSocket);
+
+	// A 3.3 client with the default format and the Raw encoding.
+	theSocket = ConnectScreenRFBTests(theScreenManager->GetPort());
+	ASSERT_GE(theSocket, 0);
+	ASSERT_TRUE(ReadScreenRFBTests(theSocket, theVersion, 12));
+	WriteScreenRFBTests(theSocket, std::vector<KUInt8>({ 'R', 'F', 'B', ' ', '0', '0', '3', '.', '0', '0', '3', '\n' }));
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 4), 1u);
+	WriteScreenRFBTests(theSocket, { 0 });
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), theWidth);
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), theHeight);
+	ASSERT_TRUE(ReadScreenRFBTests(theSocket, theFormat, 16));
+	theNameLength = ReadScreenRFBTestsValue(theSocket, 4);
+	ASSERT_TRUE(ReadScreenRFBTests(theSocket, theName.data(), theNameLength));
+	RequestScreenRFBTestsUpdate(theSocket, 0, theWidth, theHeight);
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 1), 1u);
+	(void) ReadScreenRFBTestsValue(theSocket, 1);
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), 0u);
+	EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), 16u);
+	for (KUInt32 indexColor = 0; indexColor < 16; indexColor++)
+	{
+		EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), indexColor * 0x1111);
+		EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), indexColor * 0x1111);
+		EXPECT_EQ(ReadScreenRFBTestsValue(theSocket, 2), indexColor * 0x1111);
+	}
+	std::fill(theFrame.begin(), theFrame.end(), 0xDEADBEEF);
+	ReadScreenRFBTestsUpdate(theSocket, 1, &theFrame, theWidth, &theRects);
+	EXPECT_TRUE(theFrame == GetScreenRFBTestsScreen(theScreenManager, false));
+	(void) ::close(theSocket);
+
+	delete theScreenManager;
+	delete theInterruptManager;
+}
+#endif
@@ -0,0 +1,241 @@
+#include "Emulator/Log/TRAMLog.h"
+#include "Emulator/Screen/TNullScreenManager.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+
+static KUInt8
+GetScreenRotationTestsPixel(const KUInt8* inBuffer, KUInt32 inWidth, KUInt32 inX, KUInt32 inY)
+{
+	KUInt8 theByte = inBuffer[(inY * inWidth + inX) / 2];
+	return (inX & 1) ? (theByte & 0x0F) : (theByte >> 4);
+}
+
+static void
+FillScreenRotationTestsPixmap(TMemory* inMemory, KUInt32 inBaseAddy, KUInt32 inBytes, KUInt32 inSeed)
+{
+	for (KUInt32 offset = 0; offset < inBytes; offset += 4)
+	{
+		inSeed = inSeed * 1103515245 + 12345;
+		(void) inMemory->WriteP(inBaseAddy + offset, inSeed);
+	}
+}
+
+static void
+CheckScreenRotation(Boolean inLandscapePanel)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	// The null screen manager logs orientation changes.
+	TRAMLog theLog;
+	KUInt32 baseAddy = TTestsFixture::kPixmapBaseAddr;
+
+	for (KUInt32 theOrientation = 0; theOrientation < 4; theOrientation++)
+	{
+		// The reference is Blit_0 to a window of the Newton screen size.
+		TNullScreenManager theReference(&theLog);
+		TNullScreenManager theFullScreen(&theLog,
+			TScreenManager::kDefaultPortraitWidth,
+			TScreenManager::kDefaultPortraitHeight,
+			true, inLandscapePanel);
+		theReference.SetMemory(&theMem);
+		theFullScreen.SetMemory(&theMem);
+		theReference.SetScreenOrientation((TScreenManager::EOrientation) theOrientation);
+		theFullScreen.SetScreenOrientation((TScreenManager::EOrientation) theOrientation);
+
+		KUInt32 theWidth = theReference.GetScreenWidth();
+		KUInt32 theHeight = theReference.GetScreenHeight();
+		KUInt32 rowBytes = theWidth * TScreenManager::kBitsPerPixel / 8;
+		theFixture.WritePixmap(rowBytes);
+
+		// Whole screen, then unaligned, narrow and single pixel rectangles,
+		// copied (mode 0) or combined (mode 1).
+		const KUInt16 kRects[][5] = {
+			{ 0, 0, (KUInt16) theHeight, (KUInt16) theWidth, 0 },
+			{ 7, 13, 133, 201, 0 },
+			{ 29, 3, 211, 158, 1 },
+			{ 40, 17, 47, 21, 0 },
+			{ 1, 100, 300, 107, 1 },
+			{ 5, 5, 6, 6, 0 },
+			{ (KUInt16) (theHeight - 9), (KUInt16) (theWidth - 11),
+				(KUInt16) theHeight, (KUInt16) theWidth, 0 }
+		};
+		KUInt32 theSeed = 0x1234 + theOrientation;
+		for (const KUInt16* theValues : kRects)
+		{
+			FillScreenRotationTestsPixmap(&theMem, baseAddy, rowBytes * theHeight, theSeed++);
+			TScreenManager::SRect theRect;
+			theRect.fTop = theValues[0];
+			theRect.fLeft = theValues[1];
+			theRect.fBottom = theValues[2];
+			theRect.fRight = theValues[3];
+			theReference.Blit(TTestsFixture::kPixmapAddr, &theRect, &theRect, theValues[4]);
+			theFullScreen.Blit(TTestsFixture::kPixmapAddr, &theRect, &theRect, theValues[4]);
+		}
+
+		// Compare with a reference rotation of the Blit_0 output.
+		KUInt32 thePhysicalWidth = theFullScreen.GetActualScreenWidth();
+		KUInt32 thePhysicalHeight = theFullScreen.GetActualScreenHeight();
+		KUInt32 theUpright = inLandscapePanel
+			? TScreenManager::kOrientation_AppleRight
+			: TScreenManager::kOrientation_AppleBottom;
+		KUInt32 theQuarterTurns = (theOrientation - theUpright) & 0x03;
+		if (theQuarterTurns & 1)
+		{
+			ASSERT_EQ(thePhysicalWidth, theHeight);
+			ASSERT_EQ(thePhysicalHeight, theWidth);
+		} else
+		{
+			ASSERT_EQ(thePhysicalWidth, theWidth);
+			ASSERT_EQ(thePhysicalHeight, theHeight);
+		}
+		KUInt32 theErrors = 0;
+		for (KUInt32 indexY = 0; indexY < theHeight; indexY++)
+		{
+			for (KUInt32 indexX = 0; indexX < theWidth; indexX++)
+			{
+				KUInt32 thePhysicalX = indexX;
+				KUInt32 thePhysicalY = indexY;
+				switch (theQuarterTurns)
+				{
+					case 1:
+						thePhysicalX = theHeight - 1 - indexY;
+						thePhysicalY = indexX;
+						break;
+					case 2:
+						thePhysicalX = theWidth - 1 - indexX;
+						thePhysicalY = theHeight - 1 - indexY;
+						break;
+					case 3:
+						thePhysicalX = indexY;
+						thePhysicalY = theWidth - 1 - indexX;
+						break;
+				}
+				KUInt8 theExpected = GetScreenRotationTestsPixel(
+					theReference.GetScreenBuffer(), theWidth, indexX, indexY);
+				KUInt8 theActual = GetScreenRotationTestsPixel(
+					theFullScreen.GetScreenBuffer(), thePhysicalWidth,
+					thePhysicalX, thePhysicalY);
+				if (theExpected != theActual)
+				{
+					theErrors++;
+				}
+			}
+		}
+		EXPECT_EQ(theErrors, 0u) << "orientation " << theOrientation;
+	}
+}
+
+TEST(ScreenRotationTests, LandscapePanel)
+{
+	CheckScreenRotation(true);
+}
+
+TEST(ScreenRotationTests, PortraitPanel)
+{
+	CheckScreenRotation(false);
+}
+
+static void
+CheckScreenRotationTap(Boolean inLandscapePanel)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	TRAMLog theLog;
+	KUInt32 baseAddy = TTestsFixture::kPixmapBaseAddr;
+
+	for (KUInt32 theOrientation = 0; theOrientation < 4; theOrientation++)
+	{
+		TNullScreenManager theFullScreen(&theLog,
+			TScreenManager::kDefaultPortraitWidth,
+			TScreenManager::kDefaultPortraitHeight,
+			true, inLandscapePanel);
+		theFullScreen.SetMemory(&theMem);
+		theFullScreen.SetInterruptManager(theInterruptManager);
+		theFullScreen.SetScreenOrientation((TScreenManager::EOrientation) theOrientation);
+
+		KUInt32 theWidth = theFullScreen.GetScreenWidth();
+		KUInt32 theHeight = theFullScreen.GetScreenHeight();
+		KUInt32 rowBytes = theWidth * TScreenManager::kBitsPerPixel / 8;
+		theFixture.WritePixmap(rowBytes);
+
+		// Corners and unaligned points of the Newton screen.
+		const KUInt32 kPoints[][2] = {
+			{ 0, 0 },
+			{ theWidth - 1, 0 },
+			{ 0, theHeight - 1 },
+			{ theWidth - 1, theHeight - 1 },
+			{ 13, 101 },
+			{ 150, 7 }
+		};
+		for (const KUInt32* thePoint : kPoints)
+		{
+			// Blit a single black pixel.
+			for (KUInt32 offset = 0; offset < rowBytes * theHeight; offset += 4)
+			{
+				(void) theMem.WriteP(baseAddy + offset, 0);
+			}
+			(void) theMem.WriteP(
+				baseAddy + (thePoint[1] * rowBytes) + ((thePoint[0] / 8) * 4),
+				0xF0000000 >> ((thePoint[0] & 0x07) * 4));
+			TScreenManager::SRect theRect;
+			theRect.fTop = 0;
+			theRect.fLeft = 0;
+			theRect.fBottom = (KUInt16) theHeight;
+			theRect.fRight = (KUInt16) theWidth;
+			theFullScreen.Blit(TTestsFixture::kPixmapAddr, &theRect, &theRect, 0 /* srcCopy */);
+
+			// Find it on the physical screen, where black is 0.
+			KUInt32 thePhysicalWidth = theFullScreen.GetActualScreenWidth();
+			KUInt32 thePhysicalHeight = theFullScreen.GetActualScreenHeight();
+			KUInt32 theFound = 0;
+			KUInt32 thePhysicalX = 0;
+			KUInt32 thePhysicalY = 0;
+			for (KUInt32 indexY = 0; indexY < thePhysicalHeight; indexY++)
+			{
+				for (KUInt32 indexX = 0; indexX < thePhysicalWidth; indexX++)
+				{
+					if (GetScreenRotationTestsPixel(
+							theFullScreen.GetScreenBuffer(), thePhysicalWidth,
+							indexX, indexY)
+						== 0)
+					{
+						theFound++;
+						thePhysicalX = indexX;
+						thePhysicalY = indexY;
+					}
+				}
+			}
+			ASSERT_EQ(theFound, 1u) << "orientation " << theOrientation;
+
+			// A tap there is at the same Newton coordinates.
+			theFullScreen.PenDown((KUInt16) thePhysicalX, (KUInt16) thePhysicalY);
+			theFullScreen.PenUp();
+			KUInt32 theSample;
+			KUInt32 theTime;
+			ASSERT_TRUE(theFullScreen.GetSample(&theSample, &theTime));
+			ASSERT_TRUE(theFullScreen.GetSample(&theSample, &theTime));
+			EXPECT_EQ((theSample >> 21) & 0x7FF, thePoint[0])
+				<< "orientation " << theOrientation;
+			EXPECT_EQ((theSample >> 7) & 0x7FF, thePoint[1])
+				<< "orientation " << theOrientation;
+			ASSERT_TRUE(theFullScreen.GetSample(&theSample, &theTime));
+			EXPECT_FALSE(theFullScreen.GetSample(&theSample, &theTime));
+		}
+	}
+
+	delete theInterruptManager;
+}
+
+TEST(ScreenRotationTests, TapOnLandscapePanel)
+{
+	CheckScreenRotationTap(true);
+}
+
+TEST(ScreenRotationTests, TapOnPortraitPanel)
+{
+	CheckScreenRotationTap(false);
+}
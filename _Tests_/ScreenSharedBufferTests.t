@@ -0,0 +1,138 @@
+#if !TARGET_OS_WIN32
+#include "Emulator/Log/TRAMLog.h"
+#include "Emulator/Screen/TNullScreenManager.h"
+#include "Emulator/Screen/TSharedScreenBuffer.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <thread>
+
+// Map the region as an external viewer would.
+static const TSharedScreenBuffer::SHeader*
+MapScreenSharedBufferTests(const char* inName, size_t* outSize)
+{
+	int theFD = ::shm_open(inName, O_RDONLY, 0);
+	if (theFD < 0)
+	{
+		return nil;
+	}
+	TSharedScreenBuffer::SHeader theHeader;
+	if (::read(theFD, &theHeader, sizeof(theHeader)) != (ssize_t) sizeof(theHeader))
+	{
+		(void) ::close(theFD);
+		return nil;
+	}
+	*outSize = theHeader.fHeaderSize + theHeader.fBufferSize;
+	void* theMapping = ::mmap(nil, *outSize, PROT_READ, MAP_SHARED, theFD, 0);
+	(void) ::close(theFD);
+	if (theMapping == MAP_FAILED)
+	{
+		return nil;
+	}
+	return (const TSharedScreenBuffer::SHeader*) theMapping;
+}
+
+TEST(ScreenSharedBufferTests, ExportedBuffer)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TRAMLog theLog;
+	TNullScreenManager* theScreenManager = new TNullScreenManager(&theLog);
+	theScreenManager->SetMemory(&theMem);
+	KUInt32 theWidth = theScreenManager->GetScreenWidth();
+	KUInt32 theHeight = theScreenManager->GetScreenHeight();
+	KUInt32 rowBytes = theWidth * TScreenManager::kBitsPerPixel / 8;
+	KUInt32 baseAddy = TTestsFixture::kPixmapBaseAddr;
+	theFixture.WritePixmap(rowBytes);
+	for (KUInt32 offset = 0; offset < rowBytes * theHeight; offset += 4)
+	{
+		(void) theMem.WriteP(baseAddy + offset, offset * 0x01010101);
+	}
+	TTestsFixture::BlitRect(theScreenManager, 0, 0, 100, theWidth);
+
+	// The pixels blitted so far are moved to the region.
+	char theName[64];
+	(void) ::snprintf(theName, sizeof(theName), "/EinsteinTests-%d", (int) ::getpid());
+	ASSERT_TRUE(theScreenManager->ExportScreenBuffer(theName));
+	EXPECT_FALSE(theScreenManager->ExportScreenBuffer(theName));
+	size_t theSize;
+	const TSharedScreenBuffer::SHeader* theHeader = MapScreenSharedBufferTests(theName, &theSize);
+	ASSERT_NE(theHeader, nullptr);
+	const KUInt8* thePixels = ((const KUInt8*) theHeader) + theHeader->fHeaderSize;
+	EXPECT_EQ(theHeader->fSignature, (KUInt32) TSharedScreenBuffer::kSignature);
+	EXPECT_EQ(theHeader->fBufferSize, rowBytes * theHeight);
+	EXPECT_EQ(theHeader->fWidth, theWidth);
+	EXPECT_EQ(theHeader->fHeight, theHeight);
+	EXPECT_EQ(theHeader->fRowBytes, rowBytes);
+	EXPECT_EQ(theHeader->fSequence & 1, 0u);
+	EXPECT_EQ(0, ::memcmp(thePixels, theScreenManager->GetScreenBuffer(), rowBytes * theHeight));
+
+	// Each present bumps the sequence and publishes the dirty rectangle.
+	KUInt32 theSequence = theHeader->fSequence;
+	TTestsFixture::BlitRect(theScreenManager, 200, 10, 220, 90);
+	EXPECT_EQ(theHeader->fSequence, theSequence + 2);
+	EXPECT_EQ(theHeader->fDirtyTop, 200u);
+	EXPECT_LE(theHeader->fDirtyLeft, 10u);
+	EXPECT_EQ(theHeader->fDirtyBottom, 220u);
+	EXPECT_GE(theHeader->fDirtyRight, 90u);
+	EXPECT_EQ(0, ::memcmp(thePixels, theScreenManager->GetScreenBuffer(), rowBytes * theHeight));
+	EXPECT_NE(thePixels[(210 * rowBytes) + 20], 0);
+
+	// Rotation publishes the new geometry.
+	theSequence = theHeader->fSequence;
+	theScreenManager->SetScreenOrientation(TScreenManager::kOrientation_AppleRight);
+	EXPECT_EQ(theHeader->fSequence, theSequence + 2);
+	EXPECT_EQ(theHeader->fWidth, theHeight);
+	EXPECT_EQ(theHeader->fHeight, theWidth);
+	EXPECT_EQ(theHeader->fOrientation, (KUInt32) TScreenManager::kOrientation_AppleRight);
+	EXPECT_EQ(theHeader->fDirtyBottom, theWidth);
+	EXPECT_EQ(theHeader->fDirtyRight, theHeight);
+
+	// So does a new size, with a new buffer.
+	theSequence = theHeader->fSequence;
+	theScreenManager->ChangeScreenSize(480, 640);
+	EXPECT_EQ(theHeader->fSequence & 1, 0u);
+	EXPECT_GT(theHeader->fSequence, theSequence);
+	EXPECT_EQ(theHeader->fBufferSize, 480u * 640u / 2);
+	(void) ::munmap((void*) theHeader, theSize);
+	theHeader = MapScreenSharedBufferTests(theName, &theSize);
+	ASSERT_NE(theHeader, nullptr);
+	EXPECT_EQ(theHeader->fRowBytes * theHeader->fHeight, 480u * 640u / 2);
+
+	// A smaller size keeps the region: the old mapping can still be read.
+	theScreenManager->ChangeScreenSize(320, 480);
+	EXPECT_EQ(theHeader->fSequence & 1, 0u);
+	EXPECT_EQ(theHeader->fBufferSize, 320u * 480u / 2);
+	EXPECT_EQ(((const volatile KUInt8*) theHeader)[theSize - 1], 0);
+	(void) ::munmap((void*) theHeader, theSize);
+
+	// The region is removed with the screen manager.
+	delete theScreenManager;
+	EXPECT_EQ(MapScreenSharedBufferTests(theName, &theSize), nullptr);
+}
+
+TEST(ScreenSharedBufferTests, ConcurrentPublish)
+{
+	char theName[64];
+	(void) ::snprintf(theName, sizeof(theName), "/EinsteinTests-%d", (int) ::getpid());
+	TSharedScreenBuffer theBuffer(theName);
+	ASSERT_NE(theBuffer.Resize(320 * 480 / 2), nullptr);
+	theBuffer.Publish(320, 480, 0, 0, 0, 480, 320);
+	KUInt32 theSequence = theBuffer.GetHeader()->fSequence;
+
+	// Two threads present, as the emulator and the front-end setting the
+	// frame rate: no bump of the sequence is lost.
+	auto thePresent = [&theBuffer]() {
+		for (KUInt32 indexPresent = 0; indexPresent < 10000; indexPresent++)
+		{
+			theBuffer.Publish(320, 480, 0, 0, 0, 480, 320);
+		}
+	};
+	std::thread theOther(thePresent);
+	thePresent();
+	theOther.join();
+	EXPECT_EQ(theBuffer.GetHeader()->fSequence, theSequence + 40000);
+}
+#endif
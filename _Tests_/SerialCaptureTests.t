@@ -0,0 +1,116 @@
+#include "Emulator/Serial/TMNPFrameDecoder.h"
+#include "Emulator/Serial/TSerialCapture.h"
+#include "Emulator/Serial/TSerialCaptureReader.h"
+#include "Emulator/TInterruptManager.h"
+#include <string.h>
+#include <vector>
+#if TARGET_OS_WIN32
+#define kSerialCaptureTestsPath "c:/EinsteinSerialCaptureTests.capture"
+#else
+#define kSerialCaptureTestsPath "/tmp/EinsteinSerialCaptureTests.capture"
+#endif
+
+TEST(SerialCaptureTests, RecordsRoundTrip)
+{
+	KUInt8 theData[20];
+	for (KUInt32 indexByte = 0; indexByte < sizeof(theData); indexByte++)
+	{
+		theData[indexByte] = (KUInt8) (indexByte * 7);
+	}
+
+	// The timer wraps around between the records.
+	TSerialCapture* theCapture = new TSerialCapture(kSerialCaptureTestsPath);
+	ASSERT_TRUE(theCapture->IsOpen());
+	theCapture->AddData(0xFFFFFFF0, TSerialCapture::kTxRecord, 2, theData, sizeof(theData));
+	theCapture->AddEvent(0x10, TSerialCapture::kInterruptRecord, 2, 0x100, 0x80);
+	EXPECT_EQ(0u, theCapture->GetDroppedCount());
+	delete theCapture;
+
+	TSerialCaptureReader theReader(kSerialCaptureTestsPath);
+	ASSERT_TRUE(theReader.IsOpen());
+	EXPECT_EQ((KUInt32) TInterruptManager::kTicksPerSecond, theReader.GetTicksPerSecond());
+
+	TSerialCapture::SRecord theRecord;
+	ASSERT_TRUE(theReader.ReadRecord(&theRecord));
+	EXPECT_EQ(TSerialCapture::kTxRecord, theRecord.fType);
+	EXPECT_EQ(2, theRecord.fPort);
+	EXPECT_EQ(16, theRecord.fCount);
+	EXPECT_EQ(0, ::memcmp(theData, theRecord.fData, 16));
+	EXPECT_EQ(0u, theReader.GetTime());
+
+	ASSERT_TRUE(theReader.ReadRecord(&theRecord));
+	EXPECT_EQ(TSerialCapture::kTxRecord, theRecord.fType);
+	EXPECT_EQ(4, theRecord.fCount);
+	EXPECT_EQ(0, ::memcmp(theData + 16, theRecord.fData, 4));
+
+	ASSERT_TRUE(theReader.ReadRecord(&theRecord));
+	EXPECT_EQ(TSerialCapture::kInterruptRecord, theRecord.fType);
+	EXPECT_EQ(0x100u, theRecord.fArg[0]);
+	EXPECT_EQ(0x80u, theRecord.fArg[1]);
+	EXPECT_EQ(0x20u, theReader.GetTime());
+
+	EXPECT_FALSE(theReader.ReadRecord(&theRecord));
+	(void) ::remove(kSerialCaptureTestsPath);
+}
+
+TEST(SerialCaptureTests, DecodeMNPFrames)
+{
+	const KUInt8 theCheck[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+	EXPECT_EQ(0xBB3D, TMNPFrameDecoder::ComputeCRC(theCheck, sizeof(theCheck)));
+
+	// An LT frame with a Dock command, and a DLE in the data.
+	std::vector<KUInt8> theFrame = { 2, TMNPFrameDecoder::kLTFrame, 7 };
+	const char* theCommand = "newtdockdres";
+	theFrame.insert(theFrame.end(), theCommand, theCommand + 12);
+	theFrame.insert(theFrame.end(), { 0, 0, 0, 4, 0x10, 0x16, 0x03, 0x10 });
+	const KUInt8 theETX = 0x03;
+	KUInt16 theCRC = TMNPFrameDecoder::ComputeCRC(theFrame.data(), (KUInt32) theFrame.size());
+	theCRC = TMNPFrameDecoder::ComputeCRC(&theETX, 1, theCRC);
+
+	std::vector<KUInt8> theStream = { 'A', 'T', 0x16, 0x10, 0x02 };
+	for (KUInt8 theByte : theFrame)
+	{
+		theStream.push_back(theByte);
+		if (theByte == 0x10)
+		{
+			theStream.push_back(theByte);
+		}
+	}
+	theStream.insert(theStream.end(),
+		{ 0x10, 0x03, (KUInt8) (theCRC & 0xFF), (KUInt8) (theCRC >> 8) });
+
+	TMNPFrameDecoder theDecoder;
+	KUInt32 theFrames = 0;
+	for (KUInt8 theByte : theStream)
+	{
+		if (theDecoder.AddByte(theByte))
+		{
+			theFrames++;
+		}
+	}
+	ASSERT_EQ(1u, theFrames);
+	EXPECT_TRUE(theDecoder.IsCRCValid());
+	EXPECT_EQ(2u, theDecoder.GetDiscardedCount());
+	ASSERT_EQ(theFrame.size(), theDecoder.GetFrameSize());
+	EXPECT_EQ(0, ::memcmp(theFrame.data(), theDecoder.GetFrame(), theFrame.size()));
+
+	char theText[128];
+	theDecoder.Describe(theText, sizeof(theText));
+	EXPECT_STREQ("LT seq 7, 20 bytes, newtdock 'dres' 4 bytes", theText);
+
+	// A corrupted acknowledge.
+	const KUInt8 theAck[] = { 0x16, 0x10, 0x02, 3, TMNPFrameDecoder::kLAFrame, 7, 8,
+		0x10, 0x03, 0x00, 0x00 };
+	theFrames = 0;
+	for (KUInt8 theByte : theAck)
+	{
+		if (theDecoder.AddByte(theByte))
+		{
+			theFrames++;
+		}
+	}
+	ASSERT_EQ(1u, theFrames);
+	EXPECT_FALSE(theDecoder.IsCRCValid());
+	theDecoder.Describe(theText, sizeof(theText));
+	EXPECT_STREQ("LA seq 7, credit 8, bad CRC", theText);
+}
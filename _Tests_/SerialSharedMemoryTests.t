@@ -0,0 +1,183 @@
+#if TARGET_OS_LINUX
+#include "Emulator/Serial/TSharedMemorySerialPortManager.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TDMAManager.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <thread>
+#include <unistd.h>
+
+// One emulator on the link, without the CPU.
+struct SSerialSharedMemoryTestsNewton {
+	SSerialSharedMemoryTestsNewton(int inIndex, const char* inLinkName) :
+			mFixture(inIndex),
+			mMemory(mFixture.GetMemory())
+	{
+		mInterruptManager = new TInterruptManager(nullptr, mFixture.GetProcessor());
+		mLink = new TSharedMemorySerialPortManager(nullptr, TSerialPorts::kExtr);
+		mLink->SetLinkName(inLinkName);
+		mLink->run(mInterruptManager, nullptr, mMemory);
+
+		// A 16 bytes receive ring.
+		mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 0, kRxBase);
+		mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 1, kRxBase);
+		mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 4, 16);
+		mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 5, 16);
+		mLink->WriteDMARegister(2, TDMAManager::kSerialPort0Receive, 0, 6);
+	}
+
+	~SSerialSharedMemoryTestsNewton()
+	{
+		delete mLink;
+		delete mInterruptManager;
+	}
+
+	// The Newton sends the whole span at once. With inSize, the 16 bytes
+	// transmit ring is sent again and again until inSize bytes are sent.
+	void
+	Send(const char* inMessage, KUInt32 inSize = 0)
+	{
+		KUInt32 theSize = (KUInt32) ::strlen(inMessage);
+		for (KUInt32 indexByte = 0; indexByte < theSize; indexByte++)
+		{
+			(void) mMemory->WriteBP(kTxBase + indexByte, (KUInt8) inMessage[indexByte]);
+		}
+		if (inSize)
+		{
+			theSize = inSize;
+		}
+		mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 0, kTxBase);
+		mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 1, kTxBase);
+		mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 5, 16);
+		mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 4, theSize);
+		mLink->WriteDMARegister(2, TDMAManager::kSerialPort0Transmit, 0, 2);
+		mLink->WriteRegister(0x2400, 0);
+	}
+
+	KUInt8
+	Received(KUInt32 inIndex)
+	{
+		KUInt8 theByte = 0;
+		(void) mMemory->ReadBP(kRxBase + inIndex, theByte);
+		return theByte;
+	}
+
+	static const KUInt32 kRxBase = TMemoryConsts::kRAMStart + 0x1000;
+	static const KUInt32 kTxBase = TMemoryConsts::kRAMStart + 0x2000;
+	TTestsFixture mFixture;
+	TMemory* mMemory;
+	TInterruptManager* mInterruptManager;
+	TSharedMemorySerialPortManager* mLink;
+};
+
+// Poll for up to 2 seconds.
+static bool
+SerialSharedMemoryTestsWait(const std::function<bool()>& inDone)
+{
+	for (int indexPoll = 0; (indexPoll < 2000) && !inDone(); indexPoll++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return inDone();
+}
+
+TEST(SerialSharedMemoryTests, SendBothWaysAndRelink)
+{
+	char theLinkName[32];
+	(void) ::snprintf(theLinkName, sizeof(theLinkName), "test-%d", (int) ::getpid());
+	auto theWait = SerialSharedMemoryTestsWait;
+	SSerialSharedMemoryTestsNewton* theFirst = new SSerialSharedMemoryTestsNewton(0, theLinkName);
+	SSerialSharedMemoryTestsNewton* theSecond = new SSerialSharedMemoryTestsNewton(1, theLinkName);
+	EXPECT_TRUE(theWait([theFirst, theSecond]() {
+		return theFirst->mLink->IsLinked() && theSecond->mLink->IsLinked();
+	}));
+
+	theFirst->Send("Hello");
+	EXPECT_TRUE(theWait([theSecond]() { return theSecond->Received(4) == 'o'; }));
+	EXPECT_EQ(theSecond->Received(0), 'H');
+	EXPECT_TRUE(theWait([theFirst]() {
+		return (theFirst->mInterruptManager->GetIntRaised() & 0x00000100) != 0;
+	}));
+	EXPECT_TRUE(theWait([theSecond]() {
+		return (theSecond->mInterruptManager->GetIntRaised() & 0x00000080) != 0;
+	}));
+
+	theSecond->Send("Newton");
+	EXPECT_TRUE(theWait([theFirst]() { return theFirst->Received(5) == 'n'; }));
+	EXPECT_EQ(theFirst->Received(0), 'N');
+
+	// Another emulator takes the place of the first one.
+	delete theFirst;
+	SSerialSharedMemoryTestsNewton* theThird = new SSerialSharedMemoryTestsNewton(2, theLinkName);
+	EXPECT_TRUE(theWait([theSecond, theThird]() {
+		return theSecond->mLink->IsLinked() && theThird->mLink->IsLinked();
+	}));
+	theThird->Send("!");
+	EXPECT_TRUE(theWait([theSecond]() { return theSecond->Received(5) == '!'; }));
+
+	delete theThird;
+	delete theSecond;
+}
+
+TEST(SerialSharedMemoryTests, SendMoreThanTheRing)
+{
+	char theLinkName[32];
+	(void) ::snprintf(theLinkName, sizeof(theLinkName), "test-big-%d", (int) ::getpid());
+	auto theWait = SerialSharedMemoryTestsWait;
+	SSerialSharedMemoryTestsNewton* theFirst = new SSerialSharedMemoryTestsNewton(0, theLinkName);
+	SSerialSharedMemoryTestsNewton* theSecond = new SSerialSharedMemoryTestsNewton(1, theLinkName);
+	EXPECT_TRUE(theWait([theFirst, theSecond]() {
+		return theFirst->mLink->IsLinked() && theSecond->mLink->IsLinked();
+	}));
+
+	// The sender fills the ring several times, and must be woken up each
+	// time the receiver makes room. The receiver reads a batch about every
+	// millisecond, so the sender waits for room some 200 times.
+	theSecond->mLink->SetBitRate(10000000);
+	const KUInt32 theSize = 4 * TSharedMemorySerialPortManager::kRingSize + 16;
+	// One more byte than sent, or the receiver reports an overflow.
+	theSecond->mLink->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 4, theSize + 1);
+	theFirst->Send("0123456789abcdef", theSize);
+	EXPECT_TRUE(theWait([theFirst]() {
+		return (theFirst->mInterruptManager->GetIntRaised() & 0x00000100) != 0;
+	}));
+	EXPECT_TRUE(theWait([theSecond]() {
+		return theSecond->mLink->ReadDMARegister(1, TDMAManager::kSerialPort0Receive, 4) == 1;
+	}));
+	EXPECT_EQ(theSecond->Received(15), 'f');
+
+	delete theSecond;
+	delete theFirst;
+}
+
+TEST(SerialSharedMemoryTests, RenameWhileLinking)
+{
+	char theLinkName[32];
+	char theOtherName[32];
+	(void) ::snprintf(theLinkName, sizeof(theLinkName), "test-rename-%d", (int) ::getpid());
+	(void) ::snprintf(theOtherName, sizeof(theOtherName), "test-other-%d", (int) ::getpid());
+	auto theWait = SerialSharedMemoryTestsWait;
+	SSerialSharedMemoryTestsNewton* theFirst = new SSerialSharedMemoryTestsNewton(0, theLinkName);
+	SSerialSharedMemoryTestsNewton* theSecond = new SSerialSharedMemoryTestsNewton(1, theOtherName);
+
+	// NewtonScript renames the link while the DMA thread looks for a peer.
+	for (int indexRename = 0; indexRename < 1000; indexRename++)
+	{
+		theSecond->mLink->SetLinkName((indexRename & 1) ? theOtherName : theLinkName);
+	}
+	theSecond->mLink->SetLinkName(theLinkName);
+	EXPECT_TRUE(theWait([theFirst, theSecond]() {
+		return theFirst->mLink->IsLinked() && theSecond->mLink->IsLinked();
+	}));
+	char* theName = theSecond->mLink->GetLinkNameDup();
+	EXPECT_STREQ(theName, theLinkName);
+	::free(theName);
+
+	delete theSecond;
+	delete theFirst;
+}
+#endif
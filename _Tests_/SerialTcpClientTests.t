@@ -0,0 +1,156 @@
+#if TARGET_OS_LINUX
+#include "Emulator/Log/TRAMLog.h"
+#include "Emulator/Serial/TSerialCapture.h"
+#include "Emulator/Serial/TSerialCaptureReader.h"
+#include "Emulator/Serial/TTcpClientSerialPortManager.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TDMAManager.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <functional>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#define kSerialTcpClientTestsCapturePath "/tmp/EinsteinSerialTcpClientTests.capture"
+
+class TSerialTcpClientTestsManager : public TTcpClientSerialPortManager
+{
+public:
+	TSerialTcpClientTestsManager(TLog* inLog) :
+			TTcpClientSerialPortManager(inLog, TSerialPorts::kExtr)
+	{
+	}
+
+	using TTcpClientSerialPortManager::GetDMASendSpan;
+	using TTcpClientSerialPortManager::IsConnected;
+};
+
+// The Newton sends the whole span at once, and the DMA tells when it is
+// done.
+static bool
+SendSerialTcpClientTests(TMemory* inMemory, TInterruptManager* inInterruptManager,
+	TSerialTcpClientTestsManager* inClient, const char* inMessage)
+{
+	const KUInt32 theTxBase = TMemoryConsts::kRAMStart + 0x2000;
+	KUInt32 theSize = (KUInt32) ::strlen(inMessage);
+	for (KUInt32 indexByte = 0; indexByte < theSize; indexByte++)
+	{
+		(void) inMemory->WriteBP(theTxBase + indexByte, (KUInt8) inMessage[indexByte]);
+	}
+	inInterruptManager->ClearInterrupts(0x00000100);
+	inClient->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 0, theTxBase);
+	inClient->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 1, theTxBase);
+	inClient->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 5, 16);
+	inClient->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 4, theSize);
+	inClient->WriteDMARegister(2, TDMAManager::kSerialPort0Transmit, 0, 2);
+	inClient->WriteRegister(0x2400, 0);
+	for (int indexPoll = 0; indexPoll < 2000; indexPoll++)
+	{
+		if (inInterruptManager->GetIntRaised() & 0x00000100)
+		{
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+TEST(SerialTcpClientTests, SendSpanIsInNewtonOrder)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TSerialTcpClientTestsManager theClient(nullptr);
+	theClient.run(nullptr, nullptr, &theMem);
+
+	// Spans start and end in the middle of words.
+	const char* theMessage = "Newton MessagePad";
+	const KUInt32 theTxBase = TMemoryConsts::kRAMStart + 0x2001;
+	KUInt32 theSize = (KUInt32) ::strlen(theMessage);
+	for (KUInt32 indexByte = 0; indexByte < theSize; indexByte++)
+	{
+		(void) theMem.WriteBP(theTxBase + indexByte, (KUInt8) theMessage[indexByte]);
+	}
+	for (KUInt32 indexStart = 0; indexStart < 4; indexStart++)
+	{
+		KUInt8 theBuffer[32];
+		KUInt32 theCount = theSize - indexStart;
+		const KUInt8* theSpan = theClient.GetDMASendSpan(
+			theTxBase + indexStart, theCount, theBuffer);
+		EXPECT_EQ(0, ::memcmp(theSpan, theMessage + indexStart, theCount));
+	}
+}
+
+TEST(SerialTcpClientTests, LostBytesAreNotCaptured)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+
+	int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_NE(-1, theListener);
+	struct sockaddr_in theAddress {
+	};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t theLength = sizeof(theAddress);
+	ASSERT_EQ(0, ::bind(theListener, (struct sockaddr*) &theAddress, theLength));
+	ASSERT_EQ(0, ::listen(theListener, 1));
+	ASSERT_EQ(0, ::getsockname(theListener, (struct sockaddr*) &theAddress, &theLength));
+
+	// The errors go to the log.
+	TRAMLog theLog;
+	TSerialCapture* theCapture = new TSerialCapture(kSerialTcpClientTestsCapturePath);
+	TSerialTcpClientTestsManager* theClient = new TSerialTcpClientTestsManager(&theLog);
+	theClient->SetServerPort(ntohs(theAddress.sin_port));
+	theClient->SetCapture(theCapture);
+	theClient->run(theInterruptManager, nullptr, &theMem);
+
+	// The first batch connects.
+	ASSERT_TRUE(SendSerialTcpClientTests(&theMem, theInterruptManager, theClient, "Hello"));
+	int thePeer = ::accept(theListener, nullptr, nullptr);
+	ASSERT_NE(-1, thePeer);
+	char theReceived[6] = { 0 };
+	KUInt32 theCount = 0;
+	while (theCount < 5)
+	{
+		ssize_t theRead = ::read(thePeer, theReceived + theCount, 5 - theCount);
+		ASSERT_GT(theRead, 0);
+		theCount += (KUInt32) theRead;
+	}
+	EXPECT_STREQ(theReceived, "Hello");
+
+	// The server goes away: the bytes sent without a connection are lost
+	// and not captured.
+	::close(thePeer);
+	::close(theListener);
+	for (int indexPoll = 0; (indexPoll < 2000) && theClient->IsConnected(); indexPoll++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	EXPECT_FALSE(theClient->IsConnected());
+	ASSERT_TRUE(SendSerialTcpClientTests(&theMem, theInterruptManager, theClient, "Lost"));
+	delete theClient;
+	delete theCapture;
+
+	TSerialCaptureReader theReader(kSerialTcpClientTestsCapturePath);
+	ASSERT_TRUE(theReader.IsOpen());
+	TSerialCapture::SRecord theRecord;
+	KUInt32 theCaptured = 0;
+	while (theReader.ReadRecord(&theRecord))
+	{
+		if (theRecord.fType == TSerialCapture::kTxRecord)
+		{
+			theCaptured += theRecord.fCount;
+		}
+	}
+	EXPECT_EQ(theCaptured, 5u);
+
+	delete theInterruptManager;
+	(void) ::unlink(kSerialTcpClientTestsCapturePath);
+}
+#endif
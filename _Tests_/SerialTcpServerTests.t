@@ -0,0 +1,208 @@
+#if TARGET_OS_LINUX
+#include "Emulator/Serial/TTcpServerSerialPortManager.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TDMAManager.h"
+#include "Emulator/TInterruptManager.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <functional>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static int
+ConnectSerialTcpServerTests(int inPort)
+{
+	int theSocket = ::socket(PF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in theAddress {
+	};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_port = htons((uint16_t) inPort);
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (::connect(theSocket, (struct sockaddr*) &theAddress, sizeof(theAddress)) == -1)
+	{
+		::close(theSocket);
+		return -1;
+	}
+	return theSocket;
+}
+
+TEST(SerialTcpServerTests, ReceiveSendReconnect)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	struct sigaction theSIGPIPEAction {
+	};
+	(void) ::sigaction(SIGPIPE, nullptr, &theSIGPIPEAction);
+	TTcpServerSerialPortManager* theServer
+		= new TTcpServerSerialPortManager(nullptr, TSerialPorts::kExtr);
+	theServer->run(theInterruptManager, nullptr, &theMem);
+	theServer->SetServerAddress("127.0.0.1");
+	theServer->SetServerPort(0);
+	auto theWait = [](const std::function<bool()>& inDone) {
+		for (int indexPoll = 0; (indexPoll < 2000) && !inDone(); indexPoll++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return inDone();
+	};
+	ASSERT_TRUE(theWait([theServer]() { return theServer->GetServerPort() != 0; }));
+
+	// A 16 bytes receive ring.
+	const KUInt32 theRxBase = TMemoryConsts::kRAMStart + 0x1000;
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 0, theRxBase);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 1, theRxBase);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 4, 16);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 5, 16);
+	theServer->WriteDMARegister(2, TDMAManager::kSerialPort0Receive, 0, 6);
+
+	int theClient = ConnectSerialTcpServerTests(theServer->GetServerPort());
+	ASSERT_NE(theClient, -1);
+	ASSERT_EQ(::write(theClient, "Hello", 5), 5);
+	EXPECT_TRUE(theWait([&theMem, theRxBase]() {
+		KUInt8 theByte = 0;
+		(void) theMem.ReadBP(theRxBase + 4, theByte);
+		return theByte == 'o';
+	}));
+	EXPECT_TRUE(theWait([theInterruptManager]() {
+		return (theInterruptManager->GetIntRaised() & 0x00000080) != 0;
+	}));
+
+	// The Newton sends the whole span at once.
+	const KUInt32 theTxBase = TMemoryConsts::kRAMStart + 0x2000;
+	const char* theMessage = "Newton";
+	for (KUInt32 indexByte = 0; indexByte < 6; indexByte++)
+	{
+		(void) theMem.WriteBP(theTxBase + indexByte, (KUInt8) theMessage[indexByte]);
+	}
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 0, theTxBase);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 1, theTxBase);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 5, 16);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Transmit, 4, 6);
+	theServer->WriteDMARegister(2, TDMAManager::kSerialPort0Transmit, 0, 2);
+	theServer->WriteRegister(0x2400, 0);
+	char theReceived[7] = { 0 };
+	KUInt32 theCount = 0;
+	while (theCount < 6)
+	{
+		ssize_t theRead = ::read(theClient, theReceived + theCount, 6 - theCount);
+		ASSERT_GT(theRead, 0);
+		theCount += (KUInt32) theRead;
+	}
+	EXPECT_STREQ(theReceived, "Newton");
+	EXPECT_TRUE(theWait([theInterruptManager]() {
+		return (theInterruptManager->GetIntRaised() & 0x00000100) != 0;
+	}));
+
+	// Sends don't raise SIGPIPE: the rest of the process keeps its handler.
+	struct sigaction theNewSIGPIPEAction {
+	};
+	(void) ::sigaction(SIGPIPE, nullptr, &theNewSIGPIPEAction);
+	EXPECT_EQ(theNewSIGPIPEAction.sa_handler, theSIGPIPEAction.sa_handler);
+
+	// Another client takes over without restarting anything.
+	::close(theClient);
+	theClient = ConnectSerialTcpServerTests(theServer->GetServerPort());
+	ASSERT_NE(theClient, -1);
+	ASSERT_EQ(::write(theClient, "!", 1), 1);
+	EXPECT_TRUE(theWait([&theMem, theRxBase]() {
+		KUInt8 theByte = 0;
+		(void) theMem.ReadBP(theRxBase + 5, theByte);
+		return theByte == '!';
+	}));
+	::close(theClient);
+
+	delete theServer;
+	delete theInterruptManager;
+}
+
+TEST(SerialTcpServerTests, PacedReceiveDoesNotBlockQuit)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	TTcpServerSerialPortManager* theServer
+		= new TTcpServerSerialPortManager(nullptr, TSerialPorts::kExtr);
+	theServer->run(theInterruptManager, nullptr, &theMem);
+	theServer->SetServerAddress("127.0.0.1");
+	theServer->SetServerPort(0);
+	auto theWait = [](const std::function<bool()>& inDone) {
+		for (int indexPoll = 0; (indexPoll < 2000) && !inDone(); indexPoll++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return inDone();
+	};
+	ASSERT_TRUE(theWait([theServer]() { return theServer->GetServerPort() != 0; }));
+
+	// At 100 bps, the five bytes keep the line busy for half a second.
+	theServer->SetBitRate(100);
+	const KUInt32 theRxBase = TMemoryConsts::kRAMStart + 0x1000;
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 0, theRxBase);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 1, theRxBase);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 4, 16);
+	theServer->WriteDMARegister(1, TDMAManager::kSerialPort0Receive, 5, 16);
+	theServer->WriteDMARegister(2, TDMAManager::kSerialPort0Receive, 0, 6);
+	int theClient = ConnectSerialTcpServerTests(theServer->GetServerPort());
+	ASSERT_NE(theClient, -1);
+	ASSERT_EQ(::write(theClient, "Hello", 5), 5);
+	EXPECT_TRUE(theWait([&theMem, theRxBase]() {
+		KUInt8 theByte = 0;
+		(void) theMem.ReadBP(theRxBase + 4, theByte);
+		return theByte == 'o';
+	}));
+
+	// The next byte waits for the line, but the worker still quits at once.
+	ASSERT_EQ(::write(theClient, "!", 1), 1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	KUInt8 theByte = 0;
+	(void) theMem.ReadBP(theRxBase + 5, theByte);
+	EXPECT_NE(theByte, '!');
+	auto theStart = std::chrono::steady_clock::now();
+	delete theServer;
+	EXPECT_LT(std::chrono::steady_clock::now() - theStart, std::chrono::milliseconds(300));
+	::close(theClient);
+	delete theInterruptManager;
+}
+
+TEST(SerialTcpServerTests, MoveWhileListening)
+{
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TARMProcessor& theProcessor = *theFixture.GetProcessor();
+	TInterruptManager* theInterruptManager = new TInterruptManager(nullptr, &theProcessor);
+	TTcpServerSerialPortManager* theServer
+		= new TTcpServerSerialPortManager(nullptr, TSerialPorts::kExtr);
+	theServer->run(theInterruptManager, nullptr, &theMem);
+
+	// The emulator moves the server while the DMA thread listens.
+	for (int indexMove = 0; indexMove < 1000; indexMove++)
+	{
+		theServer->SetServerAddress((indexMove & 1) ? "127.0.0.1" : "0.0.0.0");
+		theServer->SetServerPort(0);
+	}
+	theServer->SetServerAddress("127.0.0.1");
+	auto theWait = [](const std::function<bool()>& inDone) {
+		for (int indexPoll = 0; (indexPoll < 2000) && !inDone(); indexPoll++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return inDone();
+	};
+	ASSERT_TRUE(theWait([theServer]() { return theServer->GetServerPort() != 0; }));
+	int theClient = ConnectSerialTcpServerTests(theServer->GetServerPort());
+	EXPECT_NE(theClient, -1);
+	if (theClient != -1)
+		::close(theClient);
+
+	delete theServer;
+	delete theInterruptManager;
+}
+#endif
@@ -0,0 +1,174 @@
+// ==============================
+// File:			TTestsFixture.h
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _TTESTSFIXTURE_H
+#define _TTESTSFIXTURE_H
+
+#include <K/Defines/KDefinitions.h>
+
+// ANSI C & POSIX
+#include <stdio.h>
+#include <stdlib.h>
+#if TARGET_OS_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Einstein
+#include "Emulator/Screen/TScreenManager.h"
+#include "Emulator/TARMProcessor.h"
+#include "Emulator/TMemory.h"
+
+#include <gtest/gtest.h>
+
+///
+/// Memory and processor for tests that run without a ROM.
+///
+/// The ROM is blank and the flash is a temporary file named after the test
+/// suite. Both go away with the fixture. The processor is in supervisor mode
+/// with interrupts masked, and there is no emulator to signal.
+///
+class TTestsFixture
+{
+public:
+	///
+	/// Address of the pixmap that screen tests blit from.
+	///
+	static constexpr KUInt32 kPixmapAddr = TMemoryConsts::kRAMStart;
+
+	///
+	/// Address of the pixels of that pixmap.
+	///
+	static constexpr KUInt32 kPixmapBaseAddr = kPixmapAddr + 0x100;
+
+	///
+	/// Constructor from an index.
+	///
+	/// \param inIndex		index of the fixture, for tests with several
+	///						machines.
+	///
+	explicit TTestsFixture(KUInt32 inIndex = 0) :
+			mROM((KUInt8*) ::calloc(8 * 1024 * 1024, 1)),
+			mMemory(nullptr, mROM, GetFlashPath(inIndex, mFlashPath)),
+			mProcessor(nullptr, &mMemory)
+	{
+		mProcessor.SetCPSR(TARMProcessor::kSupervisorMode
+			| TARMProcessor::kPSR_IBit | TARMProcessor::kPSR_FBit);
+	}
+
+	///
+	/// Destructor.
+	/// Removes the flash file and frees the ROM.
+	///
+	~TTestsFixture(void)
+	{
+		(void) ::unlink(mFlashPath);
+		::free(mROM);
+	}
+
+	///
+	/// Accessor on the memory.
+	///
+	TMemory*
+	GetMemory(void)
+	{
+		return &mMemory;
+	}
+
+	///
+	/// Accessor on the processor.
+	///
+	TARMProcessor*
+	GetProcessor(void)
+	{
+		return &mProcessor;
+	}
+
+	///
+	/// Write the header of the pixmap at kPixmapAddr.
+	///
+	/// \param inRowBytes	bytes per row of the pixels at kPixmapBaseAddr.
+	///
+	void
+	WritePixmap(KUInt32 inRowBytes)
+	{
+		(void) mMemory.WriteP(kPixmapAddr + 0x00, kPixmapBaseAddr);
+		(void) mMemory.WriteP(kPixmapAddr + 0x04, inRowBytes << 16);
+		(void) mMemory.WriteP(kPixmapAddr + 0x08, 0x00000000);
+	}
+
+	///
+	/// Copy a rectangle of the pixmap to the same place on the screen.
+	///
+	/// \param inScreenManager	screen manager to blit to.
+	///
+	static void
+	BlitRect(TScreenManager* inScreenManager,
+		KUInt16 inTop, KUInt16 inLeft, KUInt16 inBottom, KUInt16 inRight)
+	{
+		TScreenManager::SRect theRect;
+		theRect.fTop = inTop;
+		theRect.fLeft = inLeft;
+		theRect.fBottom = inBottom;
+		theRect.fRight = inRight;
+		inScreenManager->Blit(kPixmapAddr, &theRect, &theRect, 0 /* srcCopy */);
+	}
+
+private:
+	///
+	/// Name the flash file after the running test suite.
+	///
+	/// \param inIndex	index of the fixture.
+	/// \param outPath	buffer for the path.
+	/// \return outPath.
+	///
+	static const char*
+	GetFlashPath(KUInt32 inIndex, char* outPath)
+	{
+		const ::testing::TestInfo* theInfo
+			= ::testing::UnitTest::GetInstance()->current_test_info();
+#if TARGET_OS_WIN32
+		(void) ::snprintf(outPath, kFlashPathSize, "c:/Einstein%s%u.flash",
+			theInfo->test_suite_name(), (unsigned int) inIndex);
+#else
+		(void) ::snprintf(outPath, kFlashPathSize, "/tmp/Einstein%s%u.flash",
+			theInfo->test_suite_name(), (unsigned int) inIndex);
+#endif
+		return outPath;
+	}
+
+	static constexpr size_t kFlashPathSize = 256;
+
+	char mFlashPath[kFlashPathSize]; ///< Path of the flash file.
+	KUInt8* mROM; ///< Blank ROM.
+	TMemory mMemory; ///< Memory on the ROM and the flash.
+	TARMProcessor mProcessor; ///< Processor on the memory.
+};
+
+#endif
+// _TTESTSFIXTURE_H
+
+// ============================================================= //
+// A test that has never failed has never been run.              //
+// ============================================================= //
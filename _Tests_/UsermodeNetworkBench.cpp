@@ -0,0 +1,564 @@
+// ==============================
+// File:			UsermodeNetworkBench.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#include <K/Defines/KDefinitions.h>
+#include "EinsteinBench.h"
+
+// ANSI C & POSIX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// C++
+#include <chrono>
+#include <thread>
+
+// Einstein
+#include "Emulator/Network/TUsermodeNetwork.h"
+
+// The benchmarks play the Newton at 192.168.1.42, talking to peers on
+// 127.0.0.1, like UsermodeNetworkTests.
+
+// -------------------------------------------------------------------------- //
+//  * SendUsermodeNetworkBenchPacket( TUsermodeNetwork*, KUInt16, KUInt16, ... )
+// -------------------------------------------------------------------------- //
+static void
+SendUsermodeNetworkBenchPacket(TUsermodeNetwork* inNet, KUInt16 inSrcPort,
+	KUInt16 inDstPort, KUInt16 inFlags, KUInt32 inSeq, KUInt32 inAck,
+	const char* inPayload = nullptr, KUInt32 inPayloadSize = 0, KUInt16 inWindow = 0x1000)
+{
+	KUInt8 thePacket[54 + 64] = {
+		0x00, 0xfa, 0x7f, 0x00, 0x00, 0x01, 0x58, 0xb0, 0x35, 0x77, 0xd7, 0x22, 0x08, 0x00,
+		0x45, 0x00, 0x00, 40, 0x00, 0x01, 0x00, 0x00, 64, 6, 0x00, 0x00,
+		192, 168, 1, 42, 127, 0, 0, 1
+	};
+	if (inPayloadSize > sizeof(thePacket) - 54)
+	{
+		inPayloadSize = sizeof(thePacket) - 54;
+	}
+	thePacket[17] = (KUInt8) (40 + inPayloadSize);
+	thePacket[34] = (KUInt8) (inSrcPort >> 8);
+	thePacket[35] = (KUInt8) inSrcPort;
+	thePacket[36] = (KUInt8) (inDstPort >> 8);
+	thePacket[37] = (KUInt8) inDstPort;
+	for (int indexByte = 0; indexByte < 4; indexByte++)
+	{
+		thePacket[38 + indexByte] = (KUInt8) (inSeq >> (24 - 8 * indexByte));
+		thePacket[42 + indexByte] = (KUInt8) (inAck >> (24 - 8 * indexByte));
+	}
+	thePacket[46] = 0x50; // 20 bytes header
+	thePacket[47] = (KUInt8) inFlags;
+	thePacket[48] = (KUInt8) (inWindow >> 8);
+	thePacket[49] = (KUInt8) inWindow;
+	if (inPayloadSize)
+	{
+		(void) ::memcpy(thePacket + 54, inPayload, inPayloadSize);
+	}
+	inNet->SendPacket(thePacket, 54 + inPayloadSize);
+}
+
+// -------------------------------------------------------------------------- //
+//  * WaitForUsermodeNetworkBenchPackets( TUsermodeNetwork*, KUInt32 )
+// -------------------------------------------------------------------------- //
+static bool
+WaitForUsermodeNetworkBenchPackets(TUsermodeNetwork* inNet, KUInt32 inCount)
+{
+	// Yield rather than sleep, not to add the scheduler to the timings.
+	auto theDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (std::chrono::steady_clock::now() < theDeadline)
+	{
+		if (inNet->GetPacketCount() >= inCount)
+		{
+			return true;
+		}
+		std::this_thread::yield();
+	}
+	return inNet->GetPacketCount() >= inCount;
+}
+
+// -------------------------------------------------------------------------- //
+//  * OpenUsermodeNetworkBenchListener( int, KUInt16* )
+// -------------------------------------------------------------------------- //
+static int
+OpenUsermodeNetworkBenchListener(int inBacklog, KUInt16* outPort)
+{
+	int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (theListener == -1)
+	{
+		return -1;
+	}
+	struct sockaddr_in theAddress = {};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t theLength = sizeof(theAddress);
+	if ((::bind(theListener, (struct sockaddr*) &theAddress, theLength) != 0)
+		|| (::listen(theListener, inBacklog) != 0)
+		|| (::getsockname(theListener, (struct sockaddr*) &theAddress, &theLength) != 0))
+	{
+		::close(theListener);
+		return -1;
+	}
+	*outPort = ntohs(theAddress.sin_port);
+	return theListener;
+}
+
+// -------------------------------------------------------------------------- //
+//  * GetUsermodeNetworkBenchSeq( const KUInt8* )
+// -------------------------------------------------------------------------- //
+static KUInt32
+GetUsermodeNetworkBenchSeq(const KUInt8* inFrame)
+{
+	return ((KUInt32) inFrame[38] << 24) | ((KUInt32) inFrame[39] << 16)
+		| ((KUInt32) inFrame[40] << 8) | inFrame[41];
+}
+
+// -------------------------------------------------------------------------- //
+//  * UsermodeNetworkQueueLatency( void )
+// -------------------------------------------------------------------------- //
+static bool
+UsermodeNetworkQueueLatency(void)
+{
+	const int kRounds = 100;
+	KUInt16 thePort;
+	int theListener = OpenUsermodeNetworkBenchListener(2, &thePort);
+	if (theListener == -1)
+	{
+		return false;
+	}
+
+	// Two connections: SYN, and the ACK of the SYN ACK.
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	SendUsermodeNetworkBenchPacket(theNet, 1000, thePort, 0x02, 100, 0);
+	int thePeerA = ::accept(theListener, nullptr, nullptr);
+	SendUsermodeNetworkBenchPacket(theNet, 1001, thePort, 0x02, 200, 0);
+	int thePeerB = ::accept(theListener, nullptr, nullptr);
+	SendUsermodeNetworkBenchPacket(theNet, 1000, thePort, 0x10, 101, 1);
+	SendUsermodeNetworkBenchPacket(theNet, 1001, thePort, 0x10, 201, 1);
+
+	// Each round, both peers write, then the Newton takes the packets and
+	// acknowledges them.
+	bool theResult = (thePeerA != -1) && (thePeerB != -1);
+	std::chrono::duration<double, std::micro> theLatency(0);
+	std::chrono::duration<double, std::micro> theMaxLatency(0);
+	KUInt8 theFrame[64];
+	for (int indexRound = 0; theResult && (indexRound < kRounds); indexRound++)
+	{
+		while (theResult && (theNet->GetPacketCount() > 0))
+		{
+			KUInt32 theSize = theNet->DataAvailable();
+			theResult = (theSize <= sizeof(theFrame)) && (theNet->ReceiveData(theFrame, theSize) == 0);
+		}
+
+		// From the write of the first peer to the packet of the second one
+		// in the queue.
+		auto theWrite = std::chrono::steady_clock::now();
+		theResult = theResult
+			&& (::write(thePeerA, "hello", 5) == 5)
+			&& WaitForUsermodeNetworkBenchPackets(theNet, 1)
+			&& (::write(thePeerB, "world", 5) == 5)
+			&& WaitForUsermodeNetworkBenchPackets(theNet, 2);
+		std::chrono::duration<double, std::micro> theTime = std::chrono::steady_clock::now() - theWrite;
+		theLatency += theTime;
+		if (theTime > theMaxLatency)
+		{
+			theMaxLatency = theTime;
+		}
+		SendUsermodeNetworkBenchPacket(theNet, 1000, thePort, 0x10, 101, 1 + 5 * (indexRound + 1));
+		SendUsermodeNetworkBenchPacket(theNet, 1001, thePort, 0x10, 201, 1 + 5 * (indexRound + 1));
+	}
+	if (theResult)
+	{
+		(void) ::printf("  two connections queued in %.0f us on average, %.0f us at most\n",
+			theLatency.count() / kRounds, theMaxLatency.count());
+	}
+
+	delete theNet;
+	::close(thePeerA);
+	::close(thePeerB);
+	::close(theListener);
+
+	return theResult;
+}
+
+// -------------------------------------------------------------------------- //
+//  * UsermodeNetworkConcurrentReceive( void )
+// -------------------------------------------------------------------------- //
+static bool
+UsermodeNetworkConcurrentReceive(void)
+{
+	const int kFlows = 4;
+	const KUInt32 kSize = 1024 * 1024;
+	const KUInt16 kWindow = 16384;
+	KUInt16 thePort;
+	int theListener = OpenUsermodeNetworkBenchListener(kFlows, &thePort);
+	if (theListener == -1)
+	{
+		return false;
+	}
+
+	// Open the connections, then let every peer send at once.
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	int thePeers[kFlows];
+	KUInt32 theNext[kFlows];
+	KUInt32 theAcked[kFlows];
+	KUInt32 theSegments[kFlows];
+	KUInt8 theFrame[1600];
+	bool theResult = true;
+	int theFlowCount = 0;
+	for (; theResult && (theFlowCount < kFlows); theFlowCount++)
+	{
+		SendUsermodeNetworkBenchPacket(theNet, 4000 + theFlowCount, thePort, 0x02, 100, 0, nullptr, 0, kWindow);
+		thePeers[theFlowCount] = ::accept(theListener, nullptr, nullptr);
+		theResult = (thePeers[theFlowCount] != -1)
+			&& (theNet->DataAvailable() == 58)
+			&& (theNet->ReceiveData(theFrame, 58) == 0);
+		theNext[theFlowCount] = theAcked[theFlowCount] = GetUsermodeNetworkBenchSeq(theFrame) + 1;
+		theSegments[theFlowCount] = 0;
+		SendUsermodeNetworkBenchPacket(theNet, 4000 + theFlowCount, thePort, 0x10, 101, theNext[theFlowCount], nullptr, 0, kWindow);
+	}
+	auto theStart = std::chrono::steady_clock::now();
+	std::thread theWriters[kFlows];
+	for (int indexFlow = 0; theResult && (indexFlow < kFlows); indexFlow++)
+	{
+		int thePeer = thePeers[indexFlow];
+		theWriters[indexFlow] = std::thread(
+			[=]() {
+				KUInt8 theBody[4096];
+				::memset(theBody, 'a' + indexFlow, sizeof(theBody));
+				for (KUInt32 indexByte = 0; indexByte < kSize; indexByte += sizeof(theBody))
+				{
+					if (::send(thePeer, theBody, sizeof(theBody), MSG_NOSIGNAL) != (ssize_t) sizeof(theBody))
+					{
+						break;
+					}
+				}
+			});
+	}
+
+	// Play the Newton: take the packets of all connections in order, and
+	// acknowledge every second segment of a connection, or when nothing
+	// else is waiting.
+	KUInt32 theTotal = 0;
+	auto theDeadline = theStart + std::chrono::seconds(20);
+	while (theResult && (theTotal < kFlows * kSize) && (std::chrono::steady_clock::now() < theDeadline))
+	{
+		KUInt32 theSize = theNet->DataAvailable();
+		if (theSize == 0)
+		{
+			for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+			{
+				if (theAcked[indexFlow] != theNext[indexFlow])
+				{
+					theAcked[indexFlow] = theNext[indexFlow];
+					SendUsermodeNetworkBenchPacket(theNet, 4000 + indexFlow, thePort, 0x10, 101, theAcked[indexFlow], nullptr, 0, kWindow);
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+			continue;
+		}
+		int indexFlow = -1;
+		if ((theSize <= sizeof(theFrame)) && (theNet->ReceiveData(theFrame, theSize) == 0))
+		{
+			indexFlow = (int) (((KUInt32) theFrame[36] << 8) | theFrame[37]) - 4000;
+		}
+		if ((indexFlow < 0) || (indexFlow >= kFlows))
+		{
+			theResult = false;
+			break;
+		}
+		KUInt32 thePayloadSize = theSize - 54;
+		theNext[indexFlow] += thePayloadSize;
+		theTotal += thePayloadSize;
+		if (thePayloadSize && ((++theSegments[indexFlow] % 2) == 0))
+		{
+			theAcked[indexFlow] = theNext[indexFlow];
+			SendUsermodeNetworkBenchPacket(theNet, 4000 + indexFlow, thePort, 0x10, 101, theAcked[indexFlow], nullptr, 0, kWindow);
+		}
+	}
+	std::chrono::duration<double> theTime = std::chrono::steady_clock::now() - theStart;
+	theResult = theResult && (theTotal == kFlows * kSize);
+	if (theResult)
+	{
+		(void) ::printf("  %d connections: %u bytes in %.3f s, %.1f MB/s in total\n",
+			kFlows, (unsigned int) theTotal, theTime.count(),
+			(double) theTotal / theTime.count() / 1024.0 / 1024.0);
+	}
+
+	// Closing the peers stops the writers that wait for a full window.
+	delete theNet;
+	for (int indexFlow = 0; indexFlow < theFlowCount; indexFlow++)
+	{
+		::shutdown(thePeers[indexFlow], SHUT_RDWR);
+	}
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		if (theWriters[indexFlow].joinable())
+		{
+			theWriters[indexFlow].join();
+		}
+	}
+	for (int indexFlow = 0; indexFlow < theFlowCount; indexFlow++)
+	{
+		::close(thePeers[indexFlow]);
+	}
+	::close(theListener);
+
+	return theResult;
+}
+
+// -------------------------------------------------------------------------- //
+//  * UsermodeNetworkReceiveBench( void )
+// -------------------------------------------------------------------------- //
+bool
+UsermodeNetworkReceiveBench(void)
+{
+	bool theResult = UsermodeNetworkQueueLatency();
+	return UsermodeNetworkConcurrentReceive() && theResult;
+}
+
+// -------------------------------------------------------------------------- //
+//  * UsermodeNetworkFlowsBench( void )
+// -------------------------------------------------------------------------- //
+bool
+UsermodeNetworkFlowsBench(void)
+{
+	const int kFlows = 128;
+	const int kRounds = 20;
+	KUInt16 thePort;
+	int theListener = OpenUsermodeNetworkBenchListener(kFlows, &thePort);
+	if (theListener == -1)
+	{
+		return false;
+	}
+
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	int thePeers[kFlows];
+	int theFlowCount = 0;
+	bool theResult = true;
+	for (; theResult && (theFlowCount < kFlows); theFlowCount++)
+	{
+		SendUsermodeNetworkBenchPacket(theNet, 2000 + theFlowCount, thePort, 0x02, 100, 0);
+		thePeers[theFlowCount] = ::accept(theListener, nullptr, nullptr);
+		theResult = (thePeers[theFlowCount] != -1);
+		SendUsermodeNetworkBenchPacket(theNet, 2000 + theFlowCount, thePort, 0x10, 101, 1);
+	}
+
+	// The Newton sends to all connections in turn: each packet looks up
+	// its flow.
+	auto theStart = std::chrono::steady_clock::now();
+	for (int indexRound = 0; theResult && (indexRound < kRounds); indexRound++)
+	{
+		for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+		{
+			char thePayload[8];
+			(void) ::snprintf(thePayload, sizeof(thePayload), "%03d:%03d", indexFlow, indexRound);
+			SendUsermodeNetworkBenchPacket(theNet, 2000 + indexFlow, thePort, 0x10,
+				101 + 7 * indexRound, 1, thePayload, 7);
+		}
+	}
+	std::chrono::duration<double, std::micro> theTime = std::chrono::steady_clock::now() - theStart;
+
+	// Every packet must have reached its own peer.
+	for (int indexFlow = 0; theResult && (indexFlow < kFlows); indexFlow++)
+	{
+		char theExpected[7 * kRounds + 1];
+		for (int indexRound = 0; indexRound < kRounds; indexRound++)
+		{
+			(void) ::snprintf(theExpected + 7 * indexRound, 8, "%03d:%03d", indexFlow, indexRound);
+		}
+		char theReceived[7 * kRounds];
+		size_t theCount = 0;
+		while (theResult && (theCount < sizeof(theReceived)))
+		{
+			ssize_t theRead = ::read(thePeers[indexFlow], theReceived + theCount, sizeof(theReceived) - theCount);
+			theResult = (theRead > 0);
+			theCount += (theRead > 0) ? (size_t) theRead : 0;
+		}
+		theResult = theResult && (::memcmp(theExpected, theReceived, sizeof(theReceived)) == 0);
+	}
+	if (theResult)
+	{
+		(void) ::printf("  %d packets over %d flows: %.2f us per packet\n",
+			kFlows * kRounds, kFlows, theTime.count() / (kFlows * kRounds));
+	}
+
+	delete theNet;
+	for (int indexFlow = 0; indexFlow < theFlowCount; indexFlow++)
+	{
+		::close(thePeers[indexFlow]);
+	}
+	::close(theListener);
+
+	return theResult;
+}
+
+// -------------------------------------------------------------------------- //
+//  * DownloadUsermodeNetworkBenchFile( KUInt16, KUInt32 )
+// -------------------------------------------------------------------------- //
+static bool
+DownloadUsermodeNetworkBenchFile(KUInt16 inWindow, KUInt32 inSize)
+{
+	KUInt16 thePort;
+	int theListener = OpenUsermodeNetworkBenchListener(1, &thePort);
+	if (theListener == -1)
+	{
+		return false;
+	}
+
+	// The HTTP stand-in.
+	std::thread theServer(
+		[=]() {
+			int thePeer = ::accept(theListener, nullptr, nullptr);
+			char theRequest[64];
+			(void) ::read(thePeer, theRequest, sizeof(theRequest));
+			char theHeader[64];
+			int theHeaderSize = ::snprintf(theHeader, sizeof(theHeader),
+				"HTTP/1.0 200 OK\r\nContent-Length: %u\r\n\r\n", (unsigned int) inSize);
+			(void) ::send(thePeer, theHeader, theHeaderSize, MSG_NOSIGNAL);
+			KUInt8 theBody[4096];
+			for (KUInt32 indexByte = 0; indexByte < inSize; indexByte += sizeof(theBody))
+			{
+				KUInt32 theCount = inSize - indexByte;
+				if (theCount > sizeof(theBody))
+				{
+					theCount = sizeof(theBody);
+				}
+				for (KUInt32 indexBody = 0; indexBody < theCount; indexBody++)
+				{
+					theBody[indexBody] = (KUInt8) ((indexByte + indexBody) * 7);
+				}
+				if (::send(thePeer, theBody, theCount, MSG_NOSIGNAL) != (ssize_t) theCount)
+				{
+					break;
+				}
+			}
+			::close(thePeer);
+		});
+
+	// Download like the Newton would: take the packets in order, and delay
+	// ACKs until two segments arrived or no more data is waiting.
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	auto theStart = std::chrono::steady_clock::now();
+	SendUsermodeNetworkBenchPacket(theNet, 3000, thePort, 0x02, 100, 0, nullptr, 0, inWindow);
+	KUInt8 theFrame[1600];
+	bool theResult = (theNet->DataAvailable() == 58)
+		&& (theNet->ReceiveData(theFrame, 58) == 0);
+	KUInt32 theNext = GetUsermodeNetworkBenchSeq(theFrame) + 1;
+	KUInt32 theAcked = theNext;
+	SendUsermodeNetworkBenchPacket(theNet, 3000, thePort, 0x10, 101, theNext, nullptr, 0, inWindow);
+	const char* theRequest = "GET / HTTP/1.0\r\n\r\n";
+	SendUsermodeNetworkBenchPacket(theNet, 3000, thePort, 0x18, 101, theNext,
+		theRequest, (KUInt32) ::strlen(theRequest), inWindow);
+	KUInt32 theRequestEnd = 101 + (KUInt32) ::strlen(theRequest);
+
+	// Before any ACK, the reader thread sends as many segments as the
+	// window holds.
+	auto theQueueDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+	while (theResult && (theNet->GetPacketCount() < (KUInt32) (inWindow / 1448))
+		&& (std::chrono::steady_clock::now() < theQueueDeadline))
+	{
+		std::this_thread::yield();
+	}
+	KUInt32 theQueued = theNet->GetPacketCount();
+
+	KUInt32 theDataSize = 0;
+	KUInt32 theSegments = 0;
+	KUInt32 theMaxInFlight = 0;
+	bool theFIN = false;
+	auto theDeadline = theStart + std::chrono::seconds(20);
+	while (theResult && !theFIN && (std::chrono::steady_clock::now() < theDeadline))
+	{
+		KUInt32 theSize = theNet->DataAvailable();
+		if (theSize == 0)
+		{
+			// The delayed ACK timer.
+			if (theAcked != theNext)
+			{
+				theAcked = theNext;
+				SendUsermodeNetworkBenchPacket(theNet, 3000, thePort, 0x10, theRequestEnd, theAcked, nullptr, 0, inWindow);
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+			continue;
+		}
+		theResult = (theSize <= sizeof(theFrame))
+			&& (theNet->ReceiveData(theFrame, theSize) == 0);
+		KUInt32 thePayloadSize = theSize - 54;
+		if (theResult && thePayloadSize)
+		{
+			theResult = (GetUsermodeNetworkBenchSeq(theFrame) == theNext);
+			theDataSize += thePayloadSize;
+			theNext += thePayloadSize;
+			theSegments++;
+			if (theNext - theAcked > theMaxInFlight)
+			{
+				theMaxInFlight = theNext - theAcked;
+			}
+			if (theSegments % 2 == 0)
+			{
+				theAcked = theNext;
+				SendUsermodeNetworkBenchPacket(theNet, 3000, thePort, 0x10, theRequestEnd, theAcked, nullptr, 0, inWindow);
+			}
+		}
+		theFIN = (theFrame[47] & 0x01) != 0;
+	}
+	std::chrono::duration<double> theTime = std::chrono::steady_clock::now() - theStart;
+	theResult = theResult && theFIN && (theDataSize > inSize);
+	if (theResult)
+	{
+		(void) ::printf("  window %u: %u bytes in %u segments, %u queued before the first ACK, "
+			"at most %u in flight, %.1f MB/s\n",
+			(unsigned int) inWindow, (unsigned int) theDataSize, (unsigned int) theSegments,
+			(unsigned int) theQueued, (unsigned int) theMaxInFlight,
+			(double) theDataSize / theTime.count() / 1024.0 / 1024.0);
+	}
+
+	// Shutting the listener down lets the stand-in return if it wasn't
+	// connected.
+	delete theNet;
+	::shutdown(theListener, SHUT_RDWR);
+	theServer.join();
+	::close(theListener);
+
+	return theResult;
+}
+
+// -------------------------------------------------------------------------- //
+//  * UsermodeNetworkBulkBench( void )
+// -------------------------------------------------------------------------- //
+bool
+UsermodeNetworkBulkBench(void)
+{
+	// One segment in flight, as before the window was used, and a window
+	// of 16 kB.
+	bool theResult = DownloadUsermodeNetworkBenchFile(1448, 1024 * 1024);
+	return DownloadUsermodeNetworkBenchFile(16384, 1024 * 1024) && theResult;
+}
+
+// ============================================================= //
+// Any sufficiently advanced bug is indistinguishable from a     //
+// feature.                                                      //
+//                 -- Rich Kulawiec                              //
+// ============================================================= //
@@ -0,0 +1,576 @@
+#if TARGET_OS_LINUX
+#include "Emulator/Network/TUsermodeNetwork.h"
+#include "Emulator/TMemory.h"
+#include "_Tests_/TTestsFixture.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// A TCP packet from the Newton at 192.168.1.42 to 127.0.0.1.
+static void
+SendUsermodeNetworkTestsPacket(TUsermodeNetwork* inNet, KUInt16 inSrcPort,
+	KUInt16 inDstPort, KUInt16 inFlags, KUInt32 inSeq, KUInt32 inAck,
+	const char* inPayload = nullptr, KUInt32 inPayloadSize = 0, KUInt16 inWindow = 0x1000)
+{
+	KUInt8 thePacket[54 + 64] = {
+		0x00, 0xfa, 0x7f, 0x00, 0x00, 0x01, 0x58, 0xb0, 0x35, 0x77, 0xd7, 0x22, 0x08, 0x00,
+		0x45, 0x00, 0x00, 40, 0x00, 0x01, 0x00, 0x00, 64, 6, 0x00, 0x00,
+		192, 168, 1, 42, 127, 0, 0, 1
+	};
+	ASSERT_LE(inPayloadSize, sizeof(thePacket) - 54);
+	thePacket[17] = (KUInt8) (40 + inPayloadSize);
+	thePacket[34] = (KUInt8) (inSrcPort >> 8);
+	thePacket[35] = (KUInt8) inSrcPort;
+	thePacket[36] = (KUInt8) (inDstPort >> 8);
+	thePacket[37] = (KUInt8) inDstPort;
+	for (int indexByte = 0; indexByte < 4; indexByte++)
+	{
+		thePacket[38 + indexByte] = (KUInt8) (inSeq >> (24 - 8 * indexByte));
+		thePacket[42 + indexByte] = (KUInt8) (inAck >> (24 - 8 * indexByte));
+	}
+	thePacket[46] = 0x50; // 20 bytes header
+	thePacket[47] = (KUInt8) inFlags;
+	thePacket[48] = (KUInt8) (inWindow >> 8);
+	thePacket[49] = (KUInt8) inWindow;
+	if (inPayloadSize)
+	{
+		(void) ::memcpy(thePacket + 54, inPayload, inPayloadSize);
+	}
+	inNet->SendPacket(thePacket, 54 + inPayloadSize);
+}
+
+// Wait for the reader thread to queue packets, without the Newton timer.
+static bool
+WaitForUsermodeNetworkTestsPackets(TUsermodeNetwork* inNet, KUInt32 inCount)
+{
+	// Yield rather than sleep, so that the tests can time the reader.
+	auto theDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (std::chrono::steady_clock::now() < theDeadline)
+	{
+		if (inNet->GetPacketCount() >= inCount)
+		{
+			return true;
+		}
+		std::this_thread::yield();
+	}
+	return inNet->GetPacketCount() >= inCount;
+}
+
+TEST(UsermodeNetworkTests, ConnectionsDontWaitForEachOther)
+{
+	// The peer.
+	int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_NE(-1, theListener);
+	struct sockaddr_in theAddress = {};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t theLength = sizeof(theAddress);
+	ASSERT_EQ(0, ::bind(theListener, (struct sockaddr*) &theAddress, theLength));
+	ASSERT_EQ(0, ::listen(theListener, 2));
+	ASSERT_EQ(0, ::getsockname(theListener, (struct sockaddr*) &theAddress, &theLength));
+	KUInt16 thePort = ntohs(theAddress.sin_port);
+
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+
+	// Two connections: SYN, and the ACK of the SYN ACK.
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x02, 100, 0);
+	int thePeerA = ::accept(theListener, nullptr, nullptr);
+	SendUsermodeNetworkTestsPacket(theNet, 1001, thePort, 0x02, 200, 0);
+	int thePeerB = ::accept(theListener, nullptr, nullptr);
+	ASSERT_NE(-1, thePeerA);
+	ASSERT_NE(-1, thePeerB);
+	EXPECT_EQ(2u, theNet->GetPacketCount());
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 101, 1);
+	SendUsermodeNetworkTestsPacket(theNet, 1001, thePort, 0x10, 201, 1);
+
+	// The Newton doesn't pick up the packets: both connections still get
+	// their data queued, and each one waits for its own ACK only.
+	KUInt32 theCount = 2;
+	for (int indexRound = 0; indexRound < 8; indexRound++)
+	{
+		ASSERT_EQ(5, ::write(thePeerA, "hello", 5));
+		ASSERT_TRUE(WaitForUsermodeNetworkTestsPackets(theNet, ++theCount));
+		ASSERT_EQ(5, ::write(thePeerB, "world", 5));
+		ASSERT_TRUE(WaitForUsermodeNetworkTestsPackets(theNet, ++theCount));
+		SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 101, 1 + 5 * (indexRound + 1));
+		SendUsermodeNetworkTestsPacket(theNet, 1001, thePort, 0x10, 201, 1 + 5 * (indexRound + 1));
+	}
+
+	// When the receive window of the Newton is full, the next data waits in
+	// the socket until the ACK.
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 101, 41, nullptr, 0, 5);
+	ASSERT_EQ(5, ::write(thePeerA, "hello", 5));
+	ASSERT_TRUE(WaitForUsermodeNetworkTestsPackets(theNet, ++theCount));
+	ASSERT_EQ(5, ::write(thePeerA, "again", 5));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	EXPECT_EQ(theCount, theNet->GetPacketCount());
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 101, 46, nullptr, 0, 5);
+	EXPECT_TRUE(WaitForUsermodeNetworkTestsPackets(theNet, ++theCount));
+
+	delete theNet;
+	::close(thePeerA);
+	::close(thePeerB);
+	::close(theListener);
+}
+
+TEST(UsermodeNetworkTests, ManyFlows)
+{
+	const int kFlows = 128;
+	const int kRounds = 20;
+
+	int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_NE(-1, theListener);
+	struct sockaddr_in theAddress = {};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t theLength = sizeof(theAddress);
+	ASSERT_EQ(0, ::bind(theListener, (struct sockaddr*) &theAddress, theLength));
+	ASSERT_EQ(0, ::listen(theListener, kFlows));
+	ASSERT_EQ(0, ::getsockname(theListener, (struct sockaddr*) &theAddress, &theLength));
+	KUInt16 thePort = ntohs(theAddress.sin_port);
+
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	int thePeers[kFlows];
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		SendUsermodeNetworkTestsPacket(theNet, 2000 + indexFlow, thePort, 0x02, 100, 0);
+		thePeers[indexFlow] = ::accept(theListener, nullptr, nullptr);
+		ASSERT_NE(-1, thePeers[indexFlow]);
+		SendUsermodeNetworkTestsPacket(theNet, 2000 + indexFlow, thePort, 0x10, 101, 1);
+	}
+	EXPECT_EQ((KUInt32) kFlows, theNet->GetFlowCount());
+
+	// The Newton sends to all connections in turn, each packet must reach
+	// its own peer.
+	for (int indexRound = 0; indexRound < kRounds; indexRound++)
+	{
+		for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+		{
+			char thePayload[8];
+			(void) ::snprintf(thePayload, sizeof(thePayload), "%03d:%03d", indexFlow, indexRound);
+			SendUsermodeNetworkTestsPacket(theNet, 2000 + indexFlow, thePort, 0x10,
+				101 + 7 * indexRound, 1, thePayload, 7);
+		}
+	}
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		char theExpected[7 * kRounds + 1];
+		for (int indexRound = 0; indexRound < kRounds; indexRound++)
+		{
+			(void) ::snprintf(theExpected + 7 * indexRound, 8, "%03d:%03d", indexFlow, indexRound);
+		}
+		char theReceived[7 * kRounds];
+		size_t theCount = 0;
+		while (theCount < sizeof(theReceived))
+		{
+			ssize_t theRead = ::read(thePeers[indexFlow], theReceived + theCount, sizeof(theReceived) - theCount);
+			ASSERT_GT(theRead, 0);
+			theCount += (size_t) theRead;
+		}
+		EXPECT_EQ(0, ::memcmp(theExpected, theReceived, sizeof(theReceived)));
+	}
+
+	// Closed connections leave the index.
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		SendUsermodeNetworkTestsPacket(theNet, 2000 + indexFlow, thePort, 0x11, 101 + 7 * kRounds, 1);
+		SendUsermodeNetworkTestsPacket(theNet, 2000 + indexFlow, thePort, 0x10, 102 + 7 * kRounds, 2);
+	}
+	EXPECT_EQ(0u, theNet->GetFlowCount());
+
+	delete theNet;
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		::close(thePeers[indexFlow]);
+	}
+	::close(theListener);
+}
+
+TEST(UsermodeNetworkTests, ReceiveInPlace)
+{
+	int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_NE(-1, theListener);
+	struct sockaddr_in theAddress = {};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t theLength = sizeof(theAddress);
+	ASSERT_EQ(0, ::bind(theListener, (struct sockaddr*) &theAddress, theLength));
+	ASSERT_EQ(0, ::listen(theListener, 1));
+	ASSERT_EQ(0, ::getsockname(theListener, (struct sockaddr*) &theAddress, &theLength));
+	KUInt16 thePort = ntohs(theAddress.sin_port);
+
+	TTestsFixture theFixture;
+	TMemory& theMem = *theFixture.GetMemory();
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	theNet->SetMemory(&theMem);
+
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x02, 100, 0);
+	int thePeer = ::accept(theListener, nullptr, nullptr);
+	ASSERT_NE(-1, thePeer);
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 101, 1);
+	KUInt8 theFrame[58]; // SYN ACK with the MSS option
+	ASSERT_EQ(0, theNet->ReceiveData(theFrame, sizeof(theFrame)));
+
+	// Frames go through the pool: once it has enough buffers, it doesn't
+	// grow any more.
+	KUInt32 theBufferCount = 0;
+	for (int indexRound = 0; indexRound < 200; indexRound++)
+	{
+		char thePayload[6];
+		(void) ::snprintf(thePayload, sizeof(thePayload), "%05d", indexRound);
+		ASSERT_EQ(5, ::write(thePeer, thePayload, 5));
+		ASSERT_TRUE(WaitForUsermodeNetworkTestsPackets(theNet, 1));
+
+		// The frame is sized to the data that was received.
+		KUInt32 theRAMAddress = TMemoryConsts::kRAMStart + 0x1001;
+		ASSERT_EQ(0, theNet->ReceiveDataToMemory(theRAMAddress, 59));
+		KUInt8 theByte = 0;
+		ASSERT_FALSE(theMem.ReadB(theRAMAddress + 17, theByte));
+		EXPECT_EQ(45, theByte); // IP total length
+		for (int indexByte = 0; indexByte < 5; indexByte++)
+		{
+			ASSERT_FALSE(theMem.ReadB(theRAMAddress + 54 + indexByte, theByte));
+			EXPECT_EQ(thePayload[indexByte], (char) theByte);
+		}
+		SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 101, 1 + 5 * (indexRound + 1));
+
+		if (indexRound == 0)
+		{
+			theBufferCount = TUsermodeNetwork::GetPacketBufferCount();
+		}
+		EXPECT_EQ(theBufferCount, TUsermodeNetwork::GetPacketBufferCount());
+	}
+
+	delete theNet;
+	::close(thePeer);
+	::close(theListener);
+}
+
+TEST(UsermodeNetworkTests, AcksRideOnQueuedSegments)
+{
+	int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_NE(-1, theListener);
+	struct sockaddr_in theAddress = {};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t theLength = sizeof(theAddress);
+	ASSERT_EQ(0, ::bind(theListener, (struct sockaddr*) &theAddress, theLength));
+	ASSERT_EQ(0, ::listen(theListener, 1));
+	ASSERT_EQ(0, ::getsockname(theListener, (struct sockaddr*) &theAddress, &theLength));
+	KUInt16 thePort = ntohs(theAddress.sin_port);
+
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x02, 100, 0);
+	int thePeer = ::accept(theListener, nullptr, nullptr);
+	ASSERT_NE(-1, thePeer);
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 101, 1);
+	KUInt8 theFrame[64];
+	ASSERT_EQ(0, theNet->ReceiveData(theFrame, 58)); // SYN ACK
+
+	// Data from the Newton is acknowledged by the segment that waits for it.
+	ASSERT_EQ(5, ::write(thePeer, "hello", 5));
+	ASSERT_TRUE(WaitForUsermodeNetworkTestsPackets(theNet, 1));
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 101, 1, "ping", 4);
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 105, 1, "pong", 4);
+	EXPECT_EQ(1u, theNet->GetPacketCount());
+	ASSERT_EQ(59u, theNet->DataAvailable());
+	ASSERT_EQ(0, theNet->ReceiveData(theFrame, 59));
+	KUInt32 theAck = ((KUInt32) theFrame[42] << 24) | ((KUInt32) theFrame[43] << 16)
+		| ((KUInt32) theFrame[44] << 8) | theFrame[45];
+	EXPECT_EQ(109u, theAck);
+	EXPECT_EQ(0, TNetworkManager::GetTCPChecksum(theFrame, 59));
+	EXPECT_EQ(0, ::memcmp(theFrame + 54, "hello", 5));
+
+	// With nothing queued, the Newton gets an ACK of its own.
+	SendUsermodeNetworkTestsPacket(theNet, 1000, thePort, 0x10, 109, 6, "!", 1);
+	EXPECT_EQ(1u, theNet->GetPacketCount());
+	ASSERT_EQ(0, theNet->ReceiveData(theFrame, 54));
+	EXPECT_EQ(110, theFrame[45]);
+
+	char theReceived[10];
+	size_t theCount = 0;
+	while (theCount < sizeof(theReceived) - 1)
+	{
+		ssize_t theRead = ::read(thePeer, theReceived + theCount, sizeof(theReceived) - 1 - theCount);
+		ASSERT_GT(theRead, 0);
+		theCount += (size_t) theRead;
+	}
+	EXPECT_EQ(0, ::memcmp(theReceived, "pingpong!", 9));
+
+	delete theNet;
+	::close(thePeer);
+	::close(theListener);
+}
+
+// Download from an HTTP stand-in like the Newton would: take the packets in
+// order, check them, and delay ACKs until two segments arrived or no more
+// data is waiting. Return how many packets were queued before the first ACK.
+static void
+DownloadUsermodeNetworkTestsFile(KUInt16 inWindow, KUInt32 inSize, KUInt32* outQueued)
+{
+	int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_NE(-1, theListener);
+	struct sockaddr_in theAddress = {};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t theLength = sizeof(theAddress);
+	ASSERT_EQ(0, ::bind(theListener, (struct sockaddr*) &theAddress, theLength));
+	ASSERT_EQ(0, ::listen(theListener, 1));
+	ASSERT_EQ(0, ::getsockname(theListener, (struct sockaddr*) &theAddress, &theLength));
+	KUInt16 thePort = ntohs(theAddress.sin_port);
+
+	std::thread theServer(
+		[=]() {
+			int thePeer = ::accept(theListener, nullptr, nullptr);
+			char theRequest[64];
+			(void) ::read(thePeer, theRequest, sizeof(theRequest));
+			char theHeader[64];
+			int theHeaderSize = ::snprintf(theHeader, sizeof(theHeader),
+				"HTTP/1.0 200 OK\r\nContent-Length: %u\r\n\r\n", (unsigned int) inSize);
+			(void) ::write(thePeer, theHeader, theHeaderSize);
+			KUInt8 theBody[4096];
+			for (KUInt32 indexByte = 0; indexByte < inSize; indexByte += sizeof(theBody))
+			{
+				KUInt32 theCount = inSize - indexByte;
+				if (theCount > sizeof(theBody))
+				{
+					theCount = sizeof(theBody);
+				}
+				for (KUInt32 indexBody = 0; indexBody < theCount; indexBody++)
+				{
+					theBody[indexBody] = (KUInt8) ((indexByte + indexBody) * 7);
+				}
+				if (::write(thePeer, theBody, theCount) != (ssize_t) theCount)
+				{
+					break;
+				}
+			}
+			::close(thePeer);
+		});
+
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	auto theStart = std::chrono::steady_clock::now();
+	SendUsermodeNetworkTestsPacket(theNet, 3000, thePort, 0x02, 100, 0, nullptr, 0, inWindow);
+	KUInt8 theFrame[1600];
+	ASSERT_EQ(58u, theNet->DataAvailable());
+	ASSERT_EQ(0, theNet->ReceiveData(theFrame, 58));
+	KUInt32 theSeq = ((KUInt32) theFrame[38] << 24) | ((KUInt32) theFrame[39] << 16)
+		| ((KUInt32) theFrame[40] << 8) | theFrame[41];
+	KUInt32 theNext = theSeq + 1;
+	KUInt32 theAcked = theNext;
+	SendUsermodeNetworkTestsPacket(theNet, 3000, thePort, 0x10, 101, theNext, nullptr, 0, inWindow);
+	const char* theRequest = "GET / HTTP/1.0\r\n\r\n";
+	SendUsermodeNetworkTestsPacket(theNet, 3000, thePort, 0x18, 101, theNext,
+		theRequest, (KUInt32) ::strlen(theRequest), inWindow);
+	KUInt32 theRequestEnd = 101 + (KUInt32) ::strlen(theRequest);
+
+	// Before any ACK, the reader thread sends as many segments as the
+	// window holds.
+	auto theQueueDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+	while ((theNet->GetPacketCount() < (KUInt32) (inWindow / 1448))
+		&& (std::chrono::steady_clock::now() < theQueueDeadline))
+	{
+		std::this_thread::yield();
+	}
+	*outQueued = theNet->GetPacketCount();
+
+	KUInt8* theData = (KUInt8*) ::malloc(inSize + 64);
+	KUInt32 theDataSize = 0;
+	KUInt32 theSegments = 0;
+	KUInt32 theMaxInFlight = 0;
+	bool theFIN = false;
+	auto theDeadline = theStart + std::chrono::seconds(20);
+	while (!theFIN && (std::chrono::steady_clock::now() < theDeadline))
+	{
+		KUInt32 theSize = theNet->DataAvailable();
+		if (theSize == 0)
+		{
+			// The delayed ACK timer.
+			if (theAcked != theNext)
+			{
+				theAcked = theNext;
+				SendUsermodeNetworkTestsPacket(theNet, 3000, thePort, 0x10, theRequestEnd, theAcked, nullptr, 0, inWindow);
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+			continue;
+		}
+		ASSERT_LE(theSize, sizeof(theFrame));
+		ASSERT_EQ(0, theNet->ReceiveData(theFrame, theSize));
+		KUInt32 thePayloadSize = theSize - 54;
+		if (thePayloadSize)
+		{
+			theSeq = ((KUInt32) theFrame[38] << 24) | ((KUInt32) theFrame[39] << 16)
+				| ((KUInt32) theFrame[40] << 8) | theFrame[41];
+			ASSERT_EQ(theNext, theSeq);
+			ASSERT_LE(theDataSize + thePayloadSize, inSize + 64);
+			(void) ::memcpy(theData + theDataSize, theFrame + 54, thePayloadSize);
+			theDataSize += thePayloadSize;
+			theNext += thePayloadSize;
+			theSegments++;
+			if (theNext - theAcked > theMaxInFlight)
+			{
+				theMaxInFlight = theNext - theAcked;
+			}
+			if (theSegments % 2 == 0)
+			{
+				theAcked = theNext;
+				SendUsermodeNetworkTestsPacket(theNet, 3000, thePort, 0x10, theRequestEnd, theAcked, nullptr, 0, inWindow);
+			}
+		}
+		theFIN = (theFrame[47] & 0x01) != 0;
+	}
+
+	EXPECT_TRUE(theFIN);
+	EXPECT_LE(theMaxInFlight, inWindow);
+	const char* theBody = (const char*) ::memmem(theData, theDataSize, "\r\n\r\n", 4);
+	ASSERT_NE(nullptr, theBody);
+	theBody += 4;
+	KUInt32 theBodySize = theDataSize - (KUInt32) (theBody - (const char*) theData);
+	EXPECT_EQ(inSize, theBodySize);
+	for (KUInt32 indexByte = 0; indexByte < theBodySize; indexByte++)
+	{
+		if ((KUInt8) theBody[indexByte] != (KUInt8) (indexByte * 7))
+		{
+			ADD_FAILURE() << "bad data at " << indexByte;
+			break;
+		}
+	}
+
+	theServer.join();
+	delete theNet;
+	::free(theData);
+	::close(theListener);
+}
+
+TEST(UsermodeNetworkTests, ConcurrentReceive)
+{
+	const int kFlows = 4;
+	const KUInt32 kSize = 1024 * 1024;
+	const KUInt16 kWindow = 16384;
+
+	int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_NE(-1, theListener);
+	struct sockaddr_in theAddress = {};
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t theLength = sizeof(theAddress);
+	ASSERT_EQ(0, ::bind(theListener, (struct sockaddr*) &theAddress, theLength));
+	ASSERT_EQ(0, ::listen(theListener, kFlows));
+	ASSERT_EQ(0, ::getsockname(theListener, (struct sockaddr*) &theAddress, &theLength));
+	KUInt16 thePort = ntohs(theAddress.sin_port);
+
+	// Open the connections, then let every peer send at once.
+	TUsermodeNetwork* theNet = new TUsermodeNetwork(nullptr);
+	int thePeers[kFlows];
+	KUInt32 theNext[kFlows];
+	KUInt32 theAcked[kFlows];
+	KUInt32 theReceived[kFlows];
+	KUInt32 theSegments[kFlows];
+	KUInt8 theFrame[1600];
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		SendUsermodeNetworkTestsPacket(theNet, 4000 + indexFlow, thePort, 0x02, 100, 0, nullptr, 0, kWindow);
+		thePeers[indexFlow] = ::accept(theListener, nullptr, nullptr);
+		ASSERT_NE(-1, thePeers[indexFlow]);
+		ASSERT_EQ(58u, theNet->DataAvailable());
+		ASSERT_EQ(0, theNet->ReceiveData(theFrame, 58));
+		KUInt32 theSeq = ((KUInt32) theFrame[38] << 24) | ((KUInt32) theFrame[39] << 16)
+			| ((KUInt32) theFrame[40] << 8) | theFrame[41];
+		theNext[indexFlow] = theAcked[indexFlow] = theSeq + 1;
+		theReceived[indexFlow] = theSegments[indexFlow] = 0;
+		SendUsermodeNetworkTestsPacket(theNet, 4000 + indexFlow, thePort, 0x10, 101, theNext[indexFlow], nullptr, 0, kWindow);
+	}
+	auto theStart = std::chrono::steady_clock::now();
+	std::thread theWriters[kFlows];
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		int thePeer = thePeers[indexFlow];
+		theWriters[indexFlow] = std::thread(
+			[=]() {
+				KUInt8 theBody[4096];
+				::memset(theBody, 'a' + indexFlow, sizeof(theBody));
+				for (KUInt32 indexByte = 0; indexByte < kSize; indexByte += sizeof(theBody))
+				{
+					if (::write(thePeer, theBody, sizeof(theBody)) != (ssize_t) sizeof(theBody))
+					{
+						break;
+					}
+				}
+			});
+	}
+
+	// Play the Newton: take the packets of all connections in order, and
+	// acknowledge every second segment of a connection, or when nothing
+	// else is waiting.
+	KUInt32 theTotal = 0;
+	Boolean theDataOK = true;
+	auto theDeadline = theStart + std::chrono::seconds(20);
+	while ((theTotal < kFlows * kSize) && (std::chrono::steady_clock::now() < theDeadline))
+	{
+		KUInt32 theSize = theNet->DataAvailable();
+		if (theSize == 0)
+		{
+			for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+			{
+				if (theAcked[indexFlow] != theNext[indexFlow])
+				{
+					theAcked[indexFlow] = theNext[indexFlow];
+					SendUsermodeNetworkTestsPacket(theNet, 4000 + indexFlow, thePort, 0x10, 101, theAcked[indexFlow], nullptr, 0, kWindow);
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+			continue;
+		}
+		ASSERT_LE(theSize, sizeof(theFrame));
+		ASSERT_EQ(0, theNet->ReceiveData(theFrame, theSize));
+		int indexFlow = (int) (((KUInt32) theFrame[36] << 8) | theFrame[37]) - 4000;
+		ASSERT_GE(indexFlow, 0);
+		ASSERT_LT(indexFlow, kFlows);
+		KUInt32 thePayloadSize = theSize - 54;
+		for (KUInt32 indexByte = 0; indexByte < thePayloadSize; indexByte++)
+		{
+			theDataOK = theDataOK && (theFrame[54 + indexByte] == 'a' + indexFlow);
+		}
+		theReceived[indexFlow] += thePayloadSize;
+		theNext[indexFlow] += thePayloadSize;
+		theTotal += thePayloadSize;
+		if (thePayloadSize && ((++theSegments[indexFlow] % 2) == 0))
+		{
+			theAcked[indexFlow] = theNext[indexFlow];
+			SendUsermodeNetworkTestsPacket(theNet, 4000 + indexFlow, thePort, 0x10, 101, theAcked[indexFlow], nullptr, 0, kWindow);
+		}
+	}
+
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		theWriters[indexFlow].join();
+		EXPECT_EQ(kSize, theReceived[indexFlow]) << "connection " << indexFlow;
+	}
+	EXPECT_TRUE(theDataOK);
+
+	delete theNet;
+	for (int indexFlow = 0; indexFlow < kFlows; indexFlow++)
+	{
+		::close(thePeers[indexFlow]);
+	}
+	::close(theListener);
+}
+
+TEST(UsermodeNetworkTests, BulkTransfer)
+{
+	// One segment in flight, as before the window was used, and a window
+	// of 16 kB. The window shows in the number of segments sent ahead of
+	// the ACKs.
+	KUInt32 theStopAndWait = 0;
+	KUInt32 theWindowed = 0;
+	DownloadUsermodeNetworkTestsFile(1448, 1024 * 1024, &theStopAndWait);
+	DownloadUsermodeNetworkTestsFile(16384, 1024 * 1024, &theWindowed);
+	EXPECT_GE(theWindowed, 16384u / 1448u);
+	EXPECT_GT(theWindowed, theStopAndWait);
+}
+#endif
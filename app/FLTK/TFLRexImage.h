@@ -0,0 +1,4 @@
+#ifndef TFLRexImage_h
+#define TFLRexImage_h
+extern unsigned char gEinsteinRexImage[289840];
+#endif
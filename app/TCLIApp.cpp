@@ -25,13 +25,21 @@
 #include "TCLIApp.h"
 
 // ANSI C & POSIX
+#include <Emulator/Serial/TSerialCapture.h>
 #include <Emulator/Serial/TTcpClientSerialPortManager.h>
+#if TARGET_OS_LINUX
+#include <Emulator/Serial/TSharedMemorySerialPortManager.h>
+#endif
+#include <errno.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -55,7 +63,13 @@
 #include "Emulator/Screen/TFBScreenManager.h"
 #define TX11ScreenManager TFBScreenManager
 #endif
+#include "Emulator/Screen/TCaptureScreenManager.h"
+#include "Emulator/Screen/TInkBenchmark.h"
+#include "Emulator/Screen/TInputReplay.h"
+#include "Emulator/Screen/TRFBScreenManager.h"
+#include "Emulator/Screen/TNullScreenManager.h"
 #include "Emulator/TEmulator.h"
+#include "Emulator/TInterruptManager.h"
 #include "Emulator/TMemory.h"
 #include "Monitor/TMonitor.h"
 #include "Monitor/TSymbolList.h"
@@ -82,7 +96,10 @@ TCLIApp::TCLIApp(void) :
 		mPlatformManager(nil),
 		mLog(nil),
 		mMonitor(nil),
-		mSymbolList(nil)
+		mSymbolList(nil),
+		mInputReplay(nil),
+		mCapturePath(nil),
+		mRFBPort(TRFBScreenManager::kDefaultPort)
 {
 	::pipe(mCmdPipe);
 }
@@ -94,6 +111,10 @@ TCLIApp::~TCLIApp(void)
 {
 	::close(mCmdPipe[0]);
 	::close(mCmdPipe[1]);
+	if (mInputReplay)
+	{
+		delete mInputReplay;
+	}
 	if (mEmulator)
 	{
 		delete mEmulator;
@@ -143,6 +164,16 @@ TCLIApp::Run(int argc, char* argv[])
 	const char* theScreenManagerClass = nil;
 	const char* theDataPath = ::getenv("EINSTEIN_HOME");
 	const char* theSerialPortDriver = "tcp"; // default settings,
+	const char* theForkServerPath = nil;
+	const char* theSharedScreenName = nil;
+	const char* theInkCorpusPath = nil;
+	const char* theInkReportPath = nil;
+	const char* theSerialCapturePath = nil;
+	int bootTime = 30; // Seconds to boot before forking sessions.
+	int inkSettleTime = TInkBenchmark::kDefaultSettleTime; // Milliseconds.
+	int virtualTimeRate = 0; // Timer ticks per 1024 JIT units, 0 for host time.
+	int warpSeconds = 0; // Max seconds skipped at once when idle, 0 for no warp.
+	int frameRate = TScreenManager::kDefaultFrameRate; // 0 to present every blit.
 	int portraitWidth = TScreenManager::kDefaultPortraitWidth;
 	int portraitHeight = TScreenManager::kDefaultPortraitHeight;
 	int ramSize = 0x40;
@@ -150,6 +181,7 @@ TCLIApp::Run(int argc, char* argv[])
 	Boolean useAIFROMFile = false; // Default is to use flat rom format.
 	Boolean faceless = false; // Default is to have an interface.
 	Boolean useMonitor = false; // Default is to not have a monitor.
+	Boolean slowSerialReceive = false; // Default is to pace with the bit rate.
 	int indexArgs = 1;
 	if (argc < 2 && theDataPath == NULL)
 	{
@@ -295,11 +327,101 @@ TCLIApp::Run(int argc, char* argv[])
 		{
 			theSerialPortDriver = argv[indexArgs] + 9;
 		} else if (::strcmp(argv[indexArgs], "--serial=tcp") == 0)
+		{
+			theSerialPortDriver = argv[indexArgs] + 9;
+		} else if (::strncmp(argv[indexArgs], "--serial=tcpserver", 18) == 0)
+		{
+			theSerialPortDriver = argv[indexArgs] + 9;
+		} else if (::strncmp(argv[indexArgs], "--serial=link", 13) == 0)
 		{
 			theSerialPortDriver = argv[indexArgs] + 9;
 		} else if (::strcmp(argv[indexArgs], "--serial=null") == 0)
 		{
 			theSerialPortDriver = nil; // no string sets null driver
+		} else if (::strcmp(argv[indexArgs], "--serial-slow-receive") == 0)
+		{
+			slowSerialReceive = true;
+		} else if (::strncmp(argv[indexArgs], "--serial-capture=", 17) == 0)
+		{
+			if (argv[indexArgs][17] == '\0')
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+			theSerialCapturePath = &argv[indexArgs][17];
+		} else if (::strncmp(argv[indexArgs], "--fork-server=", 14) == 0)
+		{
+			theForkServerPath = &argv[indexArgs][14];
+		} else if (::strncmp(argv[indexArgs], "--ink-bench=", 12) == 0)
+		{
+			theInkCorpusPath = &argv[indexArgs][12];
+		} else if (::strncmp(argv[indexArgs], "--ink-report=", 13) == 0)
+		{
+			theInkReportPath = &argv[indexArgs][13];
+		} else if (::sscanf(argv[indexArgs], "--ink-settle=%i", &inkSettleTime) == 1)
+		{
+			if (inkSettleTime <= 0)
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+		} else if (::sscanf(argv[indexArgs], "--boot-time=%i", &bootTime) == 1)
+		{
+			if (bootTime < 0)
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+		} else if (::strcmp(argv[indexArgs], "--virtual-time") == 0)
+		{
+			virtualTimeRate = TInterruptManager::kDefaultVirtualTicksPerKUnits;
+		} else if (::sscanf(argv[indexArgs], "--virtual-time=%i", &virtualTimeRate) == 1)
+		{
+			if (virtualTimeRate <= 0)
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+		} else if (::strcmp(argv[indexArgs], "--warp") == 0)
+		{
+			warpSeconds = 60;
+		} else if (::sscanf(argv[indexArgs], "--warp=%i", &warpSeconds) == 1)
+		{
+			// Skipped ticks must fit in 32 bits.
+			if ((warpSeconds <= 0) || (warpSeconds > 1165))
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+		} else if (::sscanf(argv[indexArgs], "--frame-rate=%i", &frameRate) == 1)
+		{
+			if (frameRate < 0)
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+		} else if (::strncmp(argv[indexArgs], "--capture=", 10) == 0)
+		{
+			if ((mScreenManager != nil) || (argv[indexArgs][10] == '\0'))
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+
+			theScreenManagerClass = "capture";
+			mCapturePath = &argv[indexArgs][10];
+		} else if (::strcmp(argv[indexArgs], "--rfb") == 0)
+		{
+			theScreenManagerClass = "rfb";
+		} else if (::sscanf(argv[indexArgs], "--rfb=%i", &mRFBPort) == 1)
+		{
+			if ((mRFBPort <= 0) || (mRFBPort > 65535))
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+
+			theScreenManagerClass = "rfb";
+		} else if (::strncmp(argv[indexArgs], "--shared-screen=", 16) == 0)
+		{
+			if (argv[indexArgs][16] != '/')
+			{
+				SyntaxError(argv[indexArgs]);
+			}
+
+			theSharedScreenName = &argv[indexArgs][16];
 		} else if (::strcmp(argv[indexArgs], "--aif") == 0)
 		{
 			useAIFROMFile = true;
@@ -328,6 +450,47 @@ TCLIApp::Run(int argc, char* argv[])
 		::exit(0);
 	}
 
+	if (theInkCorpusPath)
+	{
+		if (useMonitor || theForkServerPath)
+		{
+			(void) ::printf("--ink-bench excludes --monitor and --fork-server.\n");
+			::exit(1);
+		}
+		// The benchmark only needs the screen hash.
+		if (theScreenManagerClass == nil)
+		{
+			theScreenManagerClass = "null";
+		}
+		if (theSoundManagerClass == nil)
+		{
+			theSoundManagerClass = "null";
+		}
+	}
+
+	if (theForkServerPath)
+	{
+		if (useMonitor || theSerialCapturePath)
+		{
+			(void) ::printf("--fork-server excludes --monitor and --serial-capture.\n");
+			::exit(1);
+		}
+		// Sessions are headless and must not share host resources.
+		if ((theScreenManagerClass != nil) && (::strcmp(theScreenManagerClass, "null") != 0))
+		{
+			(void) ::printf("--fork-server requires the null screen.\n");
+			::exit(1);
+		}
+		theScreenManagerClass = "null";
+		theSoundManagerClass = "null";
+		theSerialPortDriver = nil;
+		// Each session reopens the log to its own file.
+		if (mLog == nil)
+		{
+			mLog = new TFileLog("/dev/null");
+		}
+	}
+
 	if (portraitHeight < portraitWidth)
 	{
 		(void) ::fprintf(
@@ -357,6 +520,11 @@ TCLIApp::Run(int argc, char* argv[])
 	{
 		CreateScreenManager(theScreenManagerClass, portraitWidth, portraitHeight, fullscreen);
 	}
+	if (theSharedScreenName && !mScreenManager->ExportScreenBuffer(theSharedScreenName))
+	{
+		(void) ::fprintf(stderr, "Cannot export the screen to %s\n", theSharedScreenName);
+		::exit(1);
+	}
 	if (theMachineString == nil)
 	{
 		theMachineString = defaultMachineString;
@@ -373,43 +541,81 @@ TCLIApp::Run(int argc, char* argv[])
 		(void) ::snprintf(theREX0Path, 512, "%s/%s.rex", theDataPath, theMachineString);
 		(void) ::snprintf(theROMImagePath, 512, "%s/%s.aif", theDataPath, theMachineString);
 		mROMImage = new TAIFROMImageWithREXes(
-			theROMImagePath, theREX0Path, theREX1Path, theMachineString, useMonitor);
+			theROMImagePath, theREX0Path, theREX1Path);
 	} else
 	{
 		(void) ::snprintf(theROMImagePath, 512, "%s/%s", theDataPath, theMachineString);
 		mROMImage = new TFlatROMImageWithREX(
-			theROMImagePath, theREX1Path, theMachineString, useMonitor);
+			theROMImagePath, theREX1Path);
 	}
-	mNetworkManager = new TNullNetwork(mLog);
+	if (mROMImage->GetErrorCode() != TROMImage::kNoError)
+	{
+		(void) ::fprintf(stderr, "Cannot load the ROM image %s (error %i)\n",
+			theROMImagePath, (int) mROMImage->GetErrorCode());
+		::exit(1);
+	}
+	mNetworkManager = new TNullNetworkManager(mLog);
 	mEmulator = new TEmulator(
 		mLog, mROMImage, theFlashPath,
 		mSoundManager, mScreenManager, mNetworkManager, ramSize << 16);
 
 	mPlatformManager = mEmulator->GetPlatformManager();
 
+	if (virtualTimeRate)
+	{
+		// The timer is not running yet.
+		mEmulator->GetInterruptManager()->EnableVirtualTime(virtualTimeRate);
+	}
+
+	if (warpSeconds)
+	{
+		mEmulator->GetInterruptManager()->SetWarp(
+			(KUInt32) warpSeconds * TInterruptManager::kTicksPerSecond);
+	}
+
+	mScreenManager->SetFrameRate((KUInt32) frameRate);
+
 	mEmulator->CallOnQuit(
 		[this]() {
 			::write(mCmdPipe[1], "Q", 1);
 		});
 
-	// the commandline argument is --serial=tcp:server:port . We currently support only TCP connections
+	// the commandline argument is --serial=tcp:server:port or --serial=tcpserver:address:port,
+	// or --serial=link:name to connect two emulators through shared memory.
 	// theSerialDriver is either nil or text in the format 'server' or 'server:port' without single quotes
 	auto extrPortDriverType = TSerialPorts::kNullDriver;
-	if (theSerialPortDriver && strncmp(theSerialPortDriver, "tcp", 3) == 0)
+	if (theSerialPortDriver && strncmp(theSerialPortDriver, "tcpserver", 9) == 0)
+		extrPortDriverType = TSerialPorts::kTcpServerDriver;
+	else if (theSerialPortDriver && strncmp(theSerialPortDriver, "tcp", 3) == 0)
 		extrPortDriverType = TSerialPorts::kTcpClientDriver;
+	else if (theSerialPortDriver && strncmp(theSerialPortDriver, "link", 4) == 0)
+		extrPortDriverType = TSerialPorts::kSharedMemoryDriver;
+	if (theSerialCapturePath)
+	{
+		// The drivers are created by Initialize and get the capture then.
+		TSerialCapture* theCapture = new TSerialCapture(theSerialCapturePath);
+		if (!theCapture->IsOpen())
+		{
+			(void) ::fprintf(stderr, "Cannot create %s\n", theSerialCapturePath);
+			::exit(1);
+		}
+		mEmulator->SerialPorts.SetCapture(theCapture);
+	}
 	mEmulator->SerialPorts.Initialize(
 		extrPortDriverType,
 		TSerialPorts::kNullDriver,
 		TSerialPorts::kNullDriver,
 		TSerialPorts::kNullDriver);
-	if (extrPortDriverType == TSerialPorts::kTcpClientDriver)
+	if ((extrPortDriverType == TSerialPorts::kTcpClientDriver)
+		|| (extrPortDriverType == TSerialPorts::kTcpServerDriver))
 	{
 		TSerialPortManager* sDriver = mEmulator->SerialPorts.GetDriverFor(TSerialPorts::kExtr);
 		TTcpClientSerialPortManager* tcp = dynamic_cast<TTcpClientSerialPortManager*>(sDriver);
 		if (tcp)
 		{
 			int port = 3679;
-			theSerialPortDriver += 3; // skip 'tcp'
+			// skip 'tcp' or 'tcpserver'
+			theSerialPortDriver += (extrPortDriverType == TSerialPorts::kTcpServerDriver) ? 9 : 3;
 			if (theSerialPortDriver[0] == ':')
 				theSerialPortDriver++; // skip the ':' in 'tcp:'
 			char* server = strdup(theSerialPortDriver);
@@ -426,9 +632,20 @@ TCLIApp::Run(int argc, char* argv[])
 			}
 			tcp->SetServerPort(port);
 			tcp->SetServerAddress(server);
+			tcp->SetSlowReceive(slowSerialReceive);
 			::free(server);
 		}
 	}
+#if TARGET_OS_LINUX
+	if (extrPortDriverType == TSerialPorts::kSharedMemoryDriver)
+	{
+		TSerialPortManager* sDriver = mEmulator->SerialPorts.GetDriverFor(TSerialPorts::kExtr);
+		TSharedMemorySerialPortManager* link = dynamic_cast<TSharedMemorySerialPortManager*>(sDriver);
+		// the argument is 'link' or 'link:name'
+		if (link && (theSerialPortDriver[4] == ':') && theSerialPortDriver[5])
+			link->SetLinkName(theSerialPortDriver + 5);
+	}
+#endif
 #if 0
     // TODO: translate this code from whatever we did in macOS
     TSerialPortManager *extr = mEmulator->SerialPorts.GetDriverFor(TSerialPorts::kExtr);
@@ -461,6 +678,11 @@ TCLIApp::Run(int argc, char* argv[])
     );
 #endif
 
+	if (theRestoreFile)
+	{
+		mEmulator->LoadState(theRestoreFile);
+	}
+
 	if (useMonitor)
 	{
 		char theSymbolListPath[512];
@@ -473,6 +695,21 @@ TCLIApp::Run(int argc, char* argv[])
 		(void) ::printf("Booting...\n");
 	}
 
+	if (theForkServerPath)
+	{
+		// A restored state is ready to serve.
+		RunForkServer(theForkServerPath, theRestoreFile ? 0 : bootTime);
+		return;
+	}
+
+	if (theInkCorpusPath)
+	{
+		// A restored state is ready for input.
+		RunInkBenchmark(theInkCorpusPath, theInkReportPath, inkSettleTime,
+			theRestoreFile ? 0 : bootTime);
+		return;
+	}
+
 	pthread_t theThread;
 	int theErr = ::pthread_create(&theThread, NULL, SThreadEntry, this);
 	if (theErr)
@@ -490,6 +727,223 @@ TCLIApp::Run(int argc, char* argv[])
 	(void) ::pthread_join(theThread, NULL);
 }
 
+// -------------------------------------------------------------------------- //
+// RunForkServer( const char*, int )
+// -------------------------------------------------------------------------- //
+void
+TCLIApp::RunForkServer(const char* inSocketPath, int inBootTime)
+{
+	// Boot (or resume the restored state) once.
+	pthread_t theThread;
+	int theErr = ::pthread_create(&theThread, NULL, SThreadEntry, this);
+	if (theErr)
+	{
+		(void) ::fprintf(stderr, "Error with pthread_create (%i)\n", theErr);
+		::exit(2);
+	}
+	// Stop() is lost if Run() didn't start yet, as with a restored state.
+	while (!mEmulator->IsRunning())
+	{
+		(void) ::usleep(1000);
+	}
+	(void) ::sleep(inBootTime);
+
+	// Pause the emulator. Run() suspends the timer when it returns.
+	mEmulator->Stop();
+	(void) ::pthread_join(theThread, NULL);
+
+	// Swallow the quit notification the emulator thread sent us.
+	char theByte;
+	(void) ::read(mCmdPipe[0], &theByte, 1);
+
+	// Only this thread may exist when we fork. The null screen, sound and
+	// serial drivers have no thread.
+	mEmulator->GetInterruptManager()->StopTimerThread();
+	if (!mNetworkManager->StopThreads())
+	{
+		(void) ::fprintf(stderr, "Couldn't stop the network threads\n");
+		::exit(2);
+	}
+
+	int theServer = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un theAddress;
+	::memset(&theAddress, 0, sizeof(theAddress));
+	theAddress.sun_family = AF_UNIX;
+	(void) ::strncpy(theAddress.sun_path, inSocketPath, sizeof(theAddress.sun_path) - 1);
+	(void) ::unlink(inSocketPath);
+	if ((theServer < 0)
+		|| (::bind(theServer, (struct sockaddr*) &theAddress, sizeof(theAddress)) < 0)
+		|| (::listen(theServer, 16) < 0))
+	{
+		(void) ::fprintf(stderr, "Couldn't listen on %s (%i)\n", inSocketPath, errno);
+		::exit(2);
+	}
+
+	// We don't wait for the sessions.
+	(void) ::signal(SIGCHLD, SIG_IGN);
+
+	(void) ::printf("Ready, waiting for sessions on %s\n", inSocketPath);
+	(void) ::fflush(stdout);
+
+	while (true)
+	{
+		int theSession = ::accept(theServer, NULL, NULL);
+		if (theSession < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			(void) ::fprintf(stderr, "Error with accept (%i)\n", errno);
+			break;
+		}
+
+		pid_t thePID = ::fork();
+		if (thePID == 0)
+		{
+			::close(theServer);
+			RunForkedSession(theSession, inSocketPath);
+			// Never returns.
+		} else if (thePID < 0)
+		{
+			(void) ::fprintf(stderr, "Error with fork (%i)\n", errno);
+		}
+		::close(theSession);
+	}
+
+	::close(theServer);
+	(void) ::unlink(inSocketPath);
+}
+
+// -------------------------------------------------------------------------- //
+// RunForkedSession( int, const char* )
+// -------------------------------------------------------------------------- //
+void
+TCLIApp::RunForkedSession(int inSession, const char* inSocketPath)
+{
+	// The request is a single line with the path to the session log.
+	char theLogPath[512];
+	KUInt32 theIndex = 0;
+	char theChar;
+	while ((theIndex < sizeof(theLogPath) - 1)
+		&& (::read(inSession, &theChar, 1) == 1)
+		&& (theChar != '\n'))
+	{
+		if (theChar != '\r')
+		{
+			theLogPath[theIndex++] = theChar;
+		}
+	}
+	theLogPath[theIndex] = 0;
+	if (theIndex == 0)
+	{
+		(void) ::snprintf(theLogPath, sizeof(theLogPath), "%s.%i.log",
+			inSocketPath, (int) ::getpid());
+	}
+	// The fork server excludes the monitor, so the log is a file log.
+	TFileLog* theFileLog = dynamic_cast<TFileLog*>(mLog);
+	if (theFileLog == nil)
+	{
+		(void) ::fprintf(stderr, "Session %i can't have a log of its own\n", (int) ::getpid());
+		::_exit(2);
+	}
+	theFileLog->Reopen(theLogPath);
+
+	// RAM is copy-on-write already, the flash is mapped from a file.
+	mEmulator->GetMemory()->MakeFlashPrivate();
+
+	// The connection is our console.
+	(void) ::dup2(inSession, STDIN_FILENO);
+	(void) ::dup2(inSession, STDOUT_FILENO);
+	::close(inSession);
+	(void) ::setvbuf(stdout, NULL, _IOLBF, 0);
+	(void) ::printf("Einstein session %i, log is %s\n", (int) ::getpid(), theLogPath);
+
+	mEmulator->GetInterruptManager()->StartTimerThread();
+	mNetworkManager->StartThreads();
+
+	pthread_t theThread;
+	int theErr = ::pthread_create(&theThread, NULL, SThreadEntry, this);
+	if (theErr)
+	{
+		(void) ::printf("Error with pthread_create (%i)\n", theErr);
+		::_exit(2);
+	}
+
+	MenuLoop();
+
+	(void) ::pthread_join(theThread, NULL);
+	(void) ::fflush(stdout);
+
+	// Don't run the destructors: some would join threads of the parent.
+	::_exit(0);
+}
+
+// -------------------------------------------------------------------------- //
+// RunInkBenchmark( const char*, const char*, int, int )
+// -------------------------------------------------------------------------- //
+void
+TCLIApp::RunInkBenchmark(
+	const char* inCorpusPath,
+	const char* inReportPath,
+	int inSettleTime,
+	int inBootTime)
+{
+	FILE* theCorpus = ::fopen(inCorpusPath, "r");
+	if (theCorpus == nil)
+	{
+		(void) ::fprintf(stderr, "Cannot open %s\n", inCorpusPath);
+		::exit(1);
+	}
+
+	pthread_t theThread;
+	int theErr = ::pthread_create(&theThread, NULL, SThreadEntry, this);
+	if (theErr)
+	{
+		(void) ::fprintf(stderr, "Error with pthread_create (%i)\n", theErr);
+		::exit(2);
+	}
+	(void) ::sleep(inBootTime);
+
+	// The corpus has the path of a stroke log per line.
+	TInkBenchmark theBenchmark(
+		mLog, mScreenManager, mEmulator->GetInterruptManager(), mPlatformManager);
+	theBenchmark.SetSettleTime((KUInt32) inSettleTime);
+	char theLine[1024];
+	while (::fgets(theLine, sizeof(theLine), theCorpus))
+	{
+		theLine[::strcspn(theLine, "\r\n")] = 0;
+		if ((theLine[0] == 0) || (theLine[0] == '#'))
+		{
+			continue;
+		}
+		if (!theBenchmark.RunStroke(theLine))
+		{
+			(void) ::fprintf(stderr, "Cannot read the stroke %s\n", theLine);
+		}
+	}
+	(void) ::fclose(theCorpus);
+
+	mEmulator->Quit();
+	(void) ::pthread_join(theThread, NULL);
+
+	FILE* theReport = stdout;
+	if (inReportPath)
+	{
+		theReport = ::fopen(inReportPath, "w");
+		if (theReport == nil)
+		{
+			(void) ::fprintf(stderr, "Cannot write %s\n", inReportPath);
+			::exit(1);
+		}
+	}
+	theBenchmark.WriteReport(theReport);
+	if (theReport != stdout)
+	{
+		(void) ::fclose(theReport);
+	}
+}
+
 // -------------------------------------------------------------------------- //
 // ThreadEntry( void )
 // -------------------------------------------------------------------------- //
@@ -545,7 +999,6 @@ TCLIApp::MonitorMenuLoop(void)
 	(void) ::tcsetattr(STDIN_FILENO, TCSANOW, &theNewOptions);
 
 	int monitor_fd = mMonitor->GetMonitorSocket();
-	int max_fd = monitor_fd;
 
 	char theCommand[2048];
 	KUInt32 theIndex = 0;
@@ -640,7 +1093,7 @@ TCLIApp::MonitorMenuLoop(void)
 			if (!knownCommand)
 			{
 				char buffer[256];
-				(void) ::sprintf(buffer, "Unknown command '%s'", theCommand);
+				(void) ::snprintf(buffer, sizeof(buffer), "Unknown command '%.200s'", theCommand);
 				(void) ::printf("\007");
 				PrintLine(buffer);
 			}
@@ -698,7 +1151,7 @@ TCLIApp::AppMenuLoop(void)
 			if (!knownCommand)
 			{
 				char buffer[256];
-				(void) ::sprintf(buffer, "Unknown command '%s'", theCommand);
+				(void) ::snprintf(buffer, sizeof(buffer), "Unknown command '%.200s'", theCommand);
 				PrintLine(buffer);
 			}
 		} // else: ignore empty lines.
@@ -714,6 +1167,7 @@ Boolean
 TCLIApp::ExecuteCommand(const char* inCommand)
 {
 	char theArg[2048];
+	unsigned long long theHash;
 
 	Boolean knownCommand = true;
 	if (::strcmp(inCommand, "help") == 0)
@@ -733,10 +1187,54 @@ TCLIApp::ExecuteCommand(const char* inCommand)
 		mPlatformManager->SendBacklightEvent();
 	} else if (::strcmp(inCommand, "insert") == 0)
 	{
-		mEmulator->InsertCard();
+		mPlatformManager->SendNetworkCardEvent();
 	} else if (::sscanf(inCommand, "save %s", theArg) == 1)
 	{
 		mEmulator->SaveState(theArg);
+	} else if (::strcmp(inCommand, "hash") == 0)
+	{
+		(void) ::snprintf(theArg, sizeof(theArg), "%016llX",
+			(unsigned long long) mScreenManager->GetScreenHash());
+		PrintLine(theArg);
+	} else if (::sscanf(inCommand, "wait %llx", &theHash) == 1)
+	{
+		// Poll until the screen matches, 10 seconds by default.
+		int theSeconds = 10;
+		(void) ::sscanf(inCommand, "wait %*s %i", &theSeconds);
+		KUInt64 theScreenHash = mScreenManager->GetScreenHash();
+		for (int indexPoll = 0;
+			 (theScreenHash != theHash) && (indexPoll < theSeconds * 100);
+			 indexPoll++)
+		{
+			(void) ::usleep(10000);
+			theScreenHash = mScreenManager->GetScreenHash();
+		}
+		if (theScreenHash == theHash)
+		{
+			PrintLine("ok");
+		} else
+		{
+			(void) ::snprintf(theArg, sizeof(theArg), "timeout %016llX",
+				(unsigned long long) theScreenHash);
+			PrintLine(theArg);
+		}
+	} else if (::sscanf(inCommand, "replay %s", theArg) == 1)
+	{
+		if (mInputReplay == nil)
+		{
+			mInputReplay = new TInputReplay(
+				mLog, mScreenManager, mEmulator->GetInterruptManager(), mPlatformManager);
+		}
+		if (mInputReplay->Load(theArg))
+		{
+			mInputReplay->Start();
+			(void) ::snprintf(theArg, sizeof(theArg), "replaying %u events",
+				(unsigned int) mInputReplay->GetEventCount());
+			PrintLine(theArg);
+		} else
+		{
+			PrintLine("Cannot read the input log");
+		}
 	} else if (::strcmp(inCommand, "quit") == 0)
 	{
 		mQuit = true;
@@ -764,6 +1262,9 @@ TCLIApp::PrintHelp(void)
 	PrintLine("backlight          press the power button (long)");
 	PrintLine("ns command         compile and execute NewtonScript command");
 	PrintLine("save path          save state to file");
+	PrintLine("hash               print the hash of the screen");
+	PrintLine("wait hash [secs]   wait until the screen has this hash");
+	PrintLine("replay path        replay a pen and keyboard event log");
 	if (mMonitor)
 	{
 		mMonitor->PrintHelp();
@@ -840,9 +1341,18 @@ TCLIApp::Help(void)
 	(void) ::printf(
 		"  -a | --audio=audiodriver        (null, portaudio, coreaudio, pulseaudio)\n");
 	(void) ::printf(
-		"  -s | --screen=screen driver     (x11)\n");
+		"  -s | --screen=screen driver     (x11, null, capture, rfb)\n");
 	(void) ::printf(
 		"  --serial=serialdriver           (null, tcp:server:port, default is tcp:127.0.0.1:3679)\n");
+	(void) ::printf(
+		"                                  (tcpserver:address:port listens on port, 0 for any)\n");
+	(void) ::printf(
+		"                                  (link:name connects to the emulator with the same name)\n");
+	(void) ::printf(
+		"  --serial-slow-receive           deliver received data at about 10 KB/s, for old software\n");
+	(void) ::printf(
+		"  --serial-capture=capture file   record the serial traffic with timestamps\n"
+		"                                  (print it with EinsteinSerialDump)\n");
 	(void) ::printf(
 		"  --width=portrait width          (default is 320)\n");
 	(void) ::printf(
@@ -859,6 +1369,38 @@ TCLIApp::Help(void)
 		"  --ram=size                      ram size in 64 KB (1-255) (default: 64, i.e. 4 MB)\n");
 	(void) ::printf(
 		"  --aif                           read aif files\n");
+	(void) ::printf(
+		"  --fork-server=socket path       boot once, then fork a headless session\n"
+		"                                  per connection on this unix socket\n");
+	(void) ::printf(
+		"  --boot-time=seconds             time to boot before forking (default: 30,\n"
+		"                                  none with --restore)\n");
+	(void) ::printf(
+		"  --virtual-time[=ticks]          derive time from executed instructions\n"
+		"                                  (timer ticks per 1024 units, default: 23)\n");
+	(void) ::printf(
+		"  --warp[=seconds]                skip idle time up to the next timer\n"
+		"                                  (max seconds at once, default: 60)\n");
+	(void) ::printf(
+		"  --frame-rate=fps                max screen updates per second, 0 for\n"
+		"                                  every blit (default: 0)\n");
+	(void) ::printf(
+		"  --capture=capture file          record the screen without a window\n"
+		"                                  (render it with EinsteinCapture)\n");
+	(void) ::printf(
+		"  --rfb[=port]                    serve the screen to VNC clients on the\n"
+		"                                  loopback interface (default: 5900)\n");
+	(void) ::printf(
+		"  --shared-screen=/name           export the screen buffer in the shared\n"
+		"                                  memory region /name\n");
+	(void) ::printf(
+		"  --ink-bench=corpus file         replay the stroke logs listed in the\n"
+		"                                  file and report recognition times\n");
+	(void) ::printf(
+		"  --ink-report=report file        JSON report of --ink-bench (default: stdout)\n");
+	(void) ::printf(
+		"  --ink-settle=ms                 still screen time that ends a stroke\n"
+		"                                  (default: 500)\n");
 	::exit(1);
 }
 
@@ -928,7 +1470,44 @@ TCLIApp::CreateScreenManager(
 	int inPortraitHeight,
 	Boolean inFullScreen)
 {
-	if (::strcmp(inClass, "x11") == 0)
+	if (::strcmp(inClass, "null") == 0)
+	{
+		mScreenManager = new TNullScreenManager(
+			mLog,
+			inPortraitWidth,
+			inPortraitHeight);
+	} else if (::strcmp(inClass, "capture") == 0)
+	{
+		if (mCapturePath == nil)
+		{
+			(void) ::fprintf(stderr, "The capture screen requires --capture=file\n");
+			::exit(1);
+		}
+		TCaptureScreenManager* theScreenManager = new TCaptureScreenManager(
+			mLog,
+			mCapturePath,
+			inPortraitWidth,
+			inPortraitHeight);
+		if (!theScreenManager->IsCapturing())
+		{
+			(void) ::fprintf(stderr, "Cannot create %s\n", mCapturePath);
+			::exit(1);
+		}
+		mScreenManager = theScreenManager;
+	} else if (::strcmp(inClass, "rfb") == 0)
+	{
+		TRFBScreenManager* theScreenManager = new TRFBScreenManager(
+			mLog,
+			(KUInt16) mRFBPort,
+			inPortraitWidth,
+			inPortraitHeight);
+		if (!theScreenManager->IsListening())
+		{
+			(void) ::fprintf(stderr, "Cannot listen on port %i\n", mRFBPort);
+			::exit(1);
+		}
+		mScreenManager = theScreenManager;
+	} else if (::strcmp(inClass, "x11") == 0)
 	{
 		Boolean screenIsLandscape = true;
 
@@ -37,6 +37,7 @@ class TLog;
 class TPlatformManager;
 class TMonitor;
 class TSymbolList;
+class TInputReplay;
 
 ///
 /// Classe pour le programme einstein en ligne de commande.
@@ -136,6 +137,36 @@ private:
 	///
 	void ThreadEntry(void);
 
+	///
+	/// Boot once, then fork a session for every connection on a unix socket.
+	///
+	/// \param inSocketPath	path of the unix socket to listen on.
+	/// \param inBootTime	time to let the emulator run before forking (s).
+	///
+	void RunForkServer(const char* inSocketPath, int inBootTime);
+
+	///
+	/// Run a forked session on a connection (in the child, never returns).
+	///
+	/// \param inSession		connected socket.
+	/// \param inSocketPath	path of the server socket (for the default log).
+	///
+	void RunForkedSession(int inSession, const char* inSocketPath);
+
+	///
+	/// Replay a corpus of strokes and report how fast they are recognized.
+	///
+	/// \param inCorpusPath	file with the paths of the stroke logs.
+	/// \param inReportPath	path of the JSON report (nil for stdout).
+	/// \param inSettleTime	time the screen must be still (ms).
+	/// \param inBootTime	time to let the emulator run before (s).
+	///
+	void RunInkBenchmark(
+		const char* inCorpusPath,
+		const char* inReportPath,
+		int inSettleTime,
+		int inBootTime);
+
 	///
 	/// Boucle du menu.
 	///
@@ -179,6 +210,9 @@ private:
 	TLog* mLog; ///< Log.
 	TMonitor* mMonitor; ///< Monitor.
 	TSymbolList* mSymbolList; ///< List of symbols.
+	TInputReplay* mInputReplay; ///< Replay of an input log (replay command).
+	const char* mCapturePath; ///< Path of the capture stream (--capture).
+	int mRFBPort; ///< Port of the RFB server (--rfb).
 	Boolean mQuit; ///< If we should quit.
 	int mCmdPipe[2] { -1, -1 }; ///< Make the command line wait for keyboard an a possible Quit event
 };
@@ -0,0 +1,40 @@
+// ==============================
+// File:			Version_CMake.h
+// Project:			Einstein
+//
+// Copyright 2003-2022 by Paul Guyot (pguyot@kallisys.net).
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+#ifndef _VERSION_CMAKE_H
+#define _VERSION_CMAKE_H
+
+#define PROJECT_NAME "Einstein"
+#define PROJECT_VER  "2022.4.20"
+#define PROJECT_VER_MAJOR "2022"
+#define PROJECT_VER_MINOR "4"
+#define PROJECT_VER_PATCH "20"
+
+#define COMPILE_TIME_YYYY 2026
+// if the month is "09", C++ would interprete the number as octal, so we generate "109-100" instead.
+#define COMPILE_TIME_MM (110-100)
+#define COMPILE_TIME_DD (119-100)
+
+#endif
+		// _VERSION_CMAKE_H
+
@@ -0,0 +1,602 @@
+// ==============================
+// File:			einstein_capture.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+// Renders a stream written by TCaptureScreenManager (--capture=path) into
+// PNG files, one per frame, or into a single animated PNG.
+//
+// PNG files are 8 bits indexed, with 16 grays and 16 greens (backlight).
+// They are compressed with deflate fixed codes, with matches on the same
+// row (runs) and on the previous row only, which suits the Newton screen
+// well enough and avoids a dependency on zlib.
+
+#include <K/Defines/KDefinitions.h>
+
+// ANSI C & POSIX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// C++
+#include <vector>
+
+// Einstein
+#include "Emulator/Screen/TCaptureScreenManager.h"
+#include "Emulator/Screen/TCaptureStreamReader.h"
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+static const KUInt16 kLengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const KUInt8 kLengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const KUInt16 kDistanceBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577
+};
+static const KUInt8 kDistanceExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const KUInt32 kMaxMatch = 258;
+static const KUInt32 kMaxDistance = 32768;
+static const KUInt32 kLastFrameDelay = 1000; // ms
+
+///
+/// Deflate stream with the fixed codes (RFC 1951, 3.2.6).
+///
+class TFixedDeflater
+{
+public:
+	TFixedDeflater(std::vector<KUInt8>* outData) :
+			mData(outData),
+			mBits(0),
+			mBitCount(0)
+	{
+	}
+
+	///
+	/// Write bits, least significant first.
+	///
+	void
+	PutBits(KUInt32 inValue, KUInt32 inCount)
+	{
+		mBits |= inValue << mBitCount;
+		mBitCount += inCount;
+		while (mBitCount >= 8)
+		{
+			mData->push_back((KUInt8) mBits);
+			mBits >>= 8;
+			mBitCount -= 8;
+		}
+	}
+
+	///
+	/// Write a Huffman code, most significant bit first.
+	///
+	void
+	PutCode(KUInt32 inCode, KUInt32 inCount)
+	{
+		KUInt32 theReversed = 0;
+		for (KUInt32 indexBit = 0; indexBit < inCount; indexBit++)
+		{
+			theReversed = (theReversed << 1) | ((inCode >> indexBit) & 1);
+		}
+		PutBits(theReversed, inCount);
+	}
+
+	///
+	/// Write a literal or a length symbol.
+	///
+	void
+	PutSymbol(KUInt32 inSymbol)
+	{
+		if (inSymbol < 144)
+		{
+			PutCode(0x30 + inSymbol, 8);
+		} else if (inSymbol < 256)
+		{
+			PutCode(0x190 + (inSymbol - 144), 9);
+		} else if (inSymbol < 280)
+		{
+			PutCode(inSymbol - 256, 7);
+		} else
+		{
+			PutCode(0xC0 + (inSymbol - 280), 8);
+		}
+	}
+
+	///
+	/// Write a match.
+	///
+	void
+	PutMatch(KUInt32 inLength, KUInt32 inDistance)
+	{
+		KUInt32 indexLength = 28;
+		while (kLengthBase[indexLength] > inLength)
+		{
+			indexLength--;
+		}
+		PutSymbol(257 + indexLength);
+		PutBits(inLength - kLengthBase[indexLength], kLengthExtra[indexLength]);
+		KUInt32 indexDistance = 29;
+		while (kDistanceBase[indexDistance] > inDistance)
+		{
+			indexDistance--;
+		}
+		PutCode(indexDistance, 5);
+		PutBits(inDistance - kDistanceBase[indexDistance], kDistanceExtra[indexDistance]);
+	}
+
+	///
+	/// Flush the last bits.
+	///
+	void
+	Finish(void)
+	{
+		if (mBitCount > 0)
+		{
+			PutBits(0, 8 - mBitCount);
+		}
+	}
+
+private:
+	std::vector<KUInt8>* mData;
+	KUInt32 mBits;
+	KUInt32 mBitCount;
+};
+
+// -------------------------------------------------------------------------- //
+//  * MatchLength( const std::vector<KUInt8>&, KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+static KUInt32
+MatchLength(const std::vector<KUInt8>& inData, KUInt32 inPos, KUInt32 inDistance)
+{
+	if ((inDistance == 0) || (inDistance > inPos) || (inDistance > kMaxDistance))
+	{
+		return 0;
+	}
+	KUInt32 theMax = (KUInt32) inData.size() - inPos;
+	if (theMax > kMaxMatch)
+	{
+		theMax = kMaxMatch;
+	}
+	KUInt32 theLength = 0;
+	while ((theLength < theMax)
+		&& (inData[inPos + theLength] == inData[inPos + theLength - inDistance]))
+	{
+		theLength++;
+	}
+	return theLength;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Compress( const std::vector<KUInt8>&, KUInt32, std::vector<KUInt8>* )
+// -------------------------------------------------------------------------- //
+static void
+Compress(
+	const std::vector<KUInt8>& inData,
+	KUInt32 inRowBytes,
+	std::vector<KUInt8>* outData)
+{
+	// zlib header: deflate, 32 KB window, no dictionary.
+	outData->push_back(0x78);
+	outData->push_back(0x01);
+
+	TFixedDeflater theDeflater(outData);
+	theDeflater.PutBits(1, 1); // Final block.
+	theDeflater.PutBits(1, 2); // Fixed codes.
+	KUInt32 thePos = 0;
+	KUInt32 theSize = (KUInt32) inData.size();
+	while (thePos < theSize)
+	{
+		KUInt32 theRun = MatchLength(inData, thePos, 1);
+		KUInt32 theUp = MatchLength(inData, thePos, inRowBytes);
+		if ((theUp >= 3) && (theUp >= theRun))
+		{
+			theDeflater.PutMatch(theUp, inRowBytes);
+			thePos += theUp;
+		} else if (theRun >= 3)
+		{
+			theDeflater.PutMatch(theRun, 1);
+			thePos += theRun;
+		} else
+		{
+			theDeflater.PutSymbol(inData[thePos]);
+			thePos++;
+		}
+	}
+	theDeflater.PutSymbol(256);
+	theDeflater.Finish();
+
+	KUInt32 theA = 1;
+	KUInt32 theB = 0;
+	for (KUInt32 index = 0; index < theSize; index++)
+	{
+		theA = (theA + inData[index]) % 65521;
+		theB = (theB + theA) % 65521;
+	}
+	KUInt32 theAdler = (theB << 16) | theA;
+	outData->push_back((KUInt8) (theAdler >> 24));
+	outData->push_back((KUInt8) (theAdler >> 16));
+	outData->push_back((KUInt8) (theAdler >> 8));
+	outData->push_back((KUInt8) theAdler);
+}
+
+// -------------------------------------------------------------------------- //
+//  * Append32( std::vector<KUInt8>*, KUInt32 )
+// -------------------------------------------------------------------------- //
+static void
+Append32(std::vector<KUInt8>* ioData, KUInt32 inValue)
+{
+	ioData->push_back((KUInt8) (inValue >> 24));
+	ioData->push_back((KUInt8) (inValue >> 16));
+	ioData->push_back((KUInt8) (inValue >> 8));
+	ioData->push_back((KUInt8) inValue);
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteChunk( FILE*, const char*, const std::vector<KUInt8>& )
+// -------------------------------------------------------------------------- //
+static void
+WriteChunk(FILE* inFile, const char* inType, const std::vector<KUInt8>& inData)
+{
+	static KUInt32 sCRCTable[256];
+	static Boolean sCRCTableReady = false;
+	if (!sCRCTableReady)
+	{
+		for (KUInt32 index = 0; index < 256; index++)
+		{
+			KUInt32 theCRC = index;
+			for (int indexBit = 0; indexBit < 8; indexBit++)
+			{
+				theCRC = (theCRC & 1) ? (0xEDB88320 ^ (theCRC >> 1)) : (theCRC >> 1);
+			}
+			sCRCTable[index] = theCRC;
+		}
+		sCRCTableReady = true;
+	}
+
+	std::vector<KUInt8> theChunk;
+	Append32(&theChunk, (KUInt32) inData.size());
+	theChunk.insert(theChunk.end(), inType, inType + 4);
+	theChunk.insert(theChunk.end(), inData.begin(), inData.end());
+	KUInt32 theCRC = 0xFFFFFFFF;
+	for (size_t index = 4; index < theChunk.size(); index++)
+	{
+		theCRC = sCRCTable[(theCRC ^ theChunk[index]) & 0xFF] ^ (theCRC >> 8);
+	}
+	Append32(&theChunk, theCRC ^ 0xFFFFFFFF);
+	(void) ::fwrite(theChunk.data(), 1, theChunk.size(), inFile);
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteHeader( FILE*, KUInt32, KUInt32, KUInt32 )
+// -------------------------------------------------------------------------- //
+static void
+WriteHeader(FILE* inFile, KUInt32 inWidth, KUInt32 inHeight, KUInt32 inFrameCount)
+{
+	static const KUInt8 kSignature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+	(void) ::fwrite(kSignature, 1, sizeof(kSignature), inFile);
+
+	std::vector<KUInt8> theData;
+	Append32(&theData, inWidth);
+	Append32(&theData, inHeight);
+	theData.push_back(8); // Bit depth.
+	theData.push_back(3); // Indexed.
+	theData.push_back(0); // Deflate.
+	theData.push_back(0); // Adaptive filters.
+	theData.push_back(0); // Not interlaced.
+	WriteChunk(inFile, "IHDR", theData);
+
+	if (inFrameCount > 0)
+	{
+		theData.clear();
+		Append32(&theData, inFrameCount);
+		Append32(&theData, 0); // Loop forever.
+		WriteChunk(inFile, "acTL", theData);
+	}
+
+	// Grays, then greens (like the FLTK screen manager).
+	theData.clear();
+	for (KUInt32 indexLevel = 0; indexLevel < 16; indexLevel++)
+	{
+		KUInt8 theLevel = (KUInt8) (indexLevel * 0x11);
+		theData.push_back(theLevel);
+		theData.push_back(theLevel);
+		theData.push_back(theLevel);
+	}
+	for (KUInt32 indexLevel = 0; indexLevel < 16; indexLevel++)
+	{
+		KUInt8 theLevel = (KUInt8) (indexLevel * 0x11);
+		theData.push_back(theLevel >> 1);
+		theData.push_back(theLevel);
+		theData.push_back(theLevel >> 1);
+	}
+	WriteChunk(inFile, "PLTE", theData);
+}
+
+// -------------------------------------------------------------------------- //
+//  * CompressRect( const TCaptureStreamReader&, KUInt32, KUInt32, ... )
+// -------------------------------------------------------------------------- //
+static void
+CompressRect(
+	const TCaptureStreamReader& inReader,
+	KUInt32 inTop,
+	KUInt32 inLeft,
+	KUInt32 inBottom,
+	KUInt32 inRight,
+	std::vector<KUInt8>* outData)
+{
+	// Pixels out of the screen (after a rotation) are black.
+	KUInt32 theScreenWidth = inReader.GetWidth();
+	KUInt32 theScreenHeight = inReader.GetHeight();
+	const KUInt8* theScreen = inReader.GetScreenBuffer();
+	KUInt32 theScreenRowBytes = (theScreenWidth + 1) / 2;
+	KUInt32 thePalette = inReader.GetBacklight() ? 16 : 0;
+	KUInt32 theRowBytes = 1 + inRight - inLeft;
+	std::vector<KUInt8> theRows;
+	theRows.reserve(theRowBytes * (inBottom - inTop));
+	for (KUInt32 indexY = inTop; indexY < inBottom; indexY++)
+	{
+		theRows.push_back(0); // No filter.
+		for (KUInt32 indexX = inLeft; indexX < inRight; indexX++)
+		{
+			KUInt32 theLevel = 0;
+			if ((indexX < theScreenWidth) && (indexY < theScreenHeight))
+			{
+				KUInt8 theByte = theScreen[(indexY * theScreenRowBytes) + (indexX / 2)];
+				theLevel = (indexX & 1) ? (theByte & 0x0F) : (theByte >> 4);
+			}
+			theRows.push_back((KUInt8) (thePalette + theLevel));
+		}
+	}
+	Compress(theRows, theRowBytes, outData);
+}
+
+// -------------------------------------------------------------------------- //
+//  * IsFrame( const TCaptureStreamReader& )
+// -------------------------------------------------------------------------- //
+static Boolean
+IsFrame(const TCaptureStreamReader& inReader)
+{
+	// Geometry records clear the screen, the next frame will show it.
+	return inReader.GetRecordType() != TCaptureScreenManager::kGeometryRecord;
+}
+
+// -------------------------------------------------------------------------- //
+//  * WritePNGFiles( const char*, const char* )
+// -------------------------------------------------------------------------- //
+static int
+WritePNGFiles(const char* inCapturePath, const char* inPrefix)
+{
+	TCaptureStreamReader theReader(inCapturePath);
+	if (!theReader.IsOpen())
+	{
+		(void) ::fprintf(stderr, "Cannot read capture stream %s\n", inCapturePath);
+		return 1;
+	}
+
+	KUInt32 theFrameCount = 0;
+	std::vector<KUInt8> theData;
+	while (theReader.ReadRecord())
+	{
+		if (!IsFrame(theReader))
+		{
+			continue;
+		}
+		char thePath[1024];
+		(void) ::snprintf(thePath, sizeof(thePath), "%s-%05u.png",
+			inPrefix, (unsigned int) theFrameCount);
+		FILE* theFile = ::fopen(thePath, "wb");
+		if (theFile == nil)
+		{
+			(void) ::fprintf(stderr, "Cannot create %s\n", thePath);
+			return 1;
+		}
+		KUInt32 theWidth = theReader.GetWidth();
+		KUInt32 theHeight = theReader.GetHeight();
+		WriteHeader(theFile, theWidth, theHeight, 0);
+		theData.clear();
+		CompressRect(theReader, 0, 0, theHeight, theWidth, &theData);
+		WriteChunk(theFile, "IDAT", theData);
+		WriteChunk(theFile, "IEND", std::vector<KUInt8>());
+		(void) ::fclose(theFile);
+		theFrameCount++;
+	}
+
+	(void) ::printf("%u frames\n", (unsigned int) theFrameCount);
+	return 0;
+}
+
+// -------------------------------------------------------------------------- //
+//  * WriteAnimation( const char*, const char* )
+// -------------------------------------------------------------------------- //
+static int
+WriteAnimation(const char* inCapturePath, const char* inPath)
+{
+	// First pass: frame times and size of the canvas.
+	std::vector<KUInt64> theTimes;
+	KUInt32 theCanvasWidth;
+	KUInt32 theCanvasHeight;
+	KUInt32 theTicksPerSecond;
+	{
+		TCaptureStreamReader theReader(inCapturePath);
+		if (!theReader.IsOpen())
+		{
+			(void) ::fprintf(stderr, "Cannot read capture stream %s\n", inCapturePath);
+			return 1;
+		}
+		theCanvasWidth = theReader.GetWidth();
+		theCanvasHeight = theReader.GetHeight();
+		theTicksPerSecond = theReader.GetTicksPerSecond();
+		while (theReader.ReadRecord())
+		{
+			if (theReader.GetWidth() > theCanvasWidth)
+			{
+				theCanvasWidth = theReader.GetWidth();
+			}
+			if (theReader.GetHeight() > theCanvasHeight)
+			{
+				theCanvasHeight = theReader.GetHeight();
+			}
+			if (IsFrame(theReader))
+			{
+				theTimes.push_back(theReader.GetTime());
+			}
+		}
+	}
+	if (theTimes.empty())
+	{
+		(void) ::fprintf(stderr, "No frame in %s\n", inCapturePath);
+		return 1;
+	}
+
+	// Second pass: the first frame is the whole canvas, the following ones
+	// are the damaged rectangles, drawn over the previous frame.
+	FILE* theFile = ::fopen(inPath, "wb");
+	if (theFile == nil)
+	{
+		(void) ::fprintf(stderr, "Cannot create %s\n", inPath);
+		return 1;
+	}
+	WriteHeader(theFile, theCanvasWidth, theCanvasHeight, (KUInt32) theTimes.size());
+
+	TCaptureStreamReader theReader(inCapturePath);
+	KUInt32 theFrameIndex = 0;
+	KUInt32 theSequence = 0;
+	Boolean wholeCanvas = true;
+	std::vector<KUInt8> theData;
+	std::vector<KUInt8> theControl;
+	while (theReader.ReadRecord() && (theFrameIndex < theTimes.size()))
+	{
+		if (!IsFrame(theReader))
+		{
+			wholeCanvas = true;
+			continue;
+		}
+		KUInt32 theTop = 0;
+		KUInt32 theLeft = 0;
+		KUInt32 theBottom = theCanvasHeight;
+		KUInt32 theRight = theCanvasWidth;
+		if (!wholeCanvas
+			&& (theReader.GetRecordType() == TCaptureScreenManager::kFrameRecord))
+		{
+			theReader.GetRect(&theTop, &theLeft, &theBottom, &theRight);
+		}
+		wholeCanvas = false;
+
+		KUInt32 theDelay = kLastFrameDelay;
+		if (theFrameIndex + 1 < theTimes.size())
+		{
+			KUInt64 theTicks = theTimes[theFrameIndex + 1] - theTimes[theFrameIndex];
+			KUInt64 theMilliseconds = (theTicks * 1000) / theTicksPerSecond;
+			theDelay = (theMilliseconds > 0xFFFF) ? 0xFFFF : (KUInt32) theMilliseconds;
+		}
+
+		theControl.clear();
+		Append32(&theControl, theSequence++);
+		Append32(&theControl, theRight - theLeft);
+		Append32(&theControl, theBottom - theTop);
+		Append32(&theControl, theLeft);
+		Append32(&theControl, theTop);
+		theControl.push_back((KUInt8) (theDelay >> 8));
+		theControl.push_back((KUInt8) theDelay);
+		theControl.push_back(1000 >> 8);
+		theControl.push_back(1000 & 0xFF);
+		theControl.push_back(0); // Dispose: none.
+		theControl.push_back(0); // Blend: source.
+		WriteChunk(theFile, "fcTL", theControl);
+
+		theData.clear();
+		if (theFrameIndex == 0)
+		{
+			CompressRect(theReader, theTop, theLeft, theBottom, theRight, &theData);
+			WriteChunk(theFile, "IDAT", theData);
+		} else
+		{
+			Append32(&theData, theSequence++);
+			CompressRect(theReader, theTop, theLeft, theBottom, theRight, &theData);
+			WriteChunk(theFile, "fdAT", theData);
+		}
+		theFrameIndex++;
+	}
+	WriteChunk(theFile, "IEND", std::vector<KUInt8>());
+	(void) ::fclose(theFile);
+
+	(void) ::printf("%u frames\n", (unsigned int) theFrameIndex);
+	return 0;
+}
+
+// -------------------------------------------------------------------------- //
+//  * Usage( const char* )
+// -------------------------------------------------------------------------- //
+static int
+Usage(const char* inProgramName)
+{
+	(void) ::fprintf(stderr,
+		"%s [--apng] capture_file output\n"
+		"  Render a capture stream (written with einstein --capture=file).\n"
+		"  Without --apng, output is a prefix: output-00000.png, etc.\n"
+		"  With --apng, output is an animated PNG file.\n",
+		inProgramName);
+	return 1;
+}
+
+// -------------------------------------------------------------------------- //
+// main
+// -------------------------------------------------------------------------- //
+int
+main(int argc, char** argv)
+{
+	Boolean animation = false;
+	int indexArgs = 1;
+	if ((indexArgs < argc) && (::strcmp(argv[indexArgs], "--apng") == 0))
+	{
+		animation = true;
+		indexArgs++;
+	}
+	if (indexArgs + 2 != argc)
+	{
+		return Usage(argv[0]);
+	}
+
+	if (animation)
+	{
+		return WriteAnimation(argv[indexArgs], argv[indexArgs + 1]);
+	} else
+	{
+		return WritePNGFiles(argv[indexArgs], argv[indexArgs + 1]);
+	}
+}
+
+// ========================================================================== //
+// The only thing that saves us from the bureaucracy is its inefficiency.     //
+//                 -- Eugene McCarthy                                         //
+// ========================================================================== //
@@ -0,0 +1,244 @@
+// ==============================
+// File:			einstein_serial_dump.cp
+// Project:			Einstein
+//
+// Copyright 2022 by Paul Guyot and Matthias Melcher.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+// ==============================
+// $Id$
+// ==============================
+
+// Prints a file written by TSerialCapture (--serial-capture=path).
+//
+// By default, the bytes of each port and direction are decoded as MNP frames,
+// which is what the Dock, NCU and most serial tools use. With -a, every
+// record is printed: bytes in hex and ASCII, register writes and interrupts.
+
+#include <K/Defines/KDefinitions.h>
+
+// ANSI C & POSIX
+#include <stdio.h>
+#include <string.h>
+
+// Einstein
+#include "Emulator/Serial/TMNPFrameDecoder.h"
+#include "Emulator/Serial/TSerialCapture.h"
+#include "Emulator/Serial/TSerialCaptureReader.h"
+
+// -------------------------------------------------------------------------- //
+// Constantes
+// -------------------------------------------------------------------------- //
+
+// Same order as TSerialPorts::EPortIndex.
+static const char* const kPortNames[] = { "extr", "infr", "tblt", "mdem" };
+static const KUInt32 kPortCount = 4;
+
+// -------------------------------------------------------------------------- //
+//  * PrintTime( const TSerialCaptureReader& )
+// -------------------------------------------------------------------------- //
+static void
+PrintTime(const TSerialCaptureReader& inReader)
+{
+	(void) ::printf("%12.6f ",
+		(double) inReader.GetTime() / (double) inReader.GetTicksPerSecond());
+}
+
+// -------------------------------------------------------------------------- //
+//  * PortName( KUInt32 )
+// -------------------------------------------------------------------------- //
+static const char*
+PortName(KUInt32 inPort)
+{
+	return (inPort < kPortCount) ? kPortNames[inPort] : "????";
+}
+
+// -------------------------------------------------------------------------- //
+//  * PrintRecord( const TSerialCaptureReader&, const TSerialCapture::SRecord& )
+// -------------------------------------------------------------------------- //
+static void
+PrintRecord(
+	const TSerialCaptureReader& inReader,
+	const TSerialCapture::SRecord& inRecord)
+{
+	PrintTime(inReader);
+	(void) ::printf("%s ", PortName(inRecord.fPort));
+	switch (inRecord.fType)
+	{
+		case TSerialCapture::kTxRecord:
+		case TSerialCapture::kRxRecord:
+		{
+			(void) ::printf("%s ", (inRecord.fType == TSerialCapture::kTxRecord) ? "tx" : "rx");
+			for (KUInt32 indexByte = 0; indexByte < TSerialCapture::kMaxDataPerRecord; indexByte++)
+			{
+				if (indexByte < inRecord.fCount)
+				{
+					(void) ::printf("%02X ", (unsigned int) inRecord.fData[indexByte]);
+				} else
+				{
+					(void) ::printf("   ");
+				}
+			}
+			for (KUInt32 indexByte = 0; indexByte < inRecord.fCount; indexByte++)
+			{
+				KUInt8 theChar = inRecord.fData[indexByte];
+				(void) ::putchar(((theChar >= 0x20) && (theChar < 0x7F)) ? theChar : '.');
+			}
+			(void) ::putchar('\n');
+			break;
+		}
+
+		case TSerialCapture::kRegisterRecord:
+			(void) ::printf("register 0x%04X = 0x%08X\n",
+				(unsigned int) inRecord.fArg[0], (unsigned int) inRecord.fArg[1]);
+			break;
+
+		case TSerialCapture::kDMARegisterRecord:
+			(void) ::printf("DMA bank %u channel %u register %u = 0x%08X\n",
+				(unsigned int) (inRecord.fArg[0] >> 16),
+				(unsigned int) ((inRecord.fArg[0] >> 8) & 0xFF),
+				(unsigned int) (inRecord.fArg[0] & 0xFF),
+				(unsigned int) inRecord.fArg[1]);
+			break;
+
+		case TSerialCapture::kInterruptRecord:
+			(void) ::printf("interrupt 0x%08X, DMA event 0x%08X\n",
+				(unsigned int) inRecord.fArg[0], (unsigned int) inRecord.fArg[1]);
+			break;
+
+		case TSerialCapture::kDroppedRecord:
+			(void) ::printf("%u records dropped\n", (unsigned int) inRecord.fArg[0]);
+			break;
+
+		default:
+			(void) ::printf("unknown record %u\n", (unsigned int) inRecord.fType);
+			break;
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * PrintFrames( const TSerialCaptureReader&, const SRecord&, TMNPFrameDecoder* )
+// -------------------------------------------------------------------------- //
+static void
+PrintFrames(
+	const TSerialCaptureReader& inReader,
+	const TSerialCapture::SRecord& inRecord,
+	TMNPFrameDecoder* ioDecoders)
+{
+	if (inRecord.fType == TSerialCapture::kDroppedRecord)
+	{
+		PrintTime(inReader);
+		(void) ::printf("%u records dropped, frames may be garbled\n",
+			(unsigned int) inRecord.fArg[0]);
+		return;
+	}
+	if (((inRecord.fType != TSerialCapture::kTxRecord)
+			&& (inRecord.fType != TSerialCapture::kRxRecord))
+		|| (inRecord.fPort >= kPortCount))
+	{
+		return;
+	}
+
+	TMNPFrameDecoder* theDecoder = &ioDecoders[inRecord.fPort * 2 + inRecord.fType];
+	for (KUInt32 indexByte = 0; indexByte < inRecord.fCount; indexByte++)
+	{
+		if (theDecoder->AddByte(inRecord.fData[indexByte]))
+		{
+			char theText[128];
+			theDecoder->Describe(theText, sizeof(theText));
+			PrintTime(inReader);
+			(void) ::printf("%s %s %s\n", PortName(inRecord.fPort),
+				(inRecord.fType == TSerialCapture::kTxRecord) ? "tx" : "rx",
+				theText);
+		}
+	}
+}
+
+// -------------------------------------------------------------------------- //
+//  * Usage( const char* )
+// -------------------------------------------------------------------------- //
+static int
+Usage(const char* inProgramName)
+{
+	(void) ::fprintf(stderr,
+		"%s [-a] capture_file\n"
+		"  Print a serial capture (written with einstein --serial-capture=file).\n"
+		"  Without -a, the traffic is decoded as MNP frames.\n"
+		"  With -a, every record is printed.\n",
+		inProgramName);
+	return 1;
+}
+
+// -------------------------------------------------------------------------- //
+// main
+// -------------------------------------------------------------------------- //
+int
+main(int argc, char** argv)
+{
+	bool all = false;
+	int indexArgs = 1;
+	if ((indexArgs < argc) && (::strcmp(argv[indexArgs], "-a") == 0))
+	{
+		all = true;
+		indexArgs++;
+	}
+	if (indexArgs + 1 != argc)
+	{
+		return Usage(argv[0]);
+	}
+
+	TSerialCaptureReader theReader(argv[indexArgs]);
+	if (!theReader.IsOpen())
+	{
+		(void) ::fprintf(stderr, "Cannot read serial capture %s\n", argv[indexArgs]);
+		return 1;
+	}
+
+	// One decoder per port and direction.
+	TMNPFrameDecoder* theDecoders = new TMNPFrameDecoder[kPortCount * 2];
+	TSerialCapture::SRecord theRecord;
+	while (theReader.ReadRecord(&theRecord))
+	{
+		if (all)
+		{
+			PrintRecord(theReader, theRecord);
+		} else
+		{
+			PrintFrames(theReader, theRecord, theDecoders);
+		}
+	}
+
+	if (!all)
+	{
+		for (KUInt32 indexDecoder = 0; indexDecoder < kPortCount * 2; indexDecoder++)
+		{
+			KUInt32 theDiscarded = theDecoders[indexDecoder].GetDiscardedCount();
+			if (theDiscarded)
+			{
+				(void) ::printf("%s %s: %u bytes outside of frames\n",
+					PortName(indexDecoder / 2), (indexDecoder & 1) ? "rx" : "tx",
+					(unsigned int) theDiscarded);
+			}
+		}
+	}
+	delete[] theDecoders;
+
+	return 0;
+}
+
+// ========================================================================== //
+// Any sufficiently advanced bug is indistinguishable from a feature.         //
+//                 -- Rich Kulawiec                                           //
+// ========================================================================== //